@@ -24,6 +24,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <err.h>
+#include <time.h>
 
 #include "asoundlib.h"
 #include "alisp.h"
@@ -31,6 +32,7 @@
 static int verbose = 0;
 static int warning = 0;
 static int debug = 0;
+static int repeat = 0;
 
 static void interpret_filename(const char *file)
 {
@@ -70,9 +72,65 @@ static void interpret_filename(const char *file)
 	snd_input_close(in);
 }
 
+static double timestamp(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/*
+ * Run the file repeat times, each in a fresh instance, and show how
+ * long it takes to create, evaluate and free the instance.
+ */
+static void bench_filename(const char *file)
+{
+	struct alisp_cfg cfg;
+	struct alisp_instance *instance;
+	snd_input_t *in;
+	snd_output_t *out;
+	double t, min = 0, total = 0;
+	int i, err;
+
+	if (file == NULL || strcmp(file, "-") == 0) {
+		fprintf(stderr, "timing needs a file, not stdin\n");
+		return;
+	}
+	for (i = 0; i < repeat; i++) {
+		if ((err = snd_input_stdio_open(&in, file, "r")) < 0) {
+			fprintf(stderr, "unable to open filename '%s' (%s)\n", file, snd_strerror(err));
+			break;
+		}
+		/* the program output is not shown */
+		if ((err = snd_output_buffer_open(&out)) < 0) {
+			snd_input_close(in);
+			break;
+		}
+		memset(&cfg, 0, sizeof(cfg));
+		cfg.in = in;
+		cfg.out = cfg.eout = cfg.vout = cfg.wout = cfg.dout = out;
+		t = timestamp();
+		err = alsa_lisp(&cfg, &instance);
+		alsa_lisp_free(instance);
+		t = timestamp() - t;
+		snd_output_close(out);
+		snd_input_close(in);
+		if (err < 0) {
+			fprintf(stderr, "alsa lisp returned error %i (%s)\n", err, strerror(err));
+			break;
+		}
+		if (i == 0 || t < min)
+			min = t;
+		total += t;
+	}
+	if (i > 0)
+		printf("%s: %i runs, mean %.1f us, min %.1f us\n", file, i, total / i, min);
+}
+
 static void usage(void)
 {
-	fprintf(stderr, "usage: alsalisp [-vdw] [file...]\n");
+	fprintf(stderr, "usage: alsalisp [-vdw] [-t count] [file...]\n");
 	exit(1);
 }
 
@@ -80,7 +138,7 @@ int main(int argc, char **argv)
 {
 	int c;
 
-	while ((c = getopt(argc, argv, "vdw")) != -1) {
+	while ((c = getopt(argc, argv, "vdwt:")) != -1) {
 		switch (c) {
 		case 'v':
 			verbose = 1;
@@ -91,6 +149,11 @@ int main(int argc, char **argv)
 		case 'w':
 			warning = 1;
 			break;
+		case 't':
+			repeat = atoi(optarg);
+			if (repeat <= 0)
+				usage();
+			break;
 		case '?':
 		default:
 			usage();
@@ -102,6 +165,9 @@ int main(int argc, char **argv)
 
 	if (argc < 1)
 		interpret_filename(NULL);
+	else if (repeat > 0)
+		while (*argv)
+			bench_filename(*argv++);
 	else
 		while (*argv)
 			interpret_filename(*argv++);
@@ -21,6 +21,7 @@
 #include <sys/shm.h>
 #include <sys/socket.h>
 #include <sys/poll.h>
+#include <sys/epoll.h>
 #include <sys/un.h>
 #include <sys/uio.h>
 #include <stdio.h>
@@ -32,6 +33,7 @@
 #include <netdb.h>
 #include <limits.h>
 #include <signal.h>
+#include <pthread.h>
 
 #include "aserver.h"
 
@@ -106,8 +108,7 @@ static int make_inet_socket(int port)
 	return sock;
 }
 
-struct pollfd *pollfds;
-unsigned int pollfds_count = 0;
+int epoll_fd = -1;
 typedef struct waiter waiter_t;
 typedef int (*waiter_handler_t)(waiter_t *waiter, unsigned short events);
 struct waiter {
@@ -121,30 +122,27 @@ static void add_waiter(int fd, unsigned short events, waiter_handler_t handler,
 		void *data)
 {
 	waiter_t *w = &waiters[fd];
-	struct pollfd *pfd = &pollfds[pollfds_count];
+	struct epoll_event ev;
 	assert(!w->handler);
-	pfd->fd = fd;
-	pfd->events = events;
-	pfd->revents = 0;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		SYSERROR("epoll_ctl failed");
+		return;
+	}
 	w->fd = fd;
 	w->private_data = data;
 	w->handler = handler;
-	pollfds_count++;
 }
 
 static void del_waiter(int fd)
 {
 	waiter_t *w = &waiters[fd];
-	unsigned int k;
+	struct epoll_event ev;
 	assert(w->handler);
 	w->handler = 0;
-	for (k = 0; k < pollfds_count; ++k) {
-		if (pollfds[k].fd == fd)
-			break;
-	}
-	assert(k < pollfds_count);
-	pollfds_count--;
-	memmove(&pollfds[k], &pollfds[k + 1], pollfds_count - k);
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &ev);
 }
 
 typedef struct client client_t;
@@ -200,6 +198,10 @@ struct client {
 		struct {
 			int ctrl_id;
 			void *ctrl;
+			pthread_mutex_t mutex;	/* serializes pcm access with the worker */
+			pthread_t worker;
+			int worker_running;
+			int worker_stop;
 		} shm;
 	} transport;
 };
@@ -276,6 +278,114 @@ static void pcm_shm_appl_ptr_changed(snd_pcm_t *pcm, snd_pcm_t *src ATTRIBUTE_UN
 	pcm->appl.ptr = &ctrl->appl.ptr;
 }
 
+/* Commit what the client queued and publish the new state */
+static void pcm_shm_ring_drain(client_t *client)
+{
+	volatile snd_pcm_shm_ctrl_t *ctrl = client->transport.shm.ctrl;
+	volatile snd_pcm_shm_ring_t *ring = &ctrl->ring;
+	snd_pcm_t *pcm = client->device.pcm.handle;
+	unsigned int tail = ring->tail, head = shm_load_acquire(&ring->head);
+	snd_pcm_sframes_t result;
+	snd_pcm_state_t state;
+
+	for (; tail != head; tail++) {
+		unsigned int idx = tail & (SND_PCM_SHM_RING_ENTRIES - 1);
+		snd_pcm_uframes_t frames = ring->entries[idx].frames;
+		result = snd_pcm_mmap_commit(pcm, ring->entries[idx].offset, frames);
+		/* the client has already moved its appl_ptr */
+		if (result >= 0 && (snd_pcm_uframes_t)result != frames)
+			result = -EPIPE;
+		if (result < 0 && !ring->result)
+			ring->result = result;
+	}
+	shm_store_release(&ring->tail, tail);
+	state = snd_pcm_state(pcm);
+	if (state == SND_PCM_STATE_RUNNING || state == SND_PCM_STATE_DRAINING) {
+		snd_pcm_avail_update(pcm);
+		state = snd_pcm_state(pcm);
+	}
+	shm_store_release(&ring->hw_ptr, *pcm->hw.ptr);
+	shm_store_release(&ring->state, state);
+}
+
+static void *pcm_shm_worker(void *data)
+{
+	client_t *client = data;
+	volatile snd_pcm_shm_ctrl_t *ctrl = client->transport.shm.ctrl;
+	volatile snd_pcm_shm_ring_t *ring = &ctrl->ring;
+	snd_pcm_t *pcm = client->device.pcm.handle;
+	struct timespec period, *timeout;
+	int doorbell;
+
+	while (1) {
+		doorbell = shm_load_acquire(&ring->doorbell);
+		pthread_mutex_lock(&client->transport.shm.mutex);
+		if (client->transport.shm.worker_stop) {
+			pthread_mutex_unlock(&client->transport.shm.mutex);
+			break;
+		}
+		pcm_shm_ring_drain(client);
+		timeout = NULL;
+		/* keep the published pointers fresh once per period */
+		if (ring->state == SND_PCM_STATE_RUNNING && pcm->rate) {
+			long long ns = (long long)pcm->period_size * 1000000000LL / pcm->rate;
+			period.tv_sec = ns / 1000000000LL;
+			period.tv_nsec = ns % 1000000000LL;
+			timeout = &period;
+		}
+		pthread_mutex_unlock(&client->transport.shm.mutex);
+
+		shm_store_release(&ring->served, doorbell);
+		snd_shm_futex_wake(&ring->served, INT_MAX);
+
+		/* pairs with the sleeping check in the client commit */
+		__atomic_store_n(&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == ring->tail)
+			snd_shm_futex_wait(&ring->doorbell, doorbell, timeout);
+		__atomic_store_n(&ring->sleeping, 0, __ATOMIC_SEQ_CST);
+	}
+	return NULL;
+}
+
+static void pcm_shm_worker_kick(client_t *client)
+{
+	volatile snd_pcm_shm_ctrl_t *ctrl = client->transport.shm.ctrl;
+
+	__atomic_add_fetch(&ctrl->ring.doorbell, 1, __ATOMIC_SEQ_CST);
+	snd_shm_futex_wake(&ctrl->ring.doorbell, 1);
+}
+
+static void pcm_shm_worker_start(client_t *client)
+{
+	volatile snd_pcm_shm_ctrl_t *ctrl = client->transport.shm.ctrl;
+	snd_pcm_t *pcm = client->device.pcm.handle;
+
+	pthread_mutex_init(&client->transport.shm.mutex, NULL);
+	ctrl->ring.state = snd_pcm_state(pcm);
+	ctrl->ring.appl_ptr = *pcm->appl.ptr;
+	ctrl->ring.hw_ptr = *pcm->hw.ptr;
+	client->transport.shm.worker_stop = 0;
+	if (pthread_create(&client->transport.shm.worker, NULL,
+			   pcm_shm_worker, client)) {
+		ERROR("cannot create the worker, using the socket only");
+		return;
+	}
+	client->transport.shm.worker_running = 1;
+	ctrl->ring.enabled = 1;
+}
+
+static void pcm_shm_worker_stop(client_t *client)
+{
+	if (!client->transport.shm.worker_running)
+		return;
+	pthread_mutex_lock(&client->transport.shm.mutex);
+	client->transport.shm.worker_stop = 1;
+	pthread_mutex_unlock(&client->transport.shm.mutex);
+	pcm_shm_worker_kick(client);
+	pthread_join(client->transport.shm.worker, NULL);
+	client->transport.shm.worker_running = 0;
+}
+
 static int pcm_shm_open(client_t *client, int *cookie)
 {
 	int shmid;
@@ -306,6 +416,7 @@ static int pcm_shm_open(client_t *client, int *cookie)
 		SYSERROR("shmat failed");
 		goto _err;
 	}
+	pcm_shm_worker_start(client);
 	*cookie = shmid;
 	return 0;
 
@@ -323,6 +434,7 @@ static int pcm_shm_close(client_t *client)
 		del_waiter(client->device.pcm.fd);
 		client->polling = 0;
 	}
+	pcm_shm_worker_stop(client);
 	err = snd_pcm_close(client->device.pcm.handle);
 	ctrl->result = err;
 	if (err < 0) 
@@ -390,6 +502,7 @@ static int pcm_shm_cmd(client_t *client)
 	char buf[1];
 	int err;
 	int cmd;
+	int fd = -1;
 	snd_pcm_t *pcm;
 	err = read(client->ctrl_fd, buf, 1);
 	if (err != 1)
@@ -397,6 +510,11 @@ static int pcm_shm_cmd(client_t *client)
 	cmd = ctrl->cmd;
 	ctrl->cmd = 0;
 	pcm = client->device.pcm.handle;
+	if (cmd == SND_PCM_IOCTL_CLOSE) {
+		client->ops->close(client);
+		return shm_ack(client);
+	}
+	pthread_mutex_lock(&client->transport.shm.mutex);
 	switch (cmd) {
 	case SND_PCM_IOCTL_ASYNC:
 		ctrl->result = snd_pcm_async(pcm, ctrl->u.async.sig, ctrl->u.async.pid);
@@ -466,7 +584,7 @@ static int pcm_shm_cmd(client_t *client)
 		ctrl->result = snd_pcm_channel_info(pcm, (snd_pcm_channel_info_t *) &ctrl->u.channel_info);
 		if (ctrl->result >= 0 &&
 		    ctrl->u.channel_info.type == SND_PCM_AREA_MMAP)
-			return shm_ack_fd(client, ctrl->u.channel_info.u.mmap.fd);
+			fd = ctrl->u.channel_info.u.mmap.fd;
 		break;
 	case SNDRV_PCM_IOCTL_REWIND:
 		ctrl->result = snd_pcm_rewind(pcm, ctrl->u.rewind.frames);
@@ -502,18 +620,29 @@ static int pcm_shm_cmd(client_t *client)
 		break;
 	case SND_PCM_IOCTL_POLL_DESCRIPTOR:
 		ctrl->result = 0;
-		return shm_ack_fd(client, _snd_pcm_poll_descriptor(pcm));
-	case SND_PCM_IOCTL_CLOSE:
-		client->ops->close(client);
+		fd = _snd_pcm_poll_descriptor(pcm);
 		break;
 	case SND_PCM_IOCTL_HW_PTR_FD:
+		pthread_mutex_unlock(&client->transport.shm.mutex);
 		return shm_rbptr_fd(client, &pcm->hw);
 	case SND_PCM_IOCTL_APPL_PTR_FD:
+		pthread_mutex_unlock(&client->transport.shm.mutex);
 		return shm_rbptr_fd(client, &pcm->appl);
 	default:
 		ERROR("Bogus cmd: %x", ctrl->cmd);
 		ctrl->result = -ENOSYS;
 	}
+	if (client->transport.shm.worker_running) {
+		ctrl->ring.appl_ptr = *pcm->appl.ptr;
+		ctrl->ring.hw_ptr = *pcm->hw.ptr;
+		shm_store_release(&ctrl->ring.state, snd_pcm_state(pcm));
+	}
+	pthread_mutex_unlock(&client->transport.shm.mutex);
+	/* let the worker pick up the new state and period timeout */
+	if (client->transport.shm.worker_running)
+		pcm_shm_worker_kick(client);
+	if (fd >= 0)
+		return shm_ack_fd(client, fd);
 	return shm_ack(client);
 }
 
@@ -733,7 +862,7 @@ static int snd_client_open(client_t *client)
 		ans.result = -EINVAL;
 		goto _answer;
 	}
-	name = alloca(req.namelen);
+	name = alloca(req.namelen + 1);
 	err = read(client->ctrl_fd, name, req.namelen);
 	if (err < 0) {
 		SYSERROR("read failed");
@@ -796,10 +925,10 @@ static int client_poll_handler(waiter_t *waiter, unsigned short events ATTRIBUTE
 	client_t *client = waiter->private_data;
 	if (client->open)
 		client->ops->close(client);
-	close(client->poll_fd);
-	close(client->ctrl_fd);
 	del_waiter(client->poll_fd);
 	del_waiter(client->ctrl_fd);
+	close(client->poll_fd);
+	close(client->ctrl_fd);
 	list_del(&client->list);
 	free(client);
 	return 0;
@@ -811,8 +940,8 @@ static int client_ctrl_handler(waiter_t *waiter, unsigned short events)
 	if (events & POLLHUP) {
 		if (client->open)
 			client->ops->close(client);
-		close(client->ctrl_fd);
 		del_waiter(client->ctrl_fd);
+		close(client->ctrl_fd);
 		list_del(&client->list);
 		free(client);
 		return 0;
@@ -927,8 +1056,14 @@ static int server(const char *sockname, int port)
 		SYSERROR("sysconf failed");
 		return result;
 	}
-	pollfds = calloc((size_t) open_max, sizeof(*pollfds));
 	waiters = calloc((size_t) open_max, sizeof(*waiters));
+	epoll_fd = epoll_create(16);
+	if (epoll_fd < 0) {
+		result = -errno;
+		SYSERROR("epoll_create failed");
+		free(waiters);
+		return result;
+	}
 
 	if (sockname) {
 		int sock = make_local_socket(sockname);
@@ -964,32 +1099,27 @@ static int server(const char *sockname, int port)
 	}
 
 	while (1) {
-		struct pollfd pfds[open_max];
-		size_t pfds_count;
-		do {
-			err = poll(pollfds, pollfds_count, -1);
-		} while (err == 0);
-		if (err < 0) {
-			SYSERROR("poll failed");
+		struct epoll_event events[64];
+		int count;
+		count = epoll_wait(epoll_fd, events, 64, -1);
+		if (count < 0) {
+			if (errno != EINTR)
+				SYSERROR("epoll_wait failed");
 			continue;
 		}
 
-		pfds_count = pollfds_count;
-		memcpy(pfds, pollfds, sizeof(*pfds) * pfds_count);
-		for (k = 0; k < pfds_count; k++) {
-			struct pollfd *pfd = &pfds[k];
-			if (pfd->revents) {
-				waiter_t *w = &waiters[pfd->fd];
-				if (!w->handler)
-					continue;
-				err = w->handler(w, pfd->revents);
-				if (err < 0)
-					ERROR("waiter handler failed");
-			}
+		for (k = 0; k < (unsigned int) count; k++) {
+			waiter_t *w = &waiters[events[k].data.fd];
+			/* removed by an earlier handler of this round */
+			if (!w->handler)
+				continue;
+			err = w->handler(w, events[k].events);
+			if (err < 0)
+				ERROR("waiter handler failed");
 		}
 	}
  _end:
-	free(pollfds);
+	close(epoll_fd);
 	free(waiters);
 	return result;
 }
@@ -19,12 +19,30 @@
  */
   
 #include <netdb.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include "../src/pcm/pcm_local.h"
 #include "../src/control/control_local.h"
 
 int snd_receive_fd(int sock, void *data, size_t len, int *fd);
 int snd_is_local(struct hostent *hent);
 
+#define shm_load_acquire(ptr)		__atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define shm_store_release(ptr, v)	__atomic_store_n(ptr, v, __ATOMIC_RELEASE)
+
+/* the segment is mapped by two processes, so no FUTEX_PRIVATE_FLAG */
+static inline int snd_shm_futex_wait(volatile int *addr, int val,
+				     const struct timespec *timeout)
+{
+	return syscall(SYS_futex, addr, FUTEX_WAIT, val, timeout, NULL, 0);
+}
+
+static inline void snd_shm_futex_wake(volatile int *addr, int count)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
 typedef enum _snd_dev_type {
 	SND_DEV_TYPE_PCM,
 	SND_DEV_TYPE_CONTROL,
@@ -59,11 +77,36 @@ typedef struct {
 	int changed;
 } snd_pcm_shm_rbptr_t;
 
+#define SND_PCM_SHM_RING_ENTRIES	64	/* power of two */
+
+/*
+ * Commit ring shared between the shm client and the aserver worker.
+ * The client owns head and doorbell, the worker owns tail, served and
+ * the published state. Both futex words are process shared.
+ */
+typedef struct {
+	unsigned int enabled;		/* set by the server when a worker serves the ring */
+	unsigned int head;		/* next entry to be queued by the client */
+	unsigned int tail;		/* next entry to be committed by the worker */
+	int doorbell;			/* futex: bumped by the client to request a pass */
+	int served;			/* futex: last doorbell value seen by a finished pass */
+	int sleeping;			/* worker is blocked on doorbell */
+	int result;			/* first error of a queued commit, sticky */
+	int state;			/* server state after the last pass or command */
+	snd_pcm_uframes_t appl_ptr;	/* server appl_ptr after the last command */
+	snd_pcm_uframes_t hw_ptr;	/* server hw_ptr after the last pass or command */
+	struct {
+		snd_pcm_uframes_t offset;
+		snd_pcm_uframes_t frames;
+	} entries[SND_PCM_SHM_RING_ENTRIES];
+} snd_pcm_shm_ring_t;
+
 typedef struct {
 	long result;
 	int cmd;
 	snd_pcm_shm_rbptr_t hw;
 	snd_pcm_shm_rbptr_t appl;
+	snd_pcm_shm_ring_t ring;
 	union {
 		struct {
 			int sig;
@@ -226,6 +226,7 @@ int snd_card_get_name(int card, char **name);
 int snd_card_get_longname(int card, char **name);
 
 int snd_device_name_hint(int card, const char *iface, void ***hints);
+int snd_device_name_hint_cached(int card, const char *iface, void ***hints);
 int snd_device_name_free_hint(void **hints);
 char *snd_device_name_get_hint(const void *hint, const char *id);
 
@@ -65,6 +65,8 @@ typedef struct _snd_pcm_hw_params snd_pcm_hw_params_t;
 typedef struct _snd_pcm_sw_params snd_pcm_sw_params_t;
 /** PCM status container */
  typedef struct _snd_pcm_status snd_pcm_status_t;
+/** PCM instrumentation counters, see #snd_pcm_stats_get() */
+typedef struct _snd_pcm_stats snd_pcm_stats_t;
 /** PCM access types mask */
 typedef struct _snd_pcm_access_mask snd_pcm_access_mask_t;
 /** PCM formats mask */
@@ -485,6 +487,8 @@ snd_pcm_sframes_t snd_pcm_readi(snd_pcm_t *pcm, void *buffer, snd_pcm_uframes_t
 snd_pcm_sframes_t snd_pcm_writen(snd_pcm_t *pcm, void **bufs, snd_pcm_uframes_t size);
 snd_pcm_sframes_t snd_pcm_readn(snd_pcm_t *pcm, void **bufs, snd_pcm_uframes_t size);
 int snd_pcm_wait(snd_pcm_t *pcm, int timeout);
+int snd_pcm_set_batched_wakeup(snd_pcm_t *pcm, snd_pcm_uframes_t watermark,
+			       unsigned int coalesce_us);
 
 int snd_pcm_link(snd_pcm_t *pcm1, snd_pcm_t *pcm2);
 int snd_pcm_unlink(snd_pcm_t *pcm);
@@ -1007,6 +1011,27 @@ int snd_pcm_hw_params_dump(snd_pcm_hw_params_t *params, snd_output_t *out);
 int snd_pcm_sw_params_dump(snd_pcm_sw_params_t *params, snd_output_t *out);
 int snd_pcm_status_dump(snd_pcm_status_t *status, snd_output_t *out);
 
+size_t snd_pcm_stats_sizeof(void);
+/** \hideinitializer
+ * \brief allocate an invalid #snd_pcm_stats_t using standard alloca
+ * \param ptr returned pointer
+ */
+#define snd_pcm_stats_alloca(ptr) __snd_alloca(ptr, snd_pcm_stats)
+int snd_pcm_stats_malloc(snd_pcm_stats_t **ptr);
+void snd_pcm_stats_free(snd_pcm_stats_t *obj);
+int snd_pcm_stats_get(snd_pcm_t *pcm, snd_pcm_stats_t *stats);
+unsigned long long snd_pcm_stats_get_frames(const snd_pcm_stats_t *obj);
+unsigned long long snd_pcm_stats_get_transfer_ns(const snd_pcm_stats_t *obj);
+unsigned long snd_pcm_stats_get_transfers(const snd_pcm_stats_t *obj);
+unsigned long snd_pcm_stats_get_commits(const snd_pcm_stats_t *obj);
+unsigned long long snd_pcm_stats_get_commit_frames(const snd_pcm_stats_t *obj);
+unsigned long long snd_pcm_stats_get_commit_ns(const snd_pcm_stats_t *obj);
+unsigned long snd_pcm_stats_get_wakeups(const snd_pcm_stats_t *obj);
+unsigned long snd_pcm_stats_get_xruns(const snd_pcm_stats_t *obj);
+int snd_pcm_stats_dump(snd_pcm_t *pcm, snd_output_t *out);
+int snd_pcm_trace_dump(snd_pcm_t *pcm, snd_output_t *out);
+int snd_pcm_trace_dump_file(const char *file, snd_output_t *out);
+
 /** \} */
 
 /**
@@ -1070,6 +1095,11 @@ int snd_pcm_areas_copy(const snd_pcm_channel_area_t *dst_channels, snd_pcm_ufram
 		       const snd_pcm_channel_area_t *src_channels, snd_pcm_uframes_t src_offset,
 		       unsigned int channels, snd_pcm_uframes_t frames, snd_pcm_format_t format);
 
+int snd_pcm_multi_get_skew(snd_pcm_t *pcm, snd_pcm_uframes_t *skew,
+			   snd_pcm_uframes_t *max_skew);
+int snd_pcm_hw_get_sync_ptr_stats(snd_pcm_t *pcm, unsigned long *ioctls,
+				  unsigned long *skipped, unsigned int *rate);
+
 /** \} */
 
 /**
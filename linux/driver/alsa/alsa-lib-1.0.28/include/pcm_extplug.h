@@ -60,7 +60,7 @@ typedef snd_pcm_extplug_callback snd_pcm_extplug_callback_t;
  */
 #define SND_PCM_EXTPLUG_VERSION_MAJOR	1	/**< Protocol major version */
 #define SND_PCM_EXTPLUG_VERSION_MINOR	0	/**< Protocol minor version */
-#define SND_PCM_EXTPLUG_VERSION_TINY	2	/**< Protocol tiny version */
+#define SND_PCM_EXTPLUG_VERSION_TINY	3	/**< Protocol tiny version */
 /**
  * Filter-plugin protocol version
  */
@@ -123,6 +123,11 @@ struct snd_pcm_extplug {
 	 * slave_channels hw parameter; filled after hw_params is caled
 	 */
 	unsigned int slave_channels;
+	/**
+	 * preferred block size in frames for the block_transfer callback;
+	 * may be set until the hw_params callback returns; since v1.0.3
+	 */
+	snd_pcm_uframes_t block_size;
 };
 
 /** Callback table of extplug */
@@ -168,6 +173,15 @@ struct snd_pcm_extplug_callback {
 	 * set the channel map; optional; since v1.0.2
 	 */
 	int (*set_chmap)(snd_pcm_extplug_t *ext, const snd_pcm_chmap_t *map);
+	/**
+	 * transfer a multiple of block_size frames between contiguous
+	 * interleaved buffers starting at offset 0; optional; used
+	 * instead of transfer when block_size is set; since v1.0.3
+	 */
+	snd_pcm_sframes_t (*block_transfer)(snd_pcm_extplug_t *ext,
+					    const snd_pcm_channel_area_t *dst_areas,
+					    const snd_pcm_channel_area_t *src_areas,
+					    snd_pcm_uframes_t size);
 };
 
 
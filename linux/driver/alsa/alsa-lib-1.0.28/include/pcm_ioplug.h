@@ -71,7 +71,7 @@ typedef snd_pcm_ioplug_callback snd_pcm_ioplug_callback_t;
  */
 #define SND_PCM_IOPLUG_VERSION_MAJOR	1	/**< Protocol major version */
 #define SND_PCM_IOPLUG_VERSION_MINOR	0	/**< Protocol minor version */
-#define SND_PCM_IOPLUG_VERSION_TINY	2	/**< Protocol tiny version */
+#define SND_PCM_IOPLUG_VERSION_TINY	3	/**< Protocol tiny version */
 /**
  * IO-plugin protocol version
  */
@@ -206,6 +206,14 @@ struct snd_pcm_ioplug_callback {
 	 * set the channel map; optional; since v1.0.2
 	 */
 	int (*set_chmap)(snd_pcm_ioplug_t *io, const snd_pcm_chmap_t *map);
+	/**
+	 * export the plugin's own ring buffer as the mmap area; optional;
+	 * since v1.0.3.  Called after hw_params, returns a mappable fd
+	 * (e.g. a memfd) and its page aligned offset, or a negative error
+	 * code to keep the local buffer.  The transfer callback is then
+	 * still called for each committed range, also with RW access.
+	 */
+	int (*mmap_fd)(snd_pcm_ioplug_t *io, off_t *offsetp);
 };
 
 
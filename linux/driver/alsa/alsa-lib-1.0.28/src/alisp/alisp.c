@@ -58,14 +58,28 @@ static int alisp_include_file(struct alisp_instance *instance, const char *filen
  *  object handling
  */
 
+/* FNV-1a, names like "Synth 1 Volume" differ only in a few chars */
 static int get_string_hash(const char *s)
 {
-	int val = 0;
+	unsigned int val = 2166136261U;
 	if (s == NULL)
-		return val;
-	while (*s)
-		val += *s++;
-	return val & ALISP_OBJ_PAIR_HASH_MASK;
+		return 0;
+	while (*s) {
+		val ^= (unsigned char)*s++;
+		val *= 16777619U;
+	}
+	return (val ^ (val >> ALISP_OBJ_PAIR_HASH_SHIFT)) & ALISP_OBJ_PAIR_HASH_MASK;
+}
+
+/* the low bits of a pointer are alignment */
+static inline int get_pointer_hash(const void *ptr)
+{
+	return ((unsigned long)ptr >> 4) & ALISP_OBJ_PAIR_HASH_MASK;
+}
+
+static inline int get_func_hash(const struct alisp_object *p)
+{
+	return ((unsigned long)p / sizeof(*p)) % ALISP_FUNC_CACHE_SIZE;
 }
 
 static void nomem(void)
@@ -130,11 +144,21 @@ static struct alisp_object * new_object(struct alisp_instance *instance, int typ
 	struct alisp_object * p;
 
 	if (list_empty(&instance->free_objs_list)) {
-		p = (struct alisp_object *)malloc(sizeof(struct alisp_object));
-		if (p == NULL) {
-			nomem();
-			return NULL;
+		if (instance->chunks == NULL ||
+		    instance->chunk_used == ALISP_OBJ_CHUNK) {
+			struct alisp_object_chunk *chunk;
+
+			chunk = malloc(sizeof(*chunk));
+			if (chunk == NULL) {
+				nomem();
+				return NULL;
+			}
+			lisp_debug(instance, "allocating chunk %p", chunk);
+			chunk->next = instance->chunks;
+			instance->chunks = chunk;
+			instance->chunk_used = 0;
 		}
+		p = &instance->chunks->objs[instance->chunk_used++];
 		lisp_debug(instance, "allocating cons %p", p);
 	} else {
 		p = (struct alisp_object *)instance->free_objs_list.next;
@@ -188,11 +212,9 @@ static void delete_object(struct alisp_instance *instance, struct alisp_object *
 	list_del(&p->list);
 	instance->used_objs--;
 	free_object(p);
-	if (instance->free_objs >= ALISP_FREE_OBJ_POOL) {
-		lisp_debug(instance, "freed cons %p", p);
-		free(p);
-		return;
-	}
+	if (instance->func_name[get_func_hash(p)] == p)
+		instance->func_name[get_func_hash(p)] = NULL;
+	/* the memory goes back to the arena with the instance */
 	lisp_debug(instance, "moved cons %p to free list", p);
 	list_add(&p->list, &instance->free_objs_list);
 	instance->free_objs++;
@@ -267,7 +289,6 @@ static void free_objects(struct alisp_instance *instance)
 			pair = list_entry(pos, struct alisp_object_pair, list);
 			lisp_debug(instance, "freeing pair: '%s' -> %p", pair->name, pair->value);
 			delete_tree(instance, pair->value);
-			free((void *)pair->name);
 			free(pair);
 		}
 	}
@@ -286,12 +307,16 @@ static void free_objects(struct alisp_instance *instance)
 				delete_object(instance, p);
 			}
 		}
-	list_for_each_safe(pos, pos1, &instance->free_objs_list) {
-		p = list_entry(pos, struct alisp_object, list);
-		list_del(&p->list);
-		free(p);
-		lisp_debug(instance, "freed (all) cons %p", p);
+	/* free and used objects all live in the arena */
+	while (instance->chunks) {
+		struct alisp_object_chunk *chunk = instance->chunks;
+
+		instance->chunks = chunk->next;
+		lisp_debug(instance, "freed chunk %p", chunk);
+		free(chunk);
 	}
+	INIT_LIST_HEAD(&instance->free_objs_list);
+	instance->free_objs = 0;
 }
 
 static struct alisp_object * search_object_identifier(struct alisp_instance *instance, const char *s)
@@ -366,7 +391,7 @@ static struct alisp_object * search_object_pointer(struct alisp_instance *instan
 	struct list_head * pos;
 	struct alisp_object * p;
 
-	list_for_each(pos, &instance->used_objs_list[(long)ptr & ALISP_OBJ_PAIR_HASH_MASK][ALISP_OBJ_POINTER]) {
+	list_for_each(pos, &instance->used_objs_list[get_pointer_hash(ptr)][ALISP_OBJ_POINTER]) {
 		p = list_entry(pos, struct alisp_object, list);
 		if (p->value.ptr == ptr) {
 			if (alisp_get_refs(p) > ALISP_MAX_REFS_LIMIT)
@@ -453,7 +478,7 @@ static struct alisp_object * new_pointer(struct alisp_instance *instance, const
 		return obj;
 	obj = new_object(instance, ALISP_OBJ_POINTER);
 	if (obj) {
-		list_add(&obj->list, &instance->used_objs_list[(long)ptr & ALISP_OBJ_PAIR_HASH_MASK][ALISP_OBJ_POINTER]);
+		list_add(&obj->list, &instance->used_objs_list[get_pointer_hash(ptr)][ALISP_OBJ_POINTER]);
 		obj->value.ptr = ptr;
 	}
 	return obj;
@@ -824,23 +849,29 @@ static struct alisp_object * parse_object(struct alisp_instance *instance, int h
  *  object manipulation
  */
 
-static struct alisp_object_pair * set_object_direct(struct alisp_instance *instance, struct alisp_object * name, struct alisp_object * value)
+static struct alisp_object_pair * new_pair(const char *id)
 {
 	struct alisp_object_pair *p;
-	const char *id;
+	size_t len = strlen(id) + 1;
 
-	id = name->value.s;
-	p = (struct alisp_object_pair *)malloc(sizeof(struct alisp_object_pair));
+	p = (struct alisp_object_pair *)malloc(sizeof(struct alisp_object_pair) + len);
 	if (p == NULL) {
 		nomem();
 		return NULL;
 	}
-	p->name = strdup(id);
-	if (p->name == NULL) {
-		delete_tree(instance, value);
-		free(p);
+	p->name = memcpy(p + 1, id, len);
+	return p;
+}
+
+static struct alisp_object_pair * set_object_direct(struct alisp_instance *instance, struct alisp_object * name, struct alisp_object * value)
+{
+	struct alisp_object_pair *p;
+	const char *id;
+
+	id = name->value.s;
+	p = new_pair(id);
+	if (p == NULL)
 		return NULL;
-	}
 	list_add(&p->list, &instance->setobjs_list[get_string_hash(id)]);
 	p->value = value;
 	return p;
@@ -884,17 +915,9 @@ static struct alisp_object_pair * set_object(struct alisp_instance *instance, st
 		}
 	}
 
-	p = (struct alisp_object_pair *)malloc(sizeof(struct alisp_object_pair));
-	if (p == NULL) {
-		nomem();
-		return NULL;
-	}
-	p->name = strdup(id);
-	if (p->name == NULL) {
-		delete_tree(instance, value);
-		free(p);
+	p = new_pair(id);
+	if (p == NULL)
 		return NULL;
-	}
 	list_add(&p->list, &instance->setobjs_list[get_string_hash(id)]);
 	p->value = value;
 	return p;
@@ -919,7 +942,6 @@ static struct alisp_object * unset_object(struct alisp_instance *instance, struc
 		if (!strcmp(p->name, id)) {
 			list_del(&p->list);
 			res = p->value;
-			free((void *)p->name);
 			free(p);
 			return res;
 		}
@@ -2297,6 +2319,7 @@ static struct alisp_object * eval_func(struct alisp_instance *instance, struct a
 {
 	struct alisp_object * p1, * p2, * p3, * p4;
 	struct alisp_object ** eval_objs, ** save_objs;
+	struct alisp_object * local_objs[2 * 8];
 	int i;
 
 	p1 = car(p);
@@ -2310,10 +2333,14 @@ static struct alisp_object * eval_func(struct alisp_instance *instance, struct a
 			goto _delete;
 		}
 
-		eval_objs = malloc(2 * i * sizeof(struct alisp_object *));
-		if (eval_objs == NULL) {
-			nomem();
-			goto _delete;
+		if (i <= 8) {
+			eval_objs = local_objs;
+		} else {
+			eval_objs = malloc(2 * i * sizeof(struct alisp_object *));
+			if (eval_objs == NULL) {
+				nomem();
+				goto _delete;
+			}
 		}
 		save_objs = eval_objs + i;
 		
@@ -2366,7 +2393,8 @@ static struct alisp_object * eval_func(struct alisp_instance *instance, struct a
 		}
 
                _end:
-		free(eval_objs);
+		if (eval_objs != local_objs)
+			free(eval_objs);
 
 		return p4;
 	} else {
@@ -2505,44 +2533,28 @@ static int format_parse_char(struct alisp_instance *instance, char **s, int *len
 
 static int format_parse_integer(struct alisp_instance *instance, char **s, int *len, struct alisp_object *p)
 {
-	int res;
-	char *s1;
+	char s1[64];
 
 	if (!alisp_compare_type(p, ALISP_OBJ_INTEGER) &&
 	    !alisp_compare_type(p, ALISP_OBJ_FLOAT)) {
 		lisp_warn(instance, "format: expected integer or float\n");
 		return 0;
 	}
-	s1 = malloc(64);
-	if (s1 == NULL) {
-		nomem();
-		return -ENOMEM;
-	}
-	sprintf(s1, "%li", alisp_compare_type(p, ALISP_OBJ_FLOAT) ? (long)floor(p->value.f) : p->value.i);
-	res = append_to_string(s, len, s1, strlen(s1));
-	free(s1);
-	return res;
+	snprintf(s1, sizeof(s1), "%li", alisp_compare_type(p, ALISP_OBJ_FLOAT) ? (long)floor(p->value.f) : p->value.i);
+	return append_to_string(s, len, s1, strlen(s1));
 }
 
 static int format_parse_float(struct alisp_instance *instance, char **s, int *len, struct alisp_object *p)
 {
-	int res;
-	char *s1;
+	char s1[64];
 
 	if (!alisp_compare_type(p, ALISP_OBJ_INTEGER) &&
 	    !alisp_compare_type(p, ALISP_OBJ_FLOAT)) {
 		lisp_warn(instance, "format: expected integer or float\n");
 		return 0;
 	}
-	s1 = malloc(64);
-	if (s1 == NULL) {
-		nomem();
-		return -ENOMEM;
-	}
-	sprintf(s1, "%f", alisp_compare_type(p, ALISP_OBJ_FLOAT) ? p->value.f : (double)p->value.i);
-	res = append_to_string(s, len, s1, strlen(s1));
-	free(s1);
-	return res;
+	snprintf(s1, sizeof(s1), "%f", alisp_compare_type(p, ALISP_OBJ_FLOAT) ? p->value.f : (double)p->value.i);
+	return append_to_string(s, len, s1, strlen(s1));
 }
 
 static int format_parse_string(struct alisp_instance *instance, char **s, int *len, struct alisp_object *p)
@@ -3043,23 +3055,38 @@ static int compar(const void *p1, const void *p2)
 		      ((struct intrinsic *)p2)->name);
 }
 
-static inline struct alisp_object * eval_cons1(struct alisp_instance *instance, struct alisp_object * p1, struct alisp_object * p2)
+/*
+ * Resolve a function name to an intrinsic. Names are shared objects,
+ * so the result is kept per object until the object is deleted.
+ */
+static const struct intrinsic *find_intrinsic(struct alisp_instance *instance, struct alisp_object * p1)
 {
-	struct alisp_object * p3;
-	struct intrinsic key, *item;
+	struct intrinsic key;
+	const struct intrinsic *item;
+	int h = get_func_hash(p1);
+
+	if (instance->func_name[h] == p1)
+		return instance->func_item[h];
 
 	key.name = p1->value.s;
+	item = bsearch(&key, intrinsics,
+		       sizeof intrinsics / sizeof intrinsics[0],
+		       sizeof intrinsics[0], compar);
+	if (item == NULL)
+		item = bsearch(&key, snd_intrinsics,
+			       sizeof snd_intrinsics / sizeof snd_intrinsics[0],
+			       sizeof snd_intrinsics[0], compar);
+	instance->func_name[h] = p1;
+	instance->func_item[h] = item;
+	return item;
+}
 
-	if ((item = bsearch(&key, intrinsics,
-			    sizeof intrinsics / sizeof intrinsics[0],
-			    sizeof intrinsics[0], compar)) != NULL) {
-		delete_object(instance, p1);
-		return item->func(instance, p2);
-	}
+static inline struct alisp_object * eval_cons1(struct alisp_instance *instance, struct alisp_object * p1, struct alisp_object * p2)
+{
+	struct alisp_object * p3;
+	const struct intrinsic *item;
 
-	if ((item = bsearch(&key, snd_intrinsics,
-			    sizeof snd_intrinsics / sizeof snd_intrinsics[0],
-			    sizeof snd_intrinsics[0], compar)) != NULL) {
+	if ((item = find_intrinsic(instance, p1)) != NULL) {
 		delete_object(instance, p1);
 		return item->func(instance, p2);
 	}
@@ -111,15 +111,24 @@ static inline unsigned int alisp_dec_refs(struct alisp_object *p)
 
 struct alisp_object_pair {
 	struct list_head list;
-	const char *name;
+	const char *name;		/* stored after the pair */
  	struct alisp_object *value;
 };
 
+#define ALISP_OBJ_CHUNK		256	/* objects in one arena chunk */
+
+struct alisp_object_chunk {
+	struct alisp_object_chunk *next;
+	struct alisp_object objs[ALISP_OBJ_CHUNK];
+};
+
+struct intrinsic;
+
 #define ALISP_LEX_BUF_MAX	16
-#define ALISP_OBJ_PAIR_HASH_SHIFT 4
+#define ALISP_OBJ_PAIR_HASH_SHIFT 6
 #define ALISP_OBJ_PAIR_HASH_SIZE (1<<ALISP_OBJ_PAIR_HASH_SHIFT)
 #define ALISP_OBJ_PAIR_HASH_MASK (ALISP_OBJ_PAIR_HASH_SIZE-1)
-#define ALISP_FREE_OBJ_POOL	512	/* free objects above this pool */
+#define ALISP_FUNC_CACHE_SIZE	64	/* resolved function names */
 
 struct alisp_instance {
 	int verbose: 1,
@@ -146,6 +155,11 @@ struct alisp_instance {
 	long max_objs;
 	struct list_head free_objs_list;
 	struct list_head used_objs_list[ALISP_OBJ_PAIR_HASH_SIZE][ALISP_OBJ_LAST_SEARCH + 1];
+	struct alisp_object_chunk *chunks;	/* arena, freed with the instance */
+	unsigned int chunk_used;
 	/* set object */
 	struct list_head setobjs_list[ALISP_OBJ_PAIR_HASH_SIZE];
+	/* function name object -> intrinsic (NULL for defun) */
+	struct alisp_object *func_name[ALISP_FUNC_CACHE_SIZE];
+	const struct intrinsic *func_item[ALISP_FUNC_CACHE_SIZE];
 };
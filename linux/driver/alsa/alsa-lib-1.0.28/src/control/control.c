@@ -824,6 +824,26 @@ static const char *const build_in_ctls[] = {
 	"hw", "shm", NULL
 };
 
+/*
+ * resolve all built-in open functions on the first open, the later ones
+ * find them in the lock-free dlobj registry
+ */
+static void snd_ctl_preload_build_in(void)
+{
+	static int preloaded;
+	const char *const *build_in;
+	char open_name[64];
+
+	if (__atomic_load_n(&preloaded, __ATOMIC_ACQUIRE))
+		return;
+	for (build_in = build_in_ctls; *build_in; build_in++) {
+		snprintf(open_name, sizeof(open_name), "_snd_ctl_%s_open", *build_in);
+		snd_dlobj_cache_get(NULL, open_name,
+				    SND_DLSYM_VERSION(SND_CONTROL_DLSYM_VERSION), 0);
+	}
+	__atomic_store_n(&preloaded, 1, __ATOMIC_RELEASE);
+}
+
 static int snd_ctl_open_conf(snd_ctl_t **ctlp, const char *name,
 			     snd_config_t *ctl_root, snd_config_t *ctl_conf, int mode)
 {
@@ -923,6 +943,7 @@ static int snd_ctl_open_conf(snd_ctl_t **ctlp, const char *name,
 #ifndef PIC
 	snd_control_open_symbols();
 #endif
+	snd_ctl_preload_build_in();
 	open_func = snd_dlobj_cache_get(lib, open_name,
 			SND_DLSYM_VERSION(SND_CONTROL_DLSYM_VERSION), 1);
 	if (open_func) {
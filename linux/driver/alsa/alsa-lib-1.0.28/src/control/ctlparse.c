@@ -295,21 +295,13 @@ static int get_ctl_enum_item_index(snd_ctl_t *handle,
 	return -1;
 }
 
-/**
- * \brief parse ASCII string as CTL element value
- * \param handle CTL handle
- * \param dst destination CTL element value
- * \param info CTL element info structure
- * \param value source ASCII string
- * \return zero on success, otherwise a negative error code
- *
- * Note: For toggle command, the dst must contain previous (current)
- * state (do the #snd_ctl_elem_read call to obtain it).
- */
-int snd_ctl_ascii_value_parse(snd_ctl_t *handle,
-			      snd_ctl_elem_value_t *dst,
-			      snd_ctl_elem_info_t *info,
-			      const char *value)
+#ifndef DOC_HIDDEN
+/* used by UCM, too: ret_items is the count of items set in dst */
+int __snd_ctl_ascii_value_parse(snd_ctl_t *handle,
+				snd_ctl_elem_value_t *dst,
+				snd_ctl_elem_info_t *info,
+				const char *value,
+				unsigned int *ret_items)
 {
 	const char *ptr = value;
 	snd_ctl_elem_id_t *myid;
@@ -380,5 +372,27 @@ int snd_ctl_ascii_value_parse(snd_ctl_t *handle,
 		else if (*ptr == ',')
 			ptr++;
 	}
+	if (ret_items)
+		*ret_items = idx;
 	return 0;
 }
+#endif
+
+/**
+ * \brief parse ASCII string as CTL element value
+ * \param handle CTL handle
+ * \param dst destination CTL element value
+ * \param info CTL element info structure
+ * \param value source ASCII string
+ * \return zero on success, otherwise a negative error code
+ *
+ * Note: For toggle command, the dst must contain previous (current)
+ * state (do the #snd_ctl_elem_read call to obtain it).
+ */
+int snd_ctl_ascii_value_parse(snd_ctl_t *handle,
+			      snd_ctl_elem_value_t *dst,
+			      snd_ctl_elem_info_t *info,
+			      const char *value)
+{
+	return __snd_ctl_ascii_value_parse(handle, dst, info, value, NULL);
+}
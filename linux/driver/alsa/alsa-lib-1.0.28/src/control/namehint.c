@@ -26,6 +26,12 @@
  */
 
 #include "local.h"
+#include <ctype.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #ifndef DOC_HIDDEN
 struct hint_list {
@@ -517,6 +523,25 @@ static int add_software_devices(snd_config_t *config, snd_config_t *rw_config,
 	return 0;
 }
 
+static int hint_iface(const char *iface)
+{
+	if (strcmp(iface, "card") == 0)
+		return SND_CTL_ELEM_IFACE_CARD;
+	else if (strcmp(iface, "pcm") == 0)
+		return SND_CTL_ELEM_IFACE_PCM;
+	else if (strcmp(iface, "rawmidi") == 0)
+		return SND_CTL_ELEM_IFACE_RAWMIDI;
+	else if (strcmp(iface, "timer") == 0)
+		return SND_CTL_ELEM_IFACE_TIMER;
+	else if (strcmp(iface, "seq") == 0)
+		return SND_CTL_ELEM_IFACE_SEQUENCER;
+	else if (strcmp(iface, "hwdep") == 0)
+		return SND_CTL_ELEM_IFACE_HWDEP;
+	else if (strcmp(iface, "ctl") == 0)
+		return SND_CTL_ELEM_IFACE_MIXER;
+	return -EINVAL;
+}
+
 /**
  * \brief Get a set of device name hints
  * \param card Card number or -1 (means all cards)
@@ -562,24 +587,10 @@ int snd_device_name_hint(int card, const char *iface, void ***hints)
 	list.list = NULL;
 	list.count = list.allocated = 0;
 	list.siface = iface;
-	if (strcmp(iface, "card") == 0)
-		list.iface = SND_CTL_ELEM_IFACE_CARD;
-	else if (strcmp(iface, "pcm") == 0)
-		list.iface = SND_CTL_ELEM_IFACE_PCM;
-	else if (strcmp(iface, "rawmidi") == 0)
-		list.iface = SND_CTL_ELEM_IFACE_RAWMIDI;
-	else if (strcmp(iface, "timer") == 0)
-		list.iface = SND_CTL_ELEM_IFACE_TIMER;
-	else if (strcmp(iface, "seq") == 0)
-		list.iface = SND_CTL_ELEM_IFACE_SEQUENCER;
-	else if (strcmp(iface, "hwdep") == 0)
-		list.iface = SND_CTL_ELEM_IFACE_HWDEP;
-	else if (strcmp(iface, "ctl") == 0)
-		list.iface = SND_CTL_ELEM_IFACE_MIXER;
-	else {
-		err = -EINVAL;
+	err = hint_iface(iface);
+	if (err < 0)
 		goto __error;
-	}
+	list.iface = err;
 
 	list.show_all = 0;
 	list.cardname = NULL;
@@ -641,6 +652,392 @@ int snd_device_name_hint(int card, const char *iface, void ***hints)
 	return err;
 }
 
+/*
+ * Hint cache
+ *
+ * The hints are kept per interface, with software devices, the
+ * namehint.IFACE entries and each card apart. A card is probed again
+ * only when its device nodes change (inotify on the device directory,
+ * or the directory stat when inotify is not available). Everything is
+ * dropped when snd_config_update_r() reloads the configuration.
+ */
+
+#ifndef DOC_HIDDEN
+struct hint_set {
+	char **list;
+	unsigned int count;
+	int valid;
+	int err;
+	unsigned int gen;		/* card generation of the set */
+};
+
+struct hint_cache {
+	struct list_head list;
+	char *siface;
+	unsigned int config_gen;
+	struct hint_set soft;
+	struct hint_set user;
+	struct hint_set card[SND_MAX_CARDS];
+};
+
+static struct {
+	snd_config_t *config;
+	snd_config_update_t *update;
+	unsigned int config_gen;
+	unsigned int card_gen[SND_MAX_CARDS];
+	int inotify_fd;
+	int dir_exists;
+	struct stat dir_stat;
+	struct list_head caches;
+} hint_state = {
+	.inotify_fd = -1,
+	.caches = LIST_HEAD_INIT(hint_state.caches),
+};
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t hint_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+#endif /* DOC_HIDDEN */
+
+static inline void hint_cache_lock(void)
+{
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_lock(&hint_cache_mutex);
+#endif
+}
+
+static inline void hint_cache_unlock(void)
+{
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_unlock(&hint_cache_mutex);
+#endif
+}
+
+static void hint_set_free(struct hint_set *set)
+{
+	unsigned int i;
+
+	for (i = 0; i < set->count; i++)
+		free(set->list[i]);
+	free(set->list);
+	set->list = NULL;
+	set->count = 0;
+	set->valid = 0;
+}
+
+static void hint_cards_changed(void)
+{
+	unsigned int card;
+
+	for (card = 0; card < SND_MAX_CARDS; card++)
+		hint_state.card_gen[card]++;
+}
+
+/* card number of a device node name like pcmC0D3p */
+static int hint_node_card(const char *name)
+{
+	const char *c = strchr(name, 'C');
+	int card;
+
+	if (c == NULL || !isdigit((unsigned char)c[1]))
+		return -1;
+	card = atoi(c + 1);
+	return card < SND_MAX_CARDS ? card : -1;
+}
+
+static void hint_check_devices(void)
+{
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	struct stat st;
+	ssize_t len;
+	char *ptr;
+	int card, exists;
+
+	if (hint_state.inotify_fd >= 0) {
+		while ((len = read(hint_state.inotify_fd, buf, sizeof(buf))) > 0) {
+			for (ptr = buf; ptr < buf + len;
+			     ptr += sizeof(*ev) + ev->len) {
+				ev = (const struct inotify_event *)ptr;
+				if (ev->mask & (IN_Q_OVERFLOW | IN_IGNORED)) {
+					hint_cards_changed();
+					continue;
+				}
+				card = ev->len ? hint_node_card(ev->name) : -1;
+				if (card >= 0)
+					hint_state.card_gen[card]++;
+			}
+		}
+		if (stat(ALSA_DEVICE_DIRECTORY, &st) == 0 &&
+		    st.st_ino == hint_state.dir_stat.st_ino)
+			return;
+		/* the directory was removed, watch it again when it is back */
+		close(hint_state.inotify_fd);
+		hint_state.inotify_fd = -1;
+	}
+	/* no watch, compare the directory itself */
+	exists = stat(ALSA_DEVICE_DIRECTORY, &st) == 0;
+	if (exists != hint_state.dir_exists ||
+	    (exists && (st.st_ino != hint_state.dir_stat.st_ino ||
+			st.st_mtime != hint_state.dir_stat.st_mtime ||
+			st.st_ctime != hint_state.dir_stat.st_ctime)))
+		hint_cards_changed();
+	hint_state.dir_exists = exists;
+	if (!exists)
+		return;
+	hint_state.dir_stat = st;
+	hint_state.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (hint_state.inotify_fd < 0)
+		return;
+	if (inotify_add_watch(hint_state.inotify_fd, ALSA_DEVICE_DIRECTORY,
+			      IN_CREATE | IN_DELETE | IN_ATTRIB |
+			      IN_MOVED_FROM | IN_MOVED_TO) < 0) {
+		close(hint_state.inotify_fd);
+		hint_state.inotify_fd = -1;
+		return;
+	}
+	/* the nodes may have changed before the watch was added */
+	hint_cards_changed();
+}
+
+static struct hint_cache *hint_cache_get(const char *iface)
+{
+	struct list_head *pos;
+	struct hint_cache *cache;
+
+	list_for_each(pos, &hint_state.caches) {
+		cache = list_entry(pos, struct hint_cache, list);
+		if (strcmp(cache->siface, iface) == 0)
+			return cache;
+	}
+	cache = calloc(1, sizeof(*cache));
+	if (cache == NULL)
+		return NULL;
+	cache->siface = strdup(iface);
+	if (cache->siface == NULL) {
+		free(cache);
+		return NULL;
+	}
+	list_add_tail(&cache->list, &hint_state.caches);
+	return cache;
+}
+
+static void hint_list_init(struct hint_list *list, struct hint_cache *cache)
+{
+	snd_config_t *conf;
+
+	memset(list, 0, sizeof(*list));
+	list->siface = cache->siface;
+	list->iface = hint_iface(cache->siface);
+	if (snd_config_search(hint_state.config, "defaults.namehint.showall", &conf) >= 0)
+		list->show_all = snd_config_get_bool(conf) > 0;
+}
+
+/* move the hints to the set, the list is freed on error */
+static int hint_set_take(struct hint_set *set, struct hint_list *list, int err)
+{
+	hint_set_free(set);
+	free(list->cardname);
+	if (err < 0) {
+		while (list->count > 0)
+			free(list->list[--list->count]);
+		free(list->list);
+		list->list = NULL;
+	}
+	set->list = list->list;
+	set->count = list->count;
+	set->err = err;
+	set->valid = 1;
+	return err;
+}
+
+static int hint_build_user(struct hint_cache *cache)
+{
+	struct hint_list list;
+	snd_config_t *conf;
+	snd_config_iterator_t i, next;
+	char ehints[24];
+	const char *str;
+	int err = 0;
+
+	hint_list_init(&list, cache);
+	snprintf(ehints, sizeof(ehints), "namehint.%s", cache->siface);
+	if (snd_config_search(hint_state.config, ehints, &conf) >= 0) {
+		snd_config_for_each(i, next, conf) {
+			if (snd_config_get_string(snd_config_iterator_entry(i),
+						  &str) < 0)
+				continue;
+			err = hint_list_add(&list, str, NULL);
+			if (err < 0)
+				break;
+		}
+	}
+	return hint_set_take(&cache->user, &list, err);
+}
+
+static int hint_build_soft(struct hint_cache *cache, snd_config_t *rw_config)
+{
+	struct hint_list list;
+
+	hint_list_init(&list, cache);
+	add_software_devices(hint_state.config, rw_config, &list);
+	return hint_set_take(&cache->soft, &list, 0);
+}
+
+static int hint_build_card(struct hint_cache *cache, snd_config_t *rw_config,
+			   int card)
+{
+	struct hint_list list;
+	int err;
+
+	hint_list_init(&list, cache);
+	if (!snd_card_load(card)) {
+		err = -ENODEV;
+	} else {
+		err = get_card_name(&list, card);
+		if (err >= 0)
+			err = add_card(hint_state.config, rw_config, &list, card);
+	}
+	err = hint_set_take(&cache->card[card], &list, err);
+	cache->card[card].gen = hint_state.card_gen[card];
+	return err;
+}
+
+static int hint_set_append(char **dst, unsigned int *pos, struct hint_set *set)
+{
+	unsigned int i;
+
+	for (i = 0; i < set->count; i++) {
+		dst[*pos] = strdup(set->list[i]);
+		if (dst[*pos] == NULL)
+			return -ENOMEM;
+		(*pos)++;
+	}
+	return 0;
+}
+
+/**
+ * \brief Get a set of device name hints from the hint cache
+ * \param card Card number or -1 (means all cards)
+ * \param iface Interface identification (like "pcm", "rawmidi", "timer", "seq")
+ * \param hints Result - array of device name hints
+ * \result zero if success, otherwise a negative error code
+ *
+ * Gives the same result as #snd_device_name_hint, but the hints are
+ * kept between calls. A card is probed again only when its device
+ * files are created, removed or changed. All hints are rebuilt when
+ * the configuration files change. hints must be released with
+ * #snd_device_name_free_hint.
+ */
+int snd_device_name_hint_cached(int card, const char *iface, void ***hints)
+{
+	struct hint_cache *cache;
+	snd_config_t *rw_config = NULL;
+	unsigned int count, pos = 0;
+	char **res = NULL;
+	int c, err;
+
+	if (hints == NULL || iface == NULL)
+		return -EINVAL;
+	if (hint_iface(iface) < 0)
+		return -EINVAL;
+	if (card >= SND_MAX_CARDS)
+		return snd_device_name_hint(card, iface, hints);
+	hint_cache_lock();
+	err = snd_config_update_r(&hint_state.config, &hint_state.update, NULL);
+	if (err < 0)
+		goto __unlock;
+	if (err > 0)
+		hint_state.config_gen++;
+	hint_check_devices();
+	cache = hint_cache_get(iface);
+	if (cache == NULL) {
+		err = -ENOMEM;
+		goto __unlock;
+	}
+	if (cache->config_gen != hint_state.config_gen) {
+		hint_set_free(&cache->soft);
+		hint_set_free(&cache->user);
+		for (c = 0; c < SND_MAX_CARDS; c++)
+			hint_set_free(&cache->card[c]);
+		cache->config_gen = hint_state.config_gen;
+	}
+
+	/* rebuild what changed */
+	for (c = card >= 0 ? card : 0; c < SND_MAX_CARDS; c++) {
+		if (!cache->card[c].valid ||
+		    cache->card[c].gen != hint_state.card_gen[c]) {
+			if (rw_config == NULL) {
+				err = snd_config_copy(&rw_config, hint_state.config);
+				if (err < 0)
+					goto __unlock;
+			}
+			err = hint_build_card(cache, rw_config, c);
+			if (err == -ENOMEM)
+				goto __unlock;
+		}
+		if (card >= 0)
+			break;
+	}
+	if (card < 0 && !cache->soft.valid) {
+		if (rw_config == NULL) {
+			err = snd_config_copy(&rw_config, hint_state.config);
+			if (err < 0)
+				goto __unlock;
+		}
+		hint_build_soft(cache, rw_config);
+	}
+	if (!cache->user.valid && hint_build_user(cache) < 0) {
+		err = cache->user.err;
+		goto __unlock;
+	}
+
+	/* copy out */
+	count = cache->user.count + 1;
+	if (card >= 0) {
+		err = cache->card[card].err;
+		if (err < 0)
+			goto __unlock;
+		count += cache->card[card].count;
+	} else {
+		count += cache->soft.count;
+		for (c = 0; c < SND_MAX_CARDS; c++) {
+			if (cache->card[c].err == -ENODEV)
+				continue;
+			err = cache->card[c].err;
+			if (err < 0)
+				goto __unlock;
+			count += cache->card[c].count;
+		}
+	}
+	res = calloc(count, sizeof(char *));
+	if (res == NULL) {
+		err = -ENOMEM;
+		goto __unlock;
+	}
+	if (card >= 0) {
+		err = hint_set_append(res, &pos, &cache->card[card]);
+	} else {
+		err = hint_set_append(res, &pos, &cache->soft);
+		for (c = 0; err >= 0 && c < SND_MAX_CARDS; c++)
+			if (cache->card[c].err != -ENODEV)
+				err = hint_set_append(res, &pos, &cache->card[c]);
+	}
+	if (err >= 0)
+		err = hint_set_append(res, &pos, &cache->user);
+	if (err < 0) {
+		snd_device_name_free_hint((void **)res);
+		goto __unlock;
+	}
+	*hints = (void **)res;
+	err = 0;
+      __unlock:
+	hint_cache_unlock();
+	if (rw_config)
+		snd_config_delete(rw_config);
+	return err;
+}
+
 /**
  * \brief Free a list of device name hints.
  * \param hints List to free
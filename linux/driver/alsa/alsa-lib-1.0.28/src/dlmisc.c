@@ -122,7 +122,8 @@ int snd_dlclose(void *handle)
  * This function checks that the symbol with the version appended to its name
  * does exist in the library.
  */
-static int snd_dlsym_verify(void *handle, const char *name, const char *version)
+static int snd_dlsym_verify(void *handle, const char *name, const char *version,
+			    int verbose)
 {
 #ifdef HAVE_LIBDL
 	int res;
@@ -138,7 +139,7 @@ static int snd_dlsym_verify(void *handle, const char *name, const char *version)
 	strcat(vname, version);
 	res = dlsym(handle, vname) == NULL ? -ENOENT : 0;
 	// printf("dlsym verify: %i, vname = '%s'\n", res, vname);
-	if (res < 0)
+	if (res < 0 && verbose)
 		SNDERR("unable to verify version for symbol %s", name);
 	return res;
 #else
@@ -146,6 +147,11 @@ static int snd_dlsym_verify(void *handle, const char *name, const char *version)
 #endif
 }
 
+#ifndef DOC_HIDDEN
+static void *__snd_dlsym(void *handle, const char *name, const char *version,
+			 int verbose);
+#endif
+
 /**
  * \brief Resolves a symbol from a dynamic library - ALSA wrapper for \c dlsym.
  * \param handle Library handle, similar to \c dlsym.
@@ -160,6 +166,13 @@ static int snd_dlsym_verify(void *handle, const char *name, const char *version)
  * #SND_DLSYM_BUILD_VERSION macro.
  */
 void *snd_dlsym(void *handle, const char *name, const char *version)
+{
+	return __snd_dlsym(handle, name, version, 1);
+}
+
+#ifndef DOC_HIDDEN
+static void *__snd_dlsym(void *handle, const char *name, const char *version,
+			 int verbose)
 {
 	int err;
 
@@ -178,7 +191,7 @@ void *snd_dlsym(void *handle, const char *name, const char *version)
 #endif
 #ifdef HAVE_LIBDL
 	if (version) {
-		err = snd_dlsym_verify(handle, name, version);
+		err = snd_dlsym_verify(handle, name, version, verbose);
 		if (err < 0)
 			return NULL;
 	}
@@ -187,6 +200,7 @@ void *snd_dlsym(void *handle, const char *name, const char *version)
 	return NULL;
 #endif
 }
+#endif
 
 /*
  * dlobj cache
@@ -221,14 +235,138 @@ static inline void snd_dlobj_unlock(void) {}
 
 static LIST_HEAD(pcm_dlobj_list);
 
+/*
+ * Registry of resolved open functions, hashed by (lib, name) and by the
+ * function pointer.  Entries are only added (under the dlobj lock) and
+ * never removed, so lookups need no lock: opening a device once its
+ * type was resolved costs a hash and a strcmp.  The registered
+ * libraries stay loaded until the process exits; when the registry is
+ * full, the refcounted list below takes over.
+ */
+#define DLOBJ_HASH_SIZE		256
+
+struct dlobj_entry {
+	unsigned int hash;
+	char *lib;
+	char *name;
+	void *dlobj;
+	void *func;
+};
+
+static struct dlobj_entry *dlobj_by_name[DLOBJ_HASH_SIZE];
+static struct dlobj_entry *dlobj_by_func[DLOBJ_HASH_SIZE];
+static unsigned int dlobj_entries;
+
+static unsigned int dlobj_hash(const char *lib, const char *name)
+{
+	unsigned int hash = 2166136261U;	/* FNV-1a */
+
+	if (lib) {
+		while (*lib)
+			hash = (hash ^ (unsigned char)*lib++) * 16777619U;
+	}
+	hash = (hash ^ '\n') * 16777619U;
+	while (*name)
+		hash = (hash ^ (unsigned char)*name++) * 16777619U;
+	return hash;
+}
+
+static inline unsigned int dlobj_func_hash(void *func)
+{
+	return (unsigned int)((unsigned long)func >> 4) * 2654435761U;
+}
+
+static void *dlobj_lookup(const char *lib, const char *name, unsigned int hash)
+{
+	struct dlobj_entry *e;
+	unsigned int i;
+
+	for (i = 0; i < DLOBJ_HASH_SIZE; i++) {
+		e = __atomic_load_n(&dlobj_by_name[(hash + i) % DLOBJ_HASH_SIZE],
+				    __ATOMIC_ACQUIRE);
+		if (!e)
+			break;
+		if (e->hash != hash || !e->lib != !lib)
+			continue;
+		if ((!lib || !strcmp(e->lib, lib)) && !strcmp(e->name, name))
+			return e->func;
+	}
+	return NULL;
+}
+
+static int dlobj_registered(void *func)
+{
+	struct dlobj_entry *e;
+	unsigned int i, hash = dlobj_func_hash(func);
+
+	for (i = 0; i < DLOBJ_HASH_SIZE; i++) {
+		e = __atomic_load_n(&dlobj_by_func[(hash + i) % DLOBJ_HASH_SIZE],
+				    __ATOMIC_ACQUIRE);
+		if (!e)
+			break;
+		if (e->func == func)
+			return 1;
+	}
+	return 0;
+}
+
+static void dlobj_publish(struct dlobj_entry **table, unsigned int hash,
+			  struct dlobj_entry *e)
+{
+	unsigned int i = hash;
+
+	while (table[i % DLOBJ_HASH_SIZE])
+		i++;
+	__atomic_store_n(&table[i % DLOBJ_HASH_SIZE], e, __ATOMIC_RELEASE);
+}
+
+/* called with the dlobj lock held, takes over dlobj on success */
+static int dlobj_register(const char *lib, const char *name, unsigned int hash,
+			  void *dlobj, void *func)
+{
+	struct dlobj_entry *e;
+
+	/* keep the probe sequences short */
+	if (dlobj_entries >= DLOBJ_HASH_SIZE / 2)
+		return -ENOSPC;
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return -ENOMEM;
+	e->lib = lib ? strdup(lib) : NULL;
+	e->name = strdup(name);
+	if ((lib && !e->lib) || !e->name) {
+		free(e->lib);
+		free(e->name);
+		free(e);
+		return -ENOMEM;
+	}
+	e->hash = hash;
+	e->dlobj = dlobj;
+	e->func = func;
+	dlobj_publish(dlobj_by_func, dlobj_func_hash(func), e);
+	dlobj_publish(dlobj_by_name, hash, e);
+	dlobj_entries++;
+	return 0;
+}
+
 void *snd_dlobj_cache_get(const char *lib, const char *name,
 			  const char *version, int verbose)
 {
 	struct list_head *p;
 	struct dlobj_cache *c;
 	void *func, *dlobj;
+	unsigned int hash = dlobj_hash(lib, name);
+
+	func = dlobj_lookup(lib, name, hash);
+	if (func)
+		return func;
 
 	snd_dlobj_lock();
+	func = dlobj_lookup(lib, name, hash);
+	if (func) {
+		snd_dlobj_unlock();
+		return func;
+	}
 	list_for_each(p, &pcm_dlobj_list) {
 		c = list_entry(p, struct dlobj_cache, list);
 		if (c->lib && lib && strcmp(c->lib, lib) != 0)
@@ -254,13 +392,17 @@ void *snd_dlobj_cache_get(const char *lib, const char *name,
 		return NULL;
 	}
 
-	func = snd_dlsym(dlobj, name, version);
+	func = __snd_dlsym(dlobj, name, version, verbose);
 	if (func == NULL) {
 		if (verbose)
 			SNDERR("symbol %s is not defined inside %s",
 					name, lib ? lib : "[builtin]");
 		goto __err;
 	}
+	if (dlobj_register(lib, name, hash, dlobj, func) == 0) {
+		snd_dlobj_unlock();
+		return func;
+	}
 	c = malloc(sizeof(*c));
 	if (! c)
 		goto __err;
@@ -291,6 +433,8 @@ int snd_dlobj_cache_put(void *func)
 
 	if (!func)
 		return -ENOENT;
+	if (dlobj_registered(func))
+		return 0;
 
 	snd_dlobj_lock();
 	list_for_each(p, &pcm_dlobj_list) {
@@ -21,20 +21,72 @@
 
 #include "mixer_local.h"
 
-int bag_new(bag_t **bag)
+/* number of bag entries allocated at once by the pool */
+#define BAG_POOL_CHUNK	64
+
+struct bag_pool_chunk {
+	struct list_head list;
+	bag1_t entries[BAG_POOL_CHUNK];
+};
+
+void bag_pool_init(bag_pool_t *pool)
+{
+	INIT_LIST_HEAD(&pool->chunks);
+	pool->free = NULL;
+}
+
+void bag_pool_done(bag_pool_t *pool)
+{
+	while (!list_empty(&pool->chunks)) {
+		struct bag_pool_chunk *c;
+		c = list_entry(pool->chunks.next, struct bag_pool_chunk, list);
+		list_del(&c->list);
+		free(c);
+	}
+	pool->free = NULL;
+}
+
+static bag1_t *bag_pool_get(bag_pool_t *pool)
 {
-	bag_t *b = malloc(sizeof(*b));
+	bag1_t *b = pool->free;
+	if (!b) {
+		struct bag_pool_chunk *c;
+		unsigned int k;
+		c = malloc(sizeof(*c));
+		if (!c)
+			return NULL;
+		list_add_tail(&c->list, &pool->chunks);
+		/* free entries are chained through the ptr field */
+		for (k = 0; k < BAG_POOL_CHUNK - 1; k++)
+			c->entries[k].ptr = &c->entries[k + 1];
+		c->entries[k].ptr = NULL;
+		b = c->entries;
+	}
+	pool->free = b->ptr;
+	return b;
+}
+
+static void bag_pool_put(bag_pool_t *pool, bag1_t *b)
+{
+	b->ptr = pool->free;
+	pool->free = b;
+}
+
+int bag_new(bag_pool_t *pool, bag_t **bag)
+{
+	bag1_t *b = bag_pool_get(pool);
 	if (!b)
 		return -ENOMEM;
-	INIT_LIST_HEAD(b);
-	*bag = b;
+	b->ptr = NULL;
+	INIT_LIST_HEAD(&b->list);
+	*bag = &b->list;
 	return 0;
 }
 
-void bag_free(bag_t *bag)
+void bag_free(bag_pool_t *pool, bag_t *bag)
 {
 	assert(list_empty(bag));
-	free(bag);
+	bag_pool_put(pool, list_entry(bag, bag1_t, list));
 }
 
 int bag_empty(bag_t *bag)
@@ -42,9 +94,9 @@ int bag_empty(bag_t *bag)
 	return list_empty(bag);
 }
 
-int bag_add(bag_t *bag, void *ptr)
+int bag_add(bag_pool_t *pool, bag_t *bag, void *ptr)
 {
-	bag1_t *b = malloc(sizeof(*b));
+	bag1_t *b = bag_pool_get(pool);
 	if (!b)
 		return -ENOMEM;
 	b->ptr = ptr;
@@ -52,22 +104,25 @@ int bag_add(bag_t *bag, void *ptr)
 	return 0;
 }
 
-int bag_del(bag_t *bag, void *ptr)
+int bag_del(bag_pool_t *pool, bag_t *bag, void *ptr)
 {
 	struct list_head *pos;
 	list_for_each(pos, bag) {
 		bag1_t *b = list_entry(pos, bag1_t, list);
 		if (b->ptr == ptr) {
 			list_del(&b->list);
-			free(b);
+			bag_pool_put(pool, b);
 			return 0;
 		}
 	}
 	return -ENOENT;
 }
 
-void bag_del_all(bag_t *bag)
+void bag_del_all(bag_pool_t *pool, bag_t *bag)
 {
-	while (!list_empty(bag))
-		list_del(bag->next);
+	while (!list_empty(bag)) {
+		bag1_t *b = list_entry(bag->next, bag1_t, list);
+		list_del(&b->list);
+		bag_pool_put(pool, b);
+	}
 }
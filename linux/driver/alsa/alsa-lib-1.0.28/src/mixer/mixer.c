@@ -57,7 +57,30 @@ typedef struct _snd_mixer_slave {
 
 static int snd_mixer_compare_default(const snd_mixer_elem_t *c1,
 				     const snd_mixer_elem_t *c2);
+static int snd_mixer_sort(snd_mixer_t *mixer);
 
+static inline bag_pool_t *helem_bag_pool(snd_hctl_elem_t *helem)
+{
+	snd_mixer_t *mixer;
+	mixer = snd_hctl_get_callback_private(snd_hctl_elem_get_hctl(helem));
+	return &mixer->bag_pool;
+}
+
+/*
+ * While a bulk load is in progress, new elements are only appended to
+ * pelems and the array is sorted once when the outermost bulk ends.
+ */
+static void snd_mixer_bulk_begin(snd_mixer_t *mixer)
+{
+	mixer->bulk++;
+}
+
+static void snd_mixer_bulk_end(snd_mixer_t *mixer)
+{
+	assert(mixer->bulk > 0);
+	if (--mixer->bulk == 0 && mixer->unsorted)
+		snd_mixer_sort(mixer);
+}
 
 /**
  * \brief Opens an empty mixer
@@ -76,6 +99,7 @@ int snd_mixer_open(snd_mixer_t **mixerp, int mode ATTRIBUTE_UNUSED)
 	INIT_LIST_HEAD(&mixer->classes);
 	INIT_LIST_HEAD(&mixer->elems);
 	mixer->compare = snd_mixer_compare_default;
+	bag_pool_init(&mixer->bag_pool);
 	*mixerp = mixer;
 	return 0;
 }
@@ -92,11 +116,12 @@ int snd_mixer_elem_attach(snd_mixer_elem_t *melem,
 			  snd_hctl_elem_t *helem)
 {
 	bag_t *bag = snd_hctl_elem_get_callback_private(helem);
+	bag_pool_t *pool = helem_bag_pool(helem);
 	int err;
-	err = bag_add(bag, melem);
+	err = bag_add(pool, bag, melem);
 	if (err < 0)
 		return err;
-	return bag_add(&melem->helems, helem);
+	return bag_add(pool, &melem->helems, helem);
 }
 
 /**
@@ -111,10 +136,11 @@ int snd_mixer_elem_detach(snd_mixer_elem_t *melem,
 			  snd_hctl_elem_t *helem)
 {
 	bag_t *bag = snd_hctl_elem_get_callback_private(helem);
+	bag_pool_t *pool = helem_bag_pool(helem);
 	int err;
-	err = bag_del(bag, melem);
+	err = bag_del(pool, bag, melem);
 	assert(err >= 0);
-	err = bag_del(&melem->helems, helem);
+	err = bag_del(pool, &melem->helems, helem);
 	assert(err >= 0);
 	return 0;
 }
@@ -147,7 +173,7 @@ static int hctl_elem_event_handler(snd_hctl_elem_t *helem,
 				res = err;
 		}
 		assert(bag_empty(bag));
-		bag_free(bag);
+		bag_free(helem_bag_pool(helem), bag);
 		return res;
 	}
 	if (mask & (SND_CTL_EVENT_MASK_VALUE | SND_CTL_EVENT_MASK_INFO)) {
@@ -172,7 +198,7 @@ static int hctl_event_handler(snd_hctl_t *hctl, unsigned int mask,
 	if (mask & SND_CTL_EVENT_MASK_ADD) {
 		struct list_head *pos;
 		bag_t *bag;
-		int err = bag_new(&bag);
+		int err = bag_new(&mixer->bag_pool, &bag);
 		if (err < 0)
 			return err;
 		snd_hctl_elem_set_callback(elem, hctl_elem_event_handler);
@@ -402,15 +428,19 @@ int snd_mixer_elem_add(snd_mixer_elem_t *elem, snd_mixer_class_t *class)
 
 	if (mixer->count == mixer->alloc) {
 		snd_mixer_elem_t **m;
-		mixer->alloc += 32;
-		m = realloc(mixer->pelems, sizeof(*m) * mixer->alloc);
-		if (!m) {
-			mixer->alloc -= 32;
+		unsigned int alloc = mixer->alloc ? mixer->alloc * 2 : 32;
+		m = realloc(mixer->pelems, sizeof(*m) * alloc);
+		if (!m)
 			return -ENOMEM;
-		}
 		mixer->pelems = m;
+		mixer->alloc = alloc;
 	}
-	if (mixer->count == 0) {
+	if (mixer->bulk) {
+		list_add_tail(&elem->list, &mixer->elems);
+		mixer->pelems[mixer->count] = elem;
+		if (mixer->count > 0)
+			mixer->unsorted = 1;
+	} else if (mixer->count == 0) {
 		list_add_tail(&elem->list, &mixer->elems);
 		mixer->pelems[0] = elem;
 	} else {
@@ -446,9 +476,17 @@ int snd_mixer_elem_remove(snd_mixer_elem_t *elem)
 	unsigned int m;
 	assert(elem);
 	assert(mixer->count);
-	idx = _snd_mixer_find_elem(mixer, elem, &dir);
-	if (dir != 0)
-		return -EINVAL;
+	if (mixer->unsorted) {
+		for (idx = 0; idx < (int)mixer->count; idx++)
+			if (mixer->pelems[idx] == elem)
+				break;
+		if (idx == (int)mixer->count)
+			return -EINVAL;
+	} else {
+		idx = _snd_mixer_find_elem(mixer, elem, &dir);
+		if (dir != 0)
+			return -EINVAL;
+	}
 	bag_for_each_safe(i, n, &elem->helems) {
 		snd_hctl_elem_t *helem = bag_iterator_entry(i);
 		snd_mixer_elem_detach(elem, helem);
@@ -514,12 +552,13 @@ int snd_mixer_elem_value(snd_mixer_elem_t *elem)
 int snd_mixer_class_register(snd_mixer_class_t *class, snd_mixer_t *mixer)
 {
 	struct list_head *pos;
+	int err = 0;
 	class->mixer = mixer;
 	list_add_tail(&class->list, &mixer->classes);
 	if (!class->event)
 		return 0;
+	snd_mixer_bulk_begin(mixer);
 	list_for_each(pos, &mixer->slaves) {
-		int err;
 		snd_mixer_slave_t *slave;
 		snd_hctl_elem_t *elem;
 		slave = list_entry(pos, snd_mixer_slave_t, list);
@@ -527,11 +566,13 @@ int snd_mixer_class_register(snd_mixer_class_t *class, snd_mixer_t *mixer)
 		while (elem) {
 			err = class->event(class, SND_CTL_EVENT_MASK_ADD, elem, NULL);
 			if (err < 0)
-				return err;
+				goto _end;
 			elem = snd_hctl_elem_next(elem);
 		}
 	}
-	return 0;
+ _end:
+	snd_mixer_bulk_end(mixer);
+	return err;
 }
 
 /**
@@ -562,19 +603,24 @@ int snd_mixer_class_unregister(snd_mixer_class_t *class)
  * \brief Load a mixer elements
  * \param mixer Mixer handle
  * \return 0 on success otherwise a negative error code
+ *
+ * The elements are sorted once after all HCTLs are loaded, not on
+ * every insertion.
  */
 int snd_mixer_load(snd_mixer_t *mixer)
 {
 	struct list_head *pos;
+	int err = 0;
+	snd_mixer_bulk_begin(mixer);
 	list_for_each(pos, &mixer->slaves) {
-		int err;
 		snd_mixer_slave_t *s;
 		s = list_entry(pos, snd_mixer_slave_t, list);
 		err = snd_hctl_load(s->hctl);
 		if (err < 0)
-			return err;
+			break;
 	}
-	return 0;
+	snd_mixer_bulk_end(mixer);
+	return err;
 }
 
 /**
@@ -619,6 +665,7 @@ int snd_mixer_close(snd_mixer_t *mixer)
 		list_del(&s->list);
 		free(s);
 	}
+	bag_pool_done(&mixer->bag_pool);
 	free(mixer);
 	return res;
 }
@@ -652,6 +699,7 @@ static int snd_mixer_sort(snd_mixer_t *mixer)
 	qsort(mixer->pelems, mixer->count, sizeof(snd_mixer_elem_t *), mixer_compare);
 	for (k = 0; k < mixer->count; k++)
 		list_add_tail(&mixer->pelems[k]->list, &mixer->elems);
+	mixer->unsorted = 0;
 	return 0;
 }
 
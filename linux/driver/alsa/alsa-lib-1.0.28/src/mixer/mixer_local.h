@@ -29,12 +29,20 @@ typedef struct _bag1 {
 
 typedef struct list_head bag_t;
 
-int bag_new(bag_t **bag);
-void bag_free(bag_t *bag);
-int bag_add(bag_t *bag, void *ptr);
-int bag_del(bag_t *bag, void *ptr);
+/* bag entries are carved from chunks owned by the mixer */
+typedef struct _bag_pool {
+	bag1_t *free;			/* free entries linked through ptr */
+	struct list_head chunks;	/* allocated chunks */
+} bag_pool_t;
+
+void bag_pool_init(bag_pool_t *pool);
+void bag_pool_done(bag_pool_t *pool);
+int bag_new(bag_pool_t *pool, bag_t **bag);
+void bag_free(bag_pool_t *pool, bag_t *bag);
+int bag_add(bag_pool_t *pool, bag_t *bag, void *ptr);
+int bag_del(bag_pool_t *pool, bag_t *bag, void *ptr);
 int bag_empty(bag_t *bag);
-void bag_del_all(bag_t *bag);
+void bag_del_all(bag_pool_t *pool, bag_t *bag);
 
 typedef struct list_head *bag_iterator_t;
 
@@ -71,6 +79,9 @@ struct _snd_mixer {
 	unsigned int count;
 	unsigned int alloc;
 	unsigned int events;
+	unsigned int bulk;		/* nesting of bulk loads, sort deferred */
+	int unsorted;			/* pelems need sorting at bulk end */
+	bag_pool_t bag_pool;		/* entries for helem/melem bags */
 	snd_mixer_callback_t callback;
 	void *callback_private;
 	snd_mixer_compare_t compare;
@@ -227,6 +227,14 @@ in \ref example_test_pcm "Sine-wave generator example". To complete the
 list, we should note that #snd_pcm_wait() function contains
 embedded poll waiting implementation.
 
+With small periods a blocking stream wakes up once per period. Applications
+serving many streams can trade that for fewer, larger transfers with
+#snd_pcm_set_batched_wakeup(): #snd_pcm_wait() and the blocking read / write
+functions then predict from the last hardware timestamp when the ring buffer
+reaches the given watermark and sleep on a timer until that moment. The
+deadlines of all streams are rounded up to a common grid, so the streams
+handled by one thread wake up together.
+
 \subsection alsa_pcm_rw Read / Write transfer
 
 There are two versions of read / write routines. The first expects the
@@ -637,6 +645,7 @@ playback devices.
 #include <sys/poll.h>
 #include <sys/shm.h>
 #include <sys/mman.h>
+#include <sys/timerfd.h>
 #include <limits.h>
 #include "pcm_local.h"
 
@@ -1247,6 +1256,8 @@ use_default_symbol_version(__snd_pcm_forward, snd_pcm_forward, ALSA_0.9.0rc8);
  */ 
 snd_pcm_sframes_t snd_pcm_writei(snd_pcm_t *pcm, const void *buffer, snd_pcm_uframes_t size)
 {
+	snd_pcm_sframes_t result;
+
 	assert(pcm);
 	assert(size == 0 || buffer);
 	if (CHECK_SANITY(! pcm->setup)) {
@@ -1257,7 +1268,9 @@ snd_pcm_sframes_t snd_pcm_writei(snd_pcm_t *pcm, const void *buffer, snd_pcm_ufr
 		SNDMSG("invalid access type %s", snd_pcm_access_name(pcm->access));
 		return -EINVAL;
 	}
-	return _snd_pcm_writei(pcm, buffer, size);
+	result = _snd_pcm_writei(pcm, buffer, size);
+	snd_pcm_stats_xrun(pcm, result);
+	return result;
 }
 
 /**
@@ -1279,6 +1292,8 @@ snd_pcm_sframes_t snd_pcm_writei(snd_pcm_t *pcm, const void *buffer, snd_pcm_ufr
  */ 
 snd_pcm_sframes_t snd_pcm_writen(snd_pcm_t *pcm, void **bufs, snd_pcm_uframes_t size)
 {
+	snd_pcm_sframes_t result;
+
 	assert(pcm);
 	assert(size == 0 || bufs);
 	if (CHECK_SANITY(! pcm->setup)) {
@@ -1289,7 +1304,9 @@ snd_pcm_sframes_t snd_pcm_writen(snd_pcm_t *pcm, void **bufs, snd_pcm_uframes_t
 		SNDMSG("invalid access type %s", snd_pcm_access_name(pcm->access));
 		return -EINVAL;
 	}
-	return _snd_pcm_writen(pcm, bufs, size);
+	result = _snd_pcm_writen(pcm, bufs, size);
+	snd_pcm_stats_xrun(pcm, result);
+	return result;
 }
 
 /**
@@ -1311,6 +1328,8 @@ snd_pcm_sframes_t snd_pcm_writen(snd_pcm_t *pcm, void **bufs, snd_pcm_uframes_t
  */ 
 snd_pcm_sframes_t snd_pcm_readi(snd_pcm_t *pcm, void *buffer, snd_pcm_uframes_t size)
 {
+	snd_pcm_sframes_t result;
+
 	assert(pcm);
 	assert(size == 0 || buffer);
 	if (CHECK_SANITY(! pcm->setup)) {
@@ -1321,7 +1340,9 @@ snd_pcm_sframes_t snd_pcm_readi(snd_pcm_t *pcm, void *buffer, snd_pcm_uframes_t
 		SNDMSG("invalid access type %s", snd_pcm_access_name(pcm->access));
 		return -EINVAL;
 	}
-	return _snd_pcm_readi(pcm, buffer, size);
+	result = _snd_pcm_readi(pcm, buffer, size);
+	snd_pcm_stats_xrun(pcm, result);
+	return result;
 }
 
 /**
@@ -1343,6 +1364,8 @@ snd_pcm_sframes_t snd_pcm_readi(snd_pcm_t *pcm, void *buffer, snd_pcm_uframes_t
  */ 
 snd_pcm_sframes_t snd_pcm_readn(snd_pcm_t *pcm, void **bufs, snd_pcm_uframes_t size)
 {
+	snd_pcm_sframes_t result;
+
 	assert(pcm);
 	assert(size == 0 || bufs);
 	if (CHECK_SANITY(! pcm->setup)) {
@@ -1353,7 +1376,9 @@ snd_pcm_sframes_t snd_pcm_readn(snd_pcm_t *pcm, void **bufs, snd_pcm_uframes_t s
 		SNDMSG("invalid access type %s", snd_pcm_access_name(pcm->access));
 		return -EINVAL;
 	}
-	return _snd_pcm_readn(pcm, bufs, size);
+	result = _snd_pcm_readn(pcm, bufs, size);
+	snd_pcm_stats_xrun(pcm, result);
+	return result;
 }
 
 /**
@@ -1920,7 +1945,183 @@ int snd_pcm_dump_setup(snd_pcm_t *pcm, snd_output_t *out)
 {
 	snd_pcm_dump_hw_setup(pcm, out);
 	snd_pcm_dump_sw_setup(pcm, out);
+#ifdef SUPPORT_PCM_STATS
+	snd_pcm_stats_dump(pcm, out);
+#endif
+	return 0;
+}
+
+/**
+ * \brief get size of #snd_pcm_stats_t
+ * \return size in bytes
+ */
+size_t snd_pcm_stats_sizeof()
+{
+	return sizeof(snd_pcm_stats_t);
+}
+
+/**
+ * \brief allocate an invalid #snd_pcm_stats_t using standard malloc
+ * \param ptr returned pointer
+ * \return 0 on success otherwise negative error code
+ */
+int snd_pcm_stats_malloc(snd_pcm_stats_t **ptr)
+{
+	assert(ptr);
+	*ptr = calloc(1, sizeof(snd_pcm_stats_t));
+	if (!*ptr)
+		return -ENOMEM;
+	return 0;
+}
+
+/**
+ * \brief frees a previously allocated #snd_pcm_stats_t
+ * \param obj pointer to object to free
+ */
+void snd_pcm_stats_free(snd_pcm_stats_t *obj)
+{
+	free(obj);
+}
+
+/**
+ * \brief Get the instrumentation counters of a PCM
+ * \param pcm PCM handle
+ * \param stats Returns the counters
+ * \return 0 on success, -ENOSYS when alsa-lib was configured without
+ *         --enable-pcm-stats
+ *
+ * The counters only cover this PCM, each plugin of a chain keeps its own
+ * set. #snd_pcm_dump() prints them for every PCM of the chain as part of
+ * the setup.
+ *
+ * frames, transfers and transfer_ns count the sample conversion of the
+ * plugin itself, commits and commit_ns the mmap_commit calls on this
+ * PCM including the time spent in its slaves.  An xrun is counted when
+ * a transfer or a commit on this PCM fails with -EPIPE.
+ */
+int snd_pcm_stats_get(snd_pcm_t *pcm, snd_pcm_stats_t *stats)
+{
+	assert(pcm && stats);
+#ifdef SUPPORT_PCM_STATS
+	*stats = pcm->stats;
+	return 0;
+#else
+	return -ENOSYS;
+#endif
+}
+
+/**
+ * \brief Get the frames converted by the plugin from a PCM stats container
+ * \param obj #snd_pcm_stats_t pointer
+ * \return Frames converted by the plugin
+ */
+unsigned long long snd_pcm_stats_get_frames(const snd_pcm_stats_t *obj)
+{
+	assert(obj);
+	return obj->frames;
+}
+
+/**
+ * \brief Get the time spent in the plugin conversion from a PCM stats container
+ * \param obj #snd_pcm_stats_t pointer
+ * \return Time spent in the plugin conversion, in nanoseconds
+ */
+unsigned long long snd_pcm_stats_get_transfer_ns(const snd_pcm_stats_t *obj)
+{
+	assert(obj);
+	return obj->transfer_ns;
+}
+
+/**
+ * \brief Get the number of plugin conversion calls from a PCM stats container
+ * \param obj #snd_pcm_stats_t pointer
+ * \return Number of plugin conversion calls
+ */
+unsigned long snd_pcm_stats_get_transfers(const snd_pcm_stats_t *obj)
+{
+	assert(obj);
+	return obj->transfers;
+}
+
+/**
+ * \brief Get the number of mmap_commit calls from a PCM stats container
+ * \param obj #snd_pcm_stats_t pointer
+ * \return Number of mmap_commit calls
+ */
+unsigned long snd_pcm_stats_get_commits(const snd_pcm_stats_t *obj)
+{
+	assert(obj);
+	return obj->commits;
+}
+
+/**
+ * \brief Get the frames committed from a PCM stats container
+ * \param obj #snd_pcm_stats_t pointer
+ * \return Frames committed
+ */
+unsigned long long snd_pcm_stats_get_commit_frames(const snd_pcm_stats_t *obj)
+{
+	assert(obj);
+	return obj->commit_frames;
+}
+
+/**
+ * \brief Get the time spent in mmap_commit including the slaves from a PCM stats container
+ * \param obj #snd_pcm_stats_t pointer
+ * \return Time spent in mmap_commit including the slaves, in nanoseconds
+ */
+unsigned long long snd_pcm_stats_get_commit_ns(const snd_pcm_stats_t *obj)
+{
+	assert(obj);
+	return obj->commit_ns;
+}
+
+/**
+ * \brief Get the wakeups from #snd_pcm_wait() from a PCM stats container
+ * \param obj #snd_pcm_stats_t pointer
+ * \return Wakeups from #snd_pcm_wait()
+ */
+unsigned long snd_pcm_stats_get_wakeups(const snd_pcm_stats_t *obj)
+{
+	assert(obj);
+	return obj->wakeups;
+}
+
+/**
+ * \brief Get the xruns reported by the PCM from a PCM stats container
+ * \param obj #snd_pcm_stats_t pointer
+ * \return Xruns reported by the PCM
+ */
+unsigned long snd_pcm_stats_get_xruns(const snd_pcm_stats_t *obj)
+{
+	assert(obj);
+	return obj->xruns;
+}
+
+/**
+ * \brief Dump the instrumentation counters of a PCM
+ * \param pcm PCM handle
+ * \param out Output handle
+ * \return 0 on success, -ENOSYS when alsa-lib was configured without
+ *         --enable-pcm-stats
+ */
+int snd_pcm_stats_dump(snd_pcm_t *pcm, snd_output_t *out)
+{
+	assert(pcm);
+	assert(out);
+#ifdef SUPPORT_PCM_STATS
+	snd_output_printf(out, "  transfers    : %lu (%llu frames, %llu us)\n",
+			  pcm->stats.transfers, pcm->stats.frames,
+			  pcm->stats.transfer_ns / 1000);
+	snd_output_printf(out, "  commits      : %lu (%llu frames, %llu us)\n",
+			  pcm->stats.commits, pcm->stats.commit_frames,
+			  pcm->stats.commit_ns / 1000);
+	snd_output_printf(out, "  wakeups      : %lu\n", pcm->stats.wakeups);
+	snd_output_printf(out, "  xruns        : %lu\n", pcm->stats.xruns);
 	return 0;
+#else
+	return -ENOSYS;
+#endif
 }
 
 /**
@@ -2077,6 +2278,26 @@ static const char *const build_in_pcms[] = {
 	NULL
 };
 
+/*
+ * resolve all built-in open functions on the first open, the later ones
+ * find them in the lock-free dlobj registry
+ */
+static void snd_pcm_preload_build_in(void)
+{
+	static int preloaded;
+	const char *const *build_in;
+	char open_name[64];
+
+	if (__atomic_load_n(&preloaded, __ATOMIC_ACQUIRE))
+		return;
+	for (build_in = build_in_pcms; *build_in; build_in++) {
+		snprintf(open_name, sizeof(open_name), "_snd_pcm_%s_open", *build_in);
+		snd_dlobj_cache_get(NULL, open_name,
+				    SND_DLSYM_VERSION(SND_PCM_DLSYM_VERSION), 0);
+	}
+	__atomic_store_n(&preloaded, 1, __ATOMIC_RELEASE);
+}
+
 static int snd_pcm_open_conf(snd_pcm_t **pcmp, const char *name,
 			     snd_config_t *pcm_root, snd_config_t *pcm_conf,
 			     snd_pcm_stream_t stream, int mode)
@@ -2182,6 +2403,7 @@ static int snd_pcm_open_conf(snd_pcm_t **pcmp, const char *name,
 #ifndef PIC
 	snd_pcm_open_symbols();	/* this call is for static linking only */
 #endif
+	snd_pcm_preload_build_in();
 	open_func = snd_dlobj_cache_get(lib, open_name,
 			SND_DLSYM_VERSION(SND_PCM_DLSYM_VERSION), 1);
 	if (open_func) {
@@ -2325,6 +2547,7 @@ int snd_pcm_new(snd_pcm_t **pcmp, snd_pcm_type_t type, const char *name,
 	pcm->mode = mode;
 	pcm->poll_fd_count = 1;
 	pcm->poll_fd = -1;
+	pcm->wakeup_timerfd = -1;
 	pcm->op_arg = pcm;
 	pcm->fast_op_arg = pcm;
 	INIT_LIST_HEAD(&pcm->async_handlers);
@@ -2338,6 +2561,8 @@ int snd_pcm_free(snd_pcm_t *pcm)
 	free(pcm->name);
 	free(pcm->hw.link_dst);
 	free(pcm->appl.link_dst);
+	if (pcm->wakeup_timerfd >= 0)
+		close(pcm->wakeup_timerfd);
 	snd_dlobj_cache_put(pcm->open_func);
 	free(pcm);
 	return 0;
@@ -2389,7 +2614,129 @@ int snd_pcm_wait(snd_pcm_t *pcm, int timeout)
 	return snd_pcm_wait_nocheck(pcm, timeout);
 }
 
+/**
+ * \brief Set up batched wakeups for a PCM
+ * \param pcm PCM handle
+ * \param watermark available frames to sleep until, 0 disables batching
+ * \param coalesce_us wakeup grid in microseconds, 0 for exact deadlines
+ * \return 0 on success otherwise a negative error code
+ *
+ * When enabled, #snd_pcm_wait() and the blocking transfer functions sleep
+ * on a timer until the predicted moment the stream has \p watermark frames
+ * available (at least avail_min) instead of waking on every period. The
+ * deadline is rounded up to a multiple of \p coalesce_us on the monotonic
+ * clock unless that would use up more than half of the remaining buffer,
+ * so that streams sharing a thread are serviced in a single wakeup.
+ *
+ * The regular poll follows the timer, a wrong prediction therefore only
+ * costs an extra wakeup.
+ */
+int snd_pcm_set_batched_wakeup(snd_pcm_t *pcm, snd_pcm_uframes_t watermark,
+			       unsigned int coalesce_us)
+{
+	assert(pcm);
+	if (watermark && pcm->wakeup_timerfd < 0) {
+		pcm->wakeup_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+		if (pcm->wakeup_timerfd < 0) {
+			SYSERR("timerfd_create failed");
+			return -errno;
+		}
+	}
+	pcm->wakeup_watermark = watermark;
+	pcm->wakeup_coalesce = coalesce_us;
+	return 0;
+}
+
 #ifndef DOC_HIDDEN
+static inline long long timestamp_ns(const snd_htimestamp_t *tstamp)
+{
+	return tstamp->tv_sec * 1000000000LL + tstamp->tv_nsec;
+}
+
+/*
+ * sleep until the predicted watermark deadline, the remaining timeout
+ * for the following poll is returned in *timeout
+ */
+static int snd_pcm_wait_batched(snd_pcm_t *pcm, int *timeout)
+{
+	snd_pcm_uframes_t avail, target, limit;
+	snd_htimestamp_t tstamp, now;
+	struct itimerspec its;
+	struct pollfd pfd;
+	long long deadline, end, now_ns;
+	unsigned long long expirations;
+	int err;
+
+	if (snd_pcm_state(pcm) != SND_PCM_STATE_RUNNING || !pcm->rate)
+		return 0;
+	target = pcm->wakeup_watermark;
+	if (target < pcm->avail_min)
+		target = pcm->avail_min;
+	if (target > pcm->buffer_size)
+		target = pcm->buffer_size;
+	err = snd_pcm_htimestamp(pcm, &avail, &tstamp);
+	if (err < 0)
+		return err;
+	gettimestamp(&now, pcm->monotonic);
+	if (!tstamp.tv_sec && !tstamp.tv_nsec) {
+		/* no timestamps from this PCM, use the current position */
+		snd_pcm_sframes_t favail = snd_pcm_avail(pcm);
+		if (favail < 0)
+			return favail;
+		avail = favail;
+		tstamp = now;
+	}
+	if (avail >= target)
+		return 1;
+	deadline = timestamp_ns(&tstamp) +
+		(long long)(target - avail) * 1000000000LL / pcm->rate;
+	/* latest acceptable wakeup when rounding to the grid */
+	limit = (target + pcm->buffer_size) / 2;
+	end = timestamp_ns(&tstamp) +
+		(long long)(limit - avail) * 1000000000LL / pcm->rate;
+	now_ns = timestamp_ns(&now);
+	if (!pcm->monotonic) {
+		/* move to the clock of the timer */
+		gettimestamp(&now, 1);
+		deadline += timestamp_ns(&now) - now_ns;
+		end += timestamp_ns(&now) - now_ns;
+		now_ns = timestamp_ns(&now);
+	}
+	if (pcm->wakeup_coalesce) {
+		long long grid = pcm->wakeup_coalesce * 1000LL;
+		long long aligned = (deadline + grid - 1) / grid * grid;
+		if (aligned <= end)
+			deadline = aligned;
+	}
+	if (*timeout >= 0 && deadline - now_ns >= *timeout * 1000000LL) {
+		deadline = now_ns + *timeout * 1000000LL;
+		*timeout = 0;
+	} else if (*timeout > 0 && deadline > now_ns) {
+		*timeout -= (deadline - now_ns) / 1000000;
+	}
+	if (deadline <= now_ns)
+		return 0;
+	its.it_interval.tv_sec = 0;
+	its.it_interval.tv_nsec = 0;
+	its.it_value.tv_sec = deadline / 1000000000LL;
+	its.it_value.tv_nsec = deadline % 1000000000LL;
+	if (timerfd_settime(pcm->wakeup_timerfd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+		return -errno;
+	pfd.fd = pcm->wakeup_timerfd;
+	pfd.events = POLLIN;
+	while (poll(&pfd, 1, -1) < 0) {
+		if (errno == EINTR && !PCMINABORT(pcm))
+			continue;
+		return -errno;
+	}
+	if (read(pcm->wakeup_timerfd, &expirations, sizeof(expirations)) < 0 &&
+	    errno != EAGAIN)
+		return -errno;
+	/* let the driver see the position we slept for */
+	err = snd_pcm_hwsync(pcm);
+	return err < 0 ? err : 0;
+}
+
 /* 
  * like snd_pcm_wait() but doesn't check mmap_avail before calling poll()
  *
@@ -2414,6 +2761,11 @@ int snd_pcm_wait_nocheck(snd_pcm_t *pcm, int timeout)
 		SNDMSG("invalid poll descriptors %d\n", err);
 		return -EIO;
 	}
+	if (pcm->wakeup_watermark) {
+		err = snd_pcm_wait_batched(pcm, &timeout);
+		if (err)
+			return err;
+	}
 	do {
 		err_poll = poll(pfd, npfds, timeout);
 		if (err_poll < 0) {
@@ -2440,6 +2792,8 @@ int snd_pcm_wait_nocheck(snd_pcm_t *pcm, int timeout)
 			}
 		}
 	} while (!(revents & (POLLIN | POLLOUT)));
+	if (err_poll > 0)
+		snd_pcm_stats_wakeup(pcm);
 #if 0 /* very useful code to test poll related problems */
 	{
 		snd_pcm_sframes_t avail_update;
@@ -6629,6 +6983,9 @@ snd_pcm_sframes_t snd_pcm_mmap_commit(snd_pcm_t *pcm,
 				      snd_pcm_uframes_t offset,
 				      snd_pcm_uframes_t frames)
 {
+	snd_pcm_sframes_t result;
+	unsigned long long stamp;
+
 	assert(pcm);
 	if (CHECK_SANITY(offset != *pcm->appl.ptr % pcm->buffer_size)) {
 		SNDMSG("commit offset (%ld) doesn't match with appl_ptr (%ld) %% buf_size (%ld)",
@@ -6640,7 +6997,10 @@ snd_pcm_sframes_t snd_pcm_mmap_commit(snd_pcm_t *pcm,
 		       snd_pcm_mmap_avail(pcm));
 		return -EPIPE;
 	}
-	return pcm->fast_ops->mmap_commit(pcm->fast_op_arg, offset, frames);
+	stamp = snd_pcm_stats_stamp();
+	result = pcm->fast_ops->mmap_commit(pcm->fast_op_arg, offset, frames);
+	snd_pcm_stats_commit(pcm, result, stamp);
+	return result;
 }
 
 #ifndef DOC_HIDDEN
@@ -104,111 +104,155 @@ static const short StepSize[89] = {
 	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
 };
 
+/*
+ * Combined quantizer table: the signed predictor change and the next
+ * StepSize index for every index and 4 bit code, so the per nibble
+ * bit loop and index clamping of the reference coder become a lookup.
+ * Built on first use with the same short arithmetic as the reference,
+ * the output is bit identical.
+ */
+typedef struct {
+	int diff;
+	int next_idx;
+} adpcm_step_t;
+
+static adpcm_step_t adpcm_table[89][16];
+static int adpcm_table_ready;
+
+static void adpcm_init_table(void)
+{
+	int idx, code, i;
+
+	if (__atomic_load_n(&adpcm_table_ready, __ATOMIC_ACQUIRE))
+		return;
+	for (idx = 0; idx < 89; idx++) {
+		for (code = 0; code < 16; code++) {
+			short step = StepSize[idx];
+			short pred_diff = step >> 3;	/* (code + 0.5) * step / 4 */
+			int next;
+
+			for (i = 0x4; i; i >>= 1, step >>= 1) {
+				if (code & i)
+					pred_diff += step;
+			}
+			adpcm_table[idx][code].diff = (code & 0x8) ? -pred_diff : pred_diff;
+			next = idx + IndexAdjust[code & 0x7];
+			if (next < 0)
+				next = 0;
+			else if (next > 88)
+				next = 88;
+			adpcm_table[idx][code].next_idx = next;
+		}
+	}
+	__atomic_store_n(&adpcm_table_ready, 1, __ATOMIC_RELEASE);
+}
+
+static int adpcm_decoder(unsigned char code, snd_pcm_adpcm_state_t * state)
+{
+	const adpcm_step_t *e = &adpcm_table[state->step_idx][code];
+	int pred = state->pred_val + e->diff;
+
+	/* Clamp output value */
+	if (pred > 32767)
+		pred = 32767;
+	else if (pred < -32768)
+		pred = -32768;
+	state->pred_val = pred;
+	state->step_idx = e->next_idx;
+	return pred;
+}
+
 static char adpcm_encoder(int sl, snd_pcm_adpcm_state_t * state)
 {
 	short diff;		/* Difference between sl and predicted sample */
-	short pred_diff;	/* Predicted difference to next sample */
-
-	unsigned char sign;	/* sign of diff */
 	short step;		/* holds previous StepSize value */
-	unsigned char adjust_idx;	/* Index to IndexAdjust lookup table */
-
-	int i;
+	unsigned char code;
 
 	/* Compute difference to previous predicted value */
 	diff = sl - state->pred_val;
-	sign = (diff < 0) ? 0x8 : 0x0;
-	if (sign) {
+	code = (diff < 0) ? 0x8 : 0x0;
+	if (code)
 		diff = -diff;
-	}
 
 	/*
 	 * This code *approximately* computes:
 	 *    adjust_idx = diff * 4 / step;
-	 *    pred_diff = (adjust_idx + 0.5) * step / 4;
 	 *
-	 * But in shift step bits are dropped. The net result of this is
-	 * that even if you have fast mul/div hardware you cannot put it to
-	 * good use since the fix-up would be too expensive.
+	 * But in shift step bits are dropped, exactly as the decoder
+	 * rebuilds the difference, so the predictor update is the
+	 * decoder table entry of the resulting code.
 	 */
-
 	step = StepSize[state->step_idx];
-
-	/* Divide and clamp */
-	pred_diff = step >> 3;
-	for (adjust_idx = 0, i = 0x4; i; i >>= 1, step >>= 1) {
-		if (diff >= step) {
-			adjust_idx |= i;
-			diff -= step;
-			pred_diff += step;
-		}
+	if (diff >= step) {
+		code |= 0x4;
+		diff -= step;
 	}
-
-	/* Update and clamp previous predicted value */
-	state->pred_val += sign ? -pred_diff : pred_diff;
-
-	if (state->pred_val > 32767) {
-		state->pred_val = 32767;
-	} else if (state->pred_val < -32768) {
-		state->pred_val = -32768;
+	step >>= 1;
+	if (diff >= step) {
+		code |= 0x2;
+		diff -= step;
 	}
+	step >>= 1;
+	if (diff >= step)
+		code |= 0x1;
 
-	/* Update and clamp StepSize lookup table index */
-	state->step_idx += IndexAdjust[adjust_idx];
-
-	if (state->step_idx < 0) {
-		state->step_idx = 0;
-	} else if (state->step_idx > 88) {
-		state->step_idx = 88;
-	}
-	return (sign | adjust_idx);
+	adpcm_decoder(code, state);
+	return code;
 }
 
-
-static int adpcm_decoder(unsigned char code, snd_pcm_adpcm_state_t * state)
+/*
+ * Multi-channel kernels for interleaved S16 and interleaved nibbles:
+ * a single pass over the packed data instead of one strided pass (and
+ * one read-modify-write of every byte) per channel.
+ */
+static void adpcm_decode_interleaved(int16_t *dst,
+				     const snd_pcm_channel_area_t *src_area,
+				     snd_pcm_uframes_t src_offset,
+				     unsigned int channels,
+				     snd_pcm_uframes_t frames,
+				     snd_pcm_adpcm_state_t *states)
 {
-	short pred_diff;	/* Predicted difference to next sample */
-	short step;		/* holds previous StepSize value */
-	char sign;
-
-	int i;
-
-	/* Separate sign and magnitude */
-	sign = code & 0x8;
-	code &= 0x7;
-
-	/*
-	 * Computes pred_diff = (code + 0.5) * step / 4,
-	 * but see comment in adpcm_coder.
-	 */
-
-	step = StepSize[state->step_idx];
+	unsigned long bit = src_area->first + src_area->step * src_offset;
+	const unsigned char *src = (const unsigned char *)src_area->addr + bit / 8;
+	int low = bit % 8 != 0;
+	unsigned int channel;
 
-	/* Compute difference and new predicted value */
-	pred_diff = step >> 3;
-	for (i = 0x4; i; i >>= 1, step >>= 1) {
-		if (code & i) {
-			pred_diff += step;
+	while (frames-- > 0) {
+		for (channel = 0; channel < channels; channel++) {
+			unsigned char v;
+			if (low)
+				v = *src++ & 0x0f;
+			else
+				v = *src >> 4;
+			low ^= 1;
+			*dst++ = adpcm_decoder(v, &states[channel]);
 		}
 	}
-	state->pred_val += (sign) ? -pred_diff : pred_diff;
-
-	/* Clamp output value */
-	if (state->pred_val > 32767) {
-		state->pred_val = 32767;
-	} else if (state->pred_val < -32768) {
-		state->pred_val = -32768;
-	}
+}
 
-	/* Find new StepSize index value */
-	state->step_idx += IndexAdjust[code];
+static void adpcm_encode_interleaved(const snd_pcm_channel_area_t *dst_area,
+				     snd_pcm_uframes_t dst_offset,
+				     const int16_t *src,
+				     unsigned int channels,
+				     snd_pcm_uframes_t frames,
+				     snd_pcm_adpcm_state_t *states)
+{
+	unsigned long bit = dst_area->first + dst_area->step * dst_offset;
+	unsigned char *dst = (unsigned char *)dst_area->addr + bit / 8;
+	int low = bit % 8 != 0;
+	unsigned int channel;
 
-	if (state->step_idx < 0) {
-		state->step_idx = 0;
-	} else if (state->step_idx > 88) {
-		state->step_idx = 88;
+	while (frames-- > 0) {
+		for (channel = 0; channel < channels; channel++) {
+			unsigned char v = adpcm_encoder(*src++, &states[channel]);
+			if (low) {
+				*dst = (*dst & 0xf0) | v;
+				dst++;
+			} else
+				*dst = (*dst & 0x0f) | (v << 4);
+			low ^= 1;
+		}
 	}
-	return (state->pred_val);
 }
 
 #ifndef DOC_HIDDEN
@@ -226,6 +270,16 @@ void snd_pcm_adpcm_decode(const snd_pcm_channel_area_t *dst_areas,
 #undef PUT16_LABELS
 	void *put = put16_labels[putidx];
 	unsigned int channel;
+
+	adpcm_init_table();
+	if (putidx == (unsigned int)snd_pcm_linear_put_index(SND_PCM_FORMAT_S16, SND_PCM_FORMAT_S16) &&
+	    snd_pcm_plugin_areas_interleaved(src_areas, channels, 4) &&
+	    snd_pcm_plugin_areas_interleaved(dst_areas, channels, 16)) {
+		adpcm_decode_interleaved(snd_pcm_channel_area_addr(dst_areas, dst_offset),
+					 src_areas, src_offset, channels,
+					 frames, states);
+		return;
+	}
 	for (channel = 0; channel < channels; ++channel, ++states) {
 		const char *src;
 		int srcbit;
@@ -280,6 +334,16 @@ void snd_pcm_adpcm_encode(const snd_pcm_channel_area_t *dst_areas,
 	void *get = get16_labels[getidx];
 	unsigned int channel;
 	int16_t sample = 0;
+
+	adpcm_init_table();
+	if (getidx == (unsigned int)snd_pcm_linear_get_index(SND_PCM_FORMAT_S16, SND_PCM_FORMAT_S16) &&
+	    snd_pcm_plugin_areas_interleaved(src_areas, channels, 16) &&
+	    snd_pcm_plugin_areas_interleaved(dst_areas, channels, 4)) {
+		adpcm_encode_interleaved(dst_areas, dst_offset,
+					 snd_pcm_channel_area_addr(src_areas, src_offset),
+					 channels, frames, states);
+		return;
+	}
 	for (channel = 0; channel < channels; ++channel, ++states) {
 		const char *src;
 		char *dst;
@@ -580,6 +644,7 @@ int snd_pcm_adpcm_open(snd_pcm_t **pcmp, const char *name, snd_pcm_format_t sfor
 	pcm->poll_fd = slave->poll_fd;
 	pcm->poll_events = slave->poll_events;
 	pcm->monotonic = slave->monotonic;
+	pcm->trace = slave->trace;
 	snd_pcm_set_hw_ptr(pcm, &adpcm->plug.hw_ptr, -1, 0);
 	snd_pcm_set_appl_ptr(pcm, &adpcm->plug.appl_ptr, -1, 0);
 	*pcmp = pcm;
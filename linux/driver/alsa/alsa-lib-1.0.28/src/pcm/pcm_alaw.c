@@ -31,6 +31,9 @@
 #include "pcm_plugin.h"
 
 #include "plugin_ops.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #ifndef PIC
 /* entry for static linking */
@@ -139,6 +142,82 @@ static int alaw_to_s16(unsigned char a_val)
 	return ((a_val & 0x80) ? t : -t);
 }
 
+/*
+ * lookup tables built from the functions above on first use; the
+ * encoder is indexed by the 16 bit sample as unsigned
+ */
+static unsigned char alaw_encode_table[65536];
+static int16_t alaw_decode_table[256];
+static int alaw_tables_ready;
+
+static void alaw_init_tables(void)
+{
+	unsigned int i;
+
+	if (__atomic_load_n(&alaw_tables_ready, __ATOMIC_ACQUIRE))
+		return;
+	for (i = 0; i < 65536; i++)
+		alaw_encode_table[i] = s16_to_alaw((int16_t)i);
+	for (i = 0; i < 256; i++)
+		alaw_decode_table[i] = alaw_to_s16(i);
+	__atomic_store_n(&alaw_tables_ready, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * decode a contiguous run; SSE2 has no gather, so the vector path
+ * computes alaw_to_s16() for 8 samples at once, doing the per-lane
+ * shift as a multiplication by a power of two built in the float
+ * exponent
+ */
+static void alaw_decode_run(int16_t *dst, const unsigned char *src,
+			    snd_pcm_uframes_t n)
+{
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i x55 = _mm_set1_epi16(0x55);
+	const __m128i m7f = _mm_set1_epi32(0x7f);
+	const __m128i m0f = _mm_set1_epi32(0x0f);
+	const __m128i m80 = _mm_set1_epi32(0x80);
+	const __m128i c108 = _mm_set1_epi32(0x108);
+	const __m128i c100 = _mm_set1_epi32(0x100);
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i bias = _mm_set1_epi32(126);
+	for (; n >= 8; n -= 8, src += 8, dst += 8) {
+		__m128i a = _mm_xor_si128(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)src), zero), x55);
+		__m128i half[2];
+		int k;
+		half[0] = _mm_unpacklo_epi16(a, zero);
+		half[1] = _mm_unpackhi_epi16(a, zero);
+		for (k = 0; k < 2; k++) {
+			__m128i v = half[k];
+			__m128i mag = _mm_and_si128(v, m7f);
+			__m128i seg = _mm_srli_epi32(mag, 4);
+			__m128i seg0 = _mm_cmpeq_epi32(seg, zero);
+			__m128i base, shift, neg;
+			__m128 pow2;
+			/* seg 0: (mant << 4) + 8, else ((mant << 4) + 0x108) << (seg - 1) */
+			base = _mm_add_epi32(_mm_slli_epi32(_mm_and_si128(mag, m0f), 4),
+					     _mm_sub_epi32(c108, _mm_and_si128(seg0, c100)));
+			shift = _mm_add_epi32(seg, _mm_and_si128(seg0, one));
+			pow2 = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(shift, bias), 23));
+			v = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(base), pow2));
+			neg = _mm_cmpeq_epi32(_mm_and_si128(half[k], m80), zero);
+			half[k] = _mm_sub_epi32(_mm_xor_si128(v, neg), neg);
+		}
+		_mm_storeu_si128((__m128i *)dst, _mm_packs_epi32(half[0], half[1]));
+	}
+#endif
+	for (; n > 0; n--)
+		*dst++ = alaw_decode_table[*src++];
+}
+
+static void alaw_encode_run(unsigned char *dst, const int16_t *src,
+			    snd_pcm_uframes_t n)
+{
+	for (; n > 0; n--)
+		*dst++ = alaw_encode_table[(unsigned short)*src++];
+}
+
 #ifndef DOC_HIDDEN
 
 void snd_pcm_alaw_decode(const snd_pcm_channel_area_t *dst_areas,
@@ -153,6 +232,16 @@ void snd_pcm_alaw_decode(const snd_pcm_channel_area_t *dst_areas,
 #undef PUT16_LABELS
 	void *put = put16_labels[putidx];
 	unsigned int channel;
+	int native = putidx == (unsigned int)snd_pcm_linear_put_index(SND_PCM_FORMAT_S16, SND_PCM_FORMAT_S16);
+
+	alaw_init_tables();
+	if (native && snd_pcm_plugin_areas_interleaved(src_areas, channels, 8) &&
+	    snd_pcm_plugin_areas_interleaved(dst_areas, channels, 16)) {
+		alaw_decode_run(snd_pcm_channel_area_addr(dst_areas, dst_offset),
+				snd_pcm_channel_area_addr(src_areas, src_offset),
+				frames * channels);
+		return;
+	}
 	for (channel = 0; channel < channels; ++channel) {
 		const unsigned char *src;
 		char *dst;
@@ -164,9 +253,13 @@ void snd_pcm_alaw_decode(const snd_pcm_channel_area_t *dst_areas,
 		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
 		src_step = snd_pcm_channel_area_step(src_area);
 		dst_step = snd_pcm_channel_area_step(dst_area);
+		if (native && src_step == 1 && dst_step == 2) {
+			alaw_decode_run((int16_t *)dst, src, frames);
+			continue;
+		}
 		frames1 = frames;
 		while (frames1-- > 0) {
-			int16_t sample = alaw_to_s16(*src);
+			int16_t sample = alaw_decode_table[*src];
 			goto *put;
 #define PUT16_END after
 #include "plugin_ops.h"
@@ -191,6 +284,16 @@ void snd_pcm_alaw_encode(const snd_pcm_channel_area_t *dst_areas,
 	void *get = get16_labels[getidx];
 	unsigned int channel;
 	int16_t sample = 0;
+	int native = getidx == (unsigned int)snd_pcm_linear_get_index(SND_PCM_FORMAT_S16, SND_PCM_FORMAT_S16);
+
+	alaw_init_tables();
+	if (native && snd_pcm_plugin_areas_interleaved(src_areas, channels, 16) &&
+	    snd_pcm_plugin_areas_interleaved(dst_areas, channels, 8)) {
+		alaw_encode_run(snd_pcm_channel_area_addr(dst_areas, dst_offset),
+				snd_pcm_channel_area_addr(src_areas, src_offset),
+				frames * channels);
+		return;
+	}
 	for (channel = 0; channel < channels; ++channel) {
 		const char *src;
 		char *dst;
@@ -202,6 +305,11 @@ void snd_pcm_alaw_encode(const snd_pcm_channel_area_t *dst_areas,
 		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
 		src_step = snd_pcm_channel_area_step(src_area);
 		dst_step = snd_pcm_channel_area_step(dst_area);
+		if (native && src_step == 2 && dst_step == 1) {
+			alaw_encode_run((unsigned char *)dst,
+					(const int16_t *)src, frames);
+			continue;
+		}
 		frames1 = frames;
 		while (frames1-- > 0) {
 			goto *get;
@@ -209,7 +317,7 @@ void snd_pcm_alaw_encode(const snd_pcm_channel_area_t *dst_areas,
 #include "plugin_ops.h"
 #undef GET16_END
 		after:
-			*dst = s16_to_alaw(sample);
+			*dst = alaw_encode_table[(unsigned short)sample];
 			src += src_step;
 			dst += dst_step;
 		}
@@ -454,6 +562,7 @@ int snd_pcm_alaw_open(snd_pcm_t **pcmp, const char *name, snd_pcm_format_t sform
 	pcm->poll_fd = slave->poll_fd;
 	pcm->poll_events = slave->poll_events;
 	pcm->monotonic = slave->monotonic;
+	pcm->trace = slave->trace;
 	snd_pcm_set_hw_ptr(pcm, &alaw->plug.hw_ptr, -1, 0);
 	snd_pcm_set_appl_ptr(pcm, &alaw->plug.appl_ptr, -1, 0);
 	*pcmp = pcm;
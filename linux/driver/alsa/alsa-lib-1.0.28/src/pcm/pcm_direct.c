@@ -570,6 +570,7 @@ int snd_pcm_direct_poll_revents(snd_pcm_t *pcm, struct pollfd *pfds, unsigned in
 			avail = snd_pcm_mmap_capture_avail(pcm);
 		}
 		empty = avail < pcm->avail_min;
+		snd_pcm_trace(pcm, SND_PCM_TRACE_WAKEUP, avail);
 	}
 	switch (snd_pcm_state(dmix->spcm)) {
 	case SND_PCM_STATE_XRUN:
@@ -767,6 +768,7 @@ int snd_pcm_direct_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 	params->rate_den = 1;
 	params->fifo_size = 0;
 	params->msbits = dmix->shmptr->s.msbits;
+	snd_pcm_trace_setup(pcm, params, NULL);
 	return 0;
 }
 
@@ -776,9 +778,10 @@ int snd_pcm_direct_hw_free(snd_pcm_t *pcm ATTRIBUTE_UNUSED)
 	return 0;
 }
 
-int snd_pcm_direct_sw_params(snd_pcm_t *pcm ATTRIBUTE_UNUSED, snd_pcm_sw_params_t * params ATTRIBUTE_UNUSED)
+int snd_pcm_direct_sw_params(snd_pcm_t *pcm, snd_pcm_sw_params_t * params)
 {
 	/* values are cached in the pcm structure */
+	snd_pcm_trace_setup(pcm, NULL, params);
 	return 0;
 }
 
@@ -1598,6 +1601,7 @@ int snd_pcm_direct_parse_open_conf(snd_config_t *root, snd_config_t *conf,
 	rec->ipc_gid = -1;
 	rec->slowptr = 1;
 	rec->max_periods = 0;
+	rec->fanout = 0;
 
 	/* read defaults */
 	if (snd_config_search(root, "defaults.pcm.dmix_max_periods", &n) >= 0) {
@@ -1704,6 +1708,13 @@ int snd_pcm_direct_parse_open_conf(snd_config_t *root, snd_config_t *conf,
 			rec->max_periods = val;
 			continue;
 		}
+		if (strcmp(id, "fanout") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			rec->fanout = err;
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -111,6 +111,10 @@ typedef struct {
 		struct {
 			unsigned long long chn_mask;
 		} dshare;
+		struct {
+			unsigned int fanout_valid;	/* fanout_shmid is set */
+			int fanout_shmid;		/* IPC_PRIVATE fan-out segment */
+		} dsnoop;
 	} u;
 } snd_pcm_direct_share_t;
 
@@ -169,6 +173,9 @@ struct snd_pcm_direct {
 			mix_areas_u8_t *remix_areas_u8;
 		} dmix;
 		struct {
+			int shmid_fanout;		/* IPC shm of the deinterleaved fan-out ring */
+			struct snd_pcm_dsnoop_fanout *fanout;
+			size_t fanout_stride;		/* bytes per channel plane */
 		} dsnoop;
 		struct {
 			unsigned long long chn_mask;
@@ -323,6 +330,7 @@ struct snd_pcm_direct_open_conf {
 	int ipc_gid;
 	int slowptr;
 	int max_periods;
+	int fanout;
 	snd_config_t *slave;
 	snd_config_t *bindings;
 };
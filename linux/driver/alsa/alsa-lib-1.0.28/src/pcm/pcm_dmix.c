@@ -310,6 +310,7 @@ static void snd_pcm_dmix_sync_area(snd_pcm_t *pcm)
 	snd_pcm_uframes_t slave_hw_ptr, slave_appl_ptr, slave_size;
 	snd_pcm_uframes_t appl_ptr, size, transfer;
 	const snd_pcm_channel_area_t *src_areas, *dst_areas;
+	unsigned long long stamp;
 	
 	/* calculate the size to transfer */
 	/* check the available size in the local buffer
@@ -369,6 +370,7 @@ static void snd_pcm_dmix_sync_area(snd_pcm_t *pcm)
 	slave_appl_ptr = dmix->slave_appl_ptr % dmix->slave_buffer_size;
 	dmix->slave_appl_ptr += size;
 	dmix->slave_appl_ptr %= dmix->slave_boundary;
+	snd_pcm_trace(pcm, SND_PCM_TRACE_MIX, size);
 	dmix_down_sem(dmix);
 	for (;;) {
 		transfer = size;
@@ -376,7 +378,9 @@ static void snd_pcm_dmix_sync_area(snd_pcm_t *pcm)
 			transfer = pcm->buffer_size - appl_ptr;
 		if (slave_appl_ptr + transfer > dmix->slave_buffer_size)
 			transfer = dmix->slave_buffer_size - slave_appl_ptr;
+		stamp = snd_pcm_stats_stamp();
 		mix_areas(dmix, src_areas, dst_areas, appl_ptr, slave_appl_ptr, transfer);
+		snd_pcm_stats_transfer(pcm, transfer, stamp);
 		size -= transfer;
 		if (! size)
 			break;
@@ -431,6 +435,7 @@ static int snd_pcm_dmix_sync_ptr(snd_pcm_t *pcm)
 		gettimestamp(&dmix->trigger_tstamp, pcm->monotonic);
 		if (dmix->state == SND_PCM_STATE_RUNNING) {
 			dmix->state = SND_PCM_STATE_XRUN;
+			snd_pcm_trace_xrun(pcm, avail);
 			return -EPIPE;
 		}
 		dmix->state = SND_PCM_STATE_SETUP;
@@ -540,6 +545,7 @@ static int snd_pcm_dmix_prepare(snd_pcm_t *pcm)
 	dmix->state = SND_PCM_STATE_PREPARED;
 	dmix->appl_ptr = dmix->last_appl_ptr = 0;
 	dmix->hw_ptr = 0;
+	snd_pcm_trace(pcm, SND_PCM_TRACE_PREPARE, 0);
 	return snd_pcm_direct_set_timer_params(dmix);
 }
 
@@ -597,6 +603,7 @@ static int snd_pcm_dmix_start(snd_pcm_t *pcm)
 		snd_pcm_dmix_sync_area(pcm);
 	}
 	gettimestamp(&dmix->trigger_tstamp, pcm->monotonic);
+	snd_pcm_trace(pcm, SND_PCM_TRACE_START, 0);
 	return 0;
 }
 
@@ -607,6 +614,7 @@ static int snd_pcm_dmix_drop(snd_pcm_t *pcm)
 		return -EBADFD;
 	dmix->state = SND_PCM_STATE_SETUP;
 	snd_pcm_direct_timer_stop(dmix);
+	snd_pcm_trace(pcm, SND_PCM_TRACE_STOP, 0);
 	return 0;
 }
 
@@ -787,6 +795,7 @@ static int snd_pcm_dmix_close(snd_pcm_t *pcm)
 	free(dmix->bindings);
 	pcm->private_data = NULL;
 	free(dmix);
+	snd_pcm_trace_close(pcm);
 	return 0;
 }
 
@@ -799,6 +808,7 @@ static snd_pcm_sframes_t snd_pcm_dmix_mmap_commit(snd_pcm_t *pcm,
 
 	switch (snd_pcm_state(dmix->spcm)) {
 	case SND_PCM_STATE_XRUN:
+		snd_pcm_trace_xrun(pcm, snd_pcm_mmap_playback_avail(pcm));
 		return -EPIPE;
 	case SND_PCM_STATE_SUSPENDED:
 		return -ESTRPIPE;
@@ -808,6 +818,7 @@ static snd_pcm_sframes_t snd_pcm_dmix_mmap_commit(snd_pcm_t *pcm,
 	if (! size)
 		return 0;
 	snd_pcm_mmap_appl_forward(pcm, size);
+	snd_pcm_trace(pcm, SND_PCM_TRACE_COMMIT, size);
 	if (dmix->state == STATE_RUN_PENDING) {
 		if ((err = snd_pcm_dmix_start_timer(pcm, dmix)) < 0)
 			return err;
@@ -829,11 +840,14 @@ static snd_pcm_sframes_t snd_pcm_dmix_mmap_commit(snd_pcm_t *pcm,
 static snd_pcm_sframes_t snd_pcm_dmix_avail_update(snd_pcm_t *pcm)
 {
 	snd_pcm_direct_t *dmix = pcm->private_data;
+	snd_pcm_uframes_t avail;
 	
 	if (dmix->state == SND_PCM_STATE_RUNNING ||
 	    dmix->state == SND_PCM_STATE_DRAINING)
 		snd_pcm_dmix_sync_ptr(pcm);
-	return snd_pcm_mmap_playback_avail(pcm);
+	avail = snd_pcm_mmap_playback_avail(pcm);
+	snd_pcm_trace(pcm, SND_PCM_TRACE_AVAIL, avail);
+	return avail;
 }
 
 static int snd_pcm_dmix_htimestamp(snd_pcm_t *pcm,
@@ -1108,6 +1122,9 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 	pcm->mmap_rw = 1;
 	snd_pcm_set_hw_ptr(pcm, &dmix->hw_ptr, -1, 0);
 	snd_pcm_set_appl_ptr(pcm, &dmix->appl_ptr, -1, 0);
+	ret = snd_pcm_trace_open(pcm);
+	if (ret < 0)
+		goto _err;
 	
 	if (dmix->channels == UINT_MAX)
 		dmix->channels = dmix->shmptr->s.channels;
@@ -1282,6 +1299,10 @@ int _snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 	err = snd_pcm_direct_parse_open_conf(root, conf, stream, &dopen);
 	if (err < 0)
 		return err;
+	if (dopen.fanout) {
+		SNDERR("fanout is only supported by dsnoop");
+		return -EINVAL;
+	}
 
 	/* the default settings, it might be invalid for some hardware */
 	params.format = SND_PCM_FORMAT_S16;
@@ -902,6 +902,10 @@ int _snd_pcm_dshare_open(snd_pcm_t **pcmp, const char *name,
 	err = snd_pcm_direct_parse_open_conf(root, conf, stream, &dopen);
 	if (err < 0)
 		return err;
+	if (dopen.fanout) {
+		SNDERR("fanout is only supported by dsnoop");
+		return -EINVAL;
+	}
 
 	/* the default settings, it might be invalid for some hardware */
 	params.format = SND_PCM_FORMAT_S16;
@@ -43,7 +43,11 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/mman.h>
+#include <sched.h>
 #include "pcm_direct.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #ifndef PIC
 /* entry for static linking */
@@ -96,6 +100,343 @@ static void snoop_areas(snd_pcm_direct_t *dsnoop,
 	}
 }
 
+/*
+ *  fan-out mode
+ *
+ *  The deinterleaved copy of the hardware ring lives in a second shm
+ *  segment, one cache aligned plane per slave channel.  Whichever client
+ *  sees the hardware pointer move first fills it, the others only wait
+ *  for its pointer; the planes are mapped directly as the client buffer.
+ *
+ *  The segment is created with IPC_PRIVATE by the first fan-out client
+ *  and its id is published in the direct shm, both under the client
+ *  semaphore, so no other IPC key is ever touched.
+ */
+
+#define FANOUT_ALIGN	64
+#define FANOUT_VALID	(1ULL << 63)
+#define FANOUT_SPINS	64
+#define FANOUT_MAGIC	0x464e4f55	/* "FNOU" */
+
+struct snd_pcm_dsnoop_fanout {
+	unsigned long long ptr;		/* slave position filled up to, | FANOUT_VALID */
+	unsigned long long claim;	/* slave position being filled up to */
+	unsigned long long size;	/* segment size in bytes */
+	unsigned int magic;
+	char pad[FANOUT_ALIGN - 3 * sizeof(unsigned long long) - sizeof(unsigned int)];
+};
+
+static inline char *fanout_plane(snd_pcm_direct_t *dsnoop, unsigned int chn)
+{
+	return (char *)(dsnoop->u.dsnoop.fanout + 1) +
+		chn * dsnoop->u.dsnoop.fanout_stride;
+}
+
+static int fanout_discard(snd_pcm_direct_t *dsnoop);
+
+/* call it with the client semaphore held */
+static int fanout_create_or_connect(snd_pcm_direct_t *dsnoop)
+{
+	snd_pcm_direct_share_t *shm = dsnoop->shmptr;
+	struct snd_pcm_dsnoop_fanout *fan;
+	struct shmid_ds buf, dbuf;
+	int err, create;
+	size_t size, stride;
+
+	stride = dsnoop->slave_buffer_size *
+		 snd_pcm_format_physical_width(dsnoop->shmptr->s.format) / 8;
+	stride = (stride + FANOUT_ALIGN - 1) & ~(size_t)(FANOUT_ALIGN - 1);
+	dsnoop->u.dsnoop.fanout_stride = stride;
+	size = sizeof(struct snd_pcm_dsnoop_fanout) +
+	       dsnoop->shmptr->s.channels * stride;
+	create = !shm->u.dsnoop.fanout_valid;
+	if (create) {
+		dsnoop->u.dsnoop.shmid_fanout = shmget(IPC_PRIVATE, size,
+						       IPC_CREAT | IPC_EXCL |
+						       dsnoop->ipc_perm);
+		if (dsnoop->u.dsnoop.shmid_fanout < 0)
+			return -errno;
+	} else {
+		/* the published segment must be the one of our creator */
+		dsnoop->u.dsnoop.shmid_fanout = shm->u.dsnoop.fanout_shmid;
+		if (shmctl(dsnoop->u.dsnoop.shmid_fanout, IPC_STAT, &buf) < 0 ||
+		    shmctl(dsnoop->shmid, IPC_STAT, &dbuf) < 0 ||
+		    buf.shm_segsz != size ||
+		    buf.shm_perm.cuid != dbuf.shm_perm.cuid) {
+			dsnoop->u.dsnoop.shmid_fanout = -1;
+			return -EINVAL;
+		}
+	}
+	dsnoop->u.dsnoop.fanout = shmat(dsnoop->u.dsnoop.shmid_fanout, 0, 0);
+	if (dsnoop->u.dsnoop.fanout == (void *) -1) {
+		err = -errno;
+		if (create)
+			shmctl(dsnoop->u.dsnoop.shmid_fanout, IPC_RMID, NULL);
+		dsnoop->u.dsnoop.fanout = NULL;
+		dsnoop->u.dsnoop.shmid_fanout = -1;
+		return err;
+	}
+	fan = dsnoop->u.dsnoop.fanout;
+	if (create) {
+		if (dsnoop->ipc_gid >= 0 &&
+		    shmctl(dsnoop->u.dsnoop.shmid_fanout, IPC_STAT, &buf) == 0) {
+			buf.shm_perm.gid = dsnoop->ipc_gid;
+			shmctl(dsnoop->u.dsnoop.shmid_fanout, IPC_SET, &buf);
+		}
+		fan->size = size;
+		fan->magic = FANOUT_MAGIC;
+		shm->u.dsnoop.fanout_shmid = dsnoop->u.dsnoop.shmid_fanout;
+		shm->u.dsnoop.fanout_valid = 1;
+	} else if (fan->magic != FANOUT_MAGIC || fan->size != size) {
+		shmdt(fan);
+		dsnoop->u.dsnoop.fanout = NULL;
+		dsnoop->u.dsnoop.shmid_fanout = -1;
+		return -EINVAL;
+	}
+	mlock(fan, size);
+	return 0;
+}
+
+/* call it with the client semaphore held */
+static int fanout_discard(snd_pcm_direct_t *dsnoop)
+{
+	struct shmid_ds buf;
+	int ret = 0;
+
+	if (dsnoop->u.dsnoop.shmid_fanout < 0)
+		return -EINVAL;
+	if (dsnoop->u.dsnoop.fanout &&
+	    shmdt(dsnoop->u.dsnoop.fanout) < 0)
+		return -errno;
+	dsnoop->u.dsnoop.fanout = NULL;
+	if (shmctl(dsnoop->u.dsnoop.shmid_fanout, IPC_STAT, &buf) < 0)
+		return -errno;
+	if (buf.shm_nattch == 0) {	/* we're the last user, destroy the segment */
+		if (shmctl(dsnoop->u.dsnoop.shmid_fanout, IPC_RMID, NULL) < 0)
+			return -errno;
+		dsnoop->shmptr->u.dsnoop.fanout_valid = 0;
+		ret = 1;
+	}
+	dsnoop->u.dsnoop.shmid_fanout = -1;
+	return ret;
+}
+
+/*
+ * deinterleave kernels: frames from an interleaved ring of channels
+ * samples into per-channel planes, whole 8x8 resp. 4x4 tiles are
+ * transposed in registers
+ */
+static void fanout_deinterleave_16(char **planes, const int16_t *src,
+				   unsigned int channels,
+				   snd_pcm_uframes_t frames)
+{
+	snd_pcm_uframes_t f = 0;
+	unsigned int chn;
+
+#ifdef __SSE2__
+	if (channels % 8 == 0) {
+		for (; f + 8 <= frames; f += 8) {
+			for (chn = 0; chn < channels; chn += 8) {
+				const int16_t *s = src + f * channels + chn;
+				__m128i r0, r1, r2, r3, r4, r5, r6, r7;
+				__m128i t0, t1, t2, t3, t4, t5, t6, t7;
+				r0 = _mm_loadu_si128((const __m128i *)(s + 0 * channels));
+				r1 = _mm_loadu_si128((const __m128i *)(s + 1 * channels));
+				r2 = _mm_loadu_si128((const __m128i *)(s + 2 * channels));
+				r3 = _mm_loadu_si128((const __m128i *)(s + 3 * channels));
+				r4 = _mm_loadu_si128((const __m128i *)(s + 4 * channels));
+				r5 = _mm_loadu_si128((const __m128i *)(s + 5 * channels));
+				r6 = _mm_loadu_si128((const __m128i *)(s + 6 * channels));
+				r7 = _mm_loadu_si128((const __m128i *)(s + 7 * channels));
+				t0 = _mm_unpacklo_epi16(r0, r1);
+				t1 = _mm_unpackhi_epi16(r0, r1);
+				t2 = _mm_unpacklo_epi16(r2, r3);
+				t3 = _mm_unpackhi_epi16(r2, r3);
+				t4 = _mm_unpacklo_epi16(r4, r5);
+				t5 = _mm_unpackhi_epi16(r4, r5);
+				t6 = _mm_unpacklo_epi16(r6, r7);
+				t7 = _mm_unpackhi_epi16(r6, r7);
+				r0 = _mm_unpacklo_epi32(t0, t2);
+				r1 = _mm_unpackhi_epi32(t0, t2);
+				r2 = _mm_unpacklo_epi32(t1, t3);
+				r3 = _mm_unpackhi_epi32(t1, t3);
+				r4 = _mm_unpacklo_epi32(t4, t6);
+				r5 = _mm_unpackhi_epi32(t4, t6);
+				r6 = _mm_unpacklo_epi32(t5, t7);
+				r7 = _mm_unpackhi_epi32(t5, t7);
+				_mm_storeu_si128((__m128i *)(planes[chn + 0] + f * 2), _mm_unpacklo_epi64(r0, r4));
+				_mm_storeu_si128((__m128i *)(planes[chn + 1] + f * 2), _mm_unpackhi_epi64(r0, r4));
+				_mm_storeu_si128((__m128i *)(planes[chn + 2] + f * 2), _mm_unpacklo_epi64(r1, r5));
+				_mm_storeu_si128((__m128i *)(planes[chn + 3] + f * 2), _mm_unpackhi_epi64(r1, r5));
+				_mm_storeu_si128((__m128i *)(planes[chn + 4] + f * 2), _mm_unpacklo_epi64(r2, r6));
+				_mm_storeu_si128((__m128i *)(planes[chn + 5] + f * 2), _mm_unpackhi_epi64(r2, r6));
+				_mm_storeu_si128((__m128i *)(planes[chn + 6] + f * 2), _mm_unpacklo_epi64(r3, r7));
+				_mm_storeu_si128((__m128i *)(planes[chn + 7] + f * 2), _mm_unpackhi_epi64(r3, r7));
+			}
+		}
+	}
+#endif
+	for (chn = 0; chn < channels; chn++) {
+		int16_t *dst = (int16_t *)planes[chn];
+		const int16_t *s = src + chn;
+		snd_pcm_uframes_t i;
+		for (i = f; i < frames; i++)
+			dst[i] = s[i * channels];
+	}
+}
+
+static void fanout_deinterleave_32(char **planes, const int32_t *src,
+				   unsigned int channels,
+				   snd_pcm_uframes_t frames)
+{
+	snd_pcm_uframes_t f = 0;
+	unsigned int chn;
+
+#ifdef __SSE2__
+	if (channels % 4 == 0) {
+		for (; f + 4 <= frames; f += 4) {
+			for (chn = 0; chn < channels; chn += 4) {
+				const int32_t *s = src + f * channels + chn;
+				__m128i r0, r1, r2, r3, t0, t1, t2, t3;
+				r0 = _mm_loadu_si128((const __m128i *)(s + 0 * channels));
+				r1 = _mm_loadu_si128((const __m128i *)(s + 1 * channels));
+				r2 = _mm_loadu_si128((const __m128i *)(s + 2 * channels));
+				r3 = _mm_loadu_si128((const __m128i *)(s + 3 * channels));
+				t0 = _mm_unpacklo_epi32(r0, r1);
+				t1 = _mm_unpackhi_epi32(r0, r1);
+				t2 = _mm_unpacklo_epi32(r2, r3);
+				t3 = _mm_unpackhi_epi32(r2, r3);
+				_mm_storeu_si128((__m128i *)(planes[chn + 0] + f * 4), _mm_unpacklo_epi64(t0, t2));
+				_mm_storeu_si128((__m128i *)(planes[chn + 1] + f * 4), _mm_unpackhi_epi64(t0, t2));
+				_mm_storeu_si128((__m128i *)(planes[chn + 2] + f * 4), _mm_unpacklo_epi64(t1, t3));
+				_mm_storeu_si128((__m128i *)(planes[chn + 3] + f * 4), _mm_unpackhi_epi64(t1, t3));
+			}
+		}
+	}
+#endif
+	for (chn = 0; chn < channels; chn++) {
+		int32_t *dst = (int32_t *)planes[chn];
+		const int32_t *s = src + chn;
+		snd_pcm_uframes_t i;
+		for (i = f; i < frames; i++)
+			dst[i] = s[i * channels];
+	}
+}
+
+/* copy size frames at slave ring offset ofs (no wrap) into the planes */
+static void fanout_fill(snd_pcm_direct_t *dsnoop,
+			const snd_pcm_channel_area_t *src_areas,
+			snd_pcm_uframes_t ofs, snd_pcm_uframes_t size)
+{
+	unsigned int chn, channels = dsnoop->shmptr->s.channels;
+	snd_pcm_format_t format = dsnoop->shmptr->s.format;
+	unsigned int width = snd_pcm_format_physical_width(format);
+	char *planes[channels];
+	int interleaved = 1;
+
+	for (chn = 0; chn < channels; chn++) {
+		planes[chn] = fanout_plane(dsnoop, chn) + ofs * width / 8;
+		if (src_areas[chn].addr != src_areas[0].addr ||
+		    src_areas[chn].first != chn * width ||
+		    src_areas[chn].step != channels * width)
+			interleaved = 0;
+	}
+	if (interleaved && width == 16) {
+		fanout_deinterleave_16(planes, (const int16_t *)src_areas[0].addr +
+				       ofs * channels, channels, size);
+	} else if (interleaved && width == 32) {
+		fanout_deinterleave_32(planes, (const int32_t *)src_areas[0].addr +
+				       ofs * channels, channels, size);
+	} else {
+		for (chn = 0; chn < channels; chn++) {
+			snd_pcm_channel_area_t dst;
+			dst.addr = fanout_plane(dsnoop, chn);
+			dst.first = 0;
+			dst.step = width;
+			snd_pcm_area_copy(&dst, ofs, &src_areas[chn], ofs, size, format);
+		}
+	}
+}
+
+/*
+ * make the planes valid up to the slave position target; returns
+ * when another client has done it or after doing it ourselves
+ */
+static void snd_pcm_dsnoop_fanout_update(snd_pcm_direct_t *dsnoop,
+					 snd_pcm_uframes_t target)
+{
+	struct snd_pcm_dsnoop_fanout *fan = dsnoop->u.dsnoop.fanout;
+	snd_pcm_uframes_t bsize = dsnoop->slave_buffer_size;
+	snd_pcm_uframes_t boundary = dsnoop->slave_boundary;
+	unsigned long long done, claim;
+	snd_pcm_uframes_t from, size, ofs, transfer;
+	int spins = 0;
+
+	for (;;) {
+		done = __atomic_load_n(&fan->ptr, __ATOMIC_ACQUIRE);
+		if (done & FANOUT_VALID) {
+			from = done & ~FANOUT_VALID;
+			/* behind us by less than a buffer: done; far off:
+			 * stale from a previous run, refill
+			 */
+			if ((from + boundary - target) % boundary <= bsize)
+				return;
+			if ((target + boundary - from) % boundary > bsize)
+				from = (target + boundary - bsize) % boundary;
+		} else
+			from = (target + boundary - bsize) % boundary;
+		claim = __atomic_load_n(&fan->claim, __ATOMIC_RELAXED);
+		if (claim == (target | FANOUT_VALID) && spins < FANOUT_SPINS) {
+			/* someone else is filling this range */
+			spins++;
+			sched_yield();
+			continue;
+		}
+		if (__atomic_compare_exchange_n(&fan->claim, &claim,
+						target | FANOUT_VALID, 0,
+						__ATOMIC_ACQ_REL,
+						__ATOMIC_RELAXED) ||
+		    spins >= FANOUT_SPINS)
+			break;
+	}
+
+	size = (target + boundary - from) % boundary;
+	ofs = from % bsize;
+	while (size > 0) {
+		transfer = ofs + size > bsize ? bsize - ofs : size;
+		fanout_fill(dsnoop, snd_pcm_mmap_areas(dsnoop->spcm), ofs,
+			    transfer);
+		size -= transfer;
+		ofs = 0;
+	}
+	/* only ever move the pointer forward */
+	done = __atomic_load_n(&fan->ptr, __ATOMIC_RELAXED);
+	do {
+		if ((done & FANOUT_VALID) &&
+		    ((done & ~FANOUT_VALID) + boundary - target) % boundary <= bsize)
+			break;
+	} while (!__atomic_compare_exchange_n(&fan->ptr, &done,
+					      target | FANOUT_VALID, 0,
+					      __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+}
+
+static int snd_pcm_dsnoop_fanout_channel_info(snd_pcm_t *pcm,
+					      snd_pcm_channel_info_t *info)
+{
+	snd_pcm_direct_t *dsnoop = pcm->private_data;
+	unsigned int schn;
+
+	if (info->channel >= pcm->channels)
+		return -EINVAL;
+	schn = dsnoop->bindings ? dsnoop->bindings[info->channel] : info->channel;
+	info->addr = fanout_plane(dsnoop, schn);
+	info->first = 0;
+	info->step = pcm->sample_bits;
+	info->type = SND_PCM_AREA_LOCAL;
+	return 0;
+}
+
 /*
  *  synchronize shm ring buffer with hardware
  */
@@ -152,7 +493,10 @@ static int snd_pcm_dsnoop_sync_ptr(snd_pcm_t *pcm)
 		slave_hw_ptr += dsnoop->slave_boundary;
 		diff = slave_hw_ptr - old_slave_hw_ptr;
 	}
-	snd_pcm_dsnoop_sync_area(pcm, old_slave_hw_ptr, diff);
+	if (dsnoop->u.dsnoop.fanout)
+		snd_pcm_dsnoop_fanout_update(dsnoop, dsnoop->slave_hw_ptr);
+	else
+		snd_pcm_dsnoop_sync_area(pcm, old_slave_hw_ptr, diff);
 	dsnoop->hw_ptr += diff;
 	dsnoop->hw_ptr %= pcm->boundary;
 	// printf("sync ptr diff = %li\n", diff);
@@ -271,7 +615,9 @@ static int snd_pcm_dsnoop_prepare(snd_pcm_t *pcm)
 static int snd_pcm_dsnoop_reset(snd_pcm_t *pcm)
 {
 	snd_pcm_direct_t *dsnoop = pcm->private_data;
-	dsnoop->hw_ptr %= pcm->period_size;
+	/* the fan-out planes are indexed by the slave position */
+	if (!dsnoop->u.dsnoop.fanout)
+		dsnoop->hw_ptr %= pcm->period_size;
 	dsnoop->appl_ptr = dsnoop->hw_ptr;
 	dsnoop->slave_appl_ptr = dsnoop->slave_hw_ptr;
 	return 0;
@@ -287,6 +633,11 @@ static int snd_pcm_dsnoop_start(snd_pcm_t *pcm)
 	snd_pcm_hwsync(dsnoop->spcm);
 	snoop_timestamp(pcm);
 	dsnoop->slave_appl_ptr = dsnoop->slave_hw_ptr;
+	if (dsnoop->u.dsnoop.fanout) {
+		/* keep our ring offset equal to the slave one */
+		dsnoop->hw_ptr = dsnoop->slave_hw_ptr % pcm->buffer_size;
+		dsnoop->appl_ptr = dsnoop->hw_ptr;
+	}
 	err = snd_timer_start(dsnoop->timer);
 	if (err < 0)
 		return err;
@@ -387,6 +738,8 @@ static int snd_pcm_dsnoop_close(snd_pcm_t *pcm)
 		snd_timer_close(dsnoop->timer);
 	snd_pcm_direct_semaphore_down(dsnoop, DIRECT_IPC_SEM_CLIENT);
 	snd_pcm_close(dsnoop->spcm);
+	if (dsnoop->u.dsnoop.shmid_fanout >= 0)
+		fanout_discard(dsnoop);
  	if (dsnoop->server)
  		snd_pcm_direct_server_discard(dsnoop);
  	if (dsnoop->client)
@@ -473,23 +826,102 @@ static void snd_pcm_dsnoop_dump(snd_pcm_t *pcm, snd_output_t *out)
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
 	}
+	if (dsnoop->u.dsnoop.fanout)
+		snd_output_printf(out, "Fan-out: shared deinterleaved buffer (%zu bytes per channel)\n",
+				  dsnoop->u.dsnoop.fanout_stride);
 	if (dsnoop->spcm)
 		snd_pcm_dump(dsnoop->spcm, out);
 }
 
+/*
+ * the fan-out planes are always non-interleaved, so they can back the
+ * client buffer only for non-interleaved mmap and for read access
+ */
+static int snd_pcm_dsnoop_hw_refine(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
+{
+	snd_pcm_direct_t *dsnoop = pcm->private_data;
+	static const snd_mask_t access = { .bits = {
+					(1<<SNDRV_PCM_ACCESS_MMAP_NONINTERLEAVED) |
+					(1<<SNDRV_PCM_ACCESS_RW_INTERLEAVED) |
+					(1<<SNDRV_PCM_ACCESS_RW_NONINTERLEAVED),
+					0, 0, 0 } };
+
+	if (dsnoop->u.dsnoop.fanout &&
+	    (params->rmask & (1<<SND_PCM_HW_PARAM_ACCESS))) {
+		snd_mask_t *mask = &params->masks[SND_PCM_HW_PARAM_ACCESS - SND_PCM_HW_PARAM_FIRST_MASK];
+		if (snd_mask_refine(mask, &access))
+			params->cmask |= 1<<SND_PCM_HW_PARAM_ACCESS;
+		if (snd_mask_empty(mask))
+			return -EINVAL;
+	}
+	return snd_pcm_direct_hw_refine(pcm, params);
+}
+
+static int snd_pcm_dsnoop_channel_info(snd_pcm_t *pcm, snd_pcm_channel_info_t *info)
+{
+	snd_pcm_direct_t *dsnoop = pcm->private_data;
+
+	if (dsnoop->u.dsnoop.fanout)
+		return snd_pcm_dsnoop_fanout_channel_info(pcm, info);
+	return snd_pcm_direct_channel_info(pcm, info);
+}
+
+static int snd_pcm_dsnoop_munmap(snd_pcm_t *pcm)
+{
+	snd_pcm_direct_t *dsnoop = pcm->private_data;
+
+	if (dsnoop->u.dsnoop.fanout) {
+		free(pcm->mmap_channels);
+		free(pcm->running_areas);
+		pcm->mmap_channels = NULL;
+		pcm->running_areas = NULL;
+	}
+	return 0;
+}
+
+/* with fan-out the client buffer is the shared planes, see mmap_shadow */
+static int snd_pcm_dsnoop_mmap(snd_pcm_t *pcm)
+{
+	snd_pcm_direct_t *dsnoop = pcm->private_data;
+	unsigned int c;
+	int err;
+
+	if (!dsnoop->u.dsnoop.fanout)
+		return 0;
+	pcm->mmap_channels = calloc(pcm->channels, sizeof(pcm->mmap_channels[0]));
+	pcm->running_areas = calloc(pcm->channels, sizeof(pcm->running_areas[0]));
+	if (!pcm->mmap_channels || !pcm->running_areas) {
+		snd_pcm_dsnoop_munmap(pcm);
+		return -ENOMEM;
+	}
+	for (c = 0; c < pcm->channels; c++) {
+		snd_pcm_channel_info_t *i = &pcm->mmap_channels[c];
+		i->channel = c;
+		err = snd_pcm_dsnoop_fanout_channel_info(pcm, i);
+		if (err < 0) {
+			snd_pcm_dsnoop_munmap(pcm);
+			return err;
+		}
+		pcm->running_areas[c].addr = i->addr;
+		pcm->running_areas[c].first = i->first;
+		pcm->running_areas[c].step = i->step;
+	}
+	return 0;
+}
+
 static const snd_pcm_ops_t snd_pcm_dsnoop_ops = {
 	.close = snd_pcm_dsnoop_close,
 	.info = snd_pcm_direct_info,
-	.hw_refine = snd_pcm_direct_hw_refine,
+	.hw_refine = snd_pcm_dsnoop_hw_refine,
 	.hw_params = snd_pcm_direct_hw_params,
 	.hw_free = snd_pcm_direct_hw_free,
 	.sw_params = snd_pcm_direct_sw_params,
-	.channel_info = snd_pcm_direct_channel_info,
+	.channel_info = snd_pcm_dsnoop_channel_info,
 	.dump = snd_pcm_dsnoop_dump,
 	.nonblock = snd_pcm_direct_nonblock,
 	.async = snd_pcm_direct_async,
-	.mmap = snd_pcm_direct_mmap,
-	.munmap = snd_pcm_direct_munmap,
+	.mmap = snd_pcm_dsnoop_mmap,
+	.munmap = snd_pcm_dsnoop_munmap,
 	.query_chmaps = snd_pcm_direct_query_chmaps,
 	.get_chmap = snd_pcm_direct_get_chmap,
 	.set_chmap = snd_pcm_direct_set_chmap,
@@ -573,6 +1005,7 @@ int snd_pcm_dsnoop_open(snd_pcm_t **pcmp, const char *name,
 	dsnoop->ipc_gid = opts->ipc_gid;
 	dsnoop->semid = -1;
 	dsnoop->shmid = -1;
+	dsnoop->u.dsnoop.shmid_fanout = -1;
 
 	ret = snd_pcm_new(&pcm, dsnoop->type = SND_PCM_TYPE_DSNOOP, name, stream, mode);
 	if (ret < 0)
@@ -607,6 +1040,8 @@ int snd_pcm_dsnoop_open(snd_pcm_t **pcmp, const char *name,
 	dsnoop->state = SND_PCM_STATE_OPEN;
 	dsnoop->slowptr = opts->slowptr;
 	dsnoop->max_periods = opts->max_periods;
+	if (opts->fanout)	/* planes are indexed by the slave ring */
+		dsnoop->max_periods = -1;
 	dsnoop->sync_ptr = snd_pcm_dsnoop_sync_ptr;
 
 	if (first_instance) {
@@ -682,6 +1117,15 @@ int snd_pcm_dsnoop_open(snd_pcm_t **pcmp, const char *name,
 		dsnoop->spcm = spcm;
 	}
 
+	if (opts->fanout) {
+		ret = fanout_create_or_connect(dsnoop);
+		if (ret < 0) {
+			SNDERR("unable to create fan-out shm instance");
+			goto _err;
+		}
+		pcm->mmap_shadow = 1;
+	}
+
 	ret = snd_pcm_direct_initialize_poll_fd(dsnoop);
 	if (ret < 0) {
 		SNDERR("unable to initialize poll_fd");
@@ -712,6 +1156,8 @@ int snd_pcm_dsnoop_open(snd_pcm_t **pcmp, const char *name,
 		snd_pcm_direct_client_discard(dsnoop);
 	if (spcm)
 		snd_pcm_close(spcm);
+	if (dsnoop->u.dsnoop.shmid_fanout >= 0)
+		fanout_discard(dsnoop);
 	if (dsnoop->shmid >= 0)
 		snd_pcm_direct_shm_discard(dsnoop);
 	if (snd_pcm_direct_semaphore_discard(dsnoop) < 0)
@@ -763,9 +1209,17 @@ pcm.name {
 		N INT		# maps slave channel to client channel N
 	}
 	slowptr BOOL		# slow but more precise pointer updates
+	fanout BOOL		# share one deinterleaved copy among clients
 }
 \endcode
 
+With \c fanout enabled, the first client that sees new data copies it
+once into a second shared memory segment holding one cache aligned
+plane per slave channel, and every client uses these planes directly
+as its own ring buffer.  This saves a copy per client when many
+processes snoop the same device.  The client buffer size is then
+fixed to the slave one and MMAP_INTERLEAVED access is not available.
+
 \subsection pcm_plugins_dsnoop_funcref Function reference
 
 <UL>
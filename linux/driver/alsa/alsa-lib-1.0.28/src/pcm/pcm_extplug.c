@@ -43,6 +43,17 @@ typedef struct snd_pcm_extplug_priv {
 	snd_pcm_extplug_t *data;
 	struct snd_ext_parm params[SND_PCM_EXTPLUG_HW_PARAMS];
 	struct snd_ext_parm sparams[SND_PCM_EXTPLUG_HW_PARAMS];
+	snd_pcm_uframes_t block_size;	/* 0: plain transfer callback */
+	snd_pcm_uframes_t max_chunk;
+	void *scratch;
+	snd_pcm_channel_area_t *in_areas;	/* input FIFO ring */
+	snd_pcm_channel_area_t *out_areas;	/* output FIFO ring */
+	snd_pcm_format_t in_format, out_format;
+	unsigned int in_channels, out_channels;
+	size_t in_frame_bytes, out_frame_bytes;
+	snd_pcm_uframes_t fifo_size;	/* ring size, a multiple of block_size */
+	snd_pcm_uframes_t in_pos, in_fill, out_pos, out_fill;
+	snd_pcm_fast_ops_t fops;
 } extplug_priv_t;
 
 static const int hw_params_type[SND_PCM_EXTPLUG_HW_PARAMS] = {
@@ -284,6 +295,180 @@ static int snd_pcm_extplug_hw_refine(snd_pcm_t *pcm, snd_pcm_hw_params_t *params
 	return err;
 }
 
+/*
+ * block mode: the input is gathered into a FIFO ring and handed to
+ * block_transfer as soon as whole blocks are available, several periods
+ * per call when the application commits that much at once.  The ring
+ * size is a multiple of block_size and blocks are only consumed whole,
+ * so a block never straddles the wrap.  The output is delivered through
+ * a second ring primed with one block of silence, which is the latency
+ * reported in delay and status.
+ */
+static void snd_pcm_extplug_free_scratch(extplug_priv_t *ext)
+{
+	free(ext->scratch);
+	free(ext->in_areas);
+	ext->scratch = NULL;
+	ext->in_areas = ext->out_areas = NULL;
+	ext->block_size = 0;
+	ext->plug.latency = 0;
+}
+
+static void setup_scratch_areas(snd_pcm_channel_area_t *areas, char *addr,
+				unsigned int channels, snd_pcm_format_t format)
+{
+	unsigned int width = snd_pcm_format_physical_width(format);
+	unsigned int ch;
+
+	for (ch = 0; ch < channels; ch++) {
+		areas[ch].addr = addr;
+		areas[ch].first = ch * width;
+		areas[ch].step = channels * width;
+	}
+}
+
+static void snd_pcm_extplug_reset_fifo(extplug_priv_t *ext)
+{
+	ext->in_pos = ext->in_fill = 0;
+	ext->out_pos = 0;
+	ext->out_fill = ext->block_size;
+	snd_pcm_areas_silence(ext->out_areas, 0, ext->out_channels,
+			      ext->block_size, ext->out_format);
+}
+
+static int snd_pcm_extplug_alloc_scratch(extplug_priv_t *ext,
+					 snd_pcm_uframes_t block_size,
+					 snd_pcm_uframes_t buffer_size)
+{
+	snd_pcm_extplug_t *data = ext->data;
+	size_t in_bytes, out_bytes;
+
+	if (data->stream == SND_PCM_STREAM_PLAYBACK) {
+		ext->in_format = data->format;
+		ext->in_channels = data->channels;
+		ext->out_format = data->slave_format;
+		ext->out_channels = data->slave_channels;
+	} else {
+		ext->in_format = data->slave_format;
+		ext->in_channels = data->slave_channels;
+		ext->out_format = data->format;
+		ext->out_channels = data->channels;
+	}
+	ext->in_frame_bytes = snd_pcm_format_physical_width(ext->in_format) *
+		ext->in_channels / 8;
+	ext->out_frame_bytes = snd_pcm_format_physical_width(ext->out_format) *
+		ext->out_channels / 8;
+	/* less than a block waits in the input FIFO and one block in the
+	 * output one, on top of a transfer of at most buffer_size frames
+	 */
+	ext->fifo_size = (buffer_size + 2 * block_size - 1) / block_size *
+		block_size;
+	in_bytes = ext->fifo_size * ext->in_frame_bytes;
+	in_bytes = (in_bytes + 63) & ~(size_t)63;
+	out_bytes = ext->fifo_size * ext->out_frame_bytes;
+	if (posix_memalign(&ext->scratch, 64, in_bytes + out_bytes))
+		return -ENOMEM;
+	ext->in_areas = malloc((ext->in_channels + ext->out_channels) *
+			       sizeof(*ext->in_areas));
+	if (!ext->in_areas) {
+		free(ext->scratch);
+		ext->scratch = NULL;
+		return -ENOMEM;
+	}
+	ext->out_areas = ext->in_areas + ext->in_channels;
+	setup_scratch_areas(ext->in_areas, ext->scratch,
+			    ext->in_channels, ext->in_format);
+	setup_scratch_areas(ext->out_areas, (char *)ext->scratch + in_bytes,
+			    ext->out_channels, ext->out_format);
+	ext->max_chunk = buffer_size;
+	ext->block_size = block_size;
+	ext->plug.latency = block_size;
+	snd_pcm_extplug_reset_fifo(ext);
+	return 0;
+}
+
+/* copy between a FIFO ring and a linear range, splitting at the wrap */
+static void fifo_copy(const snd_pcm_channel_area_t *fifo,
+		      snd_pcm_uframes_t pos,
+		      const snd_pcm_channel_area_t *areas,
+		      snd_pcm_uframes_t offset, snd_pcm_uframes_t size,
+		      snd_pcm_uframes_t fifo_size, int to_fifo,
+		      unsigned int channels, snd_pcm_format_t format)
+{
+	while (size) {
+		snd_pcm_uframes_t n = size;
+
+		if (n > fifo_size - pos)
+			n = fifo_size - pos;
+		if (to_fifo)
+			snd_pcm_areas_copy(fifo, pos, areas, offset,
+					   channels, n, format);
+		else
+			snd_pcm_areas_copy(areas, offset, fifo, pos,
+					   channels, n, format);
+		pos = (pos + n) % fifo_size;
+		offset += n;
+		size -= n;
+	}
+}
+
+static snd_pcm_uframes_t
+snd_pcm_extplug_transfer_fifo(extplug_priv_t *ext,
+			      const snd_pcm_channel_area_t *dst_areas,
+			      snd_pcm_uframes_t dst_offset,
+			      const snd_pcm_channel_area_t *src_areas,
+			      snd_pcm_uframes_t src_offset,
+			      snd_pcm_uframes_t size)
+{
+	snd_pcm_uframes_t frames;
+	char *in_base = ext->in_areas[0].addr;
+	char *out_base = ext->out_areas[0].addr;
+
+	if (size > ext->max_chunk)
+		size = ext->max_chunk;
+	fifo_copy(ext->in_areas, (ext->in_pos + ext->in_fill) % ext->fifo_size,
+		  src_areas, src_offset, size, ext->fifo_size, 1,
+		  ext->in_channels, ext->in_format);
+	ext->in_fill += size;
+	frames = ext->in_fill - ext->in_fill % ext->block_size;
+	while (frames) {
+		snd_pcm_channel_area_t in[ext->in_channels];
+		snd_pcm_channel_area_t out[ext->out_channels];
+		snd_pcm_uframes_t out_ofs, n;
+		snd_pcm_sframes_t result;
+
+		/* both ring offsets are block aligned, so is n */
+		out_ofs = (ext->out_pos + ext->out_fill) % ext->fifo_size;
+		n = frames;
+		if (n > ext->fifo_size - ext->in_pos)
+			n = ext->fifo_size - ext->in_pos;
+		if (n > ext->fifo_size - out_ofs)
+			n = ext->fifo_size - out_ofs;
+		setup_scratch_areas(in, in_base +
+				    ext->in_pos * ext->in_frame_bytes,
+				    ext->in_channels, ext->in_format);
+		setup_scratch_areas(out, out_base +
+				    out_ofs * ext->out_frame_bytes,
+				    ext->out_channels, ext->out_format);
+		result = ext->data->callback->block_transfer(ext->data, out,
+							     in, n);
+		if (result < 0)
+			result = 0;
+		if ((snd_pcm_uframes_t)result < n)
+			snd_pcm_areas_silence(out, result, ext->out_channels,
+					      n - result, ext->out_format);
+		ext->in_pos = (ext->in_pos + n) % ext->fifo_size;
+		ext->in_fill -= n;
+		ext->out_fill += n;
+		frames -= n;
+	}
+	fifo_copy(ext->out_areas, ext->out_pos, dst_areas, dst_offset, size,
+		  ext->fifo_size, 0, ext->out_channels, ext->out_format);
+	ext->out_pos = (ext->out_pos + size) % ext->fifo_size;
+	ext->out_fill -= size;
+	return size;
+}
+
 /*
  * hw_params callback
  */
@@ -312,6 +497,17 @@ static int snd_pcm_extplug_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *params
 		if (err < 0)
 			return err;
 	}
+	snd_pcm_extplug_free_scratch(ext);
+	if (ext->data->version >= 0x010003 &&
+	    ext->data->callback->block_transfer && ext->data->block_size) {
+		snd_pcm_uframes_t buffer_size;
+
+		INTERNAL(snd_pcm_hw_params_get_buffer_size)(params, &buffer_size);
+		err = snd_pcm_extplug_alloc_scratch(ext, ext->data->block_size,
+						    buffer_size);
+		if (err < 0)
+			return err;
+	}
 	return 0;
 }
 
@@ -323,6 +519,7 @@ static int snd_pcm_extplug_hw_free(snd_pcm_t *pcm)
 	extplug_priv_t *ext = pcm->private_data;
 
 	snd_pcm_hw_free(ext->plug.gen.slave);
+	snd_pcm_extplug_free_scratch(ext);
 	if (ext->data->callback->hw_free)
 		return ext->data->callback->hw_free(ext->data);
 	return 0;
@@ -344,8 +541,14 @@ snd_pcm_extplug_write_areas(snd_pcm_t *pcm,
 
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	size = ext->data->callback->transfer(ext->data, slave_areas, slave_offset,
-					     areas, offset, size);
+	if (ext->block_size)
+		size = snd_pcm_extplug_transfer_fifo(ext, slave_areas,
+						     slave_offset, areas,
+						     offset, size);
+	else
+		size = ext->data->callback->transfer(ext->data, slave_areas,
+						     slave_offset, areas,
+						     offset, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -366,19 +569,30 @@ snd_pcm_extplug_read_areas(snd_pcm_t *pcm,
 
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	size = ext->data->callback->transfer(ext->data, areas, offset,
-					     slave_areas, slave_offset, size);
+	if (ext->block_size)
+		size = snd_pcm_extplug_transfer_fifo(ext, areas, offset,
+						     slave_areas, slave_offset,
+						     size);
+	else
+		size = ext->data->callback->transfer(ext->data, areas, offset,
+						     slave_areas, slave_offset,
+						     size);
 	*slave_sizep = size;
 	return size;
 }
 
 /*
- * call init callback
+ * reset the block FIFOs and call init callback
  */
 static int snd_pcm_extplug_init(snd_pcm_t *pcm)
 {
 	extplug_priv_t *ext = pcm->private_data;
-	return ext->data->callback->init(ext->data);
+
+	if (ext->block_size)
+		snd_pcm_extplug_reset_fifo(ext);
+	if (ext->data->version >= 0x010001 && ext->data->callback->init)
+		return ext->data->callback->init(ext->data);
+	return 0;
 }
 
 /*
@@ -400,6 +614,9 @@ static void snd_pcm_extplug_dump(snd_pcm_t *pcm, snd_output_t *out)
 			snd_pcm_dump_setup(pcm, out);
 		}
 	}
+	if (ext->block_size)
+		snd_output_printf(out, "Block size: %lu frames\n",
+				  ext->block_size);
 	snd_output_printf(out, "Slave: ");
 	snd_pcm_dump(ext->plug.gen.slave, out);
 }
@@ -419,6 +636,7 @@ static int snd_pcm_extplug_close(snd_pcm_t *pcm)
 
 	snd_pcm_close(ext->plug.gen.slave);
 	clear_ext_params(ext);
+	snd_pcm_extplug_free_scratch(ext);
 	if (ext->data->callback->close)
 		ext->data->callback->close(ext->data);
 	free(ext);
@@ -622,6 +840,22 @@ The init callback is called when the PCM is at prepare state or any
 initialization is issued.  Use this callback to reset the PCM instance
 to a sane initial state.
 
+Plugins that process fixed-size blocks (FFT-based filters, for
+example) can set the block_size field and provide the block_transfer
+callback instead of splitting the work themselves (since v1.0.3).
+The block_size field may still be changed in the hw_params callback,
+e.g. to derive it from the period size.  In this mode alsa-lib
+gathers the input into an interleaved scratch ring whose size is a
+multiple of block_size, so a block never straddles the wrap, and calls
+block_transfer with all whole blocks available at once (in two calls
+when they reach over the end of the ring), which is several periods
+when the application writes that much in one go.
+The areas passed to block_transfer always start at offset 0 and the
+size is a multiple of block_size.  The output is delayed by one block,
+which is included in #snd_pcm_delay() and #snd_pcm_status().
+The transfer callback is still mandatory and is used whenever
+block_size is zero.
+
 The hw_params constraints can be defined via either
 #snd_pcm_extplug_set_param_minmax() and #snd_pcm_extplug_set_param_list()
 functions after calling #snd_pcm_extplug_create().
@@ -704,8 +938,7 @@ int snd_pcm_extplug_create(snd_pcm_extplug_t *extplug, const char *name,
 	ext->plug.undo_write = snd_pcm_plugin_undo_write_generic;
 	ext->plug.gen.slave = spcm;
 	ext->plug.gen.close_slave = 1;
-	if (extplug->version >= 0x010001 && extplug->callback->init)
-		ext->plug.init = snd_pcm_extplug_init;
+	ext->plug.init = snd_pcm_extplug_init;
 
 	err = snd_pcm_new(&pcm, SND_PCM_TYPE_EXTPLUG, name, stream, mode);
 	if (err < 0) {
@@ -715,7 +948,8 @@ int snd_pcm_extplug_create(snd_pcm_extplug_t *extplug, const char *name,
 
 	extplug->pcm = pcm;
 	pcm->ops = &snd_pcm_extplug_ops;
-	pcm->fast_ops = &snd_pcm_plugin_fast_ops;
+	ext->fops = snd_pcm_plugin_fast_ops;
+	pcm->fast_ops = &ext->fops;
 	pcm->private_data = ext;
 	pcm->poll_fd = spcm->poll_fd;
 	pcm->poll_events = spcm->poll_events;
@@ -241,6 +241,7 @@ int snd_pcm_hooks_open(snd_pcm_t **pcmp, const char *name, snd_pcm_t *slave, int
 	pcm->poll_events = slave->poll_events;
 	pcm->mmap_shadow = 1;
 	pcm->monotonic = slave->monotonic;
+	pcm->trace = slave->trace;
 	snd_pcm_link_hw_ptr(pcm, slave);
 	snd_pcm_link_appl_ptr(pcm, slave);
 	*pcmp = pcm;
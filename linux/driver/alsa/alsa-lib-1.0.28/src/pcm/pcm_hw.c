@@ -92,9 +92,20 @@ typedef struct {
 	int fd;
 	int card, device, subdevice;
 	int sync_ptr_ioctl;
+	unsigned int sync_status: 1;	/* status is read with SYNC_PTR */
+	unsigned int sync_control: 1;	/* control is written with SYNC_PTR */
 	volatile struct snd_pcm_mmap_status * mmap_status;
 	struct snd_pcm_mmap_control *mmap_control;
 	struct snd_pcm_sync_ptr *sync_ptr;
+	/* SYNC_PTR rate limit and accounting */
+	int sync_ptr_interval;		/* us, -1 = a quarter of the period */
+	long long sync_ptr_limit;	/* ns, in effect for the current setup */
+	long long sync_ptr_stamp;	/* last status refresh, 0 = stale */
+	unsigned long sync_ptr_count;
+	unsigned long sync_ptr_skipped;
+	long long sync_ptr_window;	/* start of the rate window */
+	unsigned long sync_ptr_window_count;
+	unsigned int sync_ptr_rate;	/* ioctls per second */
 	int period_event;
 	snd_timer_t *period_timer;
 	struct pollfd period_timer_pfd;
@@ -129,9 +140,31 @@ struct timespec snd_pcm_hw_fast_tstamp(snd_pcm_t *pcm)
 }
 #endif /* DOC_HIDDEN */
 
+static inline long long sync_ptr_now(void)
+{
+	snd_htimestamp_t ts;
+	gettimestamp(&ts, 1);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sync_ptr_account(snd_pcm_hw_t *hw, long long now)
+{
+	long long elapsed = now - hw->sync_ptr_window;
+	if (elapsed < 1000000000LL)
+		return;
+	hw->sync_ptr_rate = (hw->sync_ptr_count - hw->sync_ptr_window_count) *
+		1000000000LL / elapsed;
+	hw->sync_ptr_window = now;
+	hw->sync_ptr_window_count = hw->sync_ptr_count;
+}
+
 static int sync_ptr1(snd_pcm_hw_t *hw, unsigned int flags)
 {
 	int err;
+	long long now;
+	/* a mmapped control record is authoritative, only read it back */
+	if (!hw->sync_control)
+		flags |= SNDRV_PCM_SYNC_PTR_APPL | SNDRV_PCM_SYNC_PTR_AVAIL_MIN;
 	hw->sync_ptr->flags = flags;
 	err = ioctl((hw)->fd, SNDRV_PCM_IOCTL_SYNC_PTR, (hw)->sync_ptr);
 	if (err < 0) {
@@ -139,6 +172,10 @@ static int sync_ptr1(snd_pcm_hw_t *hw, unsigned int flags)
 		SYSMSG("SNDRV_PCM_IOCTL_SYNC_PTR failed (%i)", err);
 		return err;
 	}
+	now = sync_ptr_now();
+	hw->sync_ptr_stamp = now;
+	hw->sync_ptr_count++;
+	sync_ptr_account(hw, now);
 	return 0;
 }
 
@@ -147,6 +184,49 @@ static inline int sync_ptr(snd_pcm_hw_t *hw, unsigned int flags)
 	return hw->sync_ptr ? sync_ptr1(hw, flags) : 0;
 }
 
+/* push appl_ptr and avail_min when the control record is not mmapped */
+static inline int sync_ptr_control(snd_pcm_hw_t *hw)
+{
+	return hw->sync_control ? sync_ptr1(hw, 0) : 0;
+}
+
+/*
+ * Refresh the status record when it is not mmapped.  A refresh younger
+ * than sync_ptr_limit is reused, unless the caller wants to know the
+ * available space and the cached value would make it wait.
+ */
+static int sync_ptr_status(snd_pcm_t *pcm, unsigned int flags, int need_avail)
+{
+	snd_pcm_hw_t *hw = pcm->private_data;
+
+	if (!hw->sync_status)
+		return 0;
+	if (hw->sync_ptr_limit > 0 && hw->sync_ptr_stamp &&
+	    (!need_avail || snd_pcm_mmap_avail(pcm) >= pcm->avail_min) &&
+	    sync_ptr_now() - hw->sync_ptr_stamp < hw->sync_ptr_limit) {
+		hw->sync_ptr_skipped++;
+		return 0;
+	}
+	return sync_ptr1(hw, flags);
+}
+
+/* a read or write ioctl returned, -EPIPE means the stream is in xrun */
+static inline void snd_pcm_hw_trace_xfer(snd_pcm_t *pcm, int err,
+					 snd_pcm_sframes_t result)
+{
+	if (!pcm->trace)
+		return;
+	snd_pcm_trace(pcm, SND_PCM_TRACE_COMMIT, err < 0 ? err : result);
+	if (err == -EPIPE)
+		snd_pcm_trace_xrun(pcm, snd_pcm_mmap_avail(pcm));
+}
+
+static inline void snd_pcm_hw_trace_wakeup(snd_pcm_t *pcm, unsigned short revents)
+{
+	if (pcm->trace && (revents & pcm->poll_events))
+		snd_pcm_trace(pcm, SND_PCM_TRACE_WAKEUP, snd_pcm_mmap_avail(pcm));
+}
+
 static int snd_pcm_hw_clear_timer_queue(snd_pcm_hw_t *hw)
 {
 	if (hw->period_timer_need_poll) {
@@ -192,6 +272,17 @@ static int snd_pcm_hw_poll_revents(snd_pcm_t *pcm, struct pollfd *pfds, unsigned
 		events |= pcm->poll_events & ~(POLLERR|POLLNVAL);
 	}
 	*revents = events;
+	snd_pcm_hw_trace_wakeup(pcm, events);
+	return 0;
+}
+
+/* without the period timer only to see the wakeups */
+static int snd_pcm_hw_poll_revents_fd(snd_pcm_t *pcm, struct pollfd *pfds, unsigned nfds, unsigned short *revents)
+{
+	if (nfds != 1)
+		return -EINVAL;
+	*revents = pfds->revents;
+	snd_pcm_hw_trace_wakeup(pcm, *revents);
 	return 0;
 }
 
@@ -329,6 +420,15 @@ static int snd_pcm_hw_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 	}
 	params->info &= ~0xf0000000;
 	params->info |= (pcm->monotonic ? SND_PCM_INFO_MONOTONIC : 0);
+	snd_pcm_trace_setup(pcm, params, NULL);
+	if (hw->sync_ptr_interval >= 0) {
+		hw->sync_ptr_limit = hw->sync_ptr_interval * 1000LL;
+	} else {
+		unsigned int period_time;
+		if (INTERNAL(snd_pcm_hw_params_get_period_time)(params, &period_time, 0) < 0)
+			period_time = 0;
+		hw->sync_ptr_limit = period_time * 1000LL / 4;
+	}
 	err = sync_ptr(hw, 0);
 	if (err < 0)
 		return err;
@@ -442,7 +542,8 @@ static int snd_pcm_hw_sw_params(snd_pcm_t *pcm, snd_pcm_sw_params_t * params)
 	    params->silence_size == pcm->silence_size &&
 	    old_period_event == hw->period_event) {
 		hw->mmap_control->avail_min = params->avail_min;
-		return sync_ptr(hw, 0);
+		snd_pcm_trace_setup(pcm, NULL, params);
+		return sync_ptr_control(hw);
 	}
 	if (ioctl(fd, SNDRV_PCM_IOCTL_SW_PARAMS, params) < 0) {
 		err = -errno;
@@ -451,6 +552,7 @@ static int snd_pcm_hw_sw_params(snd_pcm_t *pcm, snd_pcm_sw_params_t * params)
 	}
 	sw_set_period_event(params, old_period_event);
 	hw->mmap_control->avail_min = params->avail_min;
+	snd_pcm_trace_setup(pcm, NULL, params);
 	if (hw->period_event != old_period_event) {
 		err = snd_pcm_hw_change_timer(pcm, old_period_event);
 		if (err < 0)
@@ -500,7 +602,7 @@ static int snd_pcm_hw_status(snd_pcm_t *pcm, snd_pcm_status_t * status)
 static snd_pcm_state_t snd_pcm_hw_state(snd_pcm_t *pcm)
 {
 	snd_pcm_hw_t *hw = pcm->private_data;
-	int err = sync_ptr(hw, 0);
+	int err = sync_ptr_status(pcm, 0, 0);
 	if (err < 0)
 		return err;
 	return (snd_pcm_state_t) hw->mmap_status->state;
@@ -523,8 +625,8 @@ static int snd_pcm_hw_hwsync(snd_pcm_t *pcm)
 	snd_pcm_hw_t *hw = pcm->private_data;
 	int fd = hw->fd, err;
 	if (SNDRV_PROTOCOL_VERSION(2, 0, 3) <= hw->version) {
-		if (hw->sync_ptr) {
-			err = sync_ptr1(hw, SNDRV_PCM_SYNC_PTR_HWSYNC);
+		if (hw->sync_status) {
+			err = sync_ptr_status(pcm, SNDRV_PCM_SYNC_PTR_HWSYNC, 0);
 			if (err < 0)
 				return err;
 		} else {
@@ -559,6 +661,7 @@ static int snd_pcm_hw_prepare(snd_pcm_t *pcm)
 		SYSMSG("SNDRV_PCM_IOCTL_PREPARE failed (%i)", err);
 		return err;
 	}
+	snd_pcm_trace(pcm, SND_PCM_TRACE_PREPARE, 0);
 	return sync_ptr(hw, SNDRV_PCM_SYNC_PTR_APPL);
 }
 
@@ -582,7 +685,8 @@ static int snd_pcm_hw_start(snd_pcm_t *pcm)
 	assert(pcm->stream != SND_PCM_STREAM_PLAYBACK ||
 	       snd_pcm_mmap_playback_hw_avail(pcm) > 0);
 #endif
-	sync_ptr(hw, 0);
+	sync_ptr_control(hw);
+	hw->sync_ptr_stamp = 0;
 	if (ioctl(hw->fd, SNDRV_PCM_IOCTL_START) < 0) {
 		err = -errno;
 		SYSMSG("SNDRV_PCM_IOCTL_START failed (%i)", err);
@@ -592,6 +696,7 @@ static int snd_pcm_hw_start(snd_pcm_t *pcm)
 #endif
 		return err;
 	}
+	snd_pcm_trace(pcm, SND_PCM_TRACE_START, 0);
 	return 0;
 }
 
@@ -599,12 +704,14 @@ static int snd_pcm_hw_drop(snd_pcm_t *pcm)
 {
 	snd_pcm_hw_t *hw = pcm->private_data;
 	int err;
+	hw->sync_ptr_stamp = 0;
 	if (ioctl(hw->fd, SNDRV_PCM_IOCTL_DROP) < 0) {
 		err = -errno;
 		SYSMSG("SNDRV_PCM_IOCTL_DROP failed (%i)", err);
 		return err;
 	} else {
 	}
+	snd_pcm_trace(pcm, SND_PCM_TRACE_STOP, 0);
 	return 0;
 }
 
@@ -612,11 +719,13 @@ static int snd_pcm_hw_drain(snd_pcm_t *pcm)
 {
 	snd_pcm_hw_t *hw = pcm->private_data;
 	int err;
+	hw->sync_ptr_stamp = 0;
 	if (ioctl(hw->fd, SNDRV_PCM_IOCTL_DRAIN) < 0) {
 		err = -errno;
 		SYSMSG("SNDRV_PCM_IOCTL_DRAIN failed (%i)", err);
 		return err;
 	}
+	snd_pcm_trace(pcm, SND_PCM_TRACE_STOP, 0);
 	return 0;
 }
 
@@ -624,6 +733,7 @@ static int snd_pcm_hw_pause(snd_pcm_t *pcm, int enable)
 {
 	snd_pcm_hw_t *hw = pcm->private_data;
 	int err;
+	hw->sync_ptr_stamp = 0;
 	if (ioctl(hw->fd, SNDRV_PCM_IOCTL_PAUSE, enable) < 0) {
 		err = -errno;
 		SYSMSG("SNDRV_PCM_IOCTL_PAUSE failed (%i)", err);
@@ -705,6 +815,7 @@ static int snd_pcm_hw_resume(snd_pcm_t *pcm)
 {
 	snd_pcm_hw_t *hw = pcm->private_data;
 	int fd = hw->fd, err;
+	hw->sync_ptr_stamp = 0;
 	if (ioctl(fd, SNDRV_PCM_IOCTL_RESUME) < 0) {
 		err = -errno;
 		SYSMSG("SNDRV_PCM_IOCTL_RESUME failed (%i)", err);
@@ -768,6 +879,7 @@ static snd_pcm_sframes_t snd_pcm_hw_writei(snd_pcm_t *pcm, const void *buffer, s
 #ifdef DEBUG_RW
 	fprintf(stderr, "hw_writei: frames = %li, xferi.result = %li, err = %i\n", size, xferi.result, err);
 #endif
+	snd_pcm_hw_trace_xfer(pcm, err, xferi.result);
 	if (err < 0)
 		return snd_pcm_check_error(pcm, err);
 	return xferi.result;
@@ -787,6 +899,7 @@ static snd_pcm_sframes_t snd_pcm_hw_writen(snd_pcm_t *pcm, void **bufs, snd_pcm_
 #ifdef DEBUG_RW
 	fprintf(stderr, "hw_writen: frames = %li, result = %li, err = %i\n", size, xfern.result, err);
 #endif
+	snd_pcm_hw_trace_xfer(pcm, err, xfern.result);
 	if (err < 0)
 		return snd_pcm_check_error(pcm, err);
 	return xfern.result;
@@ -806,6 +919,7 @@ static snd_pcm_sframes_t snd_pcm_hw_readi(snd_pcm_t *pcm, void *buffer, snd_pcm_
 #ifdef DEBUG_RW
 	fprintf(stderr, "hw_readi: frames = %li, result = %li, err = %i\n", size, xferi.result, err);
 #endif
+	snd_pcm_hw_trace_xfer(pcm, err, xferi.result);
 	if (err < 0)
 		return snd_pcm_check_error(pcm, err);
 	return xferi.result;
@@ -825,6 +939,7 @@ static snd_pcm_sframes_t snd_pcm_hw_readn(snd_pcm_t *pcm, void **bufs, snd_pcm_u
 #ifdef DEBUG_RW
 	fprintf(stderr, "hw_readn: frames = %li, result = %li, err = %i\n", size, xfern.result, err);
 #endif
+	snd_pcm_hw_trace_xfer(pcm, err, xfern.result);
 	if (err < 0)
 		return snd_pcm_check_error(pcm, err);
 	return xfern.result;
@@ -855,8 +970,7 @@ static int snd_pcm_hw_mmap_status(snd_pcm_t *pcm)
 		if (hw->sync_ptr == NULL)
 			return -ENOMEM;
 		hw->mmap_status = &hw->sync_ptr->s.status;
-		hw->mmap_control = &hw->sync_ptr->c.control;
-		hw->sync_ptr_ioctl = 1;
+		hw->sync_status = 1;
 	} else {
 		hw->mmap_status = ptr;
 	}
@@ -867,20 +981,28 @@ static int snd_pcm_hw_mmap_status(snd_pcm_t *pcm)
 static int snd_pcm_hw_mmap_control(snd_pcm_t *pcm)
 {
 	snd_pcm_hw_t *hw = pcm->private_data;
-	void *ptr;
-	int err;
-	if (hw->sync_ptr == NULL) {
+	void *ptr = MAP_FAILED;
+
+	/*
+	 * the control record is tried on its own: some kernels refuse the
+	 * status page but still map the control one, which saves the
+	 * ioctl on every commit
+	 */
+	if (hw->sync_ptr_ioctl == 0)
 		ptr = mmap(NULL, page_align(sizeof(struct snd_pcm_mmap_control)),
 			   PROT_READ|PROT_WRITE, MAP_FILE|MAP_SHARED, 
 			   hw->fd, SNDRV_PCM_MMAP_OFFSET_CONTROL);
-		if (ptr == MAP_FAILED || ptr == NULL) {
-			err = -errno;
-			SYSMSG("control mmap failed (%i)", err);
-			return err;
+	if (ptr == MAP_FAILED || ptr == NULL) {
+		if (hw->sync_ptr == NULL) {
+			hw->sync_ptr = calloc(1, sizeof(struct snd_pcm_sync_ptr));
+			if (hw->sync_ptr == NULL)
+				return -ENOMEM;
 		}
-		hw->mmap_control = ptr;
-	} else {
+		hw->mmap_control = &hw->sync_ptr->c.control;
 		hw->mmap_control->avail_min = 1;
+		hw->sync_control = 1;
+	} else {
+		hw->mmap_control = ptr;
 	}
 	snd_pcm_set_appl_ptr(pcm, &hw->mmap_control->appl_ptr, hw->fd, SNDRV_PCM_MMAP_OFFSET_CONTROL);
 	return 0;
@@ -890,10 +1012,7 @@ static int snd_pcm_hw_munmap_status(snd_pcm_t *pcm)
 {
 	snd_pcm_hw_t *hw = pcm->private_data;
 	int err;
-	if (hw->sync_ptr_ioctl) {
-		free(hw->sync_ptr);
-		hw->sync_ptr = NULL;
-	} else {
+	if (!hw->sync_status && hw->mmap_status) {
 		if (munmap((void*)hw->mmap_status, page_align(sizeof(*hw->mmap_status))) < 0) {
 			err = -errno;
 			SYSMSG("status munmap failed (%i)", err);
@@ -907,10 +1026,7 @@ static int snd_pcm_hw_munmap_control(snd_pcm_t *pcm)
 {
 	snd_pcm_hw_t *hw = pcm->private_data;
 	int err;
-	if (hw->sync_ptr_ioctl) {
-		free(hw->sync_ptr);
-		hw->sync_ptr = NULL;
-	} else {
+	if (!hw->sync_control && hw->mmap_control) {
 		if (munmap(hw->mmap_control, page_align(sizeof(*hw->mmap_control))) < 0) {
 			err = -errno;
 			SYSMSG("control munmap failed (%i)", err);
@@ -940,6 +1056,8 @@ static int snd_pcm_hw_close(snd_pcm_t *pcm)
 	}
 	snd_pcm_hw_munmap_status(pcm);
 	snd_pcm_hw_munmap_control(pcm);
+	snd_pcm_trace_close(pcm);
+	free(hw->sync_ptr);
 	free(hw);
 	return err;
 }
@@ -951,7 +1069,8 @@ static snd_pcm_sframes_t snd_pcm_hw_mmap_commit(snd_pcm_t *pcm,
 	snd_pcm_hw_t *hw = pcm->private_data;
 
 	snd_pcm_mmap_appl_forward(pcm, size);
-	sync_ptr(hw, 0);
+	sync_ptr_control(hw);
+	snd_pcm_trace(pcm, SND_PCM_TRACE_COMMIT, size);
 #ifdef DEBUG_MMAP
 	fprintf(stderr, "appl_forward: hw_ptr = %li, appl_ptr = %li, size = %li\n", *pcm->hw.ptr, *pcm->appl.ptr, size);
 #endif
@@ -963,25 +1082,29 @@ static snd_pcm_sframes_t snd_pcm_hw_avail_update(snd_pcm_t *pcm)
 	snd_pcm_hw_t *hw = pcm->private_data;
 	snd_pcm_uframes_t avail;
 
-	sync_ptr(hw, 0);
+	sync_ptr_status(pcm, 0, 1);
 	avail = snd_pcm_mmap_avail(pcm);
 	switch (FAST_PCM_STATE(hw)) {
 	case SNDRV_PCM_STATE_RUNNING:
 		if (avail >= pcm->stop_threshold) {
 			/* SNDRV_PCM_IOCTL_XRUN ioctl has been implemented since PCM kernel API 2.0.1 */
 			if (SNDRV_PROTOCOL_VERSION(2, 0, 1) <= hw->version) {
+				hw->sync_ptr_stamp = 0;
 				if (ioctl(hw->fd, SNDRV_PCM_IOCTL_XRUN) < 0)
 					return -errno;
 			}
 			/* everything is ok, state == SND_PCM_STATE_XRUN at the moment */
+			snd_pcm_trace_xrun(pcm, avail);
 			return -EPIPE;
 		}
 		break;
 	case SNDRV_PCM_STATE_XRUN:
+		snd_pcm_trace_xrun(pcm, avail);
 		return -EPIPE;
 	default:
 		break;
 	}
+	snd_pcm_trace(pcm, SND_PCM_TRACE_AVAIL, avail);
 	return avail;
 }
 
@@ -1283,6 +1406,13 @@ static void snd_pcm_hw_dump(snd_pcm_t *pcm, snd_output_t *out)
 		snd_output_printf(out, "  appl_ptr     : %li\n", hw->mmap_control->appl_ptr);
 		snd_output_printf(out, "  hw_ptr       : %li\n", hw->mmap_status->hw_ptr);
 	}
+	if (hw->sync_ptr) {
+		snd_output_printf(out, "SYNC_PTR for%s%s, %lu ioctls (%u/s), %lu skipped\n",
+				  hw->sync_status ? " status" : "",
+				  hw->sync_control ? " control" : "",
+				  hw->sync_ptr_count, hw->sync_ptr_rate,
+				  hw->sync_ptr_skipped);
+	}
 }
 
 static const snd_pcm_ops_t snd_pcm_hw_ops = {
@@ -1331,7 +1461,7 @@ static const snd_pcm_fast_ops_t snd_pcm_hw_fast_ops = {
 	.htimestamp = snd_pcm_hw_htimestamp,
 	.poll_descriptors = NULL,
 	.poll_descriptors_count = NULL,
-	.poll_revents = NULL,
+	.poll_revents = snd_pcm_hw_poll_revents_fd,
 };
 
 static const snd_pcm_fast_ops_t snd_pcm_hw_fast_ops_timer = {
@@ -1454,6 +1584,8 @@ int snd_pcm_hw_open_fd(snd_pcm_t **pcmp, const char *name,
 	hw->subdevice = info.subdevice;
 	hw->fd = fd;
 	hw->sync_ptr_ioctl = sync_ptr_ioctl;
+	hw->sync_ptr_interval = -1;
+	hw->sync_ptr_window = sync_ptr_now();
 	/* no restriction */
 	hw->format = SND_PCM_FORMAT_UNKNOWN;
 	hw->rate = 0;
@@ -1473,6 +1605,11 @@ int snd_pcm_hw_open_fd(snd_pcm_t **pcmp, const char *name,
 	pcm->poll_events = info.stream == SND_PCM_STREAM_PLAYBACK ? POLLOUT : POLLIN;
 	pcm->monotonic = monotonic;
 
+	ret = snd_pcm_trace_open(pcm);
+	if (ret < 0) {
+		snd_pcm_close(pcm);
+		return ret;
+	}
 	ret = snd_pcm_hw_mmap_status(pcm);
 	if (ret < 0) {
 		snd_pcm_close(pcm);
@@ -1576,6 +1713,36 @@ int snd_pcm_hw_open(snd_pcm_t **pcmp, const char *name,
 	return ret;
 }
 
+/**
+ * \brief Get the SYNC_PTR ioctl statistics of a hw PCM
+ * \param pcm hw PCM handle
+ * \param ioctls Returns the number of SYNC_PTR ioctls issued
+ * \param skipped Returns the number of status refreshes served from cache
+ * \param rate Returns the SYNC_PTR ioctls per second over the last second
+ * \return 0 on success otherwise a negative error code
+ *
+ * The counters stay zero when both the status and the control records
+ * are mmapped, no SYNC_PTR is needed then.
+ */
+int snd_pcm_hw_get_sync_ptr_stats(snd_pcm_t *pcm, unsigned long *ioctls,
+				  unsigned long *skipped, unsigned int *rate)
+{
+	snd_pcm_hw_t *hw;
+
+	assert(pcm);
+	if (pcm->type != SND_PCM_TYPE_HW)
+		return -EINVAL;
+	hw = pcm->private_data;
+	sync_ptr_account(hw, sync_ptr_now());
+	if (ioctls)
+		*ioctls = hw->sync_ptr_count;
+	if (skipped)
+		*skipped = hw->sync_ptr_skipped;
+	if (rate)
+		*rate = hw->sync_ptr_rate;
+	return 0;
+}
+
 /*! \page pcm_plugins
 
 \section pcm_plugins_hw Plugin: hw
@@ -1590,6 +1757,17 @@ changed by this option.  This influences only on the blocking behavior at
 opening the device.  If you would like to keep the compatibility with the
 older ALSA stuff, turn this option off.
 
+The status and control records of the driver are mmapped where the kernel
+allows it, each on its own. The record that cannot be mapped (or both, with
+sync_ptr_ioctl) is exchanged with the SYNC_PTR ioctl. Status refreshes are
+then rate limited: within sync_ptr_interval after the last refresh the
+cached position is reused, unless it would make the caller wait. So
+snd_pcm_hwsync(), snd_pcm_state() and the positions derived from them can
+return a snapshot up to sync_ptr_interval old, a quarter of the period by
+default; set sync_ptr_interval 0 to refresh on every call. The ioctl
+counters are shown in the dump and returned by
+snd_pcm_hw_get_sync_ptr_stats().
+
 \code
 pcm.name {
 	type hw			# Kernel PCM
@@ -1597,6 +1775,8 @@ pcm.name {
 	[device INT]		# Device number (default 0)
 	[subdevice INT]		# Subdevice number (default -1: first available)
 	[sync_ptr_ioctl BOOL]	# Use SYNC_PTR ioctl rather than the direct mmap access for control structures
+	[sync_ptr_interval INT]	# Minimum time between SYNC_PTR status refreshes in us,
+				# 0 .. INT_MAX (default: a quarter of the period)
 	[nonblock BOOL]		# Force non-blocking open mode
 	[format STR]		# Restrict only to the given format
 	[channels INT]		# Restrict only to the given channels
@@ -1610,6 +1790,7 @@ pcm.name {
 <UL>
   <LI>snd_pcm_hw_open()
   <LI>_snd_pcm_hw_open()
+  <LI>snd_pcm_hw_get_sync_ptr_stats()
 </UL>
 
 */
@@ -1634,6 +1815,7 @@ int _snd_pcm_hw_open(snd_pcm_t **pcmp, const char *name,
 	long card = -1, device = 0, subdevice = -1;
 	const char *str;
 	int err, sync_ptr_ioctl = 0;
+	long sync_ptr_interval = -1;
 	int rate = 0, channels = 0;
 	snd_pcm_format_t format = SND_PCM_FORMAT_UNKNOWN;
 	snd_config_t *n;
@@ -1693,6 +1875,21 @@ int _snd_pcm_hw_open(snd_pcm_t **pcmp, const char *name,
 			sync_ptr_ioctl = err;
 			continue;
 		}
+		if (strcmp(id, "sync_ptr_interval") == 0) {
+			err = snd_config_get_integer(n, &sync_ptr_interval);
+			if (err < 0) {
+				SNDERR("Invalid type for %s", id);
+				snd_pcm_free_chmaps(chmap);
+				return err;
+			}
+			if (sync_ptr_interval < 0 ||
+			    sync_ptr_interval > INT_MAX) {
+				SNDERR("Invalid value for %s", id);
+				snd_pcm_free_chmaps(chmap);
+				return -EINVAL;
+			}
+			continue;
+		}
 		if (strcmp(id, "nonblock") == 0) {
 			err = snd_config_get_bool(n);
 			if (err < 0)
@@ -1775,6 +1972,7 @@ int _snd_pcm_hw_open(snd_pcm_t **pcmp, const char *name,
 		hw->rate = rate;
 	if (chmap)
 		hw->chmap_override = chmap;
+	hw->sync_ptr_interval = sync_ptr_interval;
 
 	return 0;
 }
@@ -32,6 +32,10 @@
 
 #include "plugin_ops.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #ifndef PIC
 /* entry for static linking */
 const char *_snd_module_pcm_iec958 = "";
@@ -62,6 +66,10 @@ struct snd_pcm_iec958 {
 	unsigned char status[24];
 	unsigned int byteswap;
 	unsigned char preamble[3];	/* B/M/W or Z/X/Y */
+	/* status, parity and preamble bits per frame of the block for the
+	 * first and the other channels, [192] repeats [0]
+	 */
+	u_int32_t frame_bits[193][2];
 	snd_pcm_fast_ops_t fops;
 };
 
@@ -69,26 +77,6 @@ enum { PREAMBLE_Z, PREAMBLE_X, PREAMBLE_Y };
 
 #endif /* DOC_HIDDEN */
 
-/*
- * Determine parity for time slots 4 upto 30
- * to be sure that bit 4 upt 31 will carry
- * an even number of ones and zeros.
- */
-static unsigned int iec958_parity(unsigned int data)
-{
-	unsigned int parity;
-	int bit;
-
-	data >>= 4;     /* start from bit 4 */
-	parity = 0;
-	for (bit = 4; bit <= 30; bit++) {
-		if (data & 1)
-			parity++;
-		data >>= 1;
-	}
-	return (parity & 1);
-}
-
 /*
  * Compose 32bit IEC958 subframe, two sub frames
  * build one frame with two channels.
@@ -100,32 +88,45 @@ static unsigned int iec958_parity(unsigned int data)
  *     29   = user data (0)
  *     30   = channel status (24 bytes for 192 frames)
  *     31   = parity
+ *
+ * Everything but the data bits only depends on the position in the
+ * block, so it is precomputed once per block in frame_bits.  The parity
+ * over bits 4-30 is the parity of the data bits, flipped when the
+ * status bit is set.
  */
-
-static inline u_int32_t iec958_subframe(snd_pcm_iec958_t *iec, u_int32_t data, int channel)
+static void iec958_init_frame_bits(snd_pcm_iec958_t *iec)
 {
-	unsigned int byte = iec->counter >> 3;
-	unsigned int mask = 1 << (iec->counter - (byte << 3));
+	unsigned int counter, channel;
+
+	for (counter = 0; counter < 192; counter++) {
+		for (channel = 0; channel < 2; channel++) {
+			u_int32_t bits = 0;
+			if (iec->status[counter >> 3] & (1 << (counter & 7)))
+				bits |= 0xc0000000;
+			if (channel)
+				bits |= iec->preamble[PREAMBLE_Y];	/* odd sub frame, 'Y' */
+			else if (! counter)
+				bits |= iec->preamble[PREAMBLE_Z];	/* Block start, 'Z' */
+			else
+				bits |= iec->preamble[PREAMBLE_X];	/* even sub frame, 'X' */
+			iec->frame_bits[counter][channel] = bits;
+		}
+	}
+	iec->frame_bits[192][0] = iec->frame_bits[0][0];
+	iec->frame_bits[192][1] = iec->frame_bits[0][1];
+}
 
+static inline u_int32_t iec958_subframe_bits(u_int32_t data, u_int32_t bits)
+{
 	/* bit 4-27 */
 	data >>= 4;
 	data &= ~0xf;
+	return (data | bits) ^ ((u_int32_t)__builtin_parity(data) << 31);
+}
 
-	/* set IEC status bits (up to 192 bits) */
-	if (iec->status[byte] & mask)
-		data |= 0x40000000;
-
-	if (iec958_parity(data))	/* parity bit 4-30 */
-		data |= 0x80000000;
-
-	/* Preamble */
-	if (channel)
-		data |= iec->preamble[PREAMBLE_Y];	/* odd sub frame, 'Y' */
-	else if (! iec->counter)
-		data |= iec->preamble[PREAMBLE_Z];	/* Block start, 'Z' */
-	else
-		data |= iec->preamble[PREAMBLE_X];	/* even sub frame, 'X' */
-
+static inline u_int32_t iec958_subframe(snd_pcm_iec958_t *iec, u_int32_t data, int channel)
+{
+	data = iec958_subframe_bits(data, iec->frame_bits[iec->counter][channel ? 1 : 0]);
 	if (iec->byteswap)
 		data = bswap_32(data);
 
@@ -141,6 +142,92 @@ static inline int32_t iec958_to_s32(snd_pcm_iec958_t *iec, u_int32_t data)
 	return (int32_t)data;
 }
 
+/*
+ * Interleaved S32 or S16 samples to subframes, a whole frame per
+ * iteration.  The vector path handles two stereo frames at once.
+ */
+static inline void iec958_encode_frames(snd_pcm_iec958_t *iec, u_int32_t *dst,
+					const void *src, unsigned int width,
+					unsigned int channels,
+					snd_pcm_uframes_t frames)
+{
+	const int16_t *src16 = src;
+	const u_int32_t *src32 = src;
+	unsigned int counter = iec->counter;
+	unsigned int channel;
+
+#ifdef __SSE2__
+	if (channels == 2) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i m0f = _mm_set1_epi32(0xf);
+		const __m128i mff00 = _mm_set1_epi32(0xff00);
+		const __m128i mff0000 = _mm_set1_epi32(0xff0000);
+		for (; frames >= 2; frames -= 2) {
+			__m128i d, p;
+			if (width == 16) {
+				d = _mm_unpacklo_epi16(zero, _mm_loadl_epi64((const __m128i *)src16));
+				src16 += 4;
+			} else {
+				d = _mm_loadu_si128((const __m128i *)src32);
+				src32 += 4;
+			}
+			d = _mm_andnot_si128(m0f, _mm_srli_epi32(d, 4));
+			p = _mm_xor_si128(d, _mm_srli_epi32(d, 16));
+			p = _mm_xor_si128(p, _mm_srli_epi32(p, 8));
+			p = _mm_xor_si128(p, _mm_srli_epi32(p, 4));
+			p = _mm_xor_si128(p, _mm_srli_epi32(p, 2));
+			p = _mm_xor_si128(p, _mm_srli_epi32(p, 1));
+			d = _mm_or_si128(d, _mm_loadu_si128((const __m128i *)iec->frame_bits[counter]));
+			d = _mm_xor_si128(d, _mm_slli_epi32(p, 31));
+			if (iec->byteswap) {
+				__m128i lo = _mm_or_si128(_mm_slli_epi32(d, 24), _mm_srli_epi32(d, 24));
+				__m128i mid = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(d, 8), mff0000),
+							   _mm_and_si128(_mm_srli_epi32(d, 8), mff00));
+				d = _mm_or_si128(lo, mid);
+			}
+			_mm_storeu_si128((__m128i *)dst, d);
+			dst += 4;
+			counter += 2;
+			if (counter >= 192)
+				counter -= 192;
+		}
+	}
+#endif
+	for (; frames > 0; frames--) {
+		const u_int32_t *bits = iec->frame_bits[counter];
+		for (channel = 0; channel < channels; channel++) {
+			u_int32_t data;
+			if (width == 16)
+				data = (u_int32_t)(u_int16_t)*src16++ << 16;
+			else
+				data = *src32++;
+			data = iec958_subframe_bits(data, bits[channel ? 1 : 0]);
+			if (iec->byteswap)
+				data = bswap_32(data);
+			*dst++ = data;
+		}
+		if (++counter == 192)
+			counter = 0;
+	}
+	iec->counter = counter;
+}
+
+static inline void iec958_decode_run(snd_pcm_iec958_t *iec, void *dst,
+				     const u_int32_t *src, unsigned int width,
+				     snd_pcm_uframes_t n)
+{
+	int16_t *dst16 = dst;
+	int32_t *dst32 = dst;
+
+	for (; n > 0; n--) {
+		int32_t sample = iec958_to_s32(iec, *src++);
+		if (width == 16)
+			*dst16++ = sample >> 16;
+		else
+			*dst32++ = sample;
+	}
+}
+
 #ifndef DOC_HIDDEN
 static void snd_pcm_iec958_decode(snd_pcm_iec958_t *iec,
 				  const snd_pcm_channel_area_t *dst_areas,
@@ -154,6 +241,21 @@ static void snd_pcm_iec958_decode(snd_pcm_iec958_t *iec,
 #undef PUT32_LABELS
 	void *put = put32_labels[iec->getput_idx];
 	unsigned int channel;
+
+	if (snd_pcm_plugin_areas_interleaved(src_areas, channels, 32)) {
+		const u_int32_t *src = snd_pcm_channel_area_addr(src_areas, src_offset);
+		void *dst = snd_pcm_channel_area_addr(dst_areas, dst_offset);
+		if (iec->getput_idx == (unsigned int)snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S32) &&
+		    snd_pcm_plugin_areas_interleaved(dst_areas, channels, 32)) {
+			iec958_decode_run(iec, dst, src, 32, frames * channels);
+			return;
+		}
+		if (iec->getput_idx == (unsigned int)snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S16) &&
+		    snd_pcm_plugin_areas_interleaved(dst_areas, channels, 16)) {
+			iec958_decode_run(iec, dst, src, 16, frames * channels);
+			return;
+		}
+	}
 	for (channel = 0; channel < channels; ++channel) {
 		const u_int32_t *src;
 		char *dst;
@@ -193,6 +295,21 @@ static void snd_pcm_iec958_encode(snd_pcm_iec958_t *iec,
 	unsigned int channel;
 	int32_t sample = 0;
 	int counter = iec->counter;
+
+	if (snd_pcm_plugin_areas_interleaved(dst_areas, channels, 32)) {
+		const void *src = snd_pcm_channel_area_addr(src_areas, src_offset);
+		u_int32_t *dst = snd_pcm_channel_area_addr(dst_areas, dst_offset);
+		if (iec->getput_idx == (unsigned int)snd_pcm_linear_get_index(SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S32) &&
+		    snd_pcm_plugin_areas_interleaved(src_areas, channels, 32)) {
+			iec958_encode_frames(iec, dst, src, 32, channels, frames);
+			return;
+		}
+		if (iec->getput_idx == (unsigned int)snd_pcm_linear_get_index(SND_PCM_FORMAT_S16, SND_PCM_FORMAT_S32) &&
+		    snd_pcm_plugin_areas_interleaved(src_areas, channels, 16)) {
+			iec958_encode_frames(iec, dst, src, 16, channels, frames);
+			return;
+		}
+	}
 	for (channel = 0; channel < channels; ++channel) {
 		const char *src;
 		u_int32_t *dst;
@@ -518,6 +635,7 @@ int snd_pcm_iec958_open(snd_pcm_t **pcmp, const char *name, snd_pcm_format_t sfo
 		memcpy(iec->status, default_status_bits, sizeof(default_status_bits));
 
 	memcpy(iec->preamble, preamble_vals, 3);
+	iec958_init_frame_bits(iec);
 
 	err = snd_pcm_new(&pcm, SND_PCM_TYPE_IEC958, name, slave->stream, slave->mode);
 	if (err < 0) {
@@ -535,6 +653,7 @@ int snd_pcm_iec958_open(snd_pcm_t **pcmp, const char *name, snd_pcm_format_t sfo
 	pcm->poll_fd = slave->poll_fd;
 	pcm->poll_events = slave->poll_events;
 	pcm->monotonic = slave->monotonic;
+	pcm->trace = slave->trace;
 	snd_pcm_set_hw_ptr(pcm, &iec->plug.hw_ptr, -1, 0);
 	snd_pcm_set_appl_ptr(pcm, &iec->plug.appl_ptr, -1, 0);
 	*pcmp = pcm;
@@ -45,6 +45,8 @@ typedef struct snd_pcm_ioplug_priv {
 	unsigned int last_hw;
 	snd_pcm_uframes_t avail_max;
 	snd_htimestamp_t trigger_tstamp;
+	int mmap_fd;			/* exported buffer, -1 = local buffer */
+	off_t mmap_offset;
 } ioplug_priv_t;
 
 /* update the hw pointer */
@@ -82,7 +84,20 @@ static int snd_pcm_ioplug_info(snd_pcm_t *pcm, snd_pcm_info_t *info)
 
 static int snd_pcm_ioplug_channel_info(snd_pcm_t *pcm, snd_pcm_channel_info_t *info)
 {
-	return snd_pcm_channel_info_shm(pcm, info, -1);
+	ioplug_priv_t *io = pcm->private_data;
+	int err;
+
+	err = snd_pcm_channel_info_shm(pcm, info, -1);
+	if (err < 0 || io->mmap_fd < 0)
+		return err;
+	/* all channels share one mapping of the plugin buffer */
+	if (pcm->access == SND_PCM_ACCESS_MMAP_NONINTERLEAVED ||
+	    pcm->access == SND_PCM_ACCESS_RW_NONINTERLEAVED)
+		info->first = info->channel * pcm->buffer_size * pcm->sample_bits;
+	info->type = SND_PCM_AREA_MMAP;
+	info->u.mmap.fd = io->mmap_fd;
+	info->u.mmap.offset = io->mmap_offset;
+	return 0;
 }
 
 static int snd_pcm_ioplug_status(snd_pcm_t *pcm, snd_pcm_status_t * status)
@@ -414,6 +429,18 @@ static int snd_pcm_ioplug_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 		INTERNAL(snd_pcm_hw_params_get_period_size)(params, &io->data->period_size, 0);
 		INTERNAL(snd_pcm_hw_params_get_buffer_size)(params, &io->data->buffer_size);
 	}
+	io->mmap_fd = -1;
+	if (io->data->version >= 0x010003 &&
+	    io->data->callback->mmap_fd) {
+		off_t offset = 0;
+		err = io->data->callback->mmap_fd(io->data, &offset);
+		if (err >= 0) {
+			io->mmap_fd = err;
+			io->mmap_offset = offset;
+		}
+	}
+	/* read/write go through the exported buffer as well */
+	pcm->mmap_rw = io->mmap_fd >= 0 ? 1 : io->data->mmap_rw;
 	return 0;
 }
 
@@ -421,6 +448,8 @@ static int snd_pcm_ioplug_hw_free(snd_pcm_t *pcm)
 {
 	ioplug_priv_t *io = pcm->private_data;
 
+	io->mmap_fd = -1;
+	pcm->mmap_rw = io->data->mmap_rw;
 	if (io->data->callback->hw_free)
 		return io->data->callback->hw_free(io->data);
 	return 0;
@@ -599,13 +628,26 @@ static snd_pcm_sframes_t snd_pcm_ioplug_readn(snd_pcm_t *pcm, void **bufs, snd_p
 	}
 }
 
+/*
+ * Whether mmap commits and avail updates call the transfer callback:
+ * with mmap access, and with an exported buffer whatever the access
+ * is, since read/write then go through the mmap path
+ */
+static int ioplug_priv_mmap_transfer(snd_pcm_t *pcm)
+{
+	ioplug_priv_t *io = pcm->private_data;
+
+	return io->mmap_fd >= 0 ||
+	       (pcm->access != SND_PCM_ACCESS_RW_INTERLEAVED &&
+		pcm->access != SND_PCM_ACCESS_RW_NONINTERLEAVED);
+}
+
 static snd_pcm_sframes_t snd_pcm_ioplug_mmap_commit(snd_pcm_t *pcm,
 						    snd_pcm_uframes_t offset,
 						    snd_pcm_uframes_t size)
 {
 	if (pcm->stream == SND_PCM_STREAM_PLAYBACK &&
-	    pcm->access != SND_PCM_ACCESS_RW_INTERLEAVED &&
-	    pcm->access != SND_PCM_ACCESS_RW_NONINTERLEAVED) {
+	    ioplug_priv_mmap_transfer(pcm)) {
 		const snd_pcm_channel_area_t *areas;
 		snd_pcm_uframes_t ofs, frames = size;
 
@@ -628,8 +670,7 @@ static snd_pcm_sframes_t snd_pcm_ioplug_avail_update(snd_pcm_t *pcm)
 	if (io->data->state == SND_PCM_STATE_XRUN)
 		return -EPIPE;
 	if (pcm->stream == SND_PCM_STREAM_CAPTURE &&
-	    pcm->access != SND_PCM_ACCESS_RW_INTERLEAVED &&
-	    pcm->access != SND_PCM_ACCESS_RW_NONINTERLEAVED) {
+	    ioplug_priv_mmap_transfer(pcm)) {
 		if (io->data->callback->transfer) {
 			const snd_pcm_channel_area_t *areas;
 			snd_pcm_uframes_t offset, size = UINT_MAX;
@@ -751,6 +792,9 @@ static void snd_pcm_ioplug_dump(snd_pcm_t *pcm, snd_output_t *out)
 			snd_output_printf(out, "%s\n", io->data->name);
 		else
 			snd_output_printf(out, "IO-PCM Plugin\n");
+		if (io->mmap_fd >= 0)
+			snd_output_printf(out, "Exported buffer: fd %d, offset %lld\n",
+					  io->mmap_fd, (long long)io->mmap_offset);
 		if (pcm->setup) {
 			snd_output_printf(out, "Its setup is:\n");
 			snd_pcm_dump_setup(pcm, out);
@@ -871,6 +915,18 @@ When poll_fd, poll_events and mmap_rw fields are changed after
 #snd_pcm_ioplug_create(), call #snd_pcm_ioplug_reinit_status() to
 reflect the changes.
 
+Instead of the local buffer, a plugin can hand out its own ring buffer
+through the mmap_fd callback (since v1.0.3), typically a memfd which
+the plugin has mapped itself and feeds to its socket or device.  The
+buffer holds buffer_size frames in the layout of the access type
+(non-interleaved channels follow each other).  #snd_pcm_mmap_begin()
+then returns areas in this very memory, and the read/write calls copy
+straight into it, so the transfer callback does not need to copy any
+more.  It is still called as a notification for every committed range,
+whatever the access type, with areas pointing into the shared buffer:
+on playback after the frames have been written, on capture from the
+avail update before the frames are read.
+
 The driver can set an arbitrary value (pointer) to private_data
 field to refer its own data in the callbacks.
 
@@ -907,6 +963,9 @@ used to modify poll events.  If the driver needs to mangle the native
 poll events to proper poll events for PCM, you can do it in this
 callback.
 
+The mmap_fd callback is called after hw_params to export the plugin
+buffer as described above.
+
 Finally, the dump callback is used to print the status of the plugin.
 
 The hw_params constraints can be defined via either
@@ -958,6 +1017,7 @@ int snd_pcm_ioplug_create(snd_pcm_ioplug_t *ioplug, const char *name,
 	io = calloc(1, sizeof(*io));
 	if (! io)
 		return -ENOMEM;
+	io->mmap_fd = -1;
 
 	io->data = ioplug;
 	ioplug->state = SND_PCM_STATE_OPEN;
@@ -1079,12 +1139,12 @@ int snd_pcm_ioplug_reinit_status(snd_pcm_ioplug_t *ioplug)
  * \param ioplug the ioplug handle
  * \return the mmap channel areas if available, or NULL
  *
- * Returns the mmap channel areas if available.  When mmap_rw field is not set,
- * this function always returns NULL.
+ * Returns the mmap channel areas if available.  When neither mmap_rw field
+ * is set nor the buffer is exported, this function always returns NULL.
  */
 const snd_pcm_channel_area_t *snd_pcm_ioplug_mmap_areas(snd_pcm_ioplug_t *ioplug)
 {
-	if (ioplug->mmap_rw)
+	if (ioplug->mmap_rw || ioplug->pcm->mmap_rw)
 		return snd_pcm_mmap_areas(ioplug->pcm);
 	return NULL;
 }
@@ -34,11 +34,16 @@
   
 #include <dirent.h>
 #include <locale.h>
+#include <sys/mman.h>
 #ifndef HAVE_SOFT_FLOAT
 #include <math.h>
 #endif
 #include "pcm_local.h"
 #include "pcm_plugin.h"
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #include "ladspa.h"
 
@@ -56,7 +61,18 @@ typedef enum _snd_pcm_ladspa_policy {
 	SND_PCM_LADSPA_POLICY_DUPLICATE		/* duplicate bindings for all channels */
 } snd_pcm_ladspa_policy_t;
 
+typedef struct snd_pcm_ladspa_instance snd_pcm_ladspa_instance_t;
+
 typedef struct {
+	struct snd_pcm_ladspa *ladspa;
+#ifdef HAVE_LIBPTHREAD
+	pthread_t thread;
+#endif
+	snd_pcm_ladspa_instance_t **run;	/* instances of this worker in chain order */
+	unsigned int run_count;
+} snd_pcm_ladspa_worker_t;
+
+typedef struct snd_pcm_ladspa {
 	/* This field need to be the first */
 	snd_pcm_plugin_t plug;
 	/* Plugin custom fields */
@@ -65,6 +81,27 @@ typedef struct {
 	unsigned int channels;			/* forced input channels, 0 = auto */
 	unsigned int allocated;			/* count of allocated samples */
 	LADSPA_Data *zero[2];			/* zero input or dummy output */
+	void *arena;				/* all sample buffers, see allocate_memory */
+	size_t arena_size;
+	size_t arena_used;
+	unsigned int block_size;		/* fixed processing block, 0 = follow transfers */
+	snd_pcm_channel_area_t *fifo;		/* input channels, then output channels */
+	unsigned int fifo_pos;			/* frames queued in the current block */
+	snd_pcm_fast_ops_t fops;
+	unsigned int threads;			/* max threads running instances, 0 = serial */
+	snd_pcm_ladspa_worker_t *workers;	/* workers[0] is the caller of read/write */
+	unsigned int nworkers;
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_t start;			/* held while the workers are created */
+	pthread_barrier_t barrier;		/* waited twice per block */
+	int quit;				/* 1 = leave at the next block, 2 = not running */
+#endif
+	/* the block being processed, valid between the barriers */
+	const snd_pcm_channel_area_t *in_areas;
+	snd_pcm_uframes_t in_offset;
+	const snd_pcm_channel_area_t *out_areas;
+	snd_pcm_uframes_t out_offset;
+	unsigned int block;
 } snd_pcm_ladspa_t;
  
 typedef struct {
@@ -77,18 +114,20 @@ typedef struct {
         snd_pcm_ladspa_array_t ports;
 	LADSPA_Data **m_data;
         LADSPA_Data **data;
+	LADSPA_Data **connected;		/* last address given to connect_port */
 } snd_pcm_ladspa_eps_t;
 
-typedef struct snd_pcm_ladspa_instance {
+struct snd_pcm_ladspa_instance {
 	struct list_head list;
 	const LADSPA_Descriptor *desc;
 	LADSPA_Handle *handle;
 	unsigned int depth;
+	unsigned int group;			/* instances sharing no channel differ */
 	snd_pcm_ladspa_eps_t input;
 	snd_pcm_ladspa_eps_t output;
 	struct snd_pcm_ladspa_instance *prev;
 	struct snd_pcm_ladspa_instance *next;
-} snd_pcm_ladspa_instance_t;
+};
 
 typedef struct {
 	LADSPA_PortDescriptor pdesc;		/* port description */
@@ -194,17 +233,30 @@ static void snd_pcm_ladspa_free_plugins(struct list_head *plugins)
 	}
 }
 
-static void snd_pcm_ladspa_free(snd_pcm_ladspa_t *ladspa)
+static void snd_pcm_ladspa_free_workers(snd_pcm_ladspa_t *ladspa);
+
+static void snd_pcm_ladspa_free_memory(snd_pcm_ladspa_t *ladspa)
 {
-        unsigned int idx;
+	if (ladspa->arena)
+		munmap(ladspa->arena, ladspa->arena_size);
+	ladspa->arena = NULL;
+	ladspa->arena_size = ladspa->arena_used = 0;
+	ladspa->zero[0] = ladspa->zero[1] = NULL;
+	free(ladspa->fifo);
+	ladspa->fifo = NULL;
+	ladspa->fifo_pos = 0;
+}
 
+static void snd_pcm_ladspa_free(snd_pcm_ladspa_t *ladspa)
+{
+	snd_pcm_ladspa_free_workers(ladspa);
 	snd_pcm_ladspa_free_plugins(&ladspa->pplugins);
 	snd_pcm_ladspa_free_plugins(&ladspa->cplugins);
-	for (idx = 0; idx < 2; idx++) {
-		free(ladspa->zero[idx]);
-                ladspa->zero[idx] = NULL;
-        }
+	snd_pcm_ladspa_free_memory(ladspa);
         ladspa->allocated = 0;
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_destroy(&ladspa->start);
+#endif
 }
 
 static int snd_pcm_ladspa_close(snd_pcm_t *pcm)
@@ -321,7 +373,6 @@ static void snd_pcm_ladspa_free_eps(snd_pcm_ladspa_eps_t *eps)
 static void snd_pcm_ladspa_free_instances(snd_pcm_t *pcm, snd_pcm_ladspa_t *ladspa, int cleanup)
 {
 	struct list_head *list, *pos, *pos1, *next1;
-	unsigned int idx;
 	
 	list = pcm->stream == SND_PCM_STREAM_PLAYBACK ? &ladspa->pplugins : &ladspa->cplugins;
 	list_for_each(pos, list) {
@@ -333,18 +384,13 @@ static void snd_pcm_ladspa_free_instances(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
 			if (cleanup) {
 				if (plugin->desc->cleanup)
 					plugin->desc->cleanup(instance->handle);
-				if (instance->input.m_data) {
-				        for (idx = 0; idx < instance->input.channels.size; idx++)
-						free(instance->input.m_data[idx]);
-					free(instance->input.m_data);
-                                }
-				if (instance->output.m_data) {
-				        for (idx = 0; idx < instance->output.channels.size; idx++)
-						free(instance->output.m_data[idx]);
-					free(instance->output.m_data);
-                                }
+				/* m_data points into the arena */
+				free(instance->input.m_data);
+				free(instance->output.m_data);
                                 free(instance->input.data);
                                 free(instance->output.data);
+                                free(instance->input.connected);
+                                free(instance->output.connected);
 				list_del(&(instance->list));
 				snd_pcm_ladspa_free_eps(&instance->input);
 				snd_pcm_ladspa_free_eps(&instance->output);
@@ -358,6 +404,8 @@ static void snd_pcm_ladspa_free_instances(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
 			assert(list_empty(&plugin->instances));
 		}
 	}
+	if (cleanup)
+		snd_pcm_ladspa_free_memory(ladspa);
 }
 
 static int snd_pcm_ladspa_add_to_carray(snd_pcm_ladspa_array_t *array,
@@ -681,25 +729,126 @@ static int snd_pcm_ladspa_allocate_instances(snd_pcm_t *pcm, snd_pcm_ladspa_t *l
 	return 0;
 }
 
+#define LADSPA_ALIGN		64
+#define LADSPA_HUGEPAGE		(2 * 1024 * 1024)
+
+static size_t snd_pcm_ladspa_buffer_bytes(snd_pcm_ladspa_t *ladspa)
+{
+	size_t bytes = ladspa->allocated * sizeof(LADSPA_Data);
+
+	return (bytes + LADSPA_ALIGN - 1) & ~(size_t)(LADSPA_ALIGN - 1);
+}
+
+/*
+ * All sample buffers live in one anonymous mapping, so every buffer
+ * starts on a cache line and big chains get huge pages when the
+ * system has some reserved (or transparent ones otherwise).
+ */
+static int snd_pcm_ladspa_allocate_arena(snd_pcm_ladspa_t *ladspa, unsigned int buffers)
+{
+	size_t size = buffers * snd_pcm_ladspa_buffer_bytes(ladspa);
+	void *arena = MAP_FAILED;
+
+	assert(ladspa->arena == NULL);
+#ifdef MAP_HUGETLB
+	if (size >= LADSPA_HUGEPAGE) {
+		size = (size + LADSPA_HUGEPAGE - 1) & ~(size_t)(LADSPA_HUGEPAGE - 1);
+		arena = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	}
+#endif
+	if (arena == MAP_FAILED) {
+		arena = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (arena == MAP_FAILED)
+			return -ENOMEM;
+#ifdef MADV_HUGEPAGE
+		if (size >= LADSPA_HUGEPAGE)
+			madvise(arena, size, MADV_HUGEPAGE);
+#endif
+	}
+	ladspa->arena = arena;
+	ladspa->arena_size = size;
+	ladspa->arena_used = 0;
+	return 0;
+}
+
+/* the arena is mapped fresh, hence zeroed, by every init */
+static LADSPA_Data *snd_pcm_ladspa_arena_get(snd_pcm_ladspa_t *ladspa)
+{
+	size_t bytes = snd_pcm_ladspa_buffer_bytes(ladspa);
+	void *res;
+
+	if (ladspa->arena_used + bytes > ladspa->arena_size)
+		return NULL;
+	res = (char *)ladspa->arena + ladspa->arena_used;
+	ladspa->arena_used += bytes;
+	return res;
+}
+
 static LADSPA_Data *snd_pcm_ladspa_allocate_zero(snd_pcm_ladspa_t *ladspa, unsigned int idx)
 {
         if (ladspa->zero[idx] == NULL)
-                ladspa->zero[idx] = calloc(ladspa->allocated, sizeof(LADSPA_Data));
+                ladspa->zero[idx] = snd_pcm_ladspa_arena_get(ladspa);
         return ladspa->zero[idx];
 }
 
+/*
+ * With a fixed block size the transfers go through a FIFO of one
+ * block per channel. The instances always see the start of these
+ * buffers, whatever the period size is.
+ */
+static int snd_pcm_ladspa_allocate_fifo(snd_pcm_ladspa_t *ladspa,
+					unsigned int ichannels,
+					unsigned int ochannels)
+{
+	unsigned int idx;
+
+	ladspa->fifo = calloc(ichannels + ochannels, sizeof(*ladspa->fifo));
+	if (ladspa->fifo == NULL)
+		return -ENOMEM;
+	for (idx = 0; idx < ichannels + ochannels; idx++) {
+		ladspa->fifo[idx].addr = snd_pcm_ladspa_arena_get(ladspa);
+		if (ladspa->fifo[idx].addr == NULL)
+			return -ENOMEM;
+		ladspa->fifo[idx].first = 0;
+		ladspa->fifo[idx].step = sizeof(LADSPA_Data) * 8;
+	}
+	ladspa->fifo_pos = 0;
+	return 0;
+}
+
+/* drop whatever the FIFO holds from a previous run */
+static void snd_pcm_ladspa_reset_fifo(snd_pcm_t *pcm, snd_pcm_ladspa_t *ladspa)
+{
+	unsigned int ichannels, ochannels;
+
+	if (ladspa->fifo == NULL)
+		return;
+	ichannels = pcm->channels;
+	ochannels = ladspa->plug.gen.slave->channels;
+	snd_pcm_areas_silence(ladspa->fifo, 0, ichannels + ochannels,
+			      ladspa->block_size, SND_PCM_FORMAT_FLOAT);
+	ladspa->fifo_pos = 0;
+}
+
 static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *ladspa)
 {
 	struct list_head *list, *pos, *pos1;
 	snd_pcm_ladspa_instance_t *instance;
 	unsigned int channels = 16, nchannels;
-	unsigned int ichannels, ochannels;
+	unsigned int ichannels, ochannels, buffers = 2;
 	void **pchannels, **npchannels;
 	unsigned int idx, chn;
+	int err;
 	
-        ladspa->allocated = 2048;
-        if (pcm->buffer_size > ladspa->allocated)
-                ladspa->allocated = pcm->buffer_size;
+	if (ladspa->block_size) {
+		ladspa->allocated = ladspa->block_size;
+	} else {
+	        ladspa->allocated = 2048;
+	        if (pcm->buffer_size > ladspa->allocated)
+	                ladspa->allocated = pcm->buffer_size;
+	}
         if (pcm->stream == SND_PCM_STREAM_PLAYBACK) {
                 ichannels = pcm->channels;
                 ochannels = ladspa->plug.gen.slave->channels;
@@ -707,10 +856,27 @@ static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
                 ichannels = ladspa->plug.gen.slave->channels;
                 ochannels = pcm->channels;
         }
+	list = pcm->stream == SND_PCM_STREAM_PLAYBACK ? &ladspa->pplugins : &ladspa->cplugins;
+	list_for_each(pos, list) {
+		snd_pcm_ladspa_plugin_t *plugin = list_entry(pos, snd_pcm_ladspa_plugin_t, list);
+		list_for_each(pos1, &plugin->instances) {
+			instance = list_entry(pos1, snd_pcm_ladspa_instance_t, list);
+			buffers += instance->output.channels.size;
+		}
+	}
+	if (ladspa->block_size)
+		buffers += ichannels + ochannels;
+	err = snd_pcm_ladspa_allocate_arena(ladspa, buffers);
+	if (err < 0)
+		return err;
+	if (ladspa->block_size) {
+		err = snd_pcm_ladspa_allocate_fifo(ladspa, ichannels, ochannels);
+		if (err < 0)
+			return err;
+	}
 	pchannels = calloc(1, sizeof(void *) * channels);
 	if (pchannels == NULL)
 	        return -ENOMEM;
-	list = pcm->stream == SND_PCM_STREAM_PLAYBACK ? &ladspa->pplugins : &ladspa->cplugins;
 	list_for_each(pos, list) {
 		snd_pcm_ladspa_plugin_t *plugin = list_entry(pos, snd_pcm_ladspa_plugin_t, list);
 		list_for_each(pos1, &plugin->instances) {
@@ -746,10 +912,14 @@ static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
                         instance->input.m_data = calloc(instance->input.channels.size, sizeof(void *));
                         instance->output.data = calloc(instance->output.channels.size, sizeof(void *));
                         instance->output.m_data = calloc(instance->output.channels.size, sizeof(void *));
+                        instance->input.connected = calloc(instance->input.channels.size, sizeof(void *));
+                        instance->output.connected = calloc(instance->output.channels.size, sizeof(void *));
                         if (instance->input.data == NULL ||
                             instance->input.m_data == NULL ||
                             instance->output.data == NULL ||
-                            instance->output.m_data == NULL) {
+                            instance->output.m_data == NULL ||
+                            instance->input.connected == NULL ||
+                            instance->output.connected == NULL) {
                                 free(pchannels);
                                 return -ENOMEM;
                         }
@@ -772,7 +942,7 @@ static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
 			        chn = instance->output.channels.array[idx];
                                 /* FIXME/OPTIMIZE: check if we can remove double alloc */
                                 /* if LADSPA plugin has no broken inplace */
-                                instance->output.data[idx] = malloc(sizeof(LADSPA_Data) * ladspa->allocated);
+                                instance->output.data[idx] = snd_pcm_ladspa_arena_get(ladspa);
                                 if (instance->output.data[idx] == NULL) {
                                         free(pchannels);
                                         return -ENOMEM;
@@ -792,7 +962,7 @@ static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
                         for (idx = 0; idx < instance->output.channels.size; idx++) {
         			chn = instance->output.channels.array[idx];
                                 if (instance->output.data[idx] == pchannels[chn]) {
-					free(instance->output.m_data[idx]);
+					/* the buffer stays unused in the arena */
 					instance->output.m_data[idx] = NULL;
                                         if (chn < ochannels) {
                                                 instance->output.data[idx] = NULL;
@@ -825,11 +995,305 @@ static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
 	return 0;
 }
 
+static void snd_pcm_ladspa_connect_port(snd_pcm_ladspa_instance_t *instance,
+					snd_pcm_ladspa_eps_t *eps,
+					unsigned int idx,
+					LADSPA_Data *data)
+{
+	if (eps->connected[idx] == data)
+		return;
+	instance->desc->connect_port(instance->handle, eps->ports.array[idx], data);
+	eps->connected[idx] = data;
+}
+
+static void snd_pcm_ladspa_run_instance(snd_pcm_ladspa_t *ladspa,
+					snd_pcm_ladspa_instance_t *instance)
+{
+	LADSPA_Data *data;
+	unsigned int idx, chn;
+
+	for (idx = 0; idx < instance->input.channels.size; idx++) {
+		chn = instance->input.channels.array[idx];
+		data = instance->input.data[idx];
+		if (data == NULL) {
+			data = (LADSPA_Data *)((char *)ladspa->in_areas[chn].addr + (ladspa->in_areas[chn].first / 8));
+			data += ladspa->in_offset;
+		}
+		snd_pcm_ladspa_connect_port(instance, &instance->input, idx, data);
+	}
+	for (idx = 0; idx < instance->output.channels.size; idx++) {
+		chn = instance->output.channels.array[idx];
+		data = instance->output.data[idx];
+		if (data == NULL) {
+			data = (LADSPA_Data *)((char *)ladspa->out_areas[chn].addr + (ladspa->out_areas[chn].first / 8));
+			data += ladspa->out_offset;
+		}
+		snd_pcm_ladspa_connect_port(instance, &instance->output, idx, data);
+	}
+	instance->desc->run(instance->handle, ladspa->block);
+}
+
+static void snd_pcm_ladspa_run_worker(snd_pcm_ladspa_worker_t *worker)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < worker->run_count; idx++)
+		snd_pcm_ladspa_run_instance(worker->ladspa, worker->run[idx]);
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void *snd_pcm_ladspa_worker_thread(void *data)
+{
+	snd_pcm_ladspa_worker_t *worker = data;
+	snd_pcm_ladspa_t *ladspa = worker->ladspa;
+
+	pthread_mutex_lock(&ladspa->start);
+	pthread_mutex_unlock(&ladspa->start);
+	if (ladspa->quit == 2)
+		return NULL;
+	while (1) {
+		pthread_barrier_wait(&ladspa->barrier);
+		if (ladspa->quit)
+			break;
+		snd_pcm_ladspa_run_worker(worker);
+		pthread_barrier_wait(&ladspa->barrier);
+	}
+	return NULL;
+}
+#endif
+
+static void snd_pcm_ladspa_free_workers(snd_pcm_ladspa_t *ladspa)
+{
+	unsigned int idx;
+
+	if (ladspa->workers == NULL)
+		return;
+#ifdef HAVE_LIBPTHREAD
+	if (ladspa->quit == 0) {
+		ladspa->quit = 1;
+		pthread_barrier_wait(&ladspa->barrier);
+		for (idx = 1; idx < ladspa->nworkers; idx++)
+			pthread_join(ladspa->workers[idx].thread, NULL);
+		pthread_barrier_destroy(&ladspa->barrier);
+		ladspa->quit = 2;
+	}
+#endif
+	for (idx = 0; idx < ladspa->nworkers; idx++)
+		free(ladspa->workers[idx].run);
+	free(ladspa->workers);
+	ladspa->workers = NULL;
+	ladspa->nworkers = 0;
+}
+
+static unsigned int snd_pcm_ladspa_group_find(unsigned int *parent, unsigned int idx)
+{
+	while (parent[idx] != idx)
+		idx = parent[idx] = parent[parent[idx]];
+	return idx;
+}
+
+static void snd_pcm_ladspa_group_join(unsigned int *parent, unsigned int a, unsigned int b)
+{
+	a = snd_pcm_ladspa_group_find(parent, a);
+	b = snd_pcm_ladspa_group_find(parent, b);
+	if (a < b)
+		parent[b] = a;
+	else
+		parent[a] = b;
+}
+
+/*
+ * Split the instances into groups which do not share any channel, so
+ * they can run at the same time. A group keeps the chain order. The
+ * groups are spread over the workers, the biggest ones first, and the
+ * workers beyond the first one get their own pinned thread.
+ */
+static int snd_pcm_ladspa_allocate_workers(snd_pcm_t *pcm, snd_pcm_ladspa_t *ladspa)
+{
+	struct list_head *list, *pos, *pos1;
+	snd_pcm_ladspa_instance_t *instance, **instances = NULL;
+	unsigned int *parent = NULL, *owner = NULL, *gsize = NULL, *gworker = NULL;
+	unsigned int count = 0, nchannels = 0, ngroups = 0, nworkers;
+	unsigned int idx, chn, dummy = NO_ASSIGN, k;
+	int err = -ENOMEM;
+
+	list = pcm->stream == SND_PCM_STREAM_PLAYBACK ? &ladspa->pplugins : &ladspa->cplugins;
+	list_for_each(pos, list) {
+		snd_pcm_ladspa_plugin_t *plugin = list_entry(pos, snd_pcm_ladspa_plugin_t, list);
+		list_for_each(pos1, &plugin->instances) {
+			instance = list_entry(pos1, snd_pcm_ladspa_instance_t, list);
+			for (idx = 0; idx < instance->input.channels.size; idx++)
+				if (instance->input.channels.array[idx] >= nchannels)
+					nchannels = instance->input.channels.array[idx] + 1;
+			for (idx = 0; idx < instance->output.channels.size; idx++)
+				if (instance->output.channels.array[idx] >= nchannels)
+					nchannels = instance->output.channels.array[idx] + 1;
+			count++;
+		}
+	}
+	if (ladspa->threads < 2 || count < 2)
+		return 0;
+	instances = malloc(count * sizeof(*instances));
+	parent = malloc(count * sizeof(*parent));
+	gsize = calloc(count, sizeof(*gsize));
+	gworker = malloc(count * sizeof(*gworker));
+	owner = malloc((nchannels + 1) * sizeof(*owner));
+	if (!instances || !parent || !gsize || !gworker || !owner)
+		goto _end;
+	for (chn = 0; chn < nchannels; chn++)
+		owner[chn] = NO_ASSIGN;
+	count = 0;
+	list_for_each(pos, list) {
+		snd_pcm_ladspa_plugin_t *plugin = list_entry(pos, snd_pcm_ladspa_plugin_t, list);
+		list_for_each(pos1, &plugin->instances) {
+			instance = list_entry(pos1, snd_pcm_ladspa_instance_t, list);
+			instances[count] = instance;
+			parent[count] = count;
+			for (idx = 0; idx < instance->input.channels.size + instance->output.channels.size; idx++) {
+				if (idx < instance->input.channels.size)
+					chn = instance->input.channels.array[idx];
+				else
+					chn = instance->output.channels.array[idx - instance->input.channels.size];
+				if (owner[chn] == NO_ASSIGN)
+					owner[chn] = count;
+				else
+					snd_pcm_ladspa_group_join(parent, owner[chn], count);
+			}
+			/* all unused outputs share one dummy area */
+			for (idx = 0; idx < instance->output.channels.size; idx++) {
+				if (instance->output.data[idx] == NULL ||
+				    instance->output.data[idx] != ladspa->zero[1])
+					continue;
+				if (dummy == NO_ASSIGN)
+					dummy = count;
+				else
+					snd_pcm_ladspa_group_join(parent, dummy, count);
+			}
+			count++;
+		}
+	}
+	for (idx = 0; idx < count; idx++) {
+		k = snd_pcm_ladspa_group_find(parent, idx);
+		if (k == idx)
+			ngroups++;
+		gsize[k]++;
+	}
+	nworkers = ladspa->threads < ngroups ? ladspa->threads : ngroups;
+	if (nworkers < 2) {
+		err = 0;
+		goto _end;
+	}
+	ladspa->workers = calloc(nworkers, sizeof(*ladspa->workers));
+	if (ladspa->workers == NULL)
+		goto _end;
+	ladspa->nworkers = nworkers;
+	for (k = 0; k < nworkers; k++) {
+		ladspa->workers[k].ladspa = ladspa;
+		ladspa->workers[k].run = malloc(count * sizeof(*instances));
+		if (ladspa->workers[k].run == NULL)
+			goto _end;
+	}
+	/* greedy: the biggest unassigned group to the least loaded worker */
+	for (idx = 0; idx < count; idx++)
+		gworker[idx] = NO_ASSIGN;
+	while (1) {
+		unsigned int best = NO_ASSIGN, load = NO_ASSIGN, w = 0;
+		for (idx = 0; idx < count; idx++)
+			if (gsize[idx] && gworker[idx] == NO_ASSIGN &&
+			    (best == NO_ASSIGN || gsize[idx] > gsize[best]))
+				best = idx;
+		if (best == NO_ASSIGN)
+			break;
+		for (k = 0; k < nworkers; k++) {
+			unsigned int l = 0;
+			for (idx = 0; idx < count; idx++)
+				if (gworker[idx] == k)
+					l += gsize[idx];
+			if (l < load) {
+				load = l;
+				w = k;
+			}
+		}
+		gworker[best] = w;
+	}
+	for (idx = 0; idx < count; idx++) {
+		snd_pcm_ladspa_worker_t *worker;
+		k = snd_pcm_ladspa_group_find(parent, idx);
+		instances[idx]->group = k;
+		worker = &ladspa->workers[gworker[k]];
+		worker->run[worker->run_count++] = instances[idx];
+	}
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_lock(&ladspa->start);
+	for (k = 1; k < nworkers; k++) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		cpu_set_t cpuset;
+		if (pthread_create(&ladspa->workers[k].thread, NULL,
+				   snd_pcm_ladspa_worker_thread, &ladspa->workers[k]))
+			break;
+		if (cpus > 1) {
+			CPU_ZERO(&cpuset);
+			CPU_SET(k % cpus, &cpuset);
+			pthread_setaffinity_np(ladspa->workers[k].thread, sizeof(cpuset), &cpuset);
+		}
+	}
+	if (k < nworkers || pthread_barrier_init(&ladspa->barrier, NULL, nworkers)) {
+		/* run serially, the started workers leave right away */
+		SYSERR("cannot start LADSPA workers");
+		pthread_mutex_unlock(&ladspa->start);
+		while (--k > 0)
+			pthread_join(ladspa->workers[k].thread, NULL);
+		err = 0;
+		goto _end;
+	}
+	ladspa->quit = 0;
+	pthread_mutex_unlock(&ladspa->start);
+#endif
+	err = 0;
+
+      _end:
+#ifdef HAVE_LIBPTHREAD
+	if (ladspa->quit)
+#endif
+		snd_pcm_ladspa_free_workers(ladspa);
+	free(instances);
+	free(parent);
+	free(gsize);
+	free(gworker);
+	free(owner);
+	return err;
+}
+
+/*
+ * Run all instances over one block. With workers, the caller takes
+ * its own share and both barriers frame the block.
+ */
+static void snd_pcm_ladspa_run(snd_pcm_t *pcm, snd_pcm_ladspa_t *ladspa)
+{
+	struct list_head *list, *pos, *pos1;
+
+#ifdef HAVE_LIBPTHREAD
+	if (ladspa->nworkers > 1) {
+		pthread_barrier_wait(&ladspa->barrier);
+		snd_pcm_ladspa_run_worker(&ladspa->workers[0]);
+		pthread_barrier_wait(&ladspa->barrier);
+		return;
+	}
+#endif
+	list = pcm->stream == SND_PCM_STREAM_PLAYBACK ? &ladspa->pplugins : &ladspa->cplugins;
+	list_for_each(pos, list) {
+		snd_pcm_ladspa_plugin_t *plugin = list_entry(pos, snd_pcm_ladspa_plugin_t, list);
+		list_for_each(pos1, &plugin->instances)
+			snd_pcm_ladspa_run_instance(ladspa, list_entry(pos1, snd_pcm_ladspa_instance_t, list));
+	}
+}
+
 static int snd_pcm_ladspa_init(snd_pcm_t *pcm)
 {
 	snd_pcm_ladspa_t *ladspa = pcm->private_data;
 	int err;
 	
+	snd_pcm_ladspa_free_workers(ladspa);
 	snd_pcm_ladspa_free_instances(pcm, ladspa, 1);
 	err = snd_pcm_ladspa_allocate_instances(pcm, ladspa);
 	if (err < 0) {
@@ -841,6 +1305,12 @@ static int snd_pcm_ladspa_init(snd_pcm_t *pcm)
 		snd_pcm_ladspa_free_instances(pcm, ladspa, 1);
 		return err;
 	}
+	err = snd_pcm_ladspa_allocate_workers(pcm, ladspa);
+	if (err < 0) {
+		snd_pcm_ladspa_free_instances(pcm, ladspa, 1);
+		return err;
+	}
+	snd_pcm_ladspa_reset_fifo(pcm, ladspa);
 	return 0;
 }
 
@@ -848,10 +1318,60 @@ static int snd_pcm_ladspa_hw_free(snd_pcm_t *pcm)
 {
 	snd_pcm_ladspa_t *ladspa = pcm->private_data;
 
+	snd_pcm_ladspa_free_workers(ladspa);
 	snd_pcm_ladspa_free_instances(pcm, ladspa, 1);
 	return snd_pcm_generic_hw_free(pcm);
 }
 
+/*
+ * Queue size frames into the input FIFO and take as many out of the
+ * output FIFO. A block is run each time the FIFO fills up, so every
+ * frame comes out exactly block_size frames later. in_areas NULL
+ * queues silence.
+ */
+static void snd_pcm_ladspa_transfer_fifo(snd_pcm_t *pcm, snd_pcm_ladspa_t *ladspa,
+					 const snd_pcm_channel_area_t *in_areas,
+					 snd_pcm_uframes_t in_offset,
+					 unsigned int ichannels,
+					 const snd_pcm_channel_area_t *out_areas,
+					 snd_pcm_uframes_t out_offset,
+					 unsigned int ochannels,
+					 snd_pcm_uframes_t size)
+{
+	const snd_pcm_channel_area_t *fifo_in = ladspa->fifo;
+	const snd_pcm_channel_area_t *fifo_out = ladspa->fifo + ichannels;
+	snd_pcm_uframes_t size1;
+
+	while (size > 0) {
+		size1 = ladspa->block_size - ladspa->fifo_pos;
+		if (size1 > size)
+			size1 = size;
+		snd_pcm_areas_copy(out_areas, out_offset,
+				   fifo_out, ladspa->fifo_pos,
+				   ochannels, size1, SND_PCM_FORMAT_FLOAT);
+		if (in_areas)
+			snd_pcm_areas_copy(fifo_in, ladspa->fifo_pos,
+					   in_areas, in_offset,
+					   ichannels, size1, SND_PCM_FORMAT_FLOAT);
+		else
+			snd_pcm_areas_silence(fifo_in, ladspa->fifo_pos,
+					      ichannels, size1, SND_PCM_FORMAT_FLOAT);
+		ladspa->fifo_pos += size1;
+		if (ladspa->fifo_pos == ladspa->block_size) {
+			ladspa->in_areas = fifo_in;
+			ladspa->in_offset = 0;
+			ladspa->out_areas = fifo_out;
+			ladspa->out_offset = 0;
+			ladspa->block = ladspa->block_size;
+			snd_pcm_ladspa_run(pcm, ladspa);
+			ladspa->fifo_pos = 0;
+		}
+		in_offset += size1;
+		out_offset += size1;
+		size -= size1;
+	}
+}
+
 static snd_pcm_uframes_t
 snd_pcm_ladspa_write_areas(snd_pcm_t *pcm,
 			   const snd_pcm_channel_area_t *areas,
@@ -862,10 +1382,7 @@ snd_pcm_ladspa_write_areas(snd_pcm_t *pcm,
 			   snd_pcm_uframes_t *slave_sizep)
 {
 	snd_pcm_ladspa_t *ladspa = pcm->private_data;
-	snd_pcm_ladspa_instance_t *instance;
-	struct list_head *pos, *pos1;
-	LADSPA_Data *data;
-	unsigned int idx, chn, size1, size2;
+	unsigned int size1, size2;
 	
 	if (size > *slave_sizep)
 		size = *slave_sizep;
@@ -875,35 +1392,24 @@ snd_pcm_ladspa_write_areas(snd_pcm_t *pcm,
 			   areas, offset,
 			   pcm->channels, size, pcm->format);
 #else
+	if (ladspa->block_size) {
+		snd_pcm_ladspa_transfer_fifo(pcm, ladspa,
+					     areas, offset, pcm->channels,
+					     slave_areas, slave_offset,
+					     ladspa->plug.gen.slave->channels, size);
+		*slave_sizep = size2;
+		return size2;
+	}
+	ladspa->in_areas = areas;
+	ladspa->out_areas = slave_areas;
         while (size > 0) {
                 size1 = size;
                 if (size1 > ladspa->allocated)
                         size1 = ladspa->allocated;
-        	list_for_each(pos, &ladspa->pplugins) {
-        		snd_pcm_ladspa_plugin_t *plugin = list_entry(pos, snd_pcm_ladspa_plugin_t, list);
-        		list_for_each(pos1, &plugin->instances) {
-        			instance = list_entry(pos1, snd_pcm_ladspa_instance_t, list);
-        			for (idx = 0; idx < instance->input.channels.size; idx++) {
-                                        chn = instance->input.channels.array[idx];
-                                        data = instance->input.data[idx];
-                                        if (data == NULL) {
-                                		data = (LADSPA_Data *)((char *)areas[chn].addr + (areas[chn].first / 8));
-                                       		data += offset;
-                                        }
-                                        instance->desc->connect_port(instance->handle, instance->input.ports.array[idx], data);
-        			}
-        			for (idx = 0; idx < instance->output.channels.size; idx++) {
-                                        chn = instance->output.channels.array[idx];
-                                        data = instance->output.data[idx];
-                                        if (data == NULL) {
-                                		data = (LADSPA_Data *)((char *)slave_areas[chn].addr + (areas[chn].first / 8));
-                                		data += slave_offset;
-                                        }
-					instance->desc->connect_port(instance->handle, instance->output.ports.array[idx], data);
-        			}
-        			instance->desc->run(instance->handle, size1);
-        		}
-        	}
+		ladspa->in_offset = offset;
+		ladspa->out_offset = slave_offset;
+		ladspa->block = size1;
+		snd_pcm_ladspa_run(pcm, ladspa);
         	offset += size1;
         	slave_offset += size1;
         	size -= size1;
@@ -923,10 +1429,7 @@ snd_pcm_ladspa_read_areas(snd_pcm_t *pcm,
 			  snd_pcm_uframes_t *slave_sizep)
 {
 	snd_pcm_ladspa_t *ladspa = pcm->private_data;
-	snd_pcm_ladspa_instance_t *instance;
-	struct list_head *pos, *pos1;
-	LADSPA_Data *data;
-	unsigned int idx, chn, size1, size2;;
+	unsigned int size1, size2;
 
 	if (size > *slave_sizep)
 		size = *slave_sizep;
@@ -936,35 +1439,24 @@ snd_pcm_ladspa_read_areas(snd_pcm_t *pcm,
 			   slave_areas, slave_offset,
 			   pcm->channels, size, pcm->format);
 #else
+	if (ladspa->block_size) {
+		snd_pcm_ladspa_transfer_fifo(pcm, ladspa,
+					     slave_areas, slave_offset,
+					     ladspa->plug.gen.slave->channels,
+					     areas, offset, pcm->channels, size);
+		*slave_sizep = size2;
+		return size2;
+	}
+	ladspa->in_areas = slave_areas;
+	ladspa->out_areas = areas;
         while (size > 0) {
                 size1 = size;
                 if (size1 > ladspa->allocated)
                         size1 = ladspa->allocated;
-        	list_for_each(pos, &ladspa->cplugins) {
-        		snd_pcm_ladspa_plugin_t *plugin = list_entry(pos, snd_pcm_ladspa_plugin_t, list);
-        		list_for_each(pos1, &plugin->instances) {
-        			instance = list_entry(pos1, snd_pcm_ladspa_instance_t, list);
-        			for (idx = 0; idx < instance->input.channels.size; idx++) {
-                                        chn = instance->input.channels.array[idx];
-                                        data = instance->input.data[idx];
-                                        if (data == NULL) {
-                                		data = (LADSPA_Data *)((char *)slave_areas[chn].addr + (areas[chn].first / 8));
-                                		data += slave_offset;
-                                        }	
-                			instance->desc->connect_port(instance->handle, instance->input.ports.array[idx], data);
-        			}
-        			for (idx = 0; idx < instance->output.channels.size; idx++) {
-                                        chn = instance->output.channels.array[idx];
-                                        data = instance->output.data[idx];
-                                        if (data == NULL) {
-                                		data = (LADSPA_Data *)((char *)areas[chn].addr + (areas[chn].first / 8));
-                                       		data += offset;
-                                        }
-        		        	instance->desc->connect_port(instance->handle, instance->output.ports.array[idx], data);
-        			}
-        			instance->desc->run(instance->handle, size1);
-        		}
-        	}
+		ladspa->in_offset = slave_offset;
+		ladspa->out_offset = offset;
+		ladspa->block = size1;
+		snd_pcm_ladspa_run(pcm, ladspa);
         	offset += size1;
         	slave_offset += size1;
         	size -= size1;
@@ -974,6 +1466,106 @@ snd_pcm_ladspa_read_areas(snd_pcm_t *pcm,
 	return size2;
 }
 
+/*
+ * Push the block the FIFO holds back to the slave: the rest of the
+ * last processed block, then the pending frames padded with silence.
+ */
+static int snd_pcm_ladspa_flush_fifo(snd_pcm_t *pcm, snd_pcm_ladspa_t *ladspa)
+{
+	snd_pcm_t *slave = ladspa->plug.gen.slave;
+	snd_pcm_uframes_t left = ladspa->block_size;
+
+	while (left > 0) {
+		const snd_pcm_channel_area_t *areas;
+		snd_pcm_uframes_t offset, frames;
+		snd_pcm_sframes_t avail, result;
+		int err;
+
+		avail = snd_pcm_avail_update(slave);
+		if (avail < 0)
+			return avail;
+		if (avail == 0) {
+			if (snd_pcm_state(slave) == SND_PCM_STATE_PREPARED) {
+				err = snd_pcm_start(slave);
+				if (err < 0)
+					return err;
+			}
+			err = snd_pcm_wait(slave, -1);
+			if (err < 0)
+				return err;
+			continue;
+		}
+		frames = left;
+		if (frames > (snd_pcm_uframes_t)avail)
+			frames = avail;
+		err = snd_pcm_mmap_begin(slave, &areas, &offset, &frames);
+		if (err < 0)
+			return err;
+		snd_pcm_ladspa_transfer_fifo(pcm, ladspa, NULL, 0, pcm->channels,
+					     areas, offset, slave->channels,
+					     frames);
+		result = snd_pcm_mmap_commit(slave, offset, frames);
+		if (result < 0)
+			return result;
+		left -= frames;
+	}
+	snd_pcm_ladspa_reset_fifo(pcm, ladspa);
+	return 0;
+}
+
+static int snd_pcm_ladspa_drain(snd_pcm_t *pcm)
+{
+	snd_pcm_ladspa_t *ladspa = pcm->private_data;
+	snd_pcm_state_t state = snd_pcm_state(pcm);
+	int err;
+
+	if (ladspa->fifo && pcm->stream == SND_PCM_STREAM_PLAYBACK &&
+	    (state == SND_PCM_STATE_RUNNING ||
+	     (state == SND_PCM_STATE_PREPARED && *pcm->appl.ptr > 0))) {
+		err = snd_pcm_ladspa_flush_fifo(pcm, ladspa);
+		if (err < 0)
+			return err;
+	}
+	return snd_pcm_plugin_fast_ops.drain(pcm);
+}
+
+static int snd_pcm_ladspa_drop(snd_pcm_t *pcm)
+{
+	snd_pcm_ladspa_t *ladspa = pcm->private_data;
+	int err;
+
+	err = snd_pcm_plugin_fast_ops.drop(pcm);
+	if (err < 0)
+		return err;
+	snd_pcm_ladspa_reset_fifo(pcm, ladspa);
+	return 0;
+}
+
+/* the FIFO contents no longer match the stream after a seek */
+static snd_pcm_sframes_t snd_pcm_ladspa_rewind(snd_pcm_t *pcm,
+					       snd_pcm_uframes_t frames)
+{
+	snd_pcm_ladspa_t *ladspa = pcm->private_data;
+	snd_pcm_sframes_t res;
+
+	res = snd_pcm_plugin_fast_ops.rewind(pcm, frames);
+	if (res > 0)
+		snd_pcm_ladspa_reset_fifo(pcm, ladspa);
+	return res;
+}
+
+static snd_pcm_sframes_t snd_pcm_ladspa_forward(snd_pcm_t *pcm,
+						snd_pcm_uframes_t frames)
+{
+	snd_pcm_ladspa_t *ladspa = pcm->private_data;
+	snd_pcm_sframes_t res;
+
+	res = snd_pcm_plugin_fast_ops.forward(pcm, frames);
+	if (res > 0)
+		snd_pcm_ladspa_reset_fifo(pcm, ladspa);
+	return res;
+}
+
 static void snd_pcm_ladspa_dump_direction(snd_pcm_ladspa_plugin_t *plugin,
                                           snd_pcm_ladspa_plugin_io_t *io,
                                           snd_output_t *out)
@@ -1062,6 +1654,9 @@ static void snd_pcm_ladspa_dump(snd_pcm_t *pcm, snd_output_t *out)
 	snd_pcm_ladspa_plugins_dump(&ladspa->pplugins, out);
 	snd_output_printf(out, "  Capture:\n");
 	snd_pcm_ladspa_plugins_dump(&ladspa->cplugins, out);
+	if (ladspa->block_size)
+		snd_output_printf(out, "  Block size: %u (latency %u frames)\n",
+				  ladspa->block_size, ladspa->block_size);
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -1573,27 +2168,14 @@ static int snd_pcm_ladspa_build_plugins(struct list_head *list,
 	return 0;
 }
 
-/**
- * \brief Creates a new LADSPA<->ALSA Plugin
- * \param pcmp Returns created PCM handle
- * \param name Name of PCM
- * \param ladspa_path The path for LADSPA plugins
- * \param channels Force input channel count to LADSPA plugin chain, 0 = no force (auto)
- * \param ladspa_pplugins The playback configuration
- * \param ladspa_cplugins The capture configuration
- * \param slave Slave PCM handle
- * \param close_slave When set, the slave PCM handle is closed with copy PCM
- * \retval zero on success otherwise a negative error code
- * \warning Using of this function might be dangerous in the sense
- *          of compatibility reasons. The prototype might be freely
- *          changed in future.
- */
-int snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
-			const char *ladspa_path,
-			unsigned int channels,
-			snd_config_t *ladspa_pplugins,
-			snd_config_t *ladspa_cplugins,
-			snd_pcm_t *slave, int close_slave)
+static int snd_pcm_ladspa_open_conf(snd_pcm_t **pcmp, const char *name,
+				    const char *ladspa_path,
+				    unsigned int channels,
+				    snd_config_t *ladspa_pplugins,
+				    snd_config_t *ladspa_cplugins,
+				    unsigned int threads,
+				    unsigned int block_size,
+				    snd_pcm_t *slave, int close_slave)
 {
 	snd_pcm_t *pcm;
 	snd_pcm_ladspa_t *ladspa;
@@ -1618,6 +2200,13 @@ int snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
 	INIT_LIST_HEAD(&ladspa->pplugins);
 	INIT_LIST_HEAD(&ladspa->cplugins);
 	ladspa->channels = channels;
+	ladspa->threads = threads;
+	ladspa->block_size = block_size;
+	ladspa->plug.latency = block_size;	/* the FIFO holds back one block */
+#ifdef HAVE_LIBPTHREAD
+	ladspa->quit = 2;
+	pthread_mutex_init(&ladspa->start, NULL);
+#endif
 
 	if (slave->stream == SND_PCM_STREAM_PLAYBACK) {
 		err = snd_pcm_ladspa_build_plugins(&ladspa->pplugins, ladspa_path, ladspa_pplugins, reverse);
@@ -1642,11 +2231,17 @@ int snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
 		return err;
 	}
 	pcm->ops = &snd_pcm_ladspa_ops;
-	pcm->fast_ops = &snd_pcm_plugin_fast_ops;
+	ladspa->fops = snd_pcm_plugin_fast_ops;
+	ladspa->fops.drain = snd_pcm_ladspa_drain;
+	ladspa->fops.drop = snd_pcm_ladspa_drop;
+	ladspa->fops.rewind = snd_pcm_ladspa_rewind;
+	ladspa->fops.forward = snd_pcm_ladspa_forward;
+	pcm->fast_ops = &ladspa->fops;
 	pcm->private_data = ladspa;
 	pcm->poll_fd = slave->poll_fd;
 	pcm->poll_events = slave->poll_events;
 	pcm->monotonic = slave->monotonic;
+	pcm->trace = slave->trace;
 	snd_pcm_set_hw_ptr(pcm, &ladspa->plug.hw_ptr, -1, 0);
 	snd_pcm_set_appl_ptr(pcm, &ladspa->plug.appl_ptr, -1, 0);
 	*pcmp = pcm;
@@ -1654,6 +2249,33 @@ int snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
 	return 0;
 }
 
+/**
+ * \brief Creates a new LADSPA<->ALSA Plugin
+ * \param pcmp Returns created PCM handle
+ * \param name Name of PCM
+ * \param ladspa_path The path for LADSPA plugins
+ * \param channels Force input channel count to LADSPA plugin chain, 0 = no force (auto)
+ * \param ladspa_pplugins The playback configuration
+ * \param ladspa_cplugins The capture configuration
+ * \param slave Slave PCM handle
+ * \param close_slave When set, the slave PCM handle is closed with copy PCM
+ * \retval zero on success otherwise a negative error code
+ * \warning Using of this function might be dangerous in the sense
+ *          of compatibility reasons. The prototype might be freely
+ *          changed in future.
+ */
+int snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
+			const char *ladspa_path,
+			unsigned int channels,
+			snd_config_t *ladspa_pplugins,
+			snd_config_t *ladspa_cplugins,
+			snd_pcm_t *slave, int close_slave)
+{
+	return snd_pcm_ladspa_open_conf(pcmp, name, ladspa_path, channels,
+					ladspa_pplugins, ladspa_cplugins,
+					0, 0, slave, close_slave);
+}
+
 /*! \page pcm_plugins
 
 \section pcm_plugins_ladpsa Plugin: LADSPA <-> ALSA
@@ -1677,6 +2299,22 @@ connected to a dummy sample area.
 
 Instances of LADSPA plugins are created dynamically.
 
+With threads set above one, the instances are split at hw_params time
+into groups which share no channel, e.g. the per channel instances of
+a duplicate policy chain. The groups are spread over up to threads
+threads (the calling thread included, the others pinned to a CPU) and
+every block ends with a barrier. Ports are reconnected only when the
+buffer address changes.
+
+All sample buffers are taken from one anonymous mapping with 64 byte
+aligned slots (backed by huge pages for big chains). With block_size
+set, the instances always run over exactly that many frames starting
+at the beginning of these buffers, independently of the period size.
+A FIFO of one block absorbs the difference, which delays the stream
+by block_size frames; snd_pcm_delay() includes it. The FIFO starts
+silent after prepare, reset, drop, rewind and forward, and a playback
+drain pads the pending block with silence to play it out.
+
 \code
 pcm.name {
         type ladspa             # ALSA<->LADSPA PCM
@@ -1688,6 +2326,8 @@ pcm.name {
                 pcm { }         # Slave PCM definition
         }
         [channels INT]		# count input channels (input to LADSPA plugin chain)
+	[threads INT]		# run independent instances on up to INT threads
+	[block_size INT]	# process in fixed blocks of INT frames (adds latency)
 	[path STR]		# Path (directory) with LADSPA plugins
 	plugins |		# Definition for both directions
         playback_plugins |	# Definition for playback direction
@@ -1744,7 +2384,7 @@ int _snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
 	snd_pcm_t *spcm;
 	snd_config_t *slave = NULL, *sconf;
 	const char *path = NULL;
-	long channels = 0;
+	long channels = 0, threads = 0, block_size = 0;
 	snd_config_t *plugins = NULL, *pplugins = NULL, *cplugins = NULL;
 	snd_config_for_each(i, next, conf) {
 		snd_config_t *n = snd_config_iterator_entry(i);
@@ -1769,6 +2409,30 @@ int _snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
                                 channels = 0;
 			continue;
 		}
+		if (strcmp(id, "threads") == 0) {
+			err = snd_config_get_integer(n, &threads);
+			if (err < 0) {
+				SNDERR("Invalid type for %s", id);
+				return -EINVAL;
+			}
+			if (threads < 0)
+				threads = 0;
+			if (threads > 64)
+				threads = 64;
+			continue;
+		}
+		if (strcmp(id, "block_size") == 0) {
+			err = snd_config_get_integer(n, &block_size);
+			if (err < 0) {
+				SNDERR("Invalid type for %s", id);
+				return -EINVAL;
+			}
+			if (block_size < 0 || block_size > 65536) {
+				SNDERR("Invalid block_size %ld", block_size);
+				return -EINVAL;
+			}
+			continue;
+		}
 		if (strcmp(id, "plugins") == 0) {
 			plugins = n;
 			continue;
@@ -1803,7 +2467,8 @@ int _snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
 	snd_config_delete(sconf);
 	if (err < 0)
 		return err;
-	err = snd_pcm_ladspa_open(pcmp, name, path, channels, pplugins, cplugins, spcm, 1);
+	err = snd_pcm_ladspa_open_conf(pcmp, name, path, channels, pplugins, cplugins,
+				       threads, block_size, spcm, 1);
 	if (err < 0)
 		snd_pcm_close(spcm);
 	return err;
@@ -111,6 +111,46 @@ typedef struct _snd_pcm_rbptr {
 	void (*changed)(snd_pcm_t *pcm, snd_pcm_t *src);
 } snd_pcm_rbptr_t;
 
+/* event ring, also the layout of the file exported to $LIBASOUND_PCM_TRACE_DIR */
+#define SND_PCM_TRACE_MAGIC	0x43525441	/* "ATRC" */
+#define SND_PCM_TRACE_VERSION	1
+
+enum {
+	SND_PCM_TRACE_AVAIL = 1,	/* value = avail_update result */
+	SND_PCM_TRACE_COMMIT,		/* value = frames committed or written */
+	SND_PCM_TRACE_WAKEUP,		/* value = avail when poll returned */
+	SND_PCM_TRACE_XRUN,		/* value = avail at the xrun */
+	SND_PCM_TRACE_PREPARE,
+	SND_PCM_TRACE_START,
+	SND_PCM_TRACE_STOP,
+	SND_PCM_TRACE_MIX,		/* value = frames mixed by dmix */
+};
+
+typedef struct {
+	unsigned long long tstamp;	/* CLOCK_MONOTONIC, ns */
+	unsigned long long hw_ptr;
+	unsigned long long appl_ptr;
+	long long value;
+	unsigned int seq;		/* index + 1, 0 while being written */
+	unsigned int type;
+} snd_pcm_trace_event_t;
+
+typedef struct _snd_pcm_trace {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int size;		/* number of events, power of two */
+	unsigned short xrun;		/* xrun recorded since the last start */
+	unsigned short mapped;		/* exported to a file */
+	unsigned long long head;	/* events recorded so far */
+	/* setup of the owner */
+	unsigned int rate;
+	unsigned int period_size;
+	unsigned int buffer_size;
+	unsigned int avail_min;
+	char name[64];
+	snd_pcm_trace_event_t events[0];
+} snd_pcm_trace_t;
+
 typedef struct _snd_pcm_channel_info {
 	unsigned int channel;
 	void *addr;			/* base address of channel samples */
@@ -180,6 +220,18 @@ typedef struct {
 	int (*may_wait_for_avail_min)(snd_pcm_t *pcm, snd_pcm_uframes_t avail);
 } snd_pcm_fast_ops_t;
 
+/* instrumentation counters, see snd_pcm_stats_get() */
+struct _snd_pcm_stats {
+	unsigned long long frames;	/* frames converted by the plugin */
+	unsigned long long transfer_ns;	/* time spent converting them */
+	unsigned long transfers;	/* calls of the plugin conversion */
+	unsigned long commits;		/* mmap_commit calls */
+	unsigned long long commit_frames; /* frames committed */
+	unsigned long long commit_ns;	/* time spent in mmap_commit, slaves included */
+	unsigned long wakeups;		/* wakeups from snd_pcm_wait() */
+	unsigned long xruns;		/* xruns reported by this PCM */
+};
+
 struct _snd_pcm {
 	void *open_func;
 	char *name;
@@ -204,6 +256,9 @@ struct _snd_pcm {
 	snd_pcm_tstamp_t tstamp_mode;	/* timestamp mode */
 	unsigned int period_step;
 	snd_pcm_uframes_t avail_min;	/* min avail frames for wakeup */
+	snd_pcm_uframes_t wakeup_watermark;	/* batched wakeup level, 0 = off */
+	unsigned int wakeup_coalesce;	/* batched wakeup grid in us */
+	int wakeup_timerfd;		/* timer for batched wakeups */
 	int period_event;
 	snd_pcm_uframes_t start_threshold;
 	snd_pcm_uframes_t stop_threshold;
@@ -238,6 +293,10 @@ struct _snd_pcm {
 	snd_pcm_t *fast_op_arg;
 	void *private_data;
 	struct list_head async_handlers;
+	snd_pcm_trace_t *trace;		/* event ring, owned by hw or dmix */
+#ifdef SUPPORT_PCM_STATS
+	snd_pcm_stats_t stats;
+#endif
 };
 
 /* make local functions really local */
@@ -349,6 +408,12 @@ struct _snd_pcm {
 	snd1_pcm_hw_param_get_max
 #define snd_pcm_hw_param_name		\
 	snd1_pcm_hw_param_name
+#define snd_pcm_trace_open		\
+	snd1_pcm_trace_open
+#define snd_pcm_trace_setup		\
+	snd1_pcm_trace_setup
+#define snd_pcm_trace_close		\
+	snd1_pcm_trace_close
 
 int snd_pcm_new(snd_pcm_t **pcmp, snd_pcm_type_t type, const char *name,
 		snd_pcm_stream_t stream, int mode);
@@ -987,6 +1052,72 @@ static inline void gettimestamp(snd_htimestamp_t *tstamp, int monotonic)
 #endif
 }
 
+/*
+ * instrumentation counters, without --enable-pcm-stats these expand
+ * to nothing and the stamp is a constant the compiler drops
+ */
+#ifdef SUPPORT_PCM_STATS
+static inline unsigned long long snd_pcm_stats_stamp(void)
+{
+	snd_htimestamp_t ts;
+
+	gettimestamp(&ts, 1);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#define snd_pcm_stats_transfer(pcm, n, stamp) do { \
+	(pcm)->stats.transfers++; \
+	(pcm)->stats.frames += (n); \
+	(pcm)->stats.transfer_ns += snd_pcm_stats_stamp() - (stamp); \
+} while (0)
+
+#define snd_pcm_stats_commit(pcm, result, stamp) do { \
+	(pcm)->stats.commits++; \
+	if ((result) > 0) \
+		(pcm)->stats.commit_frames += (result); \
+	else if ((result) == -EPIPE) \
+		(pcm)->stats.xruns++; \
+	(pcm)->stats.commit_ns += snd_pcm_stats_stamp() - (stamp); \
+} while (0)
+
+#define snd_pcm_stats_xrun(pcm, result) do { \
+	if ((result) == -EPIPE) \
+		(pcm)->stats.xruns++; \
+} while (0)
+
+#define snd_pcm_stats_wakeup(pcm)	((pcm)->stats.wakeups++)
+#else
+#define snd_pcm_stats_stamp()			0ULL
+#define snd_pcm_stats_transfer(pcm, n, stamp)	((void)(stamp))
+#define snd_pcm_stats_commit(pcm, result, stamp) ((void)(stamp))
+#define snd_pcm_stats_xrun(pcm, result)		do { } while (0)
+#define snd_pcm_stats_wakeup(pcm)		do { } while (0)
+#endif
+
+/*
+ * xrun forensics: hw and dmix keep a ring of their recent events when
+ * $LIBASOUND_PCM_TRACE is set, plugins share the ring of their slave
+ */
+void __snd_pcm_trace_record(snd_pcm_t *pcm, unsigned int type, long long value);
+void __snd_pcm_trace_xrun(snd_pcm_t *pcm, long long value);
+int snd_pcm_trace_open(snd_pcm_t *pcm);
+void snd_pcm_trace_setup(snd_pcm_t *pcm, snd_pcm_hw_params_t *hw_params,
+			 snd_pcm_sw_params_t *sw_params);
+void snd_pcm_trace_close(snd_pcm_t *pcm);
+
+static inline void snd_pcm_trace(snd_pcm_t *pcm, unsigned int type, long long value)
+{
+	if (pcm->trace)
+		__snd_pcm_trace_record(pcm, type, value);
+}
+
+/* records the first xrun after a prepare or start only */
+static inline void snd_pcm_trace_xrun(snd_pcm_t *pcm, long long value)
+{
+	if (pcm->trace)
+		__snd_pcm_trace_xrun(pcm, value);
+}
+
 snd_pcm_chmap_query_t **
 _snd_pcm_make_single_query_chmaps(const snd_pcm_chmap_t *src);
 snd_pcm_chmap_t *_snd_pcm_copy_chmap(const snd_pcm_chmap_t *src);
@@ -31,12 +31,15 @@
 #include <time.h>
 #include <pthread.h>
 #include <dlfcn.h>
+#include <sys/eventfd.h>
 #include "pcm_local.h"
 #include "pcm_plugin.h"
 
 #define atomic_read(ptr)    __atomic_load_n(ptr, __ATOMIC_SEQ_CST )
 #define atomic_add(ptr, n)  __atomic_add_fetch(ptr, n, __ATOMIC_SEQ_CST)
 #define atomic_dec(ptr)     __atomic_sub_fetch(ptr, 1, __ATOMIC_SEQ_CST)
+#define atomic_load_acquire(ptr)	__atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define atomic_store_release(ptr, v)	__atomic_store_n(ptr, v, __ATOMIC_RELEASE)
 
 #ifndef PIC
 /* entry for static linking */
@@ -46,6 +49,18 @@ const char *_snd_module_pcm_meter = "";
 #ifndef DOC_HIDDEN
 #define FREQUENCY 50
 
+/* must be a power of two */
+#define METER_RING_SIZE 64
+
+/*
+ * A run of frames copied to the meter buffer; frames == 0 marks
+ * a pointer discontinuity (prepare, reset, rewind, forward) at pos.
+ */
+typedef struct {
+	snd_pcm_uframes_t pos;
+	snd_pcm_uframes_t frames;
+} snd_pcm_meter_event_t;
+
 struct _snd_pcm_scope {
 	int enabled;
 	char *name;
@@ -71,8 +86,98 @@ typedef struct _snd_pcm_meter {
 	pthread_cond_t running_cond;
 	struct timespec delay;
 	void *dl_handle;
+	/* event mode: single producer (audio path), single consumer (thread) */
+	int event;
+	int event_fd;
+	unsigned int frequency;
+	snd_pcm_uframes_t threshold;
+	snd_pcm_meter_event_t ring[METER_RING_SIZE];
+	unsigned int ring_head;		/* written by the producer */
+	unsigned int ring_tail;		/* written by the consumer */
+	int stopped;			/* drop or drain since the last wakeup */
+	/* producer side only */
+	snd_pcm_meter_event_t pending;
+	snd_pcm_uframes_t mark_pos;
+	int mark;
 } snd_pcm_meter_t;
 
+static int snd_pcm_meter_ring_push(snd_pcm_meter_t *meter,
+				   snd_pcm_uframes_t pos,
+				   snd_pcm_uframes_t frames)
+{
+	unsigned int head = meter->ring_head;
+	if (head - atomic_load_acquire(&meter->ring_tail) >= METER_RING_SIZE)
+		return 0;
+	meter->ring[head & (METER_RING_SIZE - 1)].pos = pos;
+	meter->ring[head & (METER_RING_SIZE - 1)].frames = frames;
+	atomic_store_release(&meter->ring_head, head + 1);
+	return 1;
+}
+
+static int snd_pcm_meter_ring_pop(snd_pcm_meter_t *meter,
+				  snd_pcm_meter_event_t *ev)
+{
+	unsigned int tail = meter->ring_tail;
+	if (tail == atomic_load_acquire(&meter->ring_head))
+		return 0;
+	*ev = meter->ring[tail & (METER_RING_SIZE - 1)];
+	atomic_store_release(&meter->ring_tail, tail + 1);
+	return 1;
+}
+
+static void snd_pcm_meter_wakeup(snd_pcm_meter_t *meter)
+{
+	uint64_t one = 1;
+	if (write(meter->event_fd, &one, sizeof(one)) < 0)
+		SYSERR("eventfd write failed");
+}
+
+/*
+ * Publish pending frames once at least threshold frames were collected,
+ * so the scope thread is woken up at most frequency times per second,
+ * or whatever is pending with force (drain, drop).
+ * When the ring is full the frames stay pending and are merged with the
+ * following ones.
+ */
+static void snd_pcm_meter_ring_flush(snd_pcm_meter_t *meter, int force)
+{
+	int wakeup = 0;
+	if (meter->mark) {
+		if (!snd_pcm_meter_ring_push(meter, meter->mark_pos, 0))
+			return;
+		meter->mark = 0;
+		wakeup = 1;
+	}
+	if (meter->pending.frames > 0 &&
+	    (meter->pending.frames >= meter->threshold || force) &&
+	    snd_pcm_meter_ring_push(meter, meter->pending.pos,
+				    meter->pending.frames)) {
+		meter->pending.frames = 0;
+		wakeup = 1;
+	}
+	if (wakeup)
+		snd_pcm_meter_wakeup(meter);
+}
+
+static void snd_pcm_meter_ring_add(snd_pcm_meter_t *meter,
+				   snd_pcm_uframes_t pos,
+				   snd_pcm_uframes_t frames)
+{
+	if (meter->pending.frames == 0)
+		meter->pending.pos = pos;
+	meter->pending.frames += frames;
+	snd_pcm_meter_ring_flush(meter, 0);
+}
+
+static void snd_pcm_meter_ring_mark(snd_pcm_meter_t *meter,
+				    snd_pcm_uframes_t pos)
+{
+	meter->pending.frames = 0;
+	meter->mark_pos = pos;
+	meter->mark = 1;
+	snd_pcm_meter_ring_flush(meter, 0);
+}
+
 static void snd_pcm_meter_add_frames(snd_pcm_t *pcm,
 				     const snd_pcm_channel_area_t *areas,
 				     snd_pcm_uframes_t ptr,
@@ -118,6 +223,9 @@ static void snd_pcm_meter_update_main(snd_pcm_t *pcm)
 		assert((snd_pcm_uframes_t) frames <= pcm->buffer_size);
 		snd_pcm_meter_add_frames(pcm, areas, old_rptr,
 					 (snd_pcm_uframes_t) frames);
+		if (meter->event)
+			snd_pcm_meter_ring_add(meter, old_rptr,
+					       (snd_pcm_uframes_t) frames);
 	}
 	if (locked)
 		pthread_mutex_unlock(&meter->update_mutex);
@@ -266,6 +374,89 @@ static void *snd_pcm_meter_thread(void *data)
 	return NULL;
 }
 
+/*
+ * Event mode: sleep on the eventfd until the audio path has published
+ * enough frames, no status polling is done while the stream is idle.
+ */
+static void *snd_pcm_meter_event_thread(void *data)
+{
+	snd_pcm_t *pcm = data;
+	snd_pcm_meter_t *meter = pcm->private_data;
+	snd_pcm_t *spcm = meter->gen.slave;
+	struct list_head *pos;
+	snd_pcm_scope_t *scope;
+	list_for_each(pos, &meter->scopes) {
+		scope = list_entry(pos, snd_pcm_scope_t, list);
+		snd_pcm_scope_enable(scope);
+	}
+	while (!meter->closed) {
+		snd_pcm_meter_event_t ev;
+		uint64_t count;
+		int update = 0, stopped;
+		if (read(meter->event_fd, &count, sizeof(count)) < 0) {
+			if (errno == EINTR)
+				continue;
+			SYSERR("eventfd read failed");
+			break;
+		}
+		while (snd_pcm_meter_ring_pop(meter, &ev)) {
+			snd_pcm_uframes_t now = ev.pos + ev.frames;
+			if (now >= pcm->boundary)
+				now -= pcm->boundary;
+			meter->now = now;
+			if (ev.frames > 0) {
+				update = 1;
+				continue;
+			}
+			update = 0;
+			list_for_each(pos, &meter->scopes) {
+				scope = list_entry(pos, snd_pcm_scope_t, list);
+				if (scope->enabled)
+					scope->ops->reset(scope);
+			}
+		}
+		if (update) {
+			if (!meter->running) {
+				list_for_each(pos, &meter->scopes) {
+					scope = list_entry(pos, snd_pcm_scope_t, list);
+					if (scope->enabled)
+						scope->ops->start(scope);
+				}
+				meter->running = 1;
+			}
+			list_for_each(pos, &meter->scopes) {
+				scope = list_entry(pos, snd_pcm_scope_t, list);
+				if (scope->enabled)
+					scope->ops->update(scope);
+			}
+		}
+		/* the last update may share the wakeup of a drop or drain */
+		stopped = 0;
+		while (atomic_read(&meter->stopped)) {
+			stopped = 1;
+			atomic_dec(&meter->stopped);
+		}
+		if ((!update || stopped) && meter->running) {
+			snd_pcm_state_t state = snd_pcm_state(spcm);
+			if (state != SND_PCM_STATE_RUNNING &&
+			    (state != SND_PCM_STATE_DRAINING ||
+			     spcm->stream != SND_PCM_STREAM_PLAYBACK)) {
+				list_for_each(pos, &meter->scopes) {
+					scope = list_entry(pos, snd_pcm_scope_t, list);
+					scope->ops->stop(scope);
+				}
+				meter->running = 0;
+			}
+		}
+	}
+	list_for_each(pos, &meter->scopes) {
+		scope = list_entry(pos, snd_pcm_scope_t, list);
+		if (scope->enabled)
+			snd_pcm_scope_disable(scope);
+	}
+	return NULL;
+}
+
 static int snd_pcm_meter_close(snd_pcm_t *pcm)
 {
 	snd_pcm_meter_t *meter = pcm->private_data;
@@ -291,13 +482,16 @@ static int snd_pcm_meter_prepare(snd_pcm_t *pcm)
 {
 	snd_pcm_meter_t *meter = pcm->private_data;
 	int err;
-	atomic_add(&meter->reset, 1);
+	if (!meter->event)
+		atomic_add(&meter->reset, 1);
 	err = snd_pcm_prepare(meter->gen.slave);
 	if (err >= 0) {
 		if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
 			meter->rptr = *pcm->appl.ptr;
 		else
 			meter->rptr = *pcm->hw.ptr;
+		if (meter->event)
+			snd_pcm_meter_ring_mark(meter, meter->rptr);
 	}
 	return err;
 }
@@ -307,8 +501,11 @@ static int snd_pcm_meter_reset(snd_pcm_t *pcm)
 	snd_pcm_meter_t *meter = pcm->private_data;
 	int err = snd_pcm_reset(meter->gen.slave);
 	if (err >= 0) {
-		if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
+		if (pcm->stream == SND_PCM_STREAM_PLAYBACK) {
 			meter->rptr = *pcm->appl.ptr;
+			if (meter->event)
+				snd_pcm_meter_ring_mark(meter, meter->rptr);
+		}
 	}
 	return err;
 }
@@ -329,8 +526,11 @@ static snd_pcm_sframes_t snd_pcm_meter_rewind(snd_pcm_t *pcm, snd_pcm_uframes_t
 {
 	snd_pcm_meter_t *meter = pcm->private_data;
 	snd_pcm_sframes_t err = snd_pcm_rewind(meter->gen.slave, frames);
-	if (err > 0 && pcm->stream == SND_PCM_STREAM_PLAYBACK)
+	if (err > 0 && pcm->stream == SND_PCM_STREAM_PLAYBACK) {
 		meter->rptr = *pcm->appl.ptr;
+		if (meter->event)
+			snd_pcm_meter_ring_mark(meter, meter->rptr);
+	}
 	return err;
 }
 
@@ -338,8 +538,41 @@ static snd_pcm_sframes_t snd_pcm_meter_forward(snd_pcm_t *pcm, snd_pcm_uframes_t
 {
 	snd_pcm_meter_t *meter = pcm->private_data;
 	snd_pcm_sframes_t err = INTERNAL(snd_pcm_forward)(meter->gen.slave, frames);
-	if (err > 0 && pcm->stream == SND_PCM_STREAM_PLAYBACK)
+	if (err > 0 && pcm->stream == SND_PCM_STREAM_PLAYBACK) {
 		meter->rptr = *pcm->appl.ptr;
+		if (meter->event)
+			snd_pcm_meter_ring_mark(meter, meter->rptr);
+	}
+	return err;
+}
+
+static int snd_pcm_meter_drop(snd_pcm_t *pcm)
+{
+	snd_pcm_meter_t *meter = pcm->private_data;
+	int err;
+	/* hand the last partial window to the scopes before they stop */
+	if (meter->event)
+		snd_pcm_meter_ring_flush(meter, 1);
+	err = snd_pcm_drop(meter->gen.slave);
+	/* let the scope thread notice the state change */
+	if (meter->event) {
+		atomic_add(&meter->stopped, 1);
+		snd_pcm_meter_wakeup(meter);
+	}
+	return err;
+}
+
+static int snd_pcm_meter_drain(snd_pcm_t *pcm)
+{
+	snd_pcm_meter_t *meter = pcm->private_data;
+	int err;
+	if (meter->event)
+		snd_pcm_meter_ring_flush(meter, 1);
+	err = snd_pcm_drain(meter->gen.slave);
+	if (meter->event) {
+		atomic_add(&meter->stopped, 1);
+		snd_pcm_meter_wakeup(meter);
+	}
 	return err;
 }
 
@@ -355,6 +588,8 @@ static snd_pcm_sframes_t snd_pcm_meter_mmap_commit(snd_pcm_t *pcm,
 	if (pcm->stream == SND_PCM_STREAM_PLAYBACK) {
 		snd_pcm_meter_add_frames(pcm, snd_pcm_mmap_areas(pcm), old_rptr, result);
 		meter->rptr = *pcm->appl.ptr;
+		if (meter->event)
+			snd_pcm_meter_ring_add(meter, old_rptr, result);
 	}
 	return result;
 }
@@ -470,7 +705,28 @@ static int snd_pcm_meter_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 		a->step = slave->sample_bits;
 	}
 	meter->closed = 0;
-	err = pthread_create(&meter->thread, NULL, snd_pcm_meter_thread, pcm);
+	if (meter->event) {
+		meter->event_fd = eventfd(0, EFD_CLOEXEC);
+		if (meter->event_fd < 0) {
+			err = -errno;
+			SYSERR("eventfd failed");
+			free(meter->buf);
+			free(meter->buf_areas);
+			meter->buf = NULL;
+			meter->buf_areas = NULL;
+			return err;
+		}
+		meter->ring_head = meter->ring_tail = 0;
+		meter->pending.frames = 0;
+		meter->mark = 0;
+		meter->threshold = slave->rate / meter->frequency;
+		if (meter->threshold == 0)
+			meter->threshold = 1;
+		err = pthread_create(&meter->thread, NULL,
+				     snd_pcm_meter_event_thread, pcm);
+	} else
+		err = pthread_create(&meter->thread, NULL,
+				     snd_pcm_meter_thread, pcm);
 	assert(err == 0);
 	return 0;
 }
@@ -480,11 +736,19 @@ static int snd_pcm_meter_hw_free(snd_pcm_t *pcm)
 	snd_pcm_meter_t *meter = pcm->private_data;
 	int err;
 	meter->closed = 1;
-	pthread_mutex_lock(&meter->running_mutex);
-	pthread_cond_signal(&meter->running_cond);
-	pthread_mutex_unlock(&meter->running_mutex);
+	if (meter->event)
+		snd_pcm_meter_wakeup(meter);
+	else {
+		pthread_mutex_lock(&meter->running_mutex);
+		pthread_cond_signal(&meter->running_cond);
+		pthread_mutex_unlock(&meter->running_mutex);
+	}
 	err = pthread_join(meter->thread, 0);
 	assert(err == 0);
+	if (meter->event) {
+		close(meter->event_fd);
+		meter->event_fd = -1;
+	}
 	free(meter->buf);
 	free(meter->buf_areas);
 	meter->buf = NULL;
@@ -530,8 +794,8 @@ static const snd_pcm_fast_ops_t snd_pcm_meter_fast_ops = {
 	.prepare = snd_pcm_meter_prepare,
 	.reset = snd_pcm_meter_reset,
 	.start = snd_pcm_meter_start,
-	.drop = snd_pcm_generic_drop,
-	.drain = snd_pcm_generic_drain,
+	.drop = snd_pcm_meter_drop,
+	.drain = snd_pcm_meter_drain,
 	.pause = snd_pcm_generic_pause,
 	.rewindable = snd_pcm_generic_rewindable,
 	.rewind = snd_pcm_meter_rewind,
@@ -577,6 +841,8 @@ int snd_pcm_meter_open(snd_pcm_t **pcmp, const char *name, unsigned int frequenc
 	meter->gen.close_slave = close_slave;
 	meter->delay.tv_sec = 0;
 	meter->delay.tv_nsec = 1000000000 / frequency;
+	meter->frequency = frequency;
+	meter->event_fd = -1;
 	INIT_LIST_HEAD(&meter->scopes);
 
 	err = snd_pcm_new(&pcm, SND_PCM_TYPE_METER, name, slave->stream, slave->mode);
@@ -592,6 +858,7 @@ int snd_pcm_meter_open(snd_pcm_t **pcmp, const char *name, unsigned int frequenc
 	pcm->poll_fd = slave->poll_fd;
 	pcm->poll_events = slave->poll_events;
 	pcm->monotonic = slave->monotonic;
+	pcm->trace = slave->trace;
 	snd_pcm_link_hw_ptr(pcm, slave);
 	snd_pcm_link_appl_ptr(pcm, slave);
 	*pcmp = pcm;
@@ -722,6 +989,8 @@ pcm.name {
                 pcm { }         # Slave PCM definition
         }
 	[frequency INT]		# Updates per second
+	[event BOOL]		# Wake up scopes when new frames are available
+				# instead of polling the slave (default no)
 	scopes {
 		ID STR		# Scope name (see pcm_scope)
 		# or
@@ -730,6 +999,12 @@ pcm.name {
 }
 \endcode
 
+With event set, the transfer path publishes the positions of new frames
+through a lock-free ring and the scope thread sleeps until about
+rate / frequency frames were collected, so an idle or stopped stream causes
+no wakeups. In this mode the "now" pointer for playback follows the
+committed frames rather than the frames actually played.
+
 \subsection pcm_plugins_meter_funcref Function reference
 
 <UL>
@@ -761,6 +1036,7 @@ int _snd_pcm_meter_open(snd_pcm_t **pcmp, const char *name,
 	snd_pcm_t *spcm;
 	snd_config_t *slave = NULL, *sconf;
 	long frequency = -1;
+	int event = 0;
 	snd_config_t *scopes = NULL;
 	snd_config_for_each(i, next, conf) {
 		snd_config_t *n = snd_config_iterator_entry(i);
@@ -781,6 +1057,13 @@ int _snd_pcm_meter_open(snd_pcm_t **pcmp, const char *name,
 			}
 			continue;
 		}
+		if (strcmp(id, "event") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			event = err;
+			continue;
+		}
 		if (strcmp(id, "scopes") == 0) {
 			if (snd_config_get_type(n) != SND_CONFIG_TYPE_COMPOUND) {
 				SNDERR("Invalid type for %s", id);
@@ -808,6 +1091,7 @@ int _snd_pcm_meter_open(snd_pcm_t **pcmp, const char *name,
 		snd_pcm_close(spcm);
 		return err;
 	}
+	((snd_pcm_meter_t *)(*pcmp)->private_data)->event = event;
 	if (!scopes)
 		return 0;
 	snd_config_for_each(i, next, scopes) {
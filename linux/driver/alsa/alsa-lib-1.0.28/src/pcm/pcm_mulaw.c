@@ -31,6 +31,9 @@
 #include "pcm_plugin.h"
 
 #include "plugin_ops.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #ifndef PIC
 /* entry for static linking */
@@ -156,6 +159,75 @@ static int ulaw_to_s16(unsigned char u_val)
 	return ((u_val & 0x80) ? (0x84 - t) : (t - 0x84));
 }
 
+/*
+ * lookup tables built from the functions above on first use; the
+ * encoder is indexed by the 16 bit sample as unsigned
+ */
+static unsigned char ulaw_encode_table[65536];
+static int16_t ulaw_decode_table[256];
+static int ulaw_tables_ready;
+
+static void ulaw_init_tables(void)
+{
+	unsigned int i;
+
+	if (__atomic_load_n(&ulaw_tables_ready, __ATOMIC_ACQUIRE))
+		return;
+	for (i = 0; i < 65536; i++)
+		ulaw_encode_table[i] = s16_to_ulaw((int16_t)i);
+	for (i = 0; i < 256; i++)
+		ulaw_decode_table[i] = ulaw_to_s16(i);
+	__atomic_store_n(&ulaw_tables_ready, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * decode a contiguous run; as in the A-law plugin the vector path
+ * evaluates ulaw_to_s16() for 8 samples, the shift by the segment
+ * being a multiplication by a power of two made in the float exponent
+ */
+static void ulaw_decode_run(int16_t *dst, const unsigned char *src,
+			    snd_pcm_uframes_t n)
+{
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i xff = _mm_set1_epi16(0xff);
+	const __m128i m0f = _mm_set1_epi32(0x0f);
+	const __m128i m70 = _mm_set1_epi32(0x70);
+	const __m128i m80 = _mm_set1_epi32(0x80);
+	const __m128i c84 = _mm_set1_epi32(0x84);
+	const __m128i bias = _mm_set1_epi32(127);
+	for (; n >= 8; n -= 8, src += 8, dst += 8) {
+		__m128i u = _mm_xor_si128(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)src), zero), xff);
+		__m128i half[2];
+		int k;
+		half[0] = _mm_unpacklo_epi16(u, zero);
+		half[1] = _mm_unpackhi_epi16(u, zero);
+		for (k = 0; k < 2; k++) {
+			__m128i v = half[k];
+			__m128i base, seg, neg;
+			__m128 pow2;
+			base = _mm_add_epi32(_mm_slli_epi32(_mm_and_si128(v, m0f), 3), c84);
+			seg = _mm_srli_epi32(_mm_and_si128(v, m70), 4);
+			pow2 = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(seg, bias), 23));
+			base = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(base), pow2));
+			base = _mm_sub_epi32(base, c84);
+			neg = _mm_cmpeq_epi32(_mm_and_si128(v, m80), m80);
+			half[k] = _mm_sub_epi32(_mm_xor_si128(base, neg), neg);
+		}
+		_mm_storeu_si128((__m128i *)dst, _mm_packs_epi32(half[0], half[1]));
+	}
+#endif
+	for (; n > 0; n--)
+		*dst++ = ulaw_decode_table[*src++];
+}
+
+static void ulaw_encode_run(unsigned char *dst, const int16_t *src,
+			    snd_pcm_uframes_t n)
+{
+	for (; n > 0; n--)
+		*dst++ = ulaw_encode_table[(unsigned short)*src++];
+}
+
 #ifndef DOC_HIDDEN
 
 void snd_pcm_mulaw_decode(const snd_pcm_channel_area_t *dst_areas,
@@ -170,6 +242,16 @@ void snd_pcm_mulaw_decode(const snd_pcm_channel_area_t *dst_areas,
 #undef PUT16_LABELS
 	void *put = put16_labels[putidx];
 	unsigned int channel;
+	int native = putidx == (unsigned int)snd_pcm_linear_put_index(SND_PCM_FORMAT_S16, SND_PCM_FORMAT_S16);
+
+	ulaw_init_tables();
+	if (native && snd_pcm_plugin_areas_interleaved(src_areas, channels, 8) &&
+	    snd_pcm_plugin_areas_interleaved(dst_areas, channels, 16)) {
+		ulaw_decode_run(snd_pcm_channel_area_addr(dst_areas, dst_offset),
+				snd_pcm_channel_area_addr(src_areas, src_offset),
+				frames * channels);
+		return;
+	}
 	for (channel = 0; channel < channels; ++channel) {
 		const unsigned char *src;
 		char *dst;
@@ -181,9 +263,13 @@ void snd_pcm_mulaw_decode(const snd_pcm_channel_area_t *dst_areas,
 		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
 		src_step = snd_pcm_channel_area_step(src_area);
 		dst_step = snd_pcm_channel_area_step(dst_area);
+		if (native && src_step == 1 && dst_step == 2) {
+			ulaw_decode_run((int16_t *)dst, src, frames);
+			continue;
+		}
 		frames1 = frames;
 		while (frames1-- > 0) {
-			int16_t sample = ulaw_to_s16(*src);
+			int16_t sample = ulaw_decode_table[*src];
 			goto *put;
 #define PUT16_END after
 #include "plugin_ops.h"
@@ -208,6 +294,16 @@ void snd_pcm_mulaw_encode(const snd_pcm_channel_area_t *dst_areas,
 	void *get = get16_labels[getidx];
 	unsigned int channel;
 	int16_t sample = 0;
+	int native = getidx == (unsigned int)snd_pcm_linear_get_index(SND_PCM_FORMAT_S16, SND_PCM_FORMAT_S16);
+
+	ulaw_init_tables();
+	if (native && snd_pcm_plugin_areas_interleaved(src_areas, channels, 16) &&
+	    snd_pcm_plugin_areas_interleaved(dst_areas, channels, 8)) {
+		ulaw_encode_run(snd_pcm_channel_area_addr(dst_areas, dst_offset),
+				snd_pcm_channel_area_addr(src_areas, src_offset),
+				frames * channels);
+		return;
+	}
 	for (channel = 0; channel < channels; ++channel) {
 		const char *src;
 		char *dst;
@@ -219,6 +315,11 @@ void snd_pcm_mulaw_encode(const snd_pcm_channel_area_t *dst_areas,
 		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
 		src_step = snd_pcm_channel_area_step(src_area);
 		dst_step = snd_pcm_channel_area_step(dst_area);
+		if (native && src_step == 2 && dst_step == 1) {
+			ulaw_encode_run((unsigned char *)dst,
+					(const int16_t *)src, frames);
+			continue;
+		}
 		frames1 = frames;
 		while (frames1-- > 0) {
 			goto *get;
@@ -226,7 +327,7 @@ void snd_pcm_mulaw_encode(const snd_pcm_channel_area_t *dst_areas,
 #include "plugin_ops.h"
 #undef GET16_END
 		after:
-			*dst = s16_to_ulaw(sample);
+			*dst = ulaw_encode_table[(unsigned short)sample];
 			src += src_step;
 			dst += dst_step;
 		}
@@ -468,6 +569,7 @@ int snd_pcm_mulaw_open(snd_pcm_t **pcmp, const char *name, snd_pcm_format_t sfor
 	pcm->poll_fd = slave->poll_fd;
 	pcm->poll_events = slave->poll_events;
 	pcm->monotonic = slave->monotonic;
+	pcm->trace = slave->trace;
 	snd_pcm_set_hw_ptr(pcm, &mulaw->plug.hw_ptr, -1, 0);
 	snd_pcm_set_appl_ptr(pcm, &mulaw->plug.appl_ptr, -1, 0);
 	*pcmp = pcm;
@@ -33,6 +33,12 @@
 #include <math.h>
 #include "pcm_local.h"
 #include "pcm_generic.h"
+#ifdef HAVE_LIBPTHREAD
+#include <limits.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 
 #ifndef PIC
 /* entry for static linking */
@@ -41,11 +47,26 @@ const char *_snd_module_pcm_multi = "";
 
 #ifndef DOC_HIDDEN
 
+typedef enum {
+	MULTI_JOB_COMMIT,
+	MULTI_JOB_AVAIL,
+	MULTI_JOB_PREPARE,
+	MULTI_JOB_START,
+	MULTI_JOB_QUIT,
+} snd_pcm_multi_job_t;
+
 typedef struct {
 	snd_pcm_t *pcm;
 	unsigned int channels_count;
 	int close_slave;
 	snd_pcm_t *linked;
+	struct snd_pcm_multi *multi;
+#ifdef HAVE_LIBPTHREAD
+	pthread_t thread;
+	int thread_running;
+	int job_seq;			/* last job seen by the thread */
+#endif
+	snd_pcm_sframes_t result;	/* of the last job */
 } snd_pcm_multi_slave_t;
 
 typedef struct {
@@ -53,21 +74,184 @@ typedef struct {
 	unsigned int slave_channel;
 } snd_pcm_multi_channel_t;
 
-typedef struct {
+typedef struct snd_pcm_multi {
 	unsigned int slaves_count;
 	unsigned int master_slave;
 	snd_pcm_multi_slave_t *slaves;
 	unsigned int channels_count;
 	snd_pcm_multi_channel_t *channels;
+	int concurrent;			/* slaves 1..n-1 run jobs in own threads */
+	/* the job being dispatched */
+	snd_pcm_multi_job_t job;
+	snd_pcm_uframes_t job_offset;
+	snd_pcm_uframes_t job_size;
+	int job_seq;			/* futex, bumped for every job */
+	int job_pending;		/* futex, slave threads still busy */
+	/* distance between the most and least advanced slave */
+	snd_pcm_uframes_t skew;
+	snd_pcm_uframes_t max_skew;
 } snd_pcm_multi_t;
 
+#define atomic_load_acquire(ptr)	__atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define atomic_store_release(ptr, v)	__atomic_store_n(ptr, v, __ATOMIC_RELEASE)
+
+#endif
+
+static snd_pcm_sframes_t snd_pcm_multi_slave_job(snd_pcm_multi_slave_t *slave)
+{
+	snd_pcm_multi_t *multi = slave->multi;
+	snd_pcm_sframes_t result;
+
+	switch (multi->job) {
+	case MULTI_JOB_COMMIT:
+		result = snd_pcm_mmap_commit(slave->pcm, multi->job_offset,
+					     multi->job_size);
+		if (result >= 0 && (snd_pcm_uframes_t)result != multi->job_size)
+			result = -EIO;
+		return result;
+	case MULTI_JOB_AVAIL:
+		return snd_pcm_avail_update(slave->pcm);
+	case MULTI_JOB_PREPARE:
+		return snd_pcm_prepare(slave->pcm);
+	case MULTI_JOB_START:
+		if (slave->linked)
+			return 0;
+		return snd_pcm_start(slave->pcm);
+	default:
+		return 0;
+	}
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void multi_futex_wait(int *addr, int val)
+{
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void multi_futex_wake(int *addr, int count)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+static void *snd_pcm_multi_slave_thread(void *data)
+{
+	snd_pcm_multi_slave_t *slave = data;
+	snd_pcm_multi_t *multi = slave->multi;
+	int seq = slave->job_seq;
+	int cur;
+
+	while (1) {
+		while ((cur = atomic_load_acquire(&multi->job_seq)) == seq)
+			multi_futex_wait(&multi->job_seq, seq);
+		seq = cur;
+		if (multi->job == MULTI_JOB_QUIT)
+			break;
+		slave->result = snd_pcm_multi_slave_job(slave);
+		if (__atomic_sub_fetch(&multi->job_pending, 1, __ATOMIC_ACQ_REL) == 0)
+			multi_futex_wake(&multi->job_pending, 1);
+	}
+	return NULL;
+}
+
+/*
+ * Fan the job out to the slave threads, run it on the first slave
+ * here and wait until all threads have checked in. The job words
+ * are written before the sequence bump which publishes them.
+ */
+static void snd_pcm_multi_dispatch(snd_pcm_multi_t *multi)
+{
+	int pending;
+
+	atomic_store_release(&multi->job_pending, (int)multi->slaves_count - 1);
+	__atomic_add_fetch(&multi->job_seq, 1, __ATOMIC_RELEASE);
+	multi_futex_wake(&multi->job_seq, INT_MAX);
+	multi->slaves[0].result = snd_pcm_multi_slave_job(&multi->slaves[0]);
+	while ((pending = atomic_load_acquire(&multi->job_pending)) != 0)
+		multi_futex_wait(&multi->job_pending, pending);
+}
+
+static void snd_pcm_multi_stop_threads(snd_pcm_multi_t *multi)
+{
+	unsigned int i;
+
+	if (!multi->concurrent)
+		return;
+	multi->job = MULTI_JOB_QUIT;
+	__atomic_add_fetch(&multi->job_seq, 1, __ATOMIC_RELEASE);
+	multi_futex_wake(&multi->job_seq, INT_MAX);
+	for (i = 1; i < multi->slaves_count; ++i) {
+		if (multi->slaves[i].thread_running)
+			pthread_join(multi->slaves[i].thread, NULL);
+		multi->slaves[i].thread_running = 0;
+	}
+	multi->concurrent = 0;
+}
+
+static int snd_pcm_multi_start_threads(snd_pcm_multi_t *multi)
+{
+	unsigned int i;
+	int err;
+
+	multi->concurrent = 1;
+	for (i = 1; i < multi->slaves_count; ++i) {
+		/* taken here, a late thread must not miss the first job */
+		multi->slaves[i].job_seq = multi->job_seq;
+		err = pthread_create(&multi->slaves[i].thread, NULL,
+				     snd_pcm_multi_slave_thread, &multi->slaves[i]);
+		if (err) {
+			snd_pcm_multi_stop_threads(multi);
+			return -err;
+		}
+		multi->slaves[i].thread_running = 1;
+	}
+	return 0;
+}
+#else
+#define snd_pcm_multi_dispatch(multi)		do { } while (0)
+#define snd_pcm_multi_stop_threads(multi)	do { } while (0)
+
+static int snd_pcm_multi_start_threads(snd_pcm_multi_t *multi ATTRIBUTE_UNUSED)
+{
+	return -ENOSYS;
+}
 #endif
 
+/*
+ * Run a job on all slaves and return the first error. Without
+ * threads the slaves are walked in order and the walk stops at the
+ * first error, except for prepare which must reach every slave.
+ */
+static snd_pcm_sframes_t snd_pcm_multi_run_job(snd_pcm_multi_t *multi,
+					       snd_pcm_multi_job_t job)
+{
+	snd_pcm_sframes_t result = 0;
+	unsigned int i;
+
+	multi->job = job;
+	if (multi->concurrent) {
+		snd_pcm_multi_dispatch(multi);
+		for (i = 0; i < multi->slaves_count; ++i)
+			if (multi->slaves[i].result < 0)
+				return multi->slaves[i].result;
+		return 0;
+	}
+	for (i = 0; i < multi->slaves_count; ++i) {
+		multi->slaves[i].result = snd_pcm_multi_slave_job(&multi->slaves[i]);
+		if (multi->slaves[i].result < 0) {
+			if (job != MULTI_JOB_PREPARE)
+				return multi->slaves[i].result;
+			result = multi->slaves[i].result;
+		}
+	}
+	return result;
+}
+
 static int snd_pcm_multi_close(snd_pcm_t *pcm)
 {
 	snd_pcm_multi_t *multi = pcm->private_data;
 	unsigned int i;
 	int ret = 0;
+	snd_pcm_multi_stop_threads(multi);
 	for (i = 0; i < multi->slaves_count; ++i) {
 		snd_pcm_multi_slave_t *slave = &multi->slaves[i];
 		if (slave->close_slave) {
@@ -418,16 +602,23 @@ static int snd_pcm_multi_delay(snd_pcm_t *pcm, snd_pcm_sframes_t *delayp)
 static snd_pcm_sframes_t snd_pcm_multi_avail_update(snd_pcm_t *pcm)
 {
 	snd_pcm_multi_t *multi = pcm->private_data;
-	snd_pcm_sframes_t ret = LONG_MAX;
+	snd_pcm_sframes_t ret = LONG_MAX, max = 0;
+	snd_pcm_sframes_t err;
 	unsigned int i;
+	err = snd_pcm_multi_run_job(multi, MULTI_JOB_AVAIL);
+	if (err < 0)
+		return err;
 	for (i = 0; i < multi->slaves_count; ++i) {
-		snd_pcm_sframes_t avail;
-		avail = snd_pcm_avail_update(multi->slaves[i].pcm);
-		if (avail < 0)
-			return avail;
+		snd_pcm_sframes_t avail = multi->slaves[i].result;
 		if (ret > avail)
 			ret = avail;
+		if (max < avail)
+			max = avail;
 	}
+	/* all slaves got the same commits, so this is their clock skew */
+	multi->skew = max - ret;
+	if (multi->skew > multi->max_skew)
+		multi->max_skew = multi->skew;
 	return ret;
 }
 
@@ -442,17 +633,11 @@ static int snd_pcm_multi_htimestamp(snd_pcm_t *pcm, snd_pcm_uframes_t *avail,
 static int snd_pcm_multi_prepare(snd_pcm_t *pcm)
 {
 	snd_pcm_multi_t *multi = pcm->private_data;
-	int result = 0, err;
-	unsigned int i;
-	for (i = 0; i < multi->slaves_count; ++i) {
-		/* We call prepare to each slave even if it's linked.
-		 * This is to make sure to sync non-mmaped control/status.
-		 */
-		err = snd_pcm_prepare(multi->slaves[i].pcm);
-		if (err < 0)
-			result = err;
-	}
-	return result;
+	multi->skew = multi->max_skew = 0;
+	/* We call prepare to each slave even if it's linked.
+	 * This is to make sure to sync non-mmaped control/status.
+	 */
+	return snd_pcm_multi_run_job(multi, MULTI_JOB_PREPARE);
 }
 
 static int snd_pcm_multi_reset(snd_pcm_t *pcm)
@@ -460,6 +645,7 @@ static int snd_pcm_multi_reset(snd_pcm_t *pcm)
 	snd_pcm_multi_t *multi = pcm->private_data;
 	int result = 0, err;
 	unsigned int i;
+	multi->skew = multi->max_skew = 0;
 	for (i = 0; i < multi->slaves_count; ++i) {
 		/* Reset each slave, as well as in prepare */
 		err = snd_pcm_reset(multi->slaves[i].pcm);
@@ -476,18 +662,9 @@ static int snd_pcm_multi_reset(snd_pcm_t *pcm)
 static int snd_pcm_multi_start(snd_pcm_t *pcm)
 {
 	snd_pcm_multi_t *multi = pcm->private_data;
-	int err = 0;
-	unsigned int i;
 	if (multi->slaves[0].linked)
 		return snd_pcm_start(multi->slaves[0].linked);
-	for (i = 0; i < multi->slaves_count; ++i) {
-		if (multi->slaves[i].linked)
-			continue;
-		err = snd_pcm_start(multi->slaves[i].pcm);
-		if (err < 0)
-			return err;
-	}
-	return err;
+	return snd_pcm_multi_run_job(multi, MULTI_JOB_START);
 }
 
 static int snd_pcm_multi_drop(snd_pcm_t *pcm)
@@ -719,18 +896,13 @@ static snd_pcm_sframes_t snd_pcm_multi_mmap_commit(snd_pcm_t *pcm,
 						   snd_pcm_uframes_t size)
 {
 	snd_pcm_multi_t *multi = pcm->private_data;
-	snd_pcm_t *slave;
-	unsigned int i;
 	snd_pcm_sframes_t result;
 
-	for (i = 0; i < multi->slaves_count; ++i) {
-		slave = multi->slaves[i].pcm;
-		result = snd_pcm_mmap_commit(slave, offset, size);
-		if (result < 0)
-			return result;
-		if ((snd_pcm_uframes_t)result != size)
-			return -EIO;
-	}
+	multi->job_offset = offset;
+	multi->job_size = size;
+	result = snd_pcm_multi_run_job(multi, MULTI_JOB_COMMIT);
+	if (result < 0)
+		return result;
 	return size;
 }
 
@@ -925,6 +1097,9 @@ static void snd_pcm_multi_dump(snd_pcm_t *pcm, snd_output_t *out)
 		snd_output_printf(out, "    %d: slave %d, channel %d\n", 
 			k, c->slave_idx, c->slave_channel);
 	}
+	snd_output_printf(out, "  Concurrent: %s\n", multi->concurrent ? "yes" : "no");
+	snd_output_printf(out, "  Skew: %lu frames (worst %lu)\n",
+			  multi->skew, multi->max_skew);
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -1048,6 +1223,7 @@ int snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
 		slave->pcm = slaves_pcm[i];
 		slave->channels_count = schannels_count[i];
 		slave->close_slave = close_slaves;
+		slave->multi = multi;
 	}
 	for (i = 0; i < channels_count; ++i) {
 		snd_pcm_multi_channel_t *bind = &multi->channels[i];
@@ -1078,12 +1254,39 @@ int snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
 	pcm->poll_fd = multi->slaves[master_slave].pcm->poll_fd;
 	pcm->poll_events = multi->slaves[master_slave].pcm->poll_events;
 	pcm->monotonic = multi->slaves[master_slave].pcm->monotonic;
+	pcm->trace = multi->slaves[master_slave].pcm->trace;
 	snd_pcm_link_hw_ptr(pcm, multi->slaves[master_slave].pcm);
 	snd_pcm_link_appl_ptr(pcm, multi->slaves[master_slave].pcm);
 	*pcmp = pcm;
 	return 0;
 }
 
+/**
+ * \brief Get the clock skew between the slaves of a Multi PCM
+ * \param pcm Multi PCM handle
+ * \param skew Returns the skew seen by the last avail update (frames)
+ * \param max_skew Returns the worst skew since the last prepare (frames)
+ * \retval zero on success otherwise a negative error code
+ *
+ * The skew is the distance between the most and the least advanced
+ * slave. It grows when the slaves run from different clocks.
+ */
+int snd_pcm_multi_get_skew(snd_pcm_t *pcm, snd_pcm_uframes_t *skew,
+			   snd_pcm_uframes_t *max_skew)
+{
+	snd_pcm_multi_t *multi;
+
+	assert(pcm);
+	if (pcm->type != SND_PCM_TYPE_MULTI)
+		return -EINVAL;
+	multi = pcm->private_data;
+	if (skew)
+		*skew = multi->skew;
+	if (max_skew)
+		*max_skew = multi->max_skew;
+	return 0;
+}
+
 /*! \page pcm_plugins
 
 \section pcm_plugins_multi Plugin: Multiple streams to One
@@ -1110,9 +1313,18 @@ pcm.name {
 		}
 	}
 	[master INT]		# Define the master slave
+	[concurrent BOOL]	# Run slave transfers in a thread per slave
 }
 \endcode
 
+With concurrent set, mmap_commit, avail_update, prepare and start are
+handed to one thread per slave (the calling thread serves the first
+slave) and the caller waits until every slave is done, so a slow slave
+plugin (rate, file, ladspa...) no longer delays the others. The slaves
+must be independent PCMs then. The distance in frames between the most
+and the least advanced slave is tracked on every avail_update and can
+be read with snd_pcm_multi_get_skew() or seen in the dump.
+
 For example, to bind two PCM streams with two-channel stereo (hw:0,0 and
 hw:0,1) as one 4-channel stereo PCM stream, define like this:
 \code
@@ -1154,6 +1366,7 @@ pcm.quad2 {
 
 <UL>
   <LI>snd_pcm_multi_open()
+  <LI>snd_pcm_multi_get_skew()
   <LI>_snd_pcm_multi_open()
 </UL>
 
@@ -1190,6 +1403,7 @@ int _snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
 	unsigned int slaves_count = 0;
 	long master_slave = 0;
 	unsigned int channels_count = 0;
+	int concurrent = 0;
 	snd_config_for_each(i, inext, conf) {
 		snd_config_t *n = snd_config_iterator_entry(i);
 		const char *id;
@@ -1220,6 +1434,12 @@ int _snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
 			}
 			continue;
 		}
+		if (strcmp(id, "concurrent") == 0) {
+			concurrent = snd_config_get_bool(n);
+			if (concurrent < 0)
+				return -EINVAL;
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -1369,6 +1589,16 @@ int _snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
 				 channels_count,
 				 channels_sidx, channels_schannel,
 				 1);
+	if (err >= 0 && concurrent && slaves_count > 1) {
+		err = snd_pcm_multi_start_threads((*pcmp)->private_data);
+		if (err < 0) {
+			SNDERR("cannot start the slave threads");
+			snd_pcm_close(*pcmp);
+			*pcmp = NULL;
+			/* the slaves went with the multi PCM */
+			memset(slaves_pcm, 0, slaves_count * sizeof(*slaves_pcm));
+		}
+	}
 _free:
 	if (err < 0) {
 		for (idx = 0; idx < slaves_count; ++idx) {
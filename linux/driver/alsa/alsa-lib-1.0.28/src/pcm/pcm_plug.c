@@ -1128,6 +1128,7 @@ int snd_pcm_plug_open(snd_pcm_t **pcmp,
 	pcm->poll_events = slave->poll_events;
 	pcm->mmap_shadow = 1;
 	pcm->monotonic = slave->monotonic;
+	pcm->trace = slave->trace;
 	snd_pcm_link_hw_ptr(pcm, slave);
 	snd_pcm_link_appl_ptr(pcm, slave);
 	*pcmp = pcm;
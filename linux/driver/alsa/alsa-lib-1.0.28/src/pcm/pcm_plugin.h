@@ -46,6 +46,7 @@ typedef struct {
 	snd_pcm_slave_xfer_areas_undo_func_t undo_write;
 	int (*init)(snd_pcm_t *pcm);
 	snd_pcm_uframes_t appl_ptr, hw_ptr;
+	snd_pcm_uframes_t latency;	/* frames held back, added to delay/status */
 	snd_atomic_write_t watom;
 } snd_pcm_plugin_t;	
 
@@ -83,6 +84,25 @@ snd_pcm_sframes_t snd_pcm_plugin_undo_write_generic
       snd_pcm_uframes_t res_size,		/* size of result areas */
       snd_pcm_uframes_t slave_undo_size);
 
+/*
+ * true when the areas describe one interleaved block of width bits
+ * samples, i.e. the whole transfer is a single run of channels * frames
+ */
+static inline int snd_pcm_plugin_areas_interleaved(const snd_pcm_channel_area_t *areas,
+						   unsigned int channels,
+						   unsigned int width)
+{
+	unsigned int c;
+
+	for (c = 0; c < channels; c++) {
+		if (areas[c].addr != areas[0].addr ||
+		    areas[c].first != areas[0].first + c * width ||
+		    areas[c].step != channels * width)
+			return 0;
+	}
+	return 1;
+}
+
 /* make local functions really local */
 #define snd_pcm_linear_get_index	snd1_pcm_linear_get_index
 #define snd_pcm_linear_put_index	snd1_pcm_linear_put_index
@@ -543,9 +543,12 @@ snd_pcm_rate_write_areas1(snd_pcm_t *pcm,
 			 snd_pcm_uframes_t slave_offset)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
+	unsigned long long stamp = snd_pcm_stats_stamp();
+
 	do_convert(slave_areas, slave_offset, rate->gen.slave->period_size,
 		   areas, offset, pcm->period_size,
 		   pcm->channels, rate);
+	snd_pcm_stats_transfer(pcm, pcm->period_size, stamp);
 }
 
 static inline void
@@ -556,9 +559,12 @@ snd_pcm_rate_read_areas1(snd_pcm_t *pcm,
 			 snd_pcm_uframes_t slave_offset)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
+	unsigned long long stamp = snd_pcm_stats_stamp();
+
 	do_convert(areas, offset, pcm->period_size,
 		   slave_areas, slave_offset, rate->gen.slave->period_size,
 		   pcm->channels, rate);
+	snd_pcm_stats_transfer(pcm, pcm->period_size, stamp);
 }
 
 static inline void snd_pcm_rate_sync_hwptr(snd_pcm_t *pcm)
@@ -1371,6 +1377,7 @@ int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 	pcm->poll_events = slave->poll_events;
 	pcm->mmap_rw = 1;
 	pcm->monotonic = slave->monotonic;
+	pcm->trace = slave->trace;
 	snd_pcm_set_hw_ptr(pcm, &rate->hw_ptr, -1, 0);
 	snd_pcm_set_appl_ptr(pcm, &rate->appl_ptr, -1, 0);
 	*pcmp = pcm;
@@ -33,9 +33,11 @@
 #include <string.h>
 #include <signal.h>
 #include <math.h>
+#include <stdint.h>
 #include <sys/socket.h>
 #include <sys/poll.h>
 #include <sys/shm.h>
+#include <sys/eventfd.h>
 #include <pthread.h>
 #include "pcm_local.h"
 
@@ -72,6 +74,13 @@ do { \
 #define Pthread_mutex_unlock(mutex) pthread_mutex_unlock(mutex)
 #endif
 
+/* client hw_ptr is written by the slave thread and read without the mutex */
+#define atomic_store_release(ptr, v)	__atomic_store_n(ptr, v, __ATOMIC_RELEASE)
+#define atomic_load_acquire(ptr)	__atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define atomic_fence()			__atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#define SHARE_IDLE	UINT64_MAX
+
 typedef struct {
 	struct list_head clients;
 	struct list_head list;
@@ -87,10 +96,16 @@ typedef struct {
 	unsigned int running_count;
 	snd_pcm_uframes_t safety_threshold;
 	snd_pcm_uframes_t silence_frames;
-	snd_pcm_sw_params_t sw_params;
 	snd_pcm_uframes_t hw_ptr;
-	int poll[2];
+	uint64_t hw_pos;		/* hw_ptr without boundary wrap */
+	uint64_t wakeup;		/* hw_pos the thread sleeps until */
+	struct _snd_pcm_share **heap;	/* clients ordered by deadline */
+	unsigned int heap_count;
+	unsigned int heap_alloc;
+	int event_fd;
 	int polling;
+	/* running client the slave waits for, NULL if unknown */
+	struct _snd_pcm_share *holder;
 	pthread_t thread;
 	pthread_mutex_t mutex;
 #ifdef MUTEX_DEBUG
@@ -99,7 +114,7 @@ typedef struct {
 	pthread_cond_t poll_cond;
 } snd_pcm_share_slave_t;
 
-typedef struct {
+typedef struct _snd_pcm_share {
 	struct list_head list;
 	snd_pcm_t *pcm;
 	snd_pcm_share_slave_t *slave;
@@ -110,7 +125,10 @@ typedef struct {
 	snd_pcm_state_t state;
 	snd_pcm_uframes_t hw_ptr;
 	snd_pcm_uframes_t appl_ptr;
+	uint64_t deadline;		/* slave hw_pos of the next event */
+	int heap_idx;			/* -1 when no event is pending */
 	int ready;
+	int dirty;			/* appl_ptr moved without the mutex */
 	int client_socket;
 	int slave_socket;
 } snd_pcm_share_t;
@@ -131,9 +149,29 @@ static snd_pcm_uframes_t snd_pcm_share_slave_avail(snd_pcm_share_slave_t *slave)
 	return avail;
 }
 
+/* Client avail for the given appl_ptr */
+static snd_pcm_uframes_t snd_pcm_share_avail(snd_pcm_t *pcm,
+					     snd_pcm_uframes_t appl_ptr)
+{
+	snd_pcm_share_t *share = pcm->private_data;
+	snd_pcm_sframes_t avail;
+	avail = share->hw_ptr - appl_ptr;
+	if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
+		avail += pcm->buffer_size;
+	if (avail < 0)
+		avail += pcm->boundary;
+	else if ((snd_pcm_uframes_t) avail >= pcm->boundary)
+		avail -= pcm->boundary;
+	return avail;
+}
+
 /* Warning: take the mutex before to call this */
-/* Return number of frames to mmap_commit the slave */
-static snd_pcm_uframes_t _snd_pcm_share_slave_forward(snd_pcm_share_slave_t *slave)
+/* Return number of frames to mmap_commit the slave. The running client
+   which limits it is returned in holder with the appl_ptr seen, holder
+   is NULL when no single client does. */
+static snd_pcm_uframes_t _snd_pcm_share_slave_forward(snd_pcm_share_slave_t *slave,
+						      snd_pcm_share_t **holder,
+						      snd_pcm_uframes_t *holder_appl)
 {
 	struct list_head *i;
 	snd_pcm_uframes_t buffer_size;
@@ -141,10 +179,12 @@ static snd_pcm_uframes_t _snd_pcm_share_slave_forward(snd_pcm_share_slave_t *sla
 	snd_pcm_sframes_t min_frames, max_frames;
 	snd_pcm_uframes_t avail, slave_avail;
 	snd_pcm_uframes_t slave_hw_avail;
+	snd_pcm_uframes_t appl_ptr;
 	slave_avail = snd_pcm_share_slave_avail(slave);
 	buffer_size = slave->pcm->buffer_size;
 	min_frames = slave_avail;
 	max_frames = 0;
+	*holder = NULL;
 	list_for_each(i, &slave->clients) {
 		snd_pcm_share_t *share = list_entry(i, snd_pcm_share_t, list);
 		snd_pcm_t *pcm = share->pcm;
@@ -158,14 +198,19 @@ static snd_pcm_uframes_t _snd_pcm_share_slave_forward(snd_pcm_share_slave_t *sla
 		default:
 			continue;
 		}
-		avail = snd_pcm_mmap_avail(pcm);
+		/* running clients may move it without the mutex */
+		appl_ptr = atomic_load_acquire(&share->appl_ptr);
+		avail = snd_pcm_share_avail(pcm, appl_ptr);
 		frames = slave_avail - avail;
 		if (frames > max_frames)
 			max_frames = frames;
 		if (share->state != SND_PCM_STATE_RUNNING)
 			continue;
-		if (frames < min_frames)
+		if (frames < min_frames) {
 			min_frames = frames;
+			*holder = share;
+			*holder_appl = appl_ptr;
+		}
 	}
 	if (max_frames == 0)
 		return 0;
@@ -180,6 +225,7 @@ static snd_pcm_uframes_t _snd_pcm_share_slave_forward(snd_pcm_share_slave_t *sla
 			frames = max_frames;
 		else
 			frames = safety_frames;
+		*holder = NULL;
 	}
 	if (frames < 0)
 		return 0;
@@ -215,7 +261,7 @@ static snd_pcm_uframes_t _snd_pcm_share_missing(snd_pcm_t *pcm)
 	default:
 		return INT_MAX;
 	}
-	share->hw_ptr = slave->hw_ptr;
+	atomic_store_release(&share->hw_ptr, slave->hw_ptr);
 	avail = snd_pcm_mmap_avail(pcm);
 	if (avail >= pcm->stop_threshold) {
 		_snd_pcm_share_stop(pcm, share->state == SND_PCM_STATE_DRAINING ? SND_PCM_STATE_SETUP : SND_PCM_STATE_XRUN);
@@ -333,78 +379,181 @@ static snd_pcm_uframes_t _snd_pcm_share_missing(snd_pcm_t *pcm)
 	return missing;
 }
 
-static snd_pcm_uframes_t _snd_pcm_share_slave_missing(snd_pcm_share_slave_t *slave)
+/* Warning: take the mutex before to call this */
+static void snd_pcm_share_slave_sync(snd_pcm_share_slave_t *slave)
+{
+	snd_pcm_uframes_t hw_ptr = *slave->pcm->hw.ptr;
+	snd_pcm_sframes_t delta = hw_ptr - slave->hw_ptr;
+	if (delta < 0)
+		delta += slave->pcm->boundary;
+	slave->hw_pos += delta;
+	slave->hw_ptr = hw_ptr;
+}
+
+/*
+ * Pending client events are kept in a binary min-heap ordered by their
+ * deadline, so the thread only reevaluates the clients which are due.
+ */
+static void snd_pcm_share_heap_set(snd_pcm_share_slave_t *slave,
+				   unsigned int idx, snd_pcm_share_t *share)
+{
+	slave->heap[idx] = share;
+	share->heap_idx = idx;
+}
+
+static void snd_pcm_share_heap_up(snd_pcm_share_slave_t *slave, unsigned int idx)
+{
+	snd_pcm_share_t *share = slave->heap[idx];
+	while (idx > 0) {
+		unsigned int parent = (idx - 1) / 2;
+		if (slave->heap[parent]->deadline <= share->deadline)
+			break;
+		snd_pcm_share_heap_set(slave, idx, slave->heap[parent]);
+		idx = parent;
+	}
+	snd_pcm_share_heap_set(slave, idx, share);
+}
+
+static void snd_pcm_share_heap_down(snd_pcm_share_slave_t *slave, unsigned int idx)
+{
+	snd_pcm_share_t *share = slave->heap[idx];
+	while (1) {
+		unsigned int child = idx * 2 + 1;
+		if (child >= slave->heap_count)
+			break;
+		if (child + 1 < slave->heap_count &&
+		    slave->heap[child + 1]->deadline < slave->heap[child]->deadline)
+			child++;
+		if (share->deadline <= slave->heap[child]->deadline)
+			break;
+		snd_pcm_share_heap_set(slave, idx, slave->heap[child]);
+		idx = child;
+	}
+	snd_pcm_share_heap_set(slave, idx, share);
+}
+
+static void snd_pcm_share_heap_remove(snd_pcm_share_slave_t *slave,
+				      snd_pcm_share_t *share)
+{
+	unsigned int idx = share->heap_idx;
+	snd_pcm_share_t *last;
+	if (share->heap_idx < 0)
+		return;
+	share->heap_idx = -1;
+	if (--slave->heap_count == idx)
+		return;
+	last = slave->heap[slave->heap_count];
+	snd_pcm_share_heap_set(slave, idx, last);
+	snd_pcm_share_heap_up(slave, idx);
+	snd_pcm_share_heap_down(slave, last->heap_idx);
+}
+
+/* Warning: take the mutex before to call this */
+static void _snd_pcm_share_schedule(snd_pcm_share_t *share,
+				    snd_pcm_uframes_t missing)
+{
+	snd_pcm_share_slave_t *slave = share->slave;
+	if (missing >= INT_MAX) {
+		snd_pcm_share_heap_remove(slave, share);
+		return;
+	}
+	if (missing == 0)
+		missing = 1;
+	share->deadline = slave->hw_pos + missing;
+	if (share->heap_idx < 0) {
+		snd_pcm_share_heap_set(slave, slave->heap_count++, share);
+		snd_pcm_share_heap_up(slave, share->heap_idx);
+	} else {
+		snd_pcm_share_heap_up(slave, share->heap_idx);
+		snd_pcm_share_heap_down(slave, share->heap_idx);
+	}
+}
+
+/* Warning: take the mutex before to call this */
+/* Force the next commit of every client to take the mutex */
+static void _snd_pcm_share_drop_holder(snd_pcm_share_slave_t *slave)
+{
+	atomic_store_release(&slave->holder, NULL);
+}
+
+/* Warning: take the mutex before to call this */
+/* Make every pending client due, e.g. after the slave was rewound */
+static void _snd_pcm_share_reschedule(snd_pcm_share_slave_t *slave)
+{
+	unsigned int k;
+	_snd_pcm_share_drop_holder(slave);
+	for (k = 0; k < slave->heap_count; k++)
+		slave->heap[k]->deadline = slave->hw_pos;
+}
+
+/* Return the slave position to wake up at for the given deadline */
+static uint64_t snd_pcm_share_wakeup(snd_pcm_share_slave_t *slave,
+				     uint64_t deadline)
+{
+	snd_pcm_uframes_t period_size = slave->pcm->period_size;
+	deadline += period_size - 1;
+	return deadline - deadline % period_size;
+}
+
+static void snd_pcm_share_slave_kick(snd_pcm_share_slave_t *slave)
+{
+	uint64_t val = 1;
+	if (write(slave->event_fd, &val, sizeof(val)) < 0 && errno != EAGAIN)
+		SYSMSG("eventfd write error");
+}
+
+/* Warning: take the mutex before to call this */
+/* Return the slave position of the next event or SHARE_IDLE */
+static uint64_t _snd_pcm_share_slave_missing(snd_pcm_share_slave_t *slave)
 {
-	snd_pcm_uframes_t missing = INT_MAX;
 	struct list_head *i;
 	/* snd_pcm_sframes_t avail = */ snd_pcm_avail_update(slave->pcm);
-	slave->hw_ptr = *slave->pcm->hw.ptr;
+	snd_pcm_share_slave_sync(slave);
 	list_for_each(i, &slave->clients) {
 		snd_pcm_share_t *share = list_entry(i, snd_pcm_share_t, list);
-		snd_pcm_t *pcm = share->pcm;
-		snd_pcm_uframes_t m = _snd_pcm_share_missing(pcm);
-		if (m < missing)
-			missing = m;
+		if (share->heap_idx >= 0)
+			atomic_store_release(&share->hw_ptr, slave->hw_ptr);
+		/* poll state of a client committed without the mutex */
+		if (__atomic_exchange_n(&share->dirty, 0, __ATOMIC_ACQUIRE))
+			_snd_pcm_share_schedule(share, _snd_pcm_share_missing(share->pcm));
 	}
-	return missing;
+	while (slave->heap_count > 0) {
+		snd_pcm_share_t *share = slave->heap[0];
+		if (share->deadline > slave->hw_pos)
+			break;
+		_snd_pcm_share_schedule(share, _snd_pcm_share_missing(share->pcm));
+	}
+	if (slave->heap_count == 0)
+		return SHARE_IDLE;
+	return snd_pcm_share_wakeup(slave, slave->heap[0]->deadline);
 }
 
 static void *snd_pcm_share_thread(void *data)
 {
 	snd_pcm_share_slave_t *slave = data;
 	snd_pcm_t *spcm = slave->pcm;
-	struct pollfd pfd[2];
-	int err;
+	struct pollfd pfd;
 
-	pfd[0].fd = slave->poll[0];
-	pfd[0].events = POLLIN;
-	err = snd_pcm_poll_descriptors(spcm, &pfd[1], 1);
-	if (err != 1) {
-		SNDERR("invalid poll descriptors %d", err);
-		return NULL;
-	}
+	pfd.fd = slave->event_fd;
+	pfd.events = POLLIN;
 	Pthread_mutex_lock(&slave->mutex);
-	err = pipe(slave->poll);
-	if (err < 0) {
-		SYSERR("can't create a pipe");
-		return NULL;
-	}
 	while (slave->open_count > 0) {
-		snd_pcm_uframes_t missing;
-		// printf("begin min_missing\n");
-		missing = _snd_pcm_share_slave_missing(slave);
-		// printf("min_missing=%ld\n", missing);
-		if (missing < INT_MAX) {
-			snd_pcm_uframes_t hw_ptr;
-			snd_pcm_sframes_t avail_min;
-			hw_ptr = slave->hw_ptr + missing;
-			hw_ptr += spcm->period_size - 1;
-			if (hw_ptr >= spcm->boundary)
-				hw_ptr -= spcm->boundary;
-			hw_ptr -= hw_ptr % spcm->period_size;
-			avail_min = hw_ptr - *spcm->appl.ptr;
-			if (spcm->stream == SND_PCM_STREAM_PLAYBACK)
-				avail_min += spcm->buffer_size;
-			if (avail_min < 0)
-				avail_min += spcm->boundary;
-			// printf("avail_min=%d\n", avail_min);
-			if ((snd_pcm_uframes_t)avail_min != spcm->avail_min) {
-				snd_pcm_sw_params_set_avail_min(spcm, &slave->sw_params, avail_min);
-				err = snd_pcm_sw_params(spcm, &slave->sw_params);
-				if (err < 0) {
-					SYSERR("snd_pcm_sw_params error");
-					return NULL;
-				}
-			}
+		uint64_t wakeup;
+		wakeup = _snd_pcm_share_slave_missing(slave);
+		if (wakeup != SHARE_IDLE) {
+			uint64_t frames = wakeup - slave->hw_pos;
+			int timeout = (frames * 1000 + spcm->rate - 1) / spcm->rate;
+			slave->wakeup = wakeup;
 			slave->polling = 1;
 			Pthread_mutex_unlock(&slave->mutex);
-			err = poll(pfd, 2, -1);
+			poll(&pfd, 1, timeout);
 			Pthread_mutex_lock(&slave->mutex);
-			if (pfd[0].revents & POLLIN) {
-				char buf[1];
-				read(pfd[0].fd, buf, 1);
+			if (pfd.revents & POLLIN) {
+				uint64_t val;
+				read(slave->event_fd, &val, sizeof(val));
 			}
 		} else {
+			slave->wakeup = SHARE_IDLE;
 			slave->polling = 0;
 			pthread_cond_wait(&slave->poll_cond, &slave->mutex);
 		}
@@ -420,35 +569,19 @@ static void _snd_pcm_share_update(snd_pcm_t *pcm)
 	snd_pcm_t *spcm = slave->pcm;
 	snd_pcm_uframes_t missing;
 	/* snd_pcm_sframes_t avail = */ snd_pcm_avail_update(spcm);
-	slave->hw_ptr = *slave->pcm->hw.ptr;
+	snd_pcm_share_slave_sync(slave);
 	missing = _snd_pcm_share_missing(pcm);
 	// printf("missing %ld\n", missing);
+	_snd_pcm_share_schedule(share, missing);
 	if (!slave->polling) {
 		pthread_cond_signal(&slave->poll_cond);
 		return;
 	}
-	if (missing < INT_MAX) {
-		snd_pcm_uframes_t hw_ptr;
-		snd_pcm_sframes_t avail_min;
-		hw_ptr = slave->hw_ptr + missing;
-		hw_ptr += spcm->period_size - 1;
-		if (hw_ptr >= spcm->boundary)
-			hw_ptr -= spcm->boundary;
-		hw_ptr -= hw_ptr % spcm->period_size;
-		avail_min = hw_ptr - *spcm->appl.ptr;
-		if (spcm->stream == SND_PCM_STREAM_PLAYBACK)
-			avail_min += spcm->buffer_size;
-		if (avail_min < 0)
-			avail_min += spcm->boundary;
-		if ((snd_pcm_uframes_t)avail_min < spcm->avail_min) {
-			int err;
-			snd_pcm_sw_params_set_avail_min(spcm, &slave->sw_params, avail_min);
-			err = snd_pcm_sw_params(spcm, &slave->sw_params);
-			if (err < 0) {
-				SYSERR("snd_pcm_sw_params error");
-				return;
-			}
-		}
+	/* the thread wakes up by itself unless the next event moved earlier */
+	if (slave->heap_count > 0 &&
+	    snd_pcm_share_wakeup(slave, slave->heap[0]->deadline) < slave->wakeup) {
+		slave->wakeup = 0;
+		snd_pcm_share_slave_kick(slave);
 	}
 }
 
@@ -648,7 +781,6 @@ static int snd_pcm_share_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 					      snd_pcm_share_hw_params_slave);
 		if (err < 0)
 			goto _end;
-		snd_pcm_sw_params_current(slave->pcm, &slave->sw_params);
 		/* >= 30 ms */
 		slave->safety_threshold = slave->pcm->rate * 30 / 1000;
 		slave->safety_threshold += slave->pcm->period_size - 1;
@@ -786,7 +918,7 @@ static snd_pcm_sframes_t snd_pcm_share_avail_update(snd_pcm_t *pcm)
 			Pthread_mutex_unlock(&slave->mutex);
 			return avail;
 		}
-		share->hw_ptr = *slave->pcm->hw.ptr;
+		atomic_store_release(&share->hw_ptr, *slave->pcm->hw.ptr);
 	}
 	Pthread_mutex_unlock(&slave->mutex);
 	avail = snd_pcm_mmap_avail(pcm);
@@ -807,6 +939,48 @@ static int snd_pcm_share_htimestamp(snd_pcm_t *pcm, snd_pcm_uframes_t *avail,
 	return err;
 }
 
+static snd_pcm_uframes_t snd_pcm_share_appl_add(snd_pcm_t *pcm,
+						snd_pcm_uframes_t appl_ptr,
+						snd_pcm_uframes_t frames)
+{
+	appl_ptr += frames;
+	if (appl_ptr >= pcm->boundary)
+		appl_ptr -= pcm->boundary;
+	return appl_ptr;
+}
+
+/* Call it with mutex held */
+/* Forward the slave as far as the running clients allow and publish the
+   holder. A client which committed without the mutex after its appl_ptr
+   was read is either seen by the recheck or sees itself as the holder. */
+static snd_pcm_sframes_t _snd_pcm_share_slave_commit(snd_pcm_share_slave_t *slave)
+{
+	snd_pcm_t *spcm = slave->pcm;
+	snd_pcm_share_t *holder;
+	snd_pcm_uframes_t holder_appl = 0;
+	snd_pcm_sframes_t frames, err;
+
+	while (1) {
+		frames = _snd_pcm_share_slave_forward(slave, &holder, &holder_appl);
+		if (frames > 0) {
+			err = snd_pcm_mmap_commit(spcm, snd_pcm_mmap_offset(spcm), frames);
+			if (err < 0) {
+				SYSMSG("snd_pcm_mmap_commit error");
+				_snd_pcm_share_drop_holder(slave);
+				return err;
+			}
+			/* client frames are already committed, so keep going */
+			if (err != frames)
+				SYSMSG("commit returns %ld for size %ld", err, frames);
+		}
+		atomic_store_release(&slave->holder, holder);
+		atomic_fence();
+		if (holder == NULL ||
+		    atomic_load_acquire(&holder->appl_ptr) == holder_appl)
+			return 0;
+	}
+}
+
 /* Call it with mutex held */
 static snd_pcm_sframes_t _snd_pcm_share_mmap_commit(snd_pcm_t *pcm,
 						    snd_pcm_uframes_t offset ATTRIBUTE_UNUSED,
@@ -829,28 +1003,70 @@ static snd_pcm_sframes_t _snd_pcm_share_mmap_commit(snd_pcm_t *pcm,
 			ret = snd_pcm_rewind(spcm, frames);
 			if (ret < 0)
 				return ret;
+			_snd_pcm_share_reschedule(slave);
 		}
 	}
-	snd_pcm_mmap_appl_forward(pcm, size);
+	atomic_store_release(&share->appl_ptr,
+			     snd_pcm_share_appl_add(pcm, share->appl_ptr, size));
 	if (share->state == SND_PCM_STATE_RUNNING) {
-		frames = _snd_pcm_share_slave_forward(slave);
-		if (frames > 0) {
-			snd_pcm_sframes_t err;
-			err = snd_pcm_mmap_commit(spcm, snd_pcm_mmap_offset(spcm), frames);
-			if (err < 0) {
-				SYSMSG("snd_pcm_mmap_commit error");
-				return err;
-			}
-			if (err != frames) {
-				SYSMSG("commit returns %ld for size %ld", err, frames);
-				return err;
-			}
-		}
+		ret = _snd_pcm_share_slave_commit(slave);
+		if (ret < 0)
+			return ret;
 		_snd_pcm_share_update(pcm);
 	}
 	return size;
 }
 
+/*
+ * Commit a running playback client without the slave mutex. Unless it is
+ * the holder, the slave cannot move forward by its frames, so publishing
+ * the new appl_ptr is enough. Return 0 when the locked path has to run.
+ */
+static snd_pcm_sframes_t snd_pcm_share_fast_commit(snd_pcm_t *pcm,
+						   snd_pcm_uframes_t size)
+{
+	snd_pcm_share_t *share = pcm->private_data;
+	snd_pcm_share_slave_t *slave = share->slave;
+	snd_pcm_t *spcm = slave->pcm;
+	snd_pcm_share_t *holder;
+	snd_pcm_sframes_t frames;
+	snd_pcm_sframes_t ret = size;
+
+	holder = atomic_load_acquire(&slave->holder);
+	if (holder == NULL || holder == share)
+		return 0;
+	frames = atomic_load_acquire(spcm->appl.ptr) - share->appl_ptr;
+	if (frames > (snd_pcm_sframes_t)pcm->buffer_size)
+		frames -= pcm->boundary;
+	else if (frames < -(snd_pcm_sframes_t)pcm->buffer_size)
+		frames += pcm->boundary;
+	if (frames > 0)
+		return 0;	/* latecomer, the slave has to be rewound */
+	atomic_store_release(&share->appl_ptr,
+			     snd_pcm_share_appl_add(pcm, share->appl_ptr, size));
+	/* pairs with the fence in _snd_pcm_share_slave_commit() */
+	atomic_fence();
+	if (atomic_load_acquire(&slave->holder) == share) {
+		/* the holder moved meanwhile and handed the slave to us */
+		Pthread_mutex_lock(&slave->mutex);
+		if (share->state == SND_PCM_STATE_RUNNING) {
+			ret = _snd_pcm_share_slave_commit(slave);
+			if (ret >= 0) {
+				_snd_pcm_share_update(pcm);
+				ret = size;
+			}
+		}
+		Pthread_mutex_unlock(&slave->mutex);
+		return ret;
+	}
+	if (snd_pcm_mmap_avail(pcm) < pcm->avail_min) {
+		/* let the thread update the poll state */
+		atomic_store_release(&share->dirty, 1);
+		snd_pcm_share_slave_kick(slave);
+	}
+	return ret;
+}
+
 static snd_pcm_sframes_t snd_pcm_share_mmap_commit(snd_pcm_t *pcm,
 						   snd_pcm_uframes_t offset,
 						   snd_pcm_uframes_t size)
@@ -858,6 +1074,12 @@ static snd_pcm_sframes_t snd_pcm_share_mmap_commit(snd_pcm_t *pcm,
 	snd_pcm_share_t *share = pcm->private_data;
 	snd_pcm_share_slave_t *slave = share->slave;
 	snd_pcm_sframes_t ret;
+	if (pcm->stream == SND_PCM_STREAM_PLAYBACK &&
+	    share->state == SND_PCM_STATE_RUNNING) {
+		ret = snd_pcm_share_fast_commit(pcm, size);
+		if (ret != 0)
+			return ret;
+	}
 	Pthread_mutex_lock(&slave->mutex);
 	ret = _snd_pcm_share_mmap_commit(pcm, offset, size);
 	Pthread_mutex_unlock(&slave->mutex);
@@ -889,7 +1111,7 @@ static int snd_pcm_share_prepare(snd_pcm_t *pcm)
 			goto _end;
 	}
 	slave->prepared_count++;
-	share->hw_ptr = 0;
+	atomic_store_release(&share->hw_ptr, 0);
 	share->appl_ptr = 0;
 	share->state = SND_PCM_STATE_PREPARED;
  _end:
@@ -905,8 +1127,9 @@ static int snd_pcm_share_reset(snd_pcm_t *pcm)
 	/* FIXME? */
 	Pthread_mutex_lock(&slave->mutex);
 	snd_pcm_areas_silence(pcm->running_areas, 0, pcm->channels, pcm->buffer_size, pcm->format);
-	share->hw_ptr = *slave->pcm->hw.ptr;
+	atomic_store_release(&share->hw_ptr, *slave->pcm->hw.ptr);
 	share->appl_ptr = share->hw_ptr;
+	_snd_pcm_share_drop_holder(slave);
 	Pthread_mutex_unlock(&slave->mutex);
 	return err;
 }
@@ -921,6 +1144,7 @@ static int snd_pcm_share_start(snd_pcm_t *pcm)
 		return -EBADFD;
 	Pthread_mutex_lock(&slave->mutex);
 	share->state = SND_PCM_STATE_RUNNING;
+	_snd_pcm_share_drop_holder(slave);
 	if (pcm->stream == SND_PCM_STREAM_PLAYBACK) {
 		snd_pcm_uframes_t hw_avail = snd_pcm_mmap_playback_hw_avail(pcm);
 		snd_pcm_uframes_t xfer = 0;
@@ -936,9 +1160,10 @@ static int snd_pcm_share_start(snd_pcm_t *pcm)
 			err = snd_pcm_rewind(spcm, sd);
 			if (err < 0)
 				goto _end;
+			_snd_pcm_share_reschedule(slave);
 		}
 		assert(share->hw_ptr == 0);
-		share->hw_ptr = *spcm->hw.ptr;
+		atomic_store_release(&share->hw_ptr, *spcm->hw.ptr);
 		share->appl_ptr = *spcm->appl.ptr;
 		while (xfer < hw_avail) {
 			snd_pcm_uframes_t frames = hw_avail - xfer;
@@ -1030,6 +1255,7 @@ static snd_pcm_sframes_t _snd_pcm_share_rewind(snd_pcm_t *pcm, snd_pcm_uframes_t
 		if (ret < 0)
 			return ret;
 		frames = ret;
+		_snd_pcm_share_reschedule(slave);
 	}
 	snd_pcm_mmap_appl_backward(pcm, frames);
 	_snd_pcm_share_update(pcm);
@@ -1087,6 +1313,7 @@ static snd_pcm_sframes_t _snd_pcm_share_forward(snd_pcm_t *pcm, snd_pcm_uframes_
 		if (ret < 0)
 			return ret;
 		frames = ret;
+		_snd_pcm_share_drop_holder(slave);
 	}
 	snd_pcm_mmap_appl_forward(pcm, frames);
 	_snd_pcm_share_update(pcm);
@@ -1138,11 +1365,14 @@ static void _snd_pcm_share_stop(snd_pcm_t *pcm, snd_pcm_state_t state)
 		snd_pcm_areas_silence(pcm->running_areas, 0, pcm->channels,
 				      pcm->buffer_size, pcm->format);
 		err = snd_pcm_delay(slave->pcm, &delay);
-		if (err >= 0 && delay > 0)
+		if (err >= 0 && delay > 0) {
 			snd_pcm_rewind(slave->pcm, delay);
+			_snd_pcm_share_reschedule(slave);
+		}
 		share->drain_silenced = 0;
 	}
 	share->state = state;
+	_snd_pcm_share_drop_holder(slave);
 	slave->prepared_count--;
 	slave->running_count--;
 	if (slave->running_count == 0) {
@@ -1177,6 +1407,7 @@ static int snd_pcm_share_drain(snd_pcm_t *pcm)
 		case SND_PCM_STATE_DRAINING:
 		case SND_PCM_STATE_RUNNING:
 			share->state = SND_PCM_STATE_DRAINING;
+			_snd_pcm_share_drop_holder(slave);
 			_snd_pcm_share_update(pcm);
 			Pthread_mutex_unlock(&slave->mutex);
 			if (!(pcm->mode & SND_PCM_NONBLOCK))
@@ -1240,7 +1471,8 @@ static int snd_pcm_share_drop(snd_pcm_t *pcm)
 		break;
 	}
 	
-	share->appl_ptr = share->hw_ptr = 0;
+	atomic_store_release(&share->hw_ptr, 0);
+	share->appl_ptr = 0;
  _end:
 	Pthread_mutex_unlock(&slave->mutex);
 	return err;
@@ -1255,19 +1487,23 @@ static int snd_pcm_share_close(snd_pcm_t *pcm)
 	Pthread_mutex_lock(&snd_pcm_share_slaves_mutex);
 	Pthread_mutex_lock(&slave->mutex);
 	slave->open_count--;
+	_snd_pcm_share_drop_holder(slave);
+	snd_pcm_share_heap_remove(slave, share);
+	list_del(&share->list);
 	if (slave->open_count == 0) {
 		pthread_cond_signal(&slave->poll_cond);
+		snd_pcm_share_slave_kick(slave);
 		Pthread_mutex_unlock(&slave->mutex);
 		err = pthread_join(slave->thread, 0);
 		assert(err == 0);
 		err = snd_pcm_close(slave->pcm);
+		close(slave->event_fd);
 		pthread_mutex_destroy(&slave->mutex);
 		pthread_cond_destroy(&slave->poll_cond);
 		list_del(&slave->list);
+		free(slave->heap);
 		free(slave);
-		list_del(&share->list);
 	} else {
-		list_del(&share->list);
 		Pthread_mutex_unlock(&slave->mutex);
 	}
 	Pthread_mutex_unlock(&snd_pcm_share_slaves_mutex);
@@ -1468,9 +1704,7 @@ int snd_pcm_share_open(snd_pcm_t **pcmp, const char *name, const char *sname,
 			free(share);
 			return err;
 		}
-		/* FIXME: bellow is a real ugly hack to get things working */
-		/* there is a memory leak somewhere, but I'm unable to trace it --jk */
-		slave = calloc(1, sizeof(snd_pcm_share_slave_t) * 8);
+		slave = calloc(1, sizeof(snd_pcm_share_slave_t));
 		if (!slave) {
 			Pthread_mutex_unlock(&snd_pcm_share_slaves_mutex);
 			snd_pcm_close(spcm);
@@ -1481,6 +1715,25 @@ int snd_pcm_share_open(snd_pcm_t **pcmp, const char *name, const char *sname,
 			free(share);
 			return err;
 		}
+		slave->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		slave->heap_alloc = 8;
+		slave->heap = calloc(slave->heap_alloc, sizeof(*slave->heap));
+		if (slave->event_fd < 0 || !slave->heap) {
+			err = slave->event_fd < 0 ? -errno : -ENOMEM;
+			Pthread_mutex_unlock(&snd_pcm_share_slaves_mutex);
+			if (slave->event_fd >= 0)
+				close(slave->event_fd);
+			free(slave->heap);
+			free(slave);
+			snd_pcm_close(spcm);
+			close(sd[0]);
+			close(sd[1]);
+			snd_pcm_free(pcm);
+			free(share->slave_channels);
+			free(share);
+			return err;
+		}
+		slave->wakeup = SHARE_IDLE;
 		INIT_LIST_HEAD(&slave->clients);
 		slave->pcm = spcm;
 		slave->channels = schannels;
@@ -1513,9 +1766,25 @@ int snd_pcm_share_open(snd_pcm_t **pcmp, const char *name, const char *sname,
 				}
 			}
 		}
+		if (slave->open_count >= slave->heap_alloc) {
+			snd_pcm_share_t **heap;
+			heap = realloc(slave->heap, slave->heap_alloc * 2 * sizeof(*heap));
+			if (!heap) {
+				Pthread_mutex_unlock(&slave->mutex);
+				close(sd[0]);
+				close(sd[1]);
+				snd_pcm_free(pcm);
+				free(share->slave_channels);
+				free(share);
+				return -ENOMEM;
+			}
+			slave->heap = heap;
+			slave->heap_alloc *= 2;
+		}
 	}
 
 	share->slave = slave;
+	share->heap_idx = -1;
 	share->pcm = pcm;
 	share->client_socket = sd[0];
 	share->slave_socket = sd[1];
@@ -1527,6 +1796,7 @@ int snd_pcm_share_open(snd_pcm_t **pcmp, const char *name, const char *sname,
 	pcm->poll_fd = share->client_socket;
 	pcm->poll_events = stream == SND_PCM_STREAM_PLAYBACK ? POLLOUT : POLLIN;
 	pcm->monotonic = slave->pcm->monotonic;
+	pcm->trace = slave->pcm->trace;
 	snd_pcm_set_hw_ptr(pcm, &share->hw_ptr, -1, 0);
 	snd_pcm_set_appl_ptr(pcm, &share->appl_ptr, -1, 0);
 
@@ -54,9 +54,60 @@ const char *_snd_module_pcm_shm = "";
 typedef struct {
 	int socket;
 	volatile snd_pcm_shm_ctrl_t *ctrl;
+	snd_pcm_uframes_t appl_ptr;	/* local appl_ptr when the ring is used */
 } snd_pcm_shm_t;
 #endif
 
+/*
+ * When the server runs a worker for this PCM, commits are queued in
+ * ctrl->ring instead of being sent over the socket and the state is
+ * read from the values the worker publishes. The appl_ptr is kept
+ * locally so that it runs ahead of the server by the queued frames.
+ */
+static inline int snd_pcm_shm_ring_enabled(snd_pcm_shm_t *shm)
+{
+	return shm->ctrl->ring.enabled;
+}
+
+static int snd_pcm_shm_server_gone(snd_pcm_shm_t *shm)
+{
+	struct pollfd pfd;
+
+	pfd.fd = shm->socket;
+	pfd.events = POLLHUP;
+	return poll(&pfd, 1, 0) == 1 && (pfd.revents & (POLLHUP | POLLERR));
+}
+
+/* Request a worker pass and wait until one started after the request is done */
+static int snd_pcm_shm_ring_sync(snd_pcm_shm_t *shm)
+{
+	volatile snd_pcm_shm_ring_t *ring = &shm->ctrl->ring;
+	struct timespec timeout = { 0, 100000000 };
+	int seq, served;
+
+	seq = __atomic_add_fetch(&ring->doorbell, 1, __ATOMIC_SEQ_CST);
+	snd_shm_futex_wake(&ring->doorbell, 1);
+	while ((int)((unsigned int)(served = shm_load_acquire(&ring->served)) -
+		     (unsigned int)seq) < 0) {
+		if (snd_shm_futex_wait(&ring->served, served, &timeout) < 0 &&
+		    errno == ETIMEDOUT && snd_pcm_shm_server_gone(shm))
+			return -EBADFD;
+	}
+	return __atomic_exchange_n(&ring->result, 0, __ATOMIC_ACQ_REL);
+}
+
+/* Commit everything queued before a synchronous command */
+static int snd_pcm_shm_ring_flush(snd_pcm_shm_t *shm)
+{
+	volatile snd_pcm_shm_ring_t *ring = &shm->ctrl->ring;
+
+	if (!snd_pcm_shm_ring_enabled(shm))
+		return 0;
+	if (ring->head == shm_load_acquire(&ring->tail))
+		return 0;
+	return snd_pcm_shm_ring_sync(shm);
+}
+
 static long snd_pcm_shm_action_fd0(snd_pcm_t *pcm, int *fd)
 {
 	snd_pcm_shm_t *shm = pcm->private_data;
@@ -80,6 +131,14 @@ static long snd_pcm_shm_action_fd0(snd_pcm_t *pcm, int *fd)
 static int snd_pcm_shm_new_rbptr(snd_pcm_t *pcm, snd_pcm_shm_t *shm,
 				 snd_pcm_rbptr_t *rbptr, volatile snd_pcm_shm_rbptr_t *shm_rbptr)
 {
+	if (snd_pcm_shm_ring_enabled(shm)) {
+		if (&pcm->appl == rbptr)
+			return 0;
+		if (!shm_rbptr->use_mmap) {
+			snd_pcm_set_hw_ptr(pcm, &shm->ctrl->ring.hw_ptr, -1, 0);
+			return 0;
+		}
+	}
 	if (!shm_rbptr->use_mmap) {
 		if (&pcm->hw == rbptr)
 			snd_pcm_set_hw_ptr(pcm, &shm_rbptr->ptr, -1, 0);
@@ -118,6 +177,9 @@ static long snd_pcm_shm_action(snd_pcm_t *pcm)
 
 	if (ctrl->hw.changed || ctrl->appl.changed)
 		return -EBADFD;
+	err = snd_pcm_shm_ring_flush(shm);
+	if (err < 0)
+		return err;
 	err = write(shm->socket, buf, 1);
 	if (err != 1)
 		return -EBADFD;
@@ -141,6 +203,8 @@ static long snd_pcm_shm_action(snd_pcm_t *pcm)
 			return err;
 		ctrl->appl.changed = 0;
 	}
+	if (snd_pcm_shm_ring_enabled(shm))
+		shm->appl_ptr = ctrl->ring.appl_ptr;
 	return result;
 }
 
@@ -153,6 +217,9 @@ static long snd_pcm_shm_action_fd(snd_pcm_t *pcm, int *fd)
 
 	if (ctrl->hw.changed || ctrl->appl.changed)
 		return -EBADFD;
+	err = snd_pcm_shm_ring_flush(shm);
+	if (err < 0)
+		return err;
 	err = write(shm->socket, buf, 1);
 	if (err != 1)
 		return -EBADFD;
@@ -175,6 +242,8 @@ static long snd_pcm_shm_action_fd(snd_pcm_t *pcm, int *fd)
 			return err;
 		ctrl->appl.changed = 0;
 	}
+	if (snd_pcm_shm_ring_enabled(shm))
+		shm->appl_ptr = ctrl->ring.appl_ptr;
 	return ctrl->result;
 }
 
@@ -404,6 +473,8 @@ static snd_pcm_state_t snd_pcm_shm_state(snd_pcm_t *pcm)
 {
 	snd_pcm_shm_t *shm = pcm->private_data;
 	volatile snd_pcm_shm_ctrl_t *ctrl = shm->ctrl;
+	if (snd_pcm_shm_ring_enabled(shm))
+		return shm_load_acquire(&ctrl->ring.state);
 	ctrl->cmd = SND_PCM_IOCTL_STATE;
 	return snd_pcm_shm_action(pcm);
 }
@@ -412,6 +483,9 @@ static int snd_pcm_shm_hwsync(snd_pcm_t *pcm)
 {
 	snd_pcm_shm_t *shm = pcm->private_data;
 	volatile snd_pcm_shm_ctrl_t *ctrl = shm->ctrl;
+	/* the worker syncs once per period, avail_update asks for more */
+	if (snd_pcm_shm_ring_enabled(shm))
+		return __atomic_exchange_n(&ctrl->ring.result, 0, __ATOMIC_ACQ_REL);
 	ctrl->cmd = SND_PCM_IOCTL_HWSYNC;
 	return snd_pcm_shm_action(pcm);
 }
@@ -429,11 +503,45 @@ static int snd_pcm_shm_delay(snd_pcm_t *pcm, snd_pcm_sframes_t *delayp)
 	return err;
 }
 
+static snd_pcm_sframes_t snd_pcm_shm_ring_avail_update(snd_pcm_t *pcm)
+{
+	snd_pcm_shm_t *shm = pcm->private_data;
+	volatile snd_pcm_shm_ring_t *ring = &shm->ctrl->ring;
+	snd_pcm_uframes_t avail;
+	int err;
+
+	err = __atomic_exchange_n(&ring->result, 0, __ATOMIC_ACQ_REL);
+	if (err < 0)
+		return err;
+	avail = snd_pcm_mmap_avail(pcm);
+	/* the worker refreshes the pointers once per period; only ask it
+	 * for a fresh look when the caller would otherwise go to sleep */
+	if (avail < pcm->avail_min &&
+	    shm_load_acquire(&ring->state) == SND_PCM_STATE_RUNNING) {
+		err = snd_pcm_shm_ring_sync(shm);
+		if (err < 0)
+			return err;
+		avail = snd_pcm_mmap_avail(pcm);
+	}
+	switch (shm_load_acquire(&ring->state)) {
+	case SND_PCM_STATE_XRUN:
+		return -EPIPE;
+	case SND_PCM_STATE_SUSPENDED:
+		return -ESTRPIPE;
+	case SND_PCM_STATE_DISCONNECTED:
+		return -ENODEV;
+	default:
+		return avail;
+	}
+}
+
 static snd_pcm_sframes_t snd_pcm_shm_avail_update(snd_pcm_t *pcm)
 {
 	snd_pcm_shm_t *shm = pcm->private_data;
 	volatile snd_pcm_shm_ctrl_t *ctrl = shm->ctrl;
 	int err;
+	if (snd_pcm_shm_ring_enabled(shm))
+		return snd_pcm_shm_ring_avail_update(pcm);
 	ctrl->cmd = SND_PCM_IOCTL_AVAIL_UPDATE;
 	err = snd_pcm_shm_action(pcm);
 	if (err < 0)
@@ -544,12 +652,43 @@ static int snd_pcm_shm_resume(snd_pcm_t *pcm)
 	return snd_pcm_shm_action(pcm);
 }
 
+static snd_pcm_sframes_t snd_pcm_shm_ring_commit(snd_pcm_t *pcm,
+						 snd_pcm_uframes_t offset,
+						 snd_pcm_uframes_t size)
+{
+	snd_pcm_shm_t *shm = pcm->private_data;
+	volatile snd_pcm_shm_ring_t *ring = &shm->ctrl->ring;
+	unsigned int head = ring->head;
+	int err;
+
+	err = __atomic_exchange_n(&ring->result, 0, __ATOMIC_ACQ_REL);
+	if (err < 0)
+		return err;
+	if (head - shm_load_acquire(&ring->tail) >= SND_PCM_SHM_RING_ENTRIES) {
+		err = snd_pcm_shm_ring_sync(shm);
+		if (err < 0)
+			return err;
+	}
+	ring->entries[head & (SND_PCM_SHM_RING_ENTRIES - 1)].offset = offset;
+	ring->entries[head & (SND_PCM_SHM_RING_ENTRIES - 1)].frames = size;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_SEQ_CST);
+	snd_pcm_mmap_appl_forward(pcm, size);
+	/* pairs with the head check the worker does after setting sleeping */
+	if (__atomic_load_n(&ring->sleeping, __ATOMIC_SEQ_CST)) {
+		__atomic_add_fetch(&ring->doorbell, 1, __ATOMIC_SEQ_CST);
+		snd_shm_futex_wake(&ring->doorbell, 1);
+	}
+	return size;
+}
+
 static snd_pcm_sframes_t snd_pcm_shm_mmap_commit(snd_pcm_t *pcm,
 						 snd_pcm_uframes_t offset ATTRIBUTE_UNUSED,
 						 snd_pcm_uframes_t size)
 {
 	snd_pcm_shm_t *shm = pcm->private_data;
 	volatile snd_pcm_shm_ctrl_t *ctrl = shm->ctrl;
+	if (snd_pcm_shm_ring_enabled(shm))
+		return snd_pcm_shm_ring_commit(pcm, offset, size);
 	ctrl->cmd = SND_PCM_IOCTL_MMAP_COMMIT;
 	ctrl->u.mmap_commit.offset = offset;
 	ctrl->u.mmap_commit.frames = size;
@@ -784,8 +923,14 @@ int snd_pcm_shm_open(snd_pcm_t **pcmp, const char *name,
 	}
 	pcm->poll_fd = err;
 	pcm->poll_events = stream == SND_PCM_STREAM_PLAYBACK ? POLLOUT : POLLIN;
-	snd_pcm_set_hw_ptr(pcm, &ctrl->hw.ptr, -1, 0);
-	snd_pcm_set_appl_ptr(pcm, &ctrl->appl.ptr, -1, 0);
+	if (snd_pcm_shm_ring_enabled(shm)) {
+		snd_pcm_set_hw_ptr(pcm, &ctrl->ring.hw_ptr, -1, 0);
+		shm->appl_ptr = ctrl->ring.appl_ptr;
+		snd_pcm_set_appl_ptr(pcm, &shm->appl_ptr, -1, 0);
+	} else {
+		snd_pcm_set_hw_ptr(pcm, &ctrl->hw.ptr, -1, 0);
+		snd_pcm_set_appl_ptr(pcm, &ctrl->appl.ptr, -1, 0);
+	}
 	*pcmp = pcm;
 	return 0;
 
@@ -805,6 +950,11 @@ This plugin communicates with aserver via shared memory. It is a raw
 communication without any conversions, but it can be expected worse
 performance.
 
+Setup and state changes are a round trip over the server socket. Once
+the server has started its worker for the PCM, mmap commits are queued
+in a ring inside the shared segment and the pointers and state are read
+from there, so a running stream does not talk to the socket at all.
+
 \code
 pcm.name {
         type shm                # Shared memory PCM
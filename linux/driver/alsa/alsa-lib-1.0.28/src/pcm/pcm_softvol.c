@@ -904,6 +904,7 @@ int snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 	 */
 	pcm->mmap_shadow = 1;
 	pcm->monotonic = slave->monotonic;
+	pcm->trace = slave->trace;
 	snd_pcm_set_hw_ptr(pcm, &svol->plug.hw_ptr, -1, 0);
 	snd_pcm_set_appl_ptr(pcm, &svol->plug.appl_ptr, -1, 0);
 	*pcmp = pcm;
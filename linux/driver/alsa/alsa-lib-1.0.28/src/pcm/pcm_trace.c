@@ -0,0 +1,364 @@
+/**
+ * \file pcm/pcm_trace.c
+ * \ingroup PCM
+ * \brief PCM xrun forensics
+ * \date 2014
+ *
+ * The hw and dmix PCMs can keep a ring of their most recent events
+ * (avail updates, commits, poll wakeups, starts and xruns) together with
+ * the ring buffer pointers and a monotonic timestamp.  Dumped after an
+ * xrun it tells a late wakeup of the application from a too small
+ * buffer or period.
+ */
+/*
+ *  PCM - xrun forensics
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pcm_local.h"
+
+#ifndef DOC_HIDDEN
+
+#define TRACE_MAX_EVENTS	(1 << 20)
+
+static unsigned int trace_file_count;
+
+static const char *const trace_names[] = {
+	[SND_PCM_TRACE_AVAIL] = "avail",
+	[SND_PCM_TRACE_COMMIT] = "commit",
+	[SND_PCM_TRACE_WAKEUP] = "wakeup",
+	[SND_PCM_TRACE_XRUN] = "XRUN",
+	[SND_PCM_TRACE_PREPARE] = "prepare",
+	[SND_PCM_TRACE_START] = "start",
+	[SND_PCM_TRACE_STOP] = "stop",
+	[SND_PCM_TRACE_MIX] = "mix",
+};
+
+static inline size_t trace_bytes(unsigned int size)
+{
+	return sizeof(snd_pcm_trace_t) + size * sizeof(snd_pcm_trace_event_t);
+}
+
+/* map the ring into $LIBASOUND_PCM_TRACE_DIR so it survives the process */
+static snd_pcm_trace_t *trace_map(const char *dir, size_t bytes)
+{
+	char path[PATH_MAX];
+	snd_pcm_trace_t *trace;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/alsa-pcm-trace.%d.%u", dir,
+		 (int)getpid(),
+		 __atomic_fetch_add(&trace_file_count, 1, __ATOMIC_RELAXED));
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		SYSERR("cannot create %s", path);
+		return NULL;
+	}
+	if (ftruncate(fd, bytes) < 0) {
+		SYSERR("cannot resize %s", path);
+		close(fd);
+		unlink(path);
+		return NULL;
+	}
+	trace = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (trace == MAP_FAILED) {
+		SYSERR("cannot map %s", path);
+		unlink(path);
+		return NULL;
+	}
+	trace->mapped = 1;
+	return trace;
+}
+
+/*
+ * Allocate the event ring of a hw or dmix PCM when $LIBASOUND_PCM_TRACE
+ * gives its size.  A ring file that cannot be created is reported and
+ * the ring is kept in memory instead.
+ */
+int snd_pcm_trace_open(snd_pcm_t *pcm)
+{
+	const char *env = getenv("LIBASOUND_PCM_TRACE");
+	const char *dir;
+	snd_pcm_trace_t *trace = NULL;
+	unsigned int size;
+	long val;
+
+	if (!env || !*env)
+		return 0;
+	val = atol(env);
+	if (val <= 0)
+		return 0;
+	if (val > TRACE_MAX_EVENTS)
+		val = TRACE_MAX_EVENTS;
+	for (size = 1; size < val; size <<= 1)
+		;
+	dir = getenv("LIBASOUND_PCM_TRACE_DIR");
+	if (dir && *dir)
+		trace = trace_map(dir, trace_bytes(size));
+	if (!trace) {
+		trace = calloc(1, trace_bytes(size));
+		if (!trace)
+			return -ENOMEM;
+	}
+	trace->version = SND_PCM_TRACE_VERSION;
+	trace->size = size;
+	if (pcm->name)
+		strncpy(trace->name, pcm->name, sizeof(trace->name) - 1);
+	/* readers of the exported file check the magic last */
+	__atomic_store_n(&trace->magic, SND_PCM_TRACE_MAGIC, __ATOMIC_RELEASE);
+	pcm->trace = trace;
+	return 0;
+}
+
+/*
+ * Remember the setup of the owner, called from its hw_params and
+ * sw_params callbacks before the PCM fields are updated
+ */
+void snd_pcm_trace_setup(snd_pcm_t *pcm, snd_pcm_hw_params_t *hw_params,
+			 snd_pcm_sw_params_t *sw_params)
+{
+	snd_pcm_trace_t *trace = pcm->trace;
+	snd_pcm_uframes_t frames;
+
+	if (!trace)
+		return;
+	if (hw_params) {
+		if (hw_params->rate_den)
+			trace->rate = hw_params->rate_num / hw_params->rate_den;
+		if (INTERNAL(snd_pcm_hw_params_get_period_size)(hw_params, &frames, NULL) >= 0)
+			trace->period_size = frames;
+		if (INTERNAL(snd_pcm_hw_params_get_buffer_size)(hw_params, &frames) >= 0)
+			trace->buffer_size = frames;
+	}
+	if (sw_params)
+		trace->avail_min = sw_params->avail_min;
+}
+
+void snd_pcm_trace_close(snd_pcm_t *pcm)
+{
+	snd_pcm_trace_t *trace = pcm->trace;
+
+	if (!trace)
+		return;
+	pcm->trace = NULL;
+	if (trace->mapped)
+		munmap(trace, trace_bytes(trace->size));
+	else
+		free(trace);
+}
+
+/*
+ * Lock-free on the writer side: the slot is claimed with an atomic
+ * increment of head and published by storing its sequence number last,
+ * a reader takes an event only if the sequence is the same before and
+ * after the copy.
+ */
+void __snd_pcm_trace_record(snd_pcm_t *pcm, unsigned int type, long long value)
+{
+	snd_pcm_trace_t *trace = pcm->trace;
+	snd_pcm_trace_event_t *ev;
+	snd_htimestamp_t ts;
+	unsigned long long n;
+
+	n = __atomic_fetch_add(&trace->head, 1, __ATOMIC_RELAXED);
+	ev = &trace->events[n & (trace->size - 1)];
+	__atomic_store_n(&ev->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	gettimestamp(&ts, 1);
+	ev->tstamp = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	ev->hw_ptr = pcm->hw.ptr ? *pcm->hw.ptr : 0;
+	ev->appl_ptr = pcm->appl.ptr ? *pcm->appl.ptr : 0;
+	ev->value = value;
+	ev->type = type;
+	__atomic_store_n(&ev->seq, (unsigned int)n + 1, __ATOMIC_RELEASE);
+	if (type == SND_PCM_TRACE_PREPARE || type == SND_PCM_TRACE_START)
+		trace->xrun = 0;
+}
+
+/*
+ * Record an xrun once, the owner keeps reporting it from avail_update
+ * until the application prepares the stream again.  With
+ * $LIBASOUND_DEBUG set the ring is dumped to stderr right away.
+ */
+void __snd_pcm_trace_xrun(snd_pcm_t *pcm, long long value)
+{
+	const char *verbose;
+	snd_output_t *out;
+
+	if (pcm->trace->xrun)
+		return;
+	pcm->trace->xrun = 1;
+	__snd_pcm_trace_record(pcm, SND_PCM_TRACE_XRUN, value);
+	verbose = getenv("LIBASOUND_DEBUG");
+	if (!verbose || !*verbose || atoi(verbose) < 1)
+		return;
+	if (snd_output_stdio_attach(&out, stderr, 0) < 0)
+		return;
+	snd_pcm_trace_dump(pcm, out);
+	snd_output_close(out);
+}
+
+static unsigned int trace_snapshot(const snd_pcm_trace_t *trace,
+				   snd_pcm_trace_event_t *events)
+{
+	unsigned long long head, n;
+	unsigned int count = 0;
+
+	head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+	n = head > trace->size ? head - trace->size : 0;
+	for (; n < head; n++) {
+		const snd_pcm_trace_event_t *ev =
+			&trace->events[n & (trace->size - 1)];
+		unsigned int seq = __atomic_load_n(&ev->seq, __ATOMIC_ACQUIRE);
+		if (seq != (unsigned int)n + 1)
+			continue;
+		events[count] = *ev;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&ev->seq, __ATOMIC_RELAXED) != seq)
+			continue;
+		count++;
+	}
+	return count;
+}
+
+static void trace_dump(const snd_pcm_trace_t *trace, snd_output_t *out,
+		       const snd_pcm_trace_event_t *events, unsigned int count)
+{
+	unsigned long long start, prev;
+	unsigned int i;
+
+	snd_output_printf(out, "Trace of %s: %u of %llu events\n",
+			  trace->name[0] ? trace->name : "PCM", count,
+			  trace->head);
+	snd_output_printf(out, "  rate %u, period %u, buffer %u, avail_min %u\n",
+			  trace->rate, trace->period_size, trace->buffer_size,
+			  trace->avail_min);
+	if (!count)
+		return;
+	start = prev = events[0].tstamp;
+	for (i = 0; i < count; i++) {
+		const snd_pcm_trace_event_t *ev = &events[i];
+		const char *name = ev->type < sizeof(trace_names) / sizeof(trace_names[0]) &&
+			trace_names[ev->type] ? trace_names[ev->type] : "?";
+		snd_output_printf(out, "  %12.3f ms %+10.3f ms  %-7s hw %10llu appl %10llu %8lld",
+				  (ev->tstamp - start) / 1000000.0,
+				  (ev->tstamp - prev) / 1000000.0,
+				  name, ev->hw_ptr, ev->appl_ptr, ev->value);
+		/* how far past avail_min the application woke up */
+		if (ev->type == SND_PCM_TRACE_WAKEUP && trace->rate &&
+		    ev->value > (long long)trace->avail_min)
+			snd_output_printf(out, "  late %.3f ms",
+					  (ev->value - trace->avail_min) *
+					  1000.0 / trace->rate);
+		snd_output_putc(out, '\n');
+		prev = ev->tstamp;
+	}
+}
+
+static int trace_dump_ring(const snd_pcm_trace_t *trace, snd_output_t *out)
+{
+	snd_pcm_trace_event_t *events;
+	unsigned int count;
+
+	events = malloc(trace->size * sizeof(*events));
+	if (!events)
+		return -ENOMEM;
+	count = trace_snapshot(trace, events);
+	trace_dump(trace, out, events, count);
+	free(events);
+	return 0;
+}
+
+#endif /* DOC_HIDDEN */
+
+/**
+ * \brief Dump the recent events of the hw or dmix PCM below a PCM
+ * \param pcm PCM handle
+ * \param out Output handle
+ * \return 0 on success, -ENOENT if no event ring is attached to the PCM
+ *
+ * The ring is allocated at open when $LIBASOUND_PCM_TRACE holds its
+ * size in events; plugins show the ring of the hw or dmix PCM they
+ * sit on.  Each line carries the time since the oldest event and since
+ * the previous one, the hardware and application pointers and the
+ * value of the event: the result of avail_update, the number of frames
+ * committed or mixed, or the available frames at a poll wakeup.
+ *
+ * The ring is usually dumped when a transfer returns -EPIPE.  With
+ * $LIBASOUND_DEBUG set, alsa-lib does so on stderr by itself.
+ */
+int snd_pcm_trace_dump(snd_pcm_t *pcm, snd_output_t *out)
+{
+	assert(pcm && out);
+	if (!pcm->trace)
+		return -ENOENT;
+	return trace_dump_ring(pcm->trace, out);
+}
+
+/**
+ * \brief Dump an event ring exported to a file
+ * \param file Path of the ring file
+ * \param out Output handle
+ * \return 0 on success otherwise a negative error code
+ *
+ * When $LIBASOUND_PCM_TRACE_DIR is set as well, the ring is kept in a
+ * shared file named alsa-pcm-trace.<pid>.<n> in that directory.  The
+ * file outlives the process, so the events before an xrun can be read
+ * afterwards or from another process while the stream runs.
+ */
+int snd_pcm_trace_dump_file(const char *file, snd_output_t *out)
+{
+	snd_pcm_trace_t *trace;
+	struct stat st;
+	int fd, err;
+
+	assert(file && out);
+	fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	if (fstat(fd, &st) < 0) {
+		err = -errno;
+		close(fd);
+		return err;
+	}
+	if ((size_t)st.st_size < sizeof(*trace)) {
+		close(fd);
+		return -EINVAL;
+	}
+	trace = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (trace == MAP_FAILED)
+		return -errno;
+	if (__atomic_load_n(&trace->magic, __ATOMIC_ACQUIRE) != SND_PCM_TRACE_MAGIC ||
+	    trace->version != SND_PCM_TRACE_VERSION ||
+	    !trace->size || (trace->size & (trace->size - 1)) ||
+	    trace_bytes(trace->size) > (size_t)st.st_size) {
+		SNDERR("%s is not a PCM trace", file);
+		err = -EINVAL;
+	} else
+		err = trace_dump_ring(trace, out);
+	munmap(trace, st.st_size);
+	return err;
+}
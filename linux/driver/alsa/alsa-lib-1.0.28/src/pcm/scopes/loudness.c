@@ -0,0 +1,497 @@
+/*
+ *  PCM - Meter loudness plugin (headless)
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+/*
+ * Per channel sample peak, RMS and EBU R128 short-term loudness computed
+ * from the s16 pseudo scope. The values are published in a POSIX shared
+ * memory segment (see loudness.h), nothing is rendered.
+ *
+ * pcm_scope.NAME {
+ *	type loudness
+ *	shm STR		# shared memory name, e.g. "/alsa-loudness-0"
+ * }
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "loudness.h"
+
+/* short-term loudness: 3 s window made of 100 ms blocks */
+#define BLOCK_MS	100
+#define BLOCKS		30
+
+typedef struct _snd_pcm_scope_loudness_channel {
+	double z[2][2];			/* K-weighting biquad states */
+	double energy;			/* K-weighted energy of the current block */
+	double blocks[BLOCKS];
+} snd_pcm_scope_loudness_channel_t;
+
+typedef struct _snd_pcm_scope_loudness {
+	snd_pcm_t *pcm;
+	snd_pcm_scope_t *s16;
+	snd_pcm_uframes_t old;
+	unsigned int channels;
+	snd_pcm_scope_loudness_channel_t *chan;
+	snd_pcm_scope_loudness_values_t *values;
+	/* K-weighting: high shelf and high pass, a[0] == 1 */
+	double b[2][3], a[2][3];
+	snd_pcm_uframes_t block_size;
+	snd_pcm_uframes_t block_pos;
+	unsigned int block_idx;
+	unsigned int blocks_filled;
+	uint64_t frames;
+	char *shm_name;
+	snd_pcm_scope_loudness_shm_t *shm;
+	size_t shm_size;
+} snd_pcm_scope_loudness_t;
+
+/*
+ * Peak (as max and min sample) and sum of squares of a s16 run.
+ */
+static void s16_peak_energy(const int16_t *ptr, snd_pcm_uframes_t n,
+			    int *maxp, int *minp, uint64_t *sump)
+{
+	int max = *maxp, min = *minp;
+	uint64_t sum = 0;
+#ifdef __SSE2__
+	if (n >= 8) {
+		__m128i vmax = _mm_set1_epi16(max > -32768 ? max : -32768);
+		__m128i vmin = _mm_set1_epi16(min < 32767 ? min : 32767);
+		__m128i vsum = _mm_setzero_si128();
+		__m128i zero = _mm_setzero_si128();
+		int16_t tmp[8];
+		uint64_t sum2[2];
+		unsigned int k;
+		for (; n >= 8; n -= 8, ptr += 8) {
+			__m128i v = _mm_loadu_si128((const __m128i *)ptr);
+			__m128i sq;
+			vmax = _mm_max_epi16(vmax, v);
+			vmin = _mm_min_epi16(vmin, v);
+			/* pair sums fit in 32 bits only as unsigned values */
+			sq = _mm_madd_epi16(v, v);
+			vsum = _mm_add_epi64(vsum, _mm_unpacklo_epi32(sq, zero));
+			vsum = _mm_add_epi64(vsum, _mm_unpackhi_epi32(sq, zero));
+		}
+		_mm_storeu_si128((__m128i *)tmp, vmax);
+		for (k = 0; k < 8; k++)
+			if (tmp[k] > max)
+				max = tmp[k];
+		_mm_storeu_si128((__m128i *)tmp, vmin);
+		for (k = 0; k < 8; k++)
+			if (tmp[k] < min)
+				min = tmp[k];
+		_mm_storeu_si128((__m128i *)sum2, vsum);
+		sum = sum2[0] + sum2[1];
+	}
+#endif
+	for (; n > 0; n--, ptr++) {
+		int s = *ptr;
+		if (s > max)
+			max = s;
+		if (s < min)
+			min = s;
+		sum += (uint64_t)(s * s);
+	}
+	*maxp = max;
+	*minp = min;
+	*sump += sum;
+}
+
+/*
+ * K-weighted energy of a s16 run; the filter is recursive, so this part
+ * runs sample by sample.
+ */
+static double kweight_energy(snd_pcm_scope_loudness_t *l,
+			     snd_pcm_scope_loudness_channel_t *c,
+			     const int16_t *ptr, snd_pcm_uframes_t n)
+{
+	double z00 = c->z[0][0], z01 = c->z[0][1];
+	double z10 = c->z[1][0], z11 = c->z[1][1];
+	double energy = 0;
+	for (; n > 0; n--, ptr++) {
+		double x = *ptr * (1.0 / 32768);
+		double y = l->b[0][0] * x + z00;
+		z00 = l->b[0][1] * x - l->a[0][1] * y + z01;
+		z01 = l->b[0][2] * x - l->a[0][2] * y;
+		x = y;
+		y = l->b[1][0] * x + z10;
+		z10 = l->b[1][1] * x - l->a[1][1] * y + z11;
+		z11 = l->b[1][2] * x - l->a[1][2] * y;
+		energy += y * y;
+	}
+	c->z[0][0] = z00;
+	c->z[0][1] = z01;
+	c->z[1][0] = z10;
+	c->z[1][1] = z11;
+	return energy;
+}
+
+/* ITU-R BS.1770 pre-filter coefficients for the given rate */
+static void kweight_init(snd_pcm_scope_loudness_t *l, unsigned int rate)
+{
+	double f0 = 1681.974450955533;
+	double g = 3.999843853973347;
+	double q = 0.7071752369554196;
+	double k = tan(M_PI * f0 / rate);
+	double vh = pow(10.0, g / 20.0);
+	double vb = pow(vh, 0.4996667741545416);
+	double a0 = 1.0 + k / q + k * k;
+
+	l->b[0][0] = (vh + vb * k / q + k * k) / a0;
+	l->b[0][1] = 2.0 * (k * k - vh) / a0;
+	l->b[0][2] = (vh - vb * k / q + k * k) / a0;
+	l->a[0][0] = 1.0;
+	l->a[0][1] = 2.0 * (k * k - 1.0) / a0;
+	l->a[0][2] = (1.0 - k / q + k * k) / a0;
+
+	f0 = 38.13547087602444;
+	q = 0.5003270373238773;
+	k = tan(M_PI * f0 / rate);
+	a0 = 1.0 + k / q + k * k;
+	l->b[1][0] = 1.0;
+	l->b[1][1] = -2.0;
+	l->b[1][2] = 1.0;
+	l->a[1][0] = 1.0;
+	l->a[1][1] = 2.0 * (k * k - 1.0) / a0;
+	l->a[1][2] = (1.0 - k / q + k * k) / a0;
+}
+
+static float to_db(double v)
+{
+	return v > 0 ? (float)(20.0 * log10(v)) : -INFINITY;
+}
+
+static float short_term(snd_pcm_scope_loudness_t *l,
+			snd_pcm_scope_loudness_channel_t *c)
+{
+	double sum = 0;
+	snd_pcm_uframes_t frames;
+	unsigned int k;
+	if (l->blocks_filled == 0) {
+		sum = c->energy;
+		frames = l->block_pos;
+	} else {
+		for (k = 0; k < l->blocks_filled; k++)
+			sum += c->blocks[k];
+		frames = l->blocks_filled * l->block_size;
+	}
+	if (frames == 0 || sum <= 0)
+		return -INFINITY;
+	return (float)(-0.691 + 10.0 * log10(sum / frames));
+}
+
+static void loudness_publish(snd_pcm_scope_loudness_t *l)
+{
+	snd_pcm_scope_loudness_shm_t *shm = l->shm;
+	if (!shm)
+		return;
+	__atomic_store_n(&shm->seq, shm->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	shm->frames = l->frames;
+	memcpy(shm->values, l->values, l->channels * sizeof(*l->values));
+	__atomic_store_n(&shm->seq, shm->seq + 1, __ATOMIC_RELEASE);
+}
+
+static int loudness_shm_open(snd_pcm_scope_loudness_t *l)
+{
+	int fd;
+	void *ptr;
+	l->shm_size = sizeof(*l->shm) + l->channels * sizeof(*l->values);
+	fd = shm_open(l->shm_name, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		SYSERR("shm_open %s failed", l->shm_name);
+		return -errno;
+	}
+	if (ftruncate(fd, l->shm_size) < 0) {
+		int err = -errno;
+		SYSERR("ftruncate failed");
+		close(fd);
+		return err;
+	}
+	ptr = mmap(NULL, l->shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED) {
+		SYSERR("mmap failed");
+		return -errno;
+	}
+	l->shm = ptr;
+	memset(l->shm, 0, l->shm_size);
+	l->shm->version = SND_PCM_SCOPE_LOUDNESS_VERSION;
+	l->shm->channels = l->channels;
+	l->shm->rate = snd_pcm_meter_get_rate(l->pcm);
+	__atomic_store_n(&l->shm->magic, SND_PCM_SCOPE_LOUDNESS_MAGIC,
+			 __ATOMIC_RELEASE);
+	return 0;
+}
+
+static void loudness_reset_state(snd_pcm_scope_loudness_t *l)
+{
+	unsigned int c;
+	memset(l->chan, 0, l->channels * sizeof(*l->chan));
+	for (c = 0; c < l->channels; c++) {
+		l->values[c].peak = -INFINITY;
+		l->values[c].rms = -INFINITY;
+		l->values[c].short_term = -INFINITY;
+	}
+	l->block_pos = 0;
+	l->block_idx = 0;
+	l->blocks_filled = 0;
+	l->frames = 0;
+}
+
+static int loudness_enable(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_loudness_t *l = snd_pcm_scope_get_callback_private(scope);
+	unsigned int rate = snd_pcm_meter_get_rate(l->pcm);
+	int err;
+	l->channels = snd_pcm_meter_get_channels(l->pcm);
+	l->chan = calloc(l->channels, sizeof(*l->chan));
+	l->values = calloc(l->channels, sizeof(*l->values));
+	if (!l->chan || !l->values) {
+		err = -ENOMEM;
+		goto _err;
+	}
+	kweight_init(l, rate);
+	l->block_size = rate * BLOCK_MS / 1000;
+	if (l->block_size == 0)
+		l->block_size = 1;
+	loudness_reset_state(l);
+	err = loudness_shm_open(l);
+	if (err < 0)
+		goto _err;
+	return 0;
+ _err:
+	free(l->chan);
+	free(l->values);
+	l->chan = NULL;
+	l->values = NULL;
+	return err;
+}
+
+static void loudness_disable(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_loudness_t *l = snd_pcm_scope_get_callback_private(scope);
+	if (l->shm) {
+		munmap(l->shm, l->shm_size);
+		l->shm = NULL;
+	}
+	free(l->chan);
+	free(l->values);
+	l->chan = NULL;
+	l->values = NULL;
+}
+
+static void loudness_close(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_loudness_t *l = snd_pcm_scope_get_callback_private(scope);
+	shm_unlink(l->shm_name);
+	free(l->shm_name);
+	free(l);
+}
+
+static void loudness_start(snd_pcm_scope_t *scope ATTRIBUTE_UNUSED)
+{
+}
+
+static void loudness_stop(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_loudness_t *l = snd_pcm_scope_get_callback_private(scope);
+	unsigned int c;
+	for (c = 0; c < l->channels; c++) {
+		l->values[c].peak = -INFINITY;
+		l->values[c].rms = -INFINITY;
+	}
+	loudness_publish(l);
+}
+
+/*
+ * Process a run which neither wraps in the s16 buffer nor crosses
+ * a 100 ms block boundary.
+ */
+static void loudness_run(snd_pcm_scope_loudness_t *l, snd_pcm_uframes_t offset,
+			 snd_pcm_uframes_t n, int *max, int *min, uint64_t *sum)
+{
+	unsigned int c;
+	for (c = 0; c < l->channels; c++) {
+		snd_pcm_scope_loudness_channel_t *ch = &l->chan[c];
+		const int16_t *ptr;
+		ptr = snd_pcm_scope_s16_get_channel_buffer(l->s16, c) + offset;
+		s16_peak_energy(ptr, n, &max[c], &min[c], &sum[c]);
+		ch->energy += kweight_energy(l, ch, ptr, n);
+	}
+	l->block_pos += n;
+	if (l->block_pos < l->block_size)
+		return;
+	for (c = 0; c < l->channels; c++) {
+		l->chan[c].blocks[l->block_idx] = l->chan[c].energy;
+		l->chan[c].energy = 0;
+	}
+	l->block_pos = 0;
+	l->block_idx = (l->block_idx + 1) % BLOCKS;
+	if (l->blocks_filled < BLOCKS)
+		l->blocks_filled++;
+}
+
+static void loudness_update(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_loudness_t *l = snd_pcm_scope_get_callback_private(scope);
+	snd_pcm_t *pcm = l->pcm;
+	snd_pcm_uframes_t bufsize = snd_pcm_meter_get_bufsize(pcm);
+	snd_pcm_sframes_t size;
+	snd_pcm_uframes_t offset, total;
+	int max[l->channels], min[l->channels];
+	uint64_t sum[l->channels];
+	unsigned int c;
+	size = snd_pcm_meter_get_now(pcm) - l->old;
+	if (size < 0)
+		size += snd_pcm_meter_get_boundary(pcm);
+	if ((snd_pcm_uframes_t) size > bufsize)
+		size = bufsize;
+	total = size;
+	if (total == 0)
+		return;
+	for (c = 0; c < l->channels; c++) {
+		max[c] = 0;
+		min[c] = 0;
+		sum[c] = 0;
+	}
+	offset = l->old % bufsize;
+	while (size > 0) {
+		snd_pcm_uframes_t n = size;
+		if (n > bufsize - offset)
+			n = bufsize - offset;
+		if (n > l->block_size - l->block_pos)
+			n = l->block_size - l->block_pos;
+		loudness_run(l, offset, n, max, min, sum);
+		offset += n;
+		if (offset == bufsize)
+			offset = 0;
+		size -= n;
+	}
+	for (c = 0; c < l->channels; c++) {
+		int peak = max[c] > -min[c] ? max[c] : -min[c];
+		l->values[c].peak = to_db(peak / 32768.0);
+		l->values[c].rms = to_db(sqrt((double)sum[c] / total) / 32768.0);
+		l->values[c].short_term = short_term(l, &l->chan[c]);
+	}
+	l->frames += total;
+	loudness_publish(l);
+	l->old = snd_pcm_meter_get_now(pcm);
+}
+
+static void loudness_reset(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_loudness_t *l = snd_pcm_scope_get_callback_private(scope);
+	loudness_reset_state(l);
+	l->old = snd_pcm_meter_get_now(l->pcm);
+}
+
+snd_pcm_scope_ops_t loudness_ops = {
+	.enable = loudness_enable,
+	.disable = loudness_disable,
+	.close = loudness_close,
+	.start = loudness_start,
+	.stop = loudness_stop,
+	.update = loudness_update,
+	.reset = loudness_reset,
+};
+
+int snd_pcm_scope_loudness_open(snd_pcm_t *pcm, const char *name,
+				const char *shm_name,
+				snd_pcm_scope_t **scopep)
+{
+	snd_pcm_scope_t *scope, *s16;
+	snd_pcm_scope_loudness_t *l;
+	int err = snd_pcm_scope_malloc(&scope);
+	if (err < 0)
+		return err;
+	l = calloc(1, sizeof(*l));
+	if (!l) {
+		free(scope);
+		return -ENOMEM;
+	}
+	l->shm_name = strdup(shm_name);
+	if (!l->shm_name) {
+		free(scope);
+		free(l);
+		return -ENOMEM;
+	}
+	l->pcm = pcm;
+	s16 = snd_pcm_meter_search_scope(pcm, "s16");
+	if (!s16) {
+		err = snd_pcm_scope_s16_open(pcm, "s16", &s16);
+		if (err < 0) {
+			free(scope);
+			free(l->shm_name);
+			free(l);
+			return err;
+		}
+	}
+	l->s16 = s16;
+	snd_pcm_scope_set_ops(scope, &loudness_ops);
+	snd_pcm_scope_set_callback_private(scope, l);
+	if (name)
+		snd_pcm_scope_set_name(scope, name);
+	snd_pcm_meter_add_scope(pcm, scope);
+	*scopep = scope;
+	return 0;
+}
+
+int _snd_pcm_scope_loudness_open(snd_pcm_t *pcm, const char *name,
+				 snd_config_t *root ATTRIBUTE_UNUSED,
+				 snd_config_t *conf)
+{
+	snd_config_iterator_t i, next;
+	snd_pcm_scope_t *scope;
+	const char *shm_name = NULL;
+	int err;
+	snd_config_for_each(i, next, conf) {
+		snd_config_t *n = snd_config_iterator_entry(i);
+		const char *id;
+		if (snd_config_get_id(n, &id) < 0)
+			continue;
+		if (strcmp(id, "comment") == 0)
+			continue;
+		if (strcmp(id, "type") == 0)
+			continue;
+		if (strcmp(id, "shm") == 0) {
+			err = snd_config_get_string(n, &shm_name);
+			if (err < 0) {
+				SNDERR("Invalid type for %s", id);
+				return -EINVAL;
+			}
+			continue;
+		}
+		SNDERR("Unknown field %s", id);
+		return -EINVAL;
+	}
+	if (!shm_name) {
+		SNDERR("shm is not defined");
+		return -EINVAL;
+	}
+	return snd_pcm_scope_loudness_open(pcm, name, shm_name, &scope);
+}
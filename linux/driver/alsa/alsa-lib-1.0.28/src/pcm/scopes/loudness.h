@@ -0,0 +1,57 @@
+/*
+ *  PCM - Meter loudness plugin (headless)
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#ifndef __ALSA_SCOPE_LOUDNESS_H
+#define __ALSA_SCOPE_LOUDNESS_H
+
+#include <stdint.h>
+#include <alsa/asoundlib.h>
+
+/** "ALDN" */
+#define SND_PCM_SCOPE_LOUDNESS_MAGIC	0x414c444e
+#define SND_PCM_SCOPE_LOUDNESS_VERSION	1
+
+/** Values of one channel, all in dB (-inf for silence) */
+typedef struct _snd_pcm_scope_loudness_values {
+	float peak;		/* sample peak over the last update, dBFS */
+	float rms;		/* RMS over the last update, dBFS */
+	float short_term;	/* EBU R128 short-term loudness (3 s), LUFS */
+} snd_pcm_scope_loudness_values_t;
+
+/**
+ * Layout of the shared memory segment. Writers bump seq to an odd value
+ * before and to an even value after an update; readers retry while seq
+ * is odd or changed across their copy.
+ */
+typedef struct _snd_pcm_scope_loudness_shm {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t channels;
+	uint32_t rate;
+	uint32_t seq;
+	uint32_t pad;
+	uint64_t frames;	/* frames metered since the last reset */
+	snd_pcm_scope_loudness_values_t values[0];
+} snd_pcm_scope_loudness_shm_t;
+
+int snd_pcm_scope_loudness_open(snd_pcm_t *pcm, const char *name,
+				const char *shm_name,
+				snd_pcm_scope_t **scopep);
+
+#endif /* __ALSA_SCOPE_LOUDNESS_H */
@@ -52,6 +52,7 @@ typedef struct {
 
 	snd_seq_event_t out_event;
 	int pending;
+	int out_sysex;		/* inside a SysEx passed through as is */
 } snd_rawmidi_virtual_t;
 
 int _snd_seq_open_lconf(snd_seq_t **seqp, const char *name, 
@@ -162,6 +163,7 @@ static int snd_rawmidi_virtual_drop(snd_rawmidi_t *rmidi)
 		snd_seq_drop_output(virt->handle);
 		snd_midi_event_reset_encode(virt->midi_event);
 		virt->pending = 0;
+		virt->out_sysex = 0;
 	} else {
 		snd_seq_drop_input(virt->handle);
 		snd_midi_event_reset_decode(virt->midi_event);
@@ -188,12 +190,80 @@ static int snd_rawmidi_virtual_drain(snd_rawmidi_t *rmidi)
 	return snd_rawmidi_virtual_drop(rmidi);
 }
 
+/*
+ * Queue an event on the user-space output buffer.  The buffer is only
+ * flushed when it fills up, the caller drains it once per write.
+ */
+static int snd_rawmidi_virtual_output_event(snd_rawmidi_virtual_t *virt, snd_seq_event_t *ev)
+{
+	int err;
+
+	snd_seq_ev_set_subs(ev);
+	snd_seq_ev_set_source(ev, virt->port);
+	snd_seq_ev_set_direct(ev);
+	err = snd_seq_event_output_buffer(virt->handle, ev);
+	if (err == -EAGAIN) {
+		err = snd_seq_drain_output(virt->handle);
+		if (err < 0)
+			return err;
+		err = snd_seq_event_output_buffer(virt->handle, ev);
+	}
+	return err < 0 ? err : 0;
+}
+
+/*
+ * Pass a run of SysEx bytes from the caller's buffer as one variable
+ * length event instead of bouncing it through the encoder in 256 byte
+ * pieces.  The run ends after F7, before any other status byte (which
+ * the encoder then handles) or when the event would not fit into the
+ * output buffer.  Returns the number of bytes consumed.
+ */
+static ssize_t snd_rawmidi_virtual_write_sysex(snd_rawmidi_virtual_t *virt,
+					       const unsigned char *buf, size_t size)
+{
+	snd_seq_event_t ev;
+	size_t len = 0, max;
+	int end = 0, err;
+
+	max = snd_seq_get_output_buffer_size(virt->handle);
+	max = max > sizeof(ev) + 1 ? max - sizeof(ev) - 1 : 1;
+	if (! virt->out_sysex) {
+		/* buf[0] is F0; a partial message in the encoder is lost
+		 * anyway, as it would be with the encoder parsing the F0
+		 */
+		snd_midi_event_reset_encode(virt->midi_event);
+		len = 1;
+	}
+	while (len < size && len < max) {
+		if (buf[len] == MIDI_CMD_COMMON_SYSEX_END) {
+			len++;
+			end = 1;
+			break;
+		}
+		if (buf[len] & 0x80)
+			break;
+		len++;
+	}
+	if (len == 0)
+		return 0;
+	snd_seq_ev_clear(&ev);
+	snd_seq_ev_set_sysex(&ev, len, (void *)buf);
+	err = snd_rawmidi_virtual_output_event(virt, &ev);
+	if (err < 0)
+		return err;
+	virt->out_sysex = ! end;
+	return len;
+}
+
 static ssize_t snd_rawmidi_virtual_write(snd_rawmidi_t *rmidi, const void *buffer, size_t size)
 {
 	snd_rawmidi_virtual_t *virt = rmidi->private_data;
+	const unsigned char *buf = buffer;
+	const unsigned char *sysex;
 	ssize_t result = 0;
 	ssize_t size1;
-	int err;
+	size_t len;
+	int err = 0;
 
 	if (virt->pending) {
 		err = snd_seq_event_output(virt->handle, &virt->out_event);
@@ -209,28 +279,52 @@ static ssize_t snd_rawmidi_virtual_write(snd_rawmidi_t *rmidi, const void *buffe
 	}
 
 	while (size > 0) {
-		size1 = snd_midi_event_encode(virt->midi_event, buffer, size, &virt->out_event);
+		len = size;
+		if (virt->out_sysex || *buf == MIDI_CMD_COMMON_SYSEX) {
+			size1 = snd_rawmidi_virtual_write_sysex(virt, buf, size);
+			if (size1 < 0) {
+				err = size1;
+				break;
+			}
+			if (size1 > 0) {
+				size -= size1;
+				result += size1;
+				buf += size1;
+				continue;
+			}
+			if (*buf < MIDI_CMD_COMMON_CLOCK) {
+				/* unterminated SysEx, a new message starts */
+				virt->out_sysex = 0;
+				continue;
+			}
+			/* realtime messages may be interleaved with SysEx */
+			len = 1;
+		} else {
+			/* stop the encoder before the next SysEx */
+			sysex = memchr(buf + 1, MIDI_CMD_COMMON_SYSEX, size - 1);
+			if (sysex)
+				len = sysex - buf;
+		}
+		size1 = snd_midi_event_encode(virt->midi_event, buf, len, &virt->out_event);
 		if (size1 <= 0)
 			break;
 		size -= size1;
 		result += size1;
-		buffer += size1;
+		buf += size1;
 		if (virt->out_event.type == SND_SEQ_EVENT_NONE)
 			continue;
-		snd_seq_ev_set_subs(&virt->out_event);
-		snd_seq_ev_set_source(&virt->out_event, virt->port);
-		snd_seq_ev_set_direct(&virt->out_event);
-		err = snd_seq_event_output(virt->handle, &virt->out_event);
+		err = snd_rawmidi_virtual_output_event(virt, &virt->out_event);
 		if (err < 0) {
 			virt->pending = 1;
-			return result > 0 ? result : err;
+			break;
 		}
 	}
 
-	if (result > 0)
+	if (result > 0) {
 		snd_seq_drain_output(virt->handle);
-
-	return result;
+		return result;
+	}
+	return err;
 }
 
 static ssize_t snd_rawmidi_virtual_read(snd_rawmidi_t *rmidi, void *buffer, size_t size)
@@ -251,6 +345,17 @@ static ssize_t snd_rawmidi_virtual_read(snd_rawmidi_t *rmidi, void *buffer, size
 			if (virt->in_event->type == SND_SEQ_EVENT_SYSEX) {
 				virt->in_buf_ptr = virt->in_event->data.ext.ptr;
 				virt->in_buf_size = virt->in_event->data.ext.len;
+			} else if (size >= sizeof(virt->in_tmp_buf)) {
+				/* enough room, decode straight into the caller's buffer */
+				size1 = snd_midi_event_decode(virt->midi_event,
+							      buffer, size,
+							      virt->in_event);
+				if (size1 > 0) {
+					size -= size1;
+					result += size1;
+					buffer += size1;
+				}
+				continue;
 			} else {
 				virt->in_buf_ptr = virt->in_tmp_buf;
 				virt->in_buf_size = snd_midi_event_decode(virt->midi_event,
@@ -263,8 +368,8 @@ static ssize_t snd_rawmidi_virtual_read(snd_rawmidi_t *rmidi, void *buffer, size
 		}
 		size1 = virt->in_buf_size - virt->in_buf_ofs;
 		if ((size_t)size1 > size) {
-			virt->in_buf_ofs += size1 - size;
-			memcpy(buffer, virt->in_buf_ptr, size);
+			memcpy(buffer, virt->in_buf_ptr + virt->in_buf_ofs, size);
+			virt->in_buf_ofs += size;
 			result += size;
 			break;
 		}
@@ -157,13 +157,10 @@ static int open_ctl(snd_use_case_mgr_t *uc_mgr,
 		return -ENOMEM;
 	}
 	uc_mgr->ctl = *ctl;
+	uc_mgr->ctl_gen++;
 	return 0;
 }
 
-extern int __snd_ctl_ascii_elem_id_parse(snd_ctl_elem_id_t *dst,
-					 const char *str,
-					 const char **ret_ptr);
-
 static int execute_cset(snd_ctl_t *ctl, const char *cset)
 {
 	const char *pos;
@@ -212,6 +209,79 @@ static int execute_cset(snd_ctl_t *ctl, const char *cset)
 	return err;
 }
 
+/*
+ * Resolve a parsed cset on the ctl: look up the numid and build the
+ * value to write. Values that keep a part of the current one (toggle,
+ * or fewer items parsed than the element has) are read and parsed
+ * each time by execute_cset().
+ */
+static int resolve_cset(snd_use_case_mgr_t *uc_mgr, snd_ctl_t *ctl,
+			struct ucm_cset *cset)
+{
+	snd_ctl_elem_info_t *info;
+	unsigned int count, items;
+	int err;
+
+	if (cset->ctl_gen == uc_mgr->ctl_gen)
+		return 0;
+	snd_ctl_elem_info_alloca(&info);
+	snd_ctl_elem_info_set_id(info, &cset->id);
+	err = snd_ctl_elem_info(ctl, info);
+	if (err < 0)
+		return err;
+	count = snd_ctl_elem_info_get_count(info);
+	cset->partial = count > 128 || strcasestr(cset->value, "toggle");
+	if (!cset->partial) {
+		if (cset->resolved == NULL) {
+			err = snd_ctl_elem_value_malloc(&cset->resolved);
+			if (err < 0)
+				return err;
+		} else {
+			snd_ctl_elem_value_clear(cset->resolved);
+		}
+		err = __snd_ctl_ascii_value_parse(ctl, cset->resolved, info,
+						  cset->value, &items);
+		if (err < 0)
+			return err;
+		/* the unparsed items keep the current value */
+		if (items < count)
+			cset->partial = 1;
+	}
+	cset->ctl_gen = uc_mgr->ctl_gen;
+	return 0;
+}
+
+/*
+ * Execute a cset element. The element is resolved right before its
+ * write, as an earlier write may create it or change its range.
+ */
+static int write_cset(snd_use_case_mgr_t *uc_mgr, snd_ctl_t *ctl,
+		      struct sequence_element *s)
+{
+	struct ucm_cset *cset = s->cset;
+	int err;
+
+	if (cset == NULL)
+		return execute_cset(ctl, s->data.cset);
+	err = resolve_cset(uc_mgr, ctl, cset);
+	if (err < 0)
+		return err;
+	if (cset->partial)
+		return execute_cset(ctl, s->data.cset);
+	err = snd_ctl_elem_write(ctl, cset->resolved);
+	if (err == -ENOENT) {
+		/* the element was replaced, look it up again */
+		cset->ctl_gen = 0;
+		err = resolve_cset(uc_mgr, ctl, cset);
+		if (err < 0)
+			return err;
+		if (cset->partial)
+			return execute_cset(ctl, s->data.cset);
+		err = snd_ctl_elem_write(ctl, cset->resolved);
+	}
+	return err < 0 ? err : 0;
+}
+
 /**
  * \brief Execute the sequence
  * \param uc_mgr Use case manager
@@ -274,7 +344,7 @@ static int execute_sequence(snd_use_case_mgr_t *uc_mgr,
 					goto __fail;
 				}
 			}
-			err = execute_cset(ctl, s->data.cset);
+			err = write_cset(uc_mgr, ctl, s);
 			if (err < 0) {
 				uc_error("unable to execute cset '%s'\n", s->data.cset);
 				goto __fail;
@@ -323,33 +393,16 @@ static int import_master_config(snd_use_case_mgr_t *uc_mgr)
 }
 
 /**
- * \brief Universal find - string in a list
- * \param list List of structures
- * \param offset Offset of list structure
- * \param soffset Offset of string structure
+ * \brief Universal find - string in a name hash
+ * \param hash Hash table of structures
+ * \param type Structure type
+ * \param value String member of structure
  * \param match String to match
  * \return structure on success, otherwise a NULL (not found)
  */
-static void *find0(struct list_head *list,
-		   unsigned long offset,
-		   unsigned long soffset,
-		   const char *match)
-{
-	struct list_head *pos;
-	char *ptr, *str;
-
-	list_for_each(pos, list) {
-		ptr = list_entry_offset(pos, char, offset);
-		str = *((char **)(ptr + soffset));
-		if (strcmp(str, match) == 0)
-			return ptr;
-	}
-	return NULL;
-}
-
-#define find(list, type, member, value, match) \
-	find0(list, (unsigned long)(&((type *)0)->member), \
-		    (unsigned long)(&((type *)0)->value), match)
+#define hash_find(hash, type, value, match) \
+	((type *)uc_mgr_hash_find(hash, \
+				  (unsigned long)(&((type *)0)->value), match))
 
 /**
  * \brief Universal string list
@@ -466,9 +519,8 @@ static int get_list20(struct list_head *list,
 static inline struct use_case_verb *find_verb(snd_use_case_mgr_t *uc_mgr,
 					      const char *verb_name)
 {
-	return find(&uc_mgr->verb_list,
-		    struct use_case_verb, list, name,
-		    verb_name);
+	return hash_find(&uc_mgr->verb_hash,
+			 struct use_case_verb, name, verb_name);
 }
 
 static int is_devlist_supported(snd_use_case_mgr_t *uc_mgr, 
@@ -529,7 +581,13 @@ static inline struct use_case_device *
 	struct use_case_device *device;
 	struct list_head *pos;
 
-	list_for_each(pos, &verb->device_list) {
+	/* the table has the first device of the name, the walk goes on
+	   from there if it is not supported */
+	device = hash_find(&verb->device_hash, struct use_case_device,
+			   name, device_name);
+	if (device == NULL)
+		return NULL;
+	for (pos = &device->list; pos != &verb->device_list; pos = pos->next) {
 		device = list_entry(pos, struct use_case_device, list);
 
 		if (strcmp(device_name, device->name))
@@ -557,7 +615,12 @@ static struct use_case_modifier *
 	struct use_case_modifier *modifier;
 	struct list_head *pos;
 
-	list_for_each(pos, &verb->modifier_list) {
+	modifier = hash_find(&verb->modifier_hash, struct use_case_modifier,
+			     name, modifier_name);
+	if (modifier == NULL)
+		return NULL;
+	for (pos = &modifier->list; pos != &verb->modifier_list;
+	     pos = pos->next) {
 		modifier = list_entry(pos, struct use_case_modifier, list);
 
 		if (strcmp(modifier->name, modifier_name))
@@ -715,6 +778,7 @@ int snd_use_case_mgr_open(snd_use_case_mgr_t **uc_mgr,
 	INIT_LIST_HEAD(&mgr->verb_list);
 	INIT_LIST_HEAD(&mgr->default_list);
 	INIT_LIST_HEAD(&mgr->value_list);
+	INIT_LIST_HEAD(&mgr->file_list);
 	INIT_LIST_HEAD(&mgr->active_modifiers);
 	INIT_LIST_HEAD(&mgr->active_devices);
 	pthread_mutex_init(&mgr->mutex, NULL);
@@ -754,7 +818,8 @@ int snd_use_case_mgr_reload(snd_use_case_mgr_t *uc_mgr)
 
 	uc_mgr_free_verb(uc_mgr);
 
-	/* reload all use cases */
+	/* reload all use cases, the files are parsed again */
+	uc_mgr_cache_drop(uc_mgr->card_name);
 	err = import_master_config(uc_mgr);
 	if (err < 0) {
 		uc_error("error: failed to reload use cases\n");
@@ -304,6 +304,9 @@ static int parse_sequence(snd_use_case_mgr_t *uc_mgr ATTRIBUTE_UNUSED,
 				uc_error("error: cset requires a string!");
 				return err;
 			}
+			err = uc_mgr_parse_cset(curr);
+			if (err < 0)
+				return err;
 			continue;
 		}
 
@@ -940,6 +943,9 @@ static int parse_verb_file(snd_use_case_mgr_t *uc_mgr,
 		uc_mgr->card_name, file);
 	filename[sizeof(filename)-1] = '\0';
 	
+	err = uc_mgr_note_file(uc_mgr, filename);
+	if (err < 0)
+		return err;
 	err = uc_mgr_config_load(filename, &cfg);
 	if (err < 0) {
 		uc_error("error: failed to open verb file %s : %d",
@@ -960,7 +966,7 @@ static int parse_verb_file(snd_use_case_mgr_t *uc_mgr,
 			if (err < 0) {
 				uc_error("error: %s failed to parse verb",
 						file);
-				return err;
+				goto __err;
 			}
 			continue;
 		}
@@ -972,7 +978,7 @@ static int parse_verb_file(snd_use_case_mgr_t *uc_mgr,
 			if (err < 0) {
 				uc_error("error: %s failed to parse device",
 						file);
-				return err;
+				goto __err;
 			}
 			continue;
 		}
@@ -984,7 +990,7 @@ static int parse_verb_file(snd_use_case_mgr_t *uc_mgr,
 			if (err < 0) {
 				uc_error("error: %s failed to parse modifier",
 						file);
-				return err;
+				goto __err;
 			}
 			continue;
 		}
@@ -993,9 +999,14 @@ static int parse_verb_file(snd_use_case_mgr_t *uc_mgr,
 	/* use case verb must have at least 1 device */
 	if (list_empty(&verb->device_list)) {
 		uc_error("error: no use case device defined", file);
-		return -EINVAL;
+		err = -EINVAL;
+		goto __err;
 	}
-	return 0;
+	err = 0;
+
+      __err:
+	snd_config_delete(cfg);
+	return err;
 }
 
 /*
@@ -1185,17 +1196,22 @@ static int parse_master_file(snd_use_case_mgr_t *uc_mgr, snd_config_t *cfg)
 	return 0;
 }
 
-static int load_master_config(const char *card_name, snd_config_t **cfg)
+static void master_config_path(const char *card_name, char *filename)
 {
-	char filename[MAX_FILE];
 	char *env = getenv(ALSA_CONFIG_UCM_VAR);
-	int err;
 
-	snprintf(filename, sizeof(filename)-1,
+	snprintf(filename, MAX_FILE-1,
 		"%s/%s/%s.conf", env ? env : ALSA_USE_CASE_DIR,
 		card_name, card_name);
 	filename[MAX_FILE-1] = '\0';
+}
+
+static int load_master_config(const char *card_name, snd_config_t **cfg)
+{
+	char filename[MAX_FILE];
+	int err;
 
+	master_config_path(card_name, filename);
 	err = uc_mgr_config_load(filename, cfg);
 	if (err < 0) {
 		uc_error("error: could not parse configuration for card %s",
@@ -1206,20 +1222,139 @@ static int load_master_config(const char *card_name, snd_config_t **cfg)
 	return 0;
 }
 
+/*
+ * Parsed configurations, one per master file. A manager opened for a
+ * card gets a copy of the cached configuration as long as none of the
+ * files it was parsed from changed (device, inode, mtime and size are
+ * compared like snd_config_update() does for the global configuration).
+ */
+struct ucm_cache {
+	struct list_head list;
+	char *name;			/* master file */
+	snd_use_case_mgr_t *config;	/* verbs, defaults, values, files */
+};
+
+static LIST_HEAD(uc_mgr_cache);
+static pthread_mutex_t uc_mgr_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct ucm_cache *cache_find(const char *name)
+{
+	struct list_head *pos;
+	struct ucm_cache *c;
+
+	list_for_each(pos, &uc_mgr_cache) {
+		c = list_entry(pos, struct ucm_cache, list);
+		if (strcmp(c->name, name) == 0)
+			return c;
+	}
+	return NULL;
+}
+
+static void cache_free(struct ucm_cache *c)
+{
+	list_del(&c->list);
+	uc_mgr_free(c->config);
+	free(c->name);
+	free(c);
+}
+
+/* return 1 if the configuration was copied from the cache */
+static int cache_lookup(snd_use_case_mgr_t *uc_mgr, const char *name)
+{
+	struct ucm_cache *c;
+	int err = 0;
+
+	pthread_mutex_lock(&uc_mgr_cache_mutex);
+	c = cache_find(name);
+	if (c && !uc_mgr_check_files(&c->config->file_list)) {
+		uc_dbg("configuration %s changed", name);
+		cache_free(c);
+		c = NULL;
+	}
+	if (c) {
+		err = uc_mgr_copy_config(uc_mgr, c->config);
+		if (err >= 0)
+			err = 1;
+	}
+	pthread_mutex_unlock(&uc_mgr_cache_mutex);
+	return err;
+}
+
+static void cache_store(snd_use_case_mgr_t *uc_mgr, const char *name)
+{
+	struct ucm_cache *c;
+
+	c = calloc(1, sizeof(*c));
+	if (c == NULL)
+		return;
+	c->name = strdup(name);
+	c->config = calloc(1, sizeof(*c->config));
+	if (c->name == NULL || c->config == NULL)
+		goto __fail;
+	INIT_LIST_HEAD(&c->config->verb_list);
+	INIT_LIST_HEAD(&c->config->default_list);
+	INIT_LIST_HEAD(&c->config->value_list);
+	INIT_LIST_HEAD(&c->config->file_list);
+	INIT_LIST_HEAD(&c->config->active_devices);
+	INIT_LIST_HEAD(&c->config->active_modifiers);
+	if (uc_mgr_copy_config(c->config, uc_mgr) < 0)
+		goto __fail;
+	pthread_mutex_lock(&uc_mgr_cache_mutex);
+	if (cache_find(name))
+		cache_free(cache_find(name));
+	list_add(&c->list, &uc_mgr_cache);
+	pthread_mutex_unlock(&uc_mgr_cache_mutex);
+	return;
+
+      __fail:
+	if (c->config)
+		uc_mgr_free(c->config);
+	free(c->name);
+	free(c);
+}
+
+/* forget the cached configuration of a card */
+void uc_mgr_cache_drop(const char *card_name)
+{
+	char filename[MAX_FILE];
+	struct ucm_cache *c;
+
+	master_config_path(card_name, filename);
+	pthread_mutex_lock(&uc_mgr_cache_mutex);
+	c = cache_find(filename);
+	if (c)
+		cache_free(c);
+	pthread_mutex_unlock(&uc_mgr_cache_mutex);
+}
+
 /* load master use case file for sound card */
 int uc_mgr_import_master_config(snd_use_case_mgr_t *uc_mgr)
 {
+	char filename[MAX_FILE];
 	snd_config_t *cfg;
 	int err;
 
-	err = load_master_config(uc_mgr->card_name, &cfg);
-	if (err < 0)
-		return err;
-	err = parse_master_file(uc_mgr, cfg);
-	snd_config_delete(cfg);
-	if (err < 0)
-		uc_mgr_free_verb(uc_mgr);
+	master_config_path(uc_mgr->card_name, filename);
+	err = cache_lookup(uc_mgr, filename);
+	if (err == 0) {
+		err = uc_mgr_note_file(uc_mgr, filename);
+		if (err < 0)
+			goto __fail;
+		err = load_master_config(uc_mgr->card_name, &cfg);
+		if (err < 0)
+			goto __fail;
+		err = parse_master_file(uc_mgr, cfg);
+		snd_config_delete(cfg);
+		if (err >= 0)
+			cache_store(uc_mgr, filename);
+	}
+	if (err >= 0)
+		err = uc_mgr_build_hash(uc_mgr);
+	if (err >= 0)
+		return 0;
 
+      __fail:
+	uc_mgr_free_verb(uc_mgr);
 	return err;
 }
 
@@ -48,12 +48,46 @@
 #define SEQUENCE_ELEMENT_TYPE_SLEEP	3
 #define SEQUENCE_ELEMENT_TYPE_EXEC	4
 
+/*
+ * Hashed lookup by name over a list of verbs, devices or modifiers.
+ * The list stays the owner, the table only points to its entries.
+ */
+struct ucm_hash {
+	unsigned int mask;
+	void **slot;
+};
+
+/*
+ * Configuration file the use case manager was parsed from.
+ */
+struct ucm_file {
+	struct list_head list;
+	char *name;
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	off_t size;
+};
+
 struct ucm_value {
         struct list_head list;
         char *name;
         char *data;
 };
 
+/*
+ * Parsed cset. The element id is parsed when the configuration is
+ * loaded, the value is resolved on the first run against a ctl and
+ * reused while the ctl stays open.
+ */
+struct ucm_cset {
+	snd_ctl_elem_id_t id;
+	const char *value;		/* value part of the cset string */
+	unsigned int ctl_gen;		/* ctl the value was resolved on */
+	unsigned int partial: 1;	/* value keeps a part of the current one */
+	snd_ctl_elem_value_t *resolved;	/* with the numid, ready to write */
+};
+
 struct sequence_element {
 	struct list_head list;
 	unsigned int type;
@@ -63,6 +97,7 @@ struct sequence_element {
 		char *cset;
 		char *exec;
 	} data;
+	struct ucm_cset *cset;	/* NULL if the cset id does not parse */
 };
 
 /*
@@ -170,6 +205,10 @@ struct use_case_verb {
 
 	/* value list */
 	struct list_head value_list;
+
+	/* name lookup in device_list and modifier_list */
+	struct ucm_hash device_hash;
+	struct ucm_hash modifier_hash;
 };
 
 /*
@@ -188,6 +227,12 @@ struct snd_use_case_mgr {
 	/* default settings - value list */
 	struct list_head value_list;
 
+	/* name lookup in verb_list */
+	struct ucm_hash verb_hash;
+
+	/* files parsed, to validate the configuration cache */
+	struct list_head file_list;
+
 	/* current status */
 	struct use_case_verb *active_verb;
 	struct list_head active_devices;
@@ -199,8 +244,18 @@ struct snd_use_case_mgr {
 	/* change to list of ctl handles */
 	snd_ctl_t *ctl;
 	char *ctl_dev;
+	unsigned int ctl_gen;	/* bumped on each ctl open */
 };
 
+extern int __snd_ctl_ascii_elem_id_parse(snd_ctl_elem_id_t *dst,
+					 const char *str,
+					 const char **ret_ptr);
+extern int __snd_ctl_ascii_value_parse(snd_ctl_t *handle,
+				       snd_ctl_elem_value_t *dst,
+				       snd_ctl_elem_info_t *info,
+				       const char *value,
+				       unsigned int *ret_items);
+
 #define uc_error SNDERR
 
 #ifdef UC_MGR_DEBUG
@@ -216,7 +271,17 @@ int uc_mgr_config_load(const char *file, snd_config_t **cfg);
 int uc_mgr_import_master_config(snd_use_case_mgr_t *uc_mgr);
 int uc_mgr_scan_master_configs(const char **_list[]);
 
+int uc_mgr_parse_cset(struct sequence_element *seq);
+int uc_mgr_note_file(snd_use_case_mgr_t *uc_mgr, const char *file);
+int uc_mgr_check_files(struct list_head *base);
+int uc_mgr_copy_config(snd_use_case_mgr_t *dst, snd_use_case_mgr_t *src);
+int uc_mgr_build_hash(snd_use_case_mgr_t *uc_mgr);
+void *uc_mgr_hash_find(struct ucm_hash *hash, unsigned long soffset,
+		       const char *match);
+void uc_mgr_cache_drop(const char *card_name);
+
 void uc_mgr_free_sequence_element(struct sequence_element *seq);
 void uc_mgr_free_transition_element(struct transition_sequence *seq);
+void uc_mgr_free_files(struct list_head *base);
 void uc_mgr_free_verb(snd_use_case_mgr_t *uc_mgr);
 void uc_mgr_free(snd_use_case_mgr_t *uc_mgr);
@@ -31,6 +31,8 @@
  */
 
 #include "ucm_local.h"
+#include <ctype.h>
+#include <sys/stat.h>
 
 void uc_mgr_error(const char *fmt,...)
 {
@@ -85,6 +87,425 @@ int uc_mgr_config_load(const char *file, snd_config_t **cfg)
 	return 0;
 }
 
+/*
+ * Parse the element id of a cset. A cset which does not parse is left
+ * to execute_cset() to report when the sequence runs.
+ */
+int uc_mgr_parse_cset(struct sequence_element *seq)
+{
+	struct ucm_cset *cset;
+	const char *pos;
+
+	cset = calloc(1, sizeof(*cset));
+	if (cset == NULL)
+		return -ENOMEM;
+	if (__snd_ctl_ascii_elem_id_parse(&cset->id, seq->data.cset, &pos) < 0) {
+		free(cset);
+		return 0;
+	}
+	while (*pos && isspace(*pos))
+		pos++;
+	if (!*pos) {
+		free(cset);
+		return 0;
+	}
+	cset->value = pos;
+	seq->cset = cset;
+	return 0;
+}
+
+static void free_cset(struct ucm_cset *cset)
+{
+	if (cset == NULL)
+		return;
+	if (cset->resolved)
+		snd_ctl_elem_value_free(cset->resolved);
+	free(cset);
+}
+
+/*
+ * Remember a file the configuration is parsed from. The file is
+ * checked before it is loaded, so a change during the load
+ * invalidates the cache rather than hiding in it.
+ */
+int uc_mgr_note_file(snd_use_case_mgr_t *uc_mgr, const char *file)
+{
+	struct ucm_file *f;
+	struct stat st;
+
+	if (stat(file, &st) < 0)
+		return 0;
+	f = calloc(1, sizeof(*f));
+	if (f == NULL)
+		return -ENOMEM;
+	f->name = strdup(file);
+	if (f->name == NULL) {
+		free(f);
+		return -ENOMEM;
+	}
+	f->dev = st.st_dev;
+	f->ino = st.st_ino;
+	f->mtime = st.st_mtime;
+	f->size = st.st_size;
+	list_add_tail(&f->list, &uc_mgr->file_list);
+	return 0;
+}
+
+/*
+ * Return 1 if none of the files changed since they were noted.
+ */
+int uc_mgr_check_files(struct list_head *base)
+{
+	struct list_head *pos;
+	struct ucm_file *f;
+	struct stat st;
+
+	if (list_empty(base))
+		return 0;
+	list_for_each(pos, base) {
+		f = list_entry(pos, struct ucm_file, list);
+		if (stat(f->name, &st) < 0)
+			return 0;
+		if (f->dev != st.st_dev || f->ino != st.st_ino ||
+		    f->mtime != st.st_mtime || f->size != st.st_size)
+			return 0;
+	}
+	return 1;
+}
+
+void uc_mgr_free_files(struct list_head *base)
+{
+	struct list_head *pos, *npos;
+	struct ucm_file *f;
+
+	list_for_each_safe(pos, npos, base) {
+		f = list_entry(pos, struct ucm_file, list);
+		free(f->name);
+		list_del(&f->list);
+		free(f);
+	}
+}
+
+/*
+ * Name hash tables
+ */
+
+static unsigned int hash_str(const char *str)
+{
+	unsigned int hash = 2166136261U;	/* FNV-1a */
+
+	while (*str)
+		hash = (hash ^ (unsigned char)*str++) * 16777619U;
+	return hash;
+}
+
+static inline const char *hash_name(void *ptr, unsigned long soffset)
+{
+	return *((char **)((char *)ptr + soffset));
+}
+
+static void hash_free(struct ucm_hash *hash)
+{
+	free(hash->slot);
+	hash->slot = NULL;
+	hash->mask = 0;
+}
+
+/* the first entry of a name wins, as with a list walk */
+static int hash_build0(struct ucm_hash *hash, struct list_head *list,
+		       unsigned long offset, unsigned long soffset)
+{
+	struct list_head *pos;
+	unsigned int size = 4, count = 0, h;
+	const char *name;
+	char *ptr;
+
+	list_for_each(pos, list)
+		count++;
+	while (size < count * 2)
+		size <<= 1;
+	hash_free(hash);
+	hash->slot = calloc(size, sizeof(void *));
+	if (hash->slot == NULL)
+		return -ENOMEM;
+	hash->mask = size - 1;
+	list_for_each(pos, list) {
+		ptr = list_entry_offset(pos, char, offset);
+		name = hash_name(ptr, soffset);
+		if (name == NULL)
+			continue;
+		for (h = hash_str(name) & hash->mask; hash->slot[h];
+		     h = (h + 1) & hash->mask)
+			if (strcmp(hash_name(hash->slot[h], soffset), name) == 0)
+				break;
+		if (hash->slot[h] == NULL)
+			hash->slot[h] = ptr;
+	}
+	return 0;
+}
+
+#define hash_build(hash, list, type, member, value) \
+	hash_build0(hash, list, (unsigned long)(&((type *)0)->member), \
+		    (unsigned long)(&((type *)0)->value))
+
+void *uc_mgr_hash_find(struct ucm_hash *hash, unsigned long soffset,
+		       const char *match)
+{
+	unsigned int h;
+
+	if (hash->slot == NULL)
+		return NULL;
+	for (h = hash_str(match) & hash->mask; hash->slot[h];
+	     h = (h + 1) & hash->mask)
+		if (strcmp(hash_name(hash->slot[h], soffset), match) == 0)
+			return hash->slot[h];
+	return NULL;
+}
+
+int uc_mgr_build_hash(snd_use_case_mgr_t *uc_mgr)
+{
+	struct list_head *pos;
+	struct use_case_verb *verb;
+	int err;
+
+	err = hash_build(&uc_mgr->verb_hash, &uc_mgr->verb_list,
+			 struct use_case_verb, list, name);
+	if (err < 0)
+		return err;
+	list_for_each(pos, &uc_mgr->verb_list) {
+		verb = list_entry(pos, struct use_case_verb, list);
+		err = hash_build(&verb->device_hash, &verb->device_list,
+				 struct use_case_device, list, name);
+		if (err < 0)
+			return err;
+		err = hash_build(&verb->modifier_hash, &verb->modifier_list,
+				 struct use_case_modifier, list, name);
+		if (err < 0)
+			return err;
+	}
+	return 0;
+}
+
+/*
+ * Copy a parsed configuration. New entries are linked before they are
+ * filled, so uc_mgr_free_verb() releases a partial copy.
+ */
+
+static int copy_str(char **dst, const char *src)
+{
+	if (src == NULL) {
+		*dst = NULL;
+		return 0;
+	}
+	*dst = strdup(src);
+	return *dst ? 0 : -ENOMEM;
+}
+
+static int copy_value(struct list_head *dst, struct list_head *src)
+{
+	struct list_head *pos;
+	struct ucm_value *v, *nv;
+
+	list_for_each(pos, src) {
+		v = list_entry(pos, struct ucm_value, list);
+		nv = calloc(1, sizeof(*nv));
+		if (nv == NULL)
+			return -ENOMEM;
+		list_add_tail(&nv->list, dst);
+		if (copy_str(&nv->name, v->name) < 0 ||
+		    copy_str(&nv->data, v->data) < 0)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+static int copy_dev_list(struct dev_list *dst, struct dev_list *src)
+{
+	struct list_head *pos;
+	struct dev_list_node *d, *nd;
+
+	dst->type = src->type;
+	list_for_each(pos, &src->list) {
+		d = list_entry(pos, struct dev_list_node, list);
+		nd = calloc(1, sizeof(*nd));
+		if (nd == NULL)
+			return -ENOMEM;
+		list_add_tail(&nd->list, &dst->list);
+		if (copy_str(&nd->name, d->name) < 0)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+static int copy_sequence(struct list_head *dst, struct list_head *src)
+{
+	struct list_head *pos;
+	struct sequence_element *s, *ns;
+
+	list_for_each(pos, src) {
+		s = list_entry(pos, struct sequence_element, list);
+		ns = calloc(1, sizeof(*ns));
+		if (ns == NULL)
+			return -ENOMEM;
+		ns->type = s->type;
+		switch (s->type) {
+		case SEQUENCE_ELEMENT_TYPE_CDEV:
+		case SEQUENCE_ELEMENT_TYPE_CSET:
+		case SEQUENCE_ELEMENT_TYPE_EXEC:
+			if (copy_str(&ns->data.exec, s->data.exec) < 0) {
+				free(ns);
+				return -ENOMEM;
+			}
+			break;
+		default:
+			ns->data = s->data;
+			break;
+		}
+		list_add_tail(&ns->list, dst);
+		if (s->cset) {
+			/* the parsed id is copied, the resolution is not */
+			ns->cset = calloc(1, sizeof(*ns->cset));
+			if (ns->cset == NULL)
+				return -ENOMEM;
+			ns->cset->id = s->cset->id;
+			ns->cset->value = ns->data.cset +
+					  (s->cset->value - s->data.cset);
+		}
+	}
+	return 0;
+}
+
+static int copy_transition(struct list_head *dst, struct list_head *src)
+{
+	struct list_head *pos;
+	struct transition_sequence *t, *nt;
+
+	list_for_each(pos, src) {
+		t = list_entry(pos, struct transition_sequence, list);
+		nt = calloc(1, sizeof(*nt));
+		if (nt == NULL)
+			return -ENOMEM;
+		INIT_LIST_HEAD(&nt->transition_list);
+		list_add_tail(&nt->list, dst);
+		if (copy_str(&nt->name, t->name) < 0 ||
+		    copy_sequence(&nt->transition_list, &t->transition_list) < 0)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+static int copy_device(struct list_head *dst, struct list_head *src)
+{
+	struct list_head *pos;
+	struct use_case_device *d, *nd;
+
+	list_for_each(pos, src) {
+		d = list_entry(pos, struct use_case_device, list);
+		nd = calloc(1, sizeof(*nd));
+		if (nd == NULL)
+			return -ENOMEM;
+		INIT_LIST_HEAD(&nd->enable_list);
+		INIT_LIST_HEAD(&nd->disable_list);
+		INIT_LIST_HEAD(&nd->transition_list);
+		INIT_LIST_HEAD(&nd->dev_list.list);
+		INIT_LIST_HEAD(&nd->value_list);
+		list_add_tail(&nd->list, dst);
+		if (copy_str(&nd->name, d->name) < 0 ||
+		    copy_str(&nd->comment, d->comment) < 0 ||
+		    copy_sequence(&nd->enable_list, &d->enable_list) < 0 ||
+		    copy_sequence(&nd->disable_list, &d->disable_list) < 0 ||
+		    copy_transition(&nd->transition_list, &d->transition_list) < 0 ||
+		    copy_dev_list(&nd->dev_list, &d->dev_list) < 0 ||
+		    copy_value(&nd->value_list, &d->value_list) < 0)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+static int copy_modifier(struct list_head *dst, struct list_head *src)
+{
+	struct list_head *pos;
+	struct use_case_modifier *m, *nm;
+
+	list_for_each(pos, src) {
+		m = list_entry(pos, struct use_case_modifier, list);
+		nm = calloc(1, sizeof(*nm));
+		if (nm == NULL)
+			return -ENOMEM;
+		INIT_LIST_HEAD(&nm->enable_list);
+		INIT_LIST_HEAD(&nm->disable_list);
+		INIT_LIST_HEAD(&nm->transition_list);
+		INIT_LIST_HEAD(&nm->dev_list.list);
+		INIT_LIST_HEAD(&nm->value_list);
+		list_add_tail(&nm->list, dst);
+		if (copy_str(&nm->name, m->name) < 0 ||
+		    copy_str(&nm->comment, m->comment) < 0 ||
+		    copy_sequence(&nm->enable_list, &m->enable_list) < 0 ||
+		    copy_sequence(&nm->disable_list, &m->disable_list) < 0 ||
+		    copy_transition(&nm->transition_list, &m->transition_list) < 0 ||
+		    copy_dev_list(&nm->dev_list, &m->dev_list) < 0 ||
+		    copy_value(&nm->value_list, &m->value_list) < 0)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+static int copy_files(struct list_head *dst, struct list_head *src)
+{
+	struct list_head *pos;
+	struct ucm_file *f, *nf;
+
+	list_for_each(pos, src) {
+		f = list_entry(pos, struct ucm_file, list);
+		nf = malloc(sizeof(*nf));
+		if (nf == NULL)
+			return -ENOMEM;
+		*nf = *f;
+		nf->name = strdup(f->name);
+		if (nf->name == NULL) {
+			free(nf);
+			return -ENOMEM;
+		}
+		list_add_tail(&nf->list, dst);
+	}
+	return 0;
+}
+
+int uc_mgr_copy_config(snd_use_case_mgr_t *dst, snd_use_case_mgr_t *src)
+{
+	struct list_head *pos;
+	struct use_case_verb *v, *nv;
+
+	if (copy_str(&dst->comment, src->comment) < 0 ||
+	    copy_sequence(&dst->default_list, &src->default_list) < 0 ||
+	    copy_value(&dst->value_list, &src->value_list) < 0 ||
+	    copy_files(&dst->file_list, &src->file_list) < 0)
+		return -ENOMEM;
+	list_for_each(pos, &src->verb_list) {
+		v = list_entry(pos, struct use_case_verb, list);
+		nv = calloc(1, sizeof(*nv));
+		if (nv == NULL)
+			return -ENOMEM;
+		INIT_LIST_HEAD(&nv->enable_list);
+		INIT_LIST_HEAD(&nv->disable_list);
+		INIT_LIST_HEAD(&nv->transition_list);
+		INIT_LIST_HEAD(&nv->device_list);
+		INIT_LIST_HEAD(&nv->modifier_list);
+		INIT_LIST_HEAD(&nv->value_list);
+		list_add_tail(&nv->list, &dst->verb_list);
+		if (copy_str(&nv->name, v->name) < 0 ||
+		    copy_str(&nv->comment, v->comment) < 0 ||
+		    copy_sequence(&nv->enable_list, &v->enable_list) < 0 ||
+		    copy_sequence(&nv->disable_list, &v->disable_list) < 0 ||
+		    copy_transition(&nv->transition_list, &v->transition_list) < 0 ||
+		    copy_value(&nv->value_list, &v->value_list) < 0 ||
+		    copy_device(&nv->device_list, &v->device_list) < 0 ||
+		    copy_modifier(&nv->modifier_list, &v->modifier_list) < 0)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
 void uc_mgr_free_value(struct list_head *base)
 {
 	struct list_head *pos, *npos;
@@ -118,6 +539,8 @@ void uc_mgr_free_sequence_element(struct sequence_element *seq)
 		return;
 	switch (seq->type) {
 	case SEQUENCE_ELEMENT_TYPE_CSET:
+		free_cset(seq->cset);
+		/* fall through */
 	case SEQUENCE_ELEMENT_TYPE_EXEC:
 		free(seq->data.exec);
 		break;
@@ -211,11 +634,15 @@ void uc_mgr_free_verb(snd_use_case_mgr_t *uc_mgr)
 		uc_mgr_free_value(&verb->value_list);
 		uc_mgr_free_device(&verb->device_list);
 		uc_mgr_free_modifier(&verb->modifier_list);
+		hash_free(&verb->device_hash);
+		hash_free(&verb->modifier_hash);
 		list_del(&verb->list);
 		free(verb);
 	}
+	hash_free(&uc_mgr->verb_hash);
 	uc_mgr_free_sequence(&uc_mgr->default_list);
 	uc_mgr_free_value(&uc_mgr->value_list);
+	uc_mgr_free_files(&uc_mgr->file_list);
 	free(uc_mgr->comment);
 	uc_mgr->comment = NULL;
 	uc_mgr->active_verb = NULL;
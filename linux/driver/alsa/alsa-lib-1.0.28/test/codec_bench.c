@@ -0,0 +1,442 @@
+/*
+ *  Codec plugin benchmark
+ *
+ *  Pushes S16 audio through the alaw, mulaw and adpcm plugins (both
+ *  directions) on top of a null PCM and reports the throughput as the
+ *  number of 8 kHz channels one core can transcode in real time.
+ *
+ *  Before timing, the plugin output is captured through a file PCM and
+ *  compared with the scalar reference coders below: every A-law and
+ *  mu-law code is decoded, and IMA ADPCM is encoded and decoded back.
+ *  Any mismatch makes the program fail.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <math.h>
+#include "../include/asoundlib.h"
+
+static unsigned int channels = 2;
+static unsigned int seconds = 60;
+static snd_pcm_access_t access_type = SND_PCM_ACCESS_RW_INTERLEAVED;
+
+/* reference coders, as in the plugins before the table driven versions */
+static int alaw_to_s16(unsigned char a_val)
+{
+	int t, seg;
+
+	a_val ^= 0x55;
+	t = a_val & 0x7f;
+	if (t < 16)
+		t = (t << 4) + 8;
+	else {
+		seg = (t >> 4) & 0x07;
+		t = ((t & 0x0f) << 4) + 0x108;
+		t <<= seg - 1;
+	}
+	return ((a_val & 0x80) ? t : -t);
+}
+
+static int ulaw_to_s16(unsigned char u_val)
+{
+	int t;
+
+	u_val = ~u_val;
+	t = ((u_val & 0x0f) << 3) + 0x84;
+	t <<= (u_val & 0x70) >> 4;
+	return ((u_val & 0x80) ? (0x84 - t) : (t - 0x84));
+}
+
+struct adpcm_state {
+	int pred_val;
+	int step_idx;
+};
+
+static const char IndexAdjust[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static const short StepSize[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+	19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+	130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+	5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static void adpcm_update(struct adpcm_state *state, unsigned char code,
+			 short pred_diff)
+{
+	state->pred_val += (code & 0x8) ? -pred_diff : pred_diff;
+	if (state->pred_val > 32767)
+		state->pred_val = 32767;
+	else if (state->pred_val < -32768)
+		state->pred_val = -32768;
+	state->step_idx += IndexAdjust[code & 0x7];
+	if (state->step_idx < 0)
+		state->step_idx = 0;
+	else if (state->step_idx > 88)
+		state->step_idx = 88;
+}
+
+static int adpcm_decoder(unsigned char code, struct adpcm_state *state)
+{
+	short step = StepSize[state->step_idx];
+	short pred_diff = step >> 3;
+	int i;
+
+	for (i = 0x4; i; i >>= 1, step >>= 1) {
+		if (code & i)
+			pred_diff += step;
+	}
+	adpcm_update(state, code, pred_diff);
+	return state->pred_val;
+}
+
+static unsigned char adpcm_encoder(int sl, struct adpcm_state *state)
+{
+	short diff = sl - state->pred_val;
+	short step = StepSize[state->step_idx];
+	short pred_diff = step >> 3;
+	unsigned char code = (diff < 0) ? 0x8 : 0x0;
+	int i;
+
+	if (code)
+		diff = -diff;
+	for (i = 0x4; i; i >>= 1, step >>= 1) {
+		if (diff >= step) {
+			code |= i;
+			diff -= step;
+			pred_diff += step;
+		}
+	}
+	adpcm_update(state, code, pred_diff);
+	return code;
+}
+
+struct codec {
+	const char *type;
+	const char *format;
+	int (*decode)(unsigned char);	/* reference, NULL for ADPCM */
+};
+
+static const struct codec codecs[] = {
+	{ "alaw", "A_LAW", alaw_to_s16 },
+	{ "mulaw", "MU_LAW", ulaw_to_s16 },
+	{ "adpcm", "IMA_ADPCM", NULL },
+};
+
+/* nibble k of interleaved IMA ADPCM data, the first one in the high bits */
+static unsigned char adpcm_nibble(const unsigned char *data, unsigned int k)
+{
+	return (k & 1) ? data[k / 2] & 0x0f : data[k / 2] >> 4;
+}
+
+static double timediff(struct timespec *t1, struct timespec *t2)
+{
+	return (t2->tv_sec - t1->tv_sec) * 1000.0 +
+	       (t2->tv_nsec - t1->tv_nsec) / 1000000.0;
+}
+
+static int open_codec(snd_pcm_t **pcmp, const struct codec *codec, int encode,
+		      const char *slave, snd_pcm_access_t access)
+{
+	char buf[256];
+	snd_config_t *top;
+	snd_input_t *in;
+	snd_pcm_format_t format;
+	int err;
+
+	/* encode: S16 in, codec to the slave; decode: the other way round */
+	snprintf(buf, sizeof(buf),
+		 "pcm.bench { type %s slave { pcm %s format %s } }",
+		 codec->type, slave, encode ? codec->format : "S16");
+	format = encode ? SND_PCM_FORMAT_S16 : snd_pcm_format_value(codec->format);
+	if ((err = snd_config_top(&top)) < 0)
+		return err;
+	if ((err = snd_input_buffer_open(&in, buf, strlen(buf))) < 0) {
+		snd_config_delete(top);
+		return err;
+	}
+	err = snd_config_load(top, in);
+	snd_input_close(in);
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcmp, "bench", SND_PCM_STREAM_PLAYBACK,
+					 0, top);
+	snd_config_delete(top);
+	if (err < 0)
+		return err;
+	err = snd_pcm_set_params(*pcmp, format, access, channels,
+				 8000, 0, 500000);
+	if (err < 0)
+		snd_pcm_close(*pcmp);
+	return err;
+}
+
+static int run(const struct codec *codec, int encode, double *ms)
+{
+	struct timespec t1, t2;
+	snd_pcm_t *pcm;
+	snd_pcm_format_t format;
+	snd_pcm_uframes_t total = seconds * 8000, chunk = 160, done;
+	void *bufs[channels];
+	unsigned char *data;
+	size_t bytes;
+	unsigned int c;
+	int err;
+
+	if ((err = open_codec(&pcm, codec, encode, "{ type null }",
+			      access_type)) < 0)
+		return err;
+	format = encode ? SND_PCM_FORMAT_S16 : snd_pcm_format_value(codec->format);
+	bytes = snd_pcm_format_size(format, chunk * channels);
+	data = malloc(bytes);
+	if (!data) {
+		snd_pcm_close(pcm);
+		return -ENOMEM;
+	}
+	if (encode) {
+		int16_t *s = (int16_t *)data;
+		for (done = 0; done < chunk * channels; done++)
+			s[done] = 16000 * sin(done * 2 * M_PI / 37.0);
+	} else {
+		for (done = 0; done < bytes; done++)
+			data[done] = rand();
+	}
+	for (c = 0; c < channels; c++)
+		bufs[c] = data + bytes / channels * c;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	for (done = 0; done < total; done += chunk) {
+		snd_pcm_sframes_t r;
+		if (access_type == SND_PCM_ACCESS_RW_INTERLEAVED)
+			r = snd_pcm_writei(pcm, data, chunk);
+		else
+			r = snd_pcm_writen(pcm, bufs, chunk);
+		if (r < 0) {
+			err = r;
+			break;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	*ms = timediff(&t1, &t2);
+	free(data);
+	snd_pcm_close(pcm);
+	return err;
+}
+
+/*
+ * Push frames of in through the codec with interleaved access and return
+ * what reached the slave, as written by a file PCM into a temporary file.
+ */
+static int capture(const struct codec *codec, int encode, const void *in,
+		   snd_pcm_uframes_t frames, void *out, size_t out_bytes)
+{
+	char slave[128];
+	snd_pcm_t *pcm;
+	FILE *f;
+	snd_pcm_sframes_t r;
+	int err;
+
+	f = tmpfile();
+	if (!f)
+		return -errno;
+	snprintf(slave, sizeof(slave),
+		 "{ type file slave.pcm { type null } file %d format raw }",
+		 dup(fileno(f)));
+	err = open_codec(&pcm, codec, encode, slave,
+			 SND_PCM_ACCESS_RW_INTERLEAVED);
+	if (err < 0) {
+		fclose(f);
+		return err;
+	}
+	r = snd_pcm_writei(pcm, in, frames);
+	snd_pcm_close(pcm);
+	if (r < 0) {
+		fclose(f);
+		return r;
+	}
+	rewind(f);
+	if (r != (snd_pcm_sframes_t)frames ||
+	    fread(out, 1, out_bytes, f) != out_bytes)
+		err = -EIO;
+	fclose(f);
+	return err;
+}
+
+/* Return the number of mismatches or a negative error code */
+static int check_g711(const struct codec *codec)
+{
+	snd_pcm_uframes_t frames = 256;
+	unsigned int k, n = frames * channels, bad = 0;
+	unsigned char *in;
+	int16_t *out;
+	int err;
+
+	in = malloc(n);
+	out = malloc(n * 2);
+	if (!in || !out) {
+		free(in);
+		free(out);
+		return -ENOMEM;
+	}
+	for (k = 0; k < n; k++)
+		in[k] = k;
+	err = capture(codec, 0, in, frames, out, n * 2);
+	for (k = 0; err >= 0 && k < n; k++) {
+		if (out[k] != codec->decode(in[k])) {
+			if (bad++ < 8)
+				printf("%s decode of 0x%02x: %d, expected %d\n",
+				       codec->type, in[k], out[k],
+				       codec->decode(in[k]));
+		}
+	}
+	free(in);
+	free(out);
+	return err < 0 ? err : (int)bad;
+}
+
+static int check_adpcm(const struct codec *codec)
+{
+	snd_pcm_uframes_t frames = 2000;
+	unsigned int k, n = frames * channels, bad = 0;
+	struct adpcm_state *states;
+	int16_t *pcm, *out;
+	unsigned char *coded;
+	int err;
+
+	pcm = malloc(n * 2);
+	out = malloc(n * 2);
+	coded = malloc((n + 1) / 2);
+	states = calloc(channels, sizeof(*states));
+	if (!pcm || !out || !coded || !states) {
+		err = -ENOMEM;
+		goto _end;
+	}
+	/* a sine with bursts of full scale square wave to hit the clamps */
+	for (k = 0; k < n; k++) {
+		if ((k / 300) % 3 == 2)
+			pcm[k] = (k / 7) & 1 ? 32767 : -32768;
+		else
+			pcm[k] = 20000 * sin(k * 2 * M_PI / 53.0);
+	}
+	err = capture(codec, 1, pcm, frames, coded, (n + 1) / 2);
+	for (k = 0; err >= 0 && k < n; k++) {
+		unsigned char code = adpcm_encoder(pcm[k], &states[k % channels]);
+		if (adpcm_nibble(coded, k) != code) {
+			if (bad++ < 8)
+				printf("%s encode of sample %u: 0x%x, expected 0x%x\n",
+				       codec->type, k, adpcm_nibble(coded, k), code);
+		}
+	}
+	if (err < 0)
+		goto _end;
+	err = capture(codec, 0, coded, frames, out, n * 2);
+	memset(states, 0, channels * sizeof(*states));
+	for (k = 0; err >= 0 && k < n; k++) {
+		int sample = adpcm_decoder(adpcm_nibble(coded, k),
+					   &states[k % channels]);
+		if (out[k] != sample) {
+			if (bad++ < 8)
+				printf("%s decode of sample %u: %d, expected %d\n",
+				       codec->type, k, out[k], sample);
+		}
+	}
+ _end:
+	free(pcm);
+	free(out);
+	free(coded);
+	free(states);
+	return err < 0 ? err : (int)bad;
+}
+
+static void help(void)
+{
+	printf(
+"Usage: codec_bench [OPTION]...\n"
+"-h,--help           help\n"
+"-c,--channels       number of channels per stream\n"
+"-s,--seconds        seconds of 8 kHz audio per run\n"
+"-n,--noninterleaved use non-interleaved access\n"
+);
+}
+
+int main(int argc, char *argv[])
+{
+	struct option long_option[] =
+	{
+		{"help", 0, NULL, 'h'},
+		{"channels", 1, NULL, 'c'},
+		{"seconds", 1, NULL, 's'},
+		{"noninterleaved", 0, NULL, 'n'},
+		{NULL, 0, NULL, 0},
+	};
+	unsigned int k;
+	int encode, err;
+
+	while (1) {
+		int c;
+		if ((c = getopt_long(argc, argv, "hc:s:n", long_option, NULL)) < 0)
+			break;
+		switch (c) {
+		case 'h':
+			help();
+			return 0;
+		case 'c':
+			channels = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'n':
+			access_type = SND_PCM_ACCESS_RW_NONINTERLEAVED;
+			break;
+		}
+	}
+	if (channels == 0)
+		channels = 1;
+	if (seconds == 0)
+		seconds = 1;
+
+	for (k = 0; k < sizeof(codecs) / sizeof(codecs[0]); k++) {
+		if (codecs[k].decode)
+			err = check_g711(&codecs[k]);
+		else
+			err = check_adpcm(&codecs[k]);
+		if (err != 0) {
+			if (err < 0)
+				printf("%s check error: %s\n", codecs[k].type,
+				       snd_strerror(err));
+			else
+				printf("%s: %d mismatches\n", codecs[k].type,
+				       err);
+			return EXIT_FAILURE;
+		}
+	}
+	printf("codec output matches the reference coders\n");
+
+	printf("%u channels, %u s of audio per run, %s\n", channels, seconds,
+	       snd_pcm_access_name(access_type));
+	for (k = 0; k < sizeof(codecs) / sizeof(codecs[0]); k++) {
+		for (encode = 1; encode >= 0; encode--) {
+			double ms;
+			err = run(&codecs[k], encode, &ms);
+			if (err < 0) {
+				printf("%s %s error: %s\n", codecs[k].type,
+				       encode ? "encode" : "decode",
+				       snd_strerror(err));
+				return EXIT_FAILURE;
+			}
+			printf("%-6s %s: %9.3fms, %8.0f channels per core at 8 kHz\n",
+			       codecs[k].type, encode ? "encode" : "decode",
+			       ms, ms > 0 ? seconds * 1000.0 * channels / ms : 0);
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,320 @@
+/*
+ *  IEC958 plugin round-trip test and benchmark
+ *
+ *  Encodes S16 and S32 audio to IEC958 subframes through the iec958
+ *  plugin, checks every subframe against a bit by bit reference encoder,
+ *  decodes the result through the plugin again and compares it with the
+ *  source.  Then reports the encoder and decoder throughput as the number
+ *  of 48 kHz streams one core can handle in real time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/asoundlib.h"
+
+static unsigned int channels = 2;
+static unsigned int seconds = 60;
+
+/* defaults of the plugin */
+static const unsigned char status_bits[24] = {
+	IEC958_AES0_CON_EMPHASIS_NONE,
+	IEC958_AES1_CON_ORIGINAL | IEC958_AES1_CON_PCM_CODER,
+	0,
+	IEC958_AES3_CON_FS_48000
+};
+static const unsigned int preamble[3] = { 0x08, 0x02, 0x04 };	/* Z, X, Y */
+
+static unsigned int ref_subframe(unsigned int sample, unsigned int counter,
+				 unsigned int channel)
+{
+	unsigned int data = (sample >> 4) & ~0xf;
+	unsigned int parity = 0, bit;
+
+	if (status_bits[counter / 8] & (1 << (counter % 8)))
+		data |= 1U << 30;
+	for (bit = 4; bit <= 30; bit++)
+		parity ^= (data >> bit) & 1;
+	data |= parity << 31;
+	if (channel)
+		data |= preamble[2];
+	else
+		data |= counter ? preamble[1] : preamble[0];
+	return data;
+}
+
+static double timediff(struct timespec *t1, struct timespec *t2)
+{
+	return (t2->tv_sec - t1->tv_sec) * 1000.0 +
+	       (t2->tv_nsec - t1->tv_nsec) / 1000000.0;
+}
+
+/* the slave is a null PCM, optionally tapped by a raw file */
+static int open_iec958(snd_pcm_t **pcmp, snd_pcm_format_t format,
+		       snd_pcm_format_t sformat, const char *file)
+{
+	char buf[512], slave[256];
+	snd_config_t *top;
+	snd_input_t *in;
+	int err;
+
+	if (file)
+		snprintf(slave, sizeof(slave),
+			 "{ type file file \"%s\" format raw slave.pcm { type null } }",
+			 file);
+	else
+		strcpy(slave, "{ type null }");
+	snprintf(buf, sizeof(buf),
+		 "pcm.iec { type iec958 slave { pcm %s format %s } }",
+		 slave, snd_pcm_format_name(sformat));
+	if ((err = snd_config_top(&top)) < 0)
+		return err;
+	if ((err = snd_input_buffer_open(&in, buf, strlen(buf))) < 0) {
+		snd_config_delete(top);
+		return err;
+	}
+	err = snd_config_load(top, in);
+	snd_input_close(in);
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcmp, "iec", SND_PCM_STREAM_PLAYBACK,
+					 0, top);
+	snd_config_delete(top);
+	if (err < 0)
+		return err;
+	err = snd_pcm_set_params(*pcmp, format, SND_PCM_ACCESS_RW_INTERLEAVED,
+				 channels, 48000, 0, 500000);
+	if (err < 0)
+		snd_pcm_close(*pcmp);
+	return err;
+}
+
+/* write in odd sized chunks so that blocks straddle the transfers */
+static int write_all(snd_pcm_t *pcm, const void *data, size_t frame_bytes,
+		     snd_pcm_uframes_t frames)
+{
+	snd_pcm_uframes_t pos, n;
+	snd_pcm_sframes_t r;
+
+	for (pos = 0; pos < frames; pos += n) {
+		n = frames - pos < 1001 ? frames - pos : 1001;
+		r = snd_pcm_writei(pcm, (const char *)data + pos * frame_bytes, n);
+		if (r < 0)
+			return r;
+		if ((snd_pcm_uframes_t)r != n)
+			return -EIO;
+	}
+	return 0;
+}
+
+static int transcode(snd_pcm_format_t format, snd_pcm_format_t sformat,
+		     const void *src, void *dst, snd_pcm_uframes_t frames)
+{
+	char file[] = "/tmp/iec958-XXXXXX";
+	snd_pcm_t *pcm;
+	size_t bytes;
+	int fd, err;
+
+	fd = mkstemp(file);
+	if (fd < 0)
+		return -errno;
+	err = open_iec958(&pcm, format, sformat, file);
+	if (err >= 0) {
+		err = write_all(pcm, src, snd_pcm_format_size(format, channels),
+				frames);
+		snd_pcm_close(pcm);
+	}
+	bytes = snd_pcm_format_size(sformat, frames * channels);
+	if (err >= 0 && read(fd, dst, bytes) != (ssize_t)bytes)
+		err = -EIO;
+	close(fd);
+	unlink(file);
+	return err;
+}
+
+static int roundtrip(snd_pcm_format_t format)
+{
+	snd_pcm_uframes_t frames = 192 * 50 + 7, i;
+	unsigned int *src, *enc, *dec;
+	unsigned int n = frames * channels;
+	int width = snd_pcm_format_width(format);
+	int err;
+
+	src = malloc(n * 4);
+	enc = malloc(n * 4);
+	dec = malloc(n * 4);
+	if (!src || !enc || !dec) {
+		err = -ENOMEM;
+		goto __end;
+	}
+	for (i = 0; i < n; i++) {
+		unsigned int sample = rand() ^ (rand() << 16);
+		if (width == 16)
+			((short *)src)[i] = sample;
+		else
+			src[i] = sample;
+	}
+
+	err = transcode(format, SND_PCM_FORMAT_IEC958_SUBFRAME, src, enc, frames);
+	if (err < 0)
+		goto __end;
+	for (i = 0; i < n; i++) {
+		unsigned int sample, ref;
+		if (width == 16)
+			sample = (unsigned int)(unsigned short)((short *)src)[i] << 16;
+		else
+			sample = src[i];
+		ref = ref_subframe(sample, (i / channels) % 192, i % channels);
+		if (enc[i] != ref) {
+			printf("%s encode mismatch at frame %lu channel %u: %08x, expected %08x\n",
+			       snd_pcm_format_name(format), i / channels,
+			       (unsigned int)(i % channels), enc[i], ref);
+			err = -EINVAL;
+			goto __end;
+		}
+	}
+
+	err = transcode(SND_PCM_FORMAT_IEC958_SUBFRAME, format, enc, dec, frames);
+	if (err < 0)
+		goto __end;
+	for (i = 0; i < n; i++) {
+		unsigned int a, b;
+		if (width == 16) {
+			a = (unsigned short)((short *)src)[i];
+			b = (unsigned short)((short *)dec)[i];
+		} else {
+			/* the subframe carries the upper 24 bits */
+			a = src[i] & ~0xff;
+			b = dec[i];
+		}
+		if (a != b) {
+			printf("%s decode mismatch at frame %lu channel %u: %08x, expected %08x\n",
+			       snd_pcm_format_name(format), i / channels,
+			       (unsigned int)(i % channels), b, a);
+			err = -EINVAL;
+			goto __end;
+		}
+	}
+	printf("%s round-trip: ok\n", snd_pcm_format_name(format));
+ __end:
+	free(src);
+	free(enc);
+	free(dec);
+	return err;
+}
+
+static int bench(snd_pcm_format_t format, int encode, double *ms)
+{
+	struct timespec t1, t2;
+	snd_pcm_t *pcm;
+	snd_pcm_format_t cformat, sformat;
+	snd_pcm_uframes_t total = seconds * 48000, chunk = 1024, done;
+	unsigned char *data;
+	size_t bytes;
+	int err = 0;
+
+	cformat = encode ? format : SND_PCM_FORMAT_IEC958_SUBFRAME;
+	sformat = encode ? SND_PCM_FORMAT_IEC958_SUBFRAME : format;
+	if ((err = open_iec958(&pcm, cformat, sformat, NULL)) < 0)
+		return err;
+	bytes = snd_pcm_format_size(cformat, chunk * channels);
+	data = malloc(bytes);
+	if (!data) {
+		snd_pcm_close(pcm);
+		return -ENOMEM;
+	}
+	for (done = 0; done < bytes; done++)
+		data[done] = rand();
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	for (done = 0; done < total; done += chunk) {
+		snd_pcm_sframes_t r = snd_pcm_writei(pcm, data, chunk);
+		if (r < 0) {
+			err = r;
+			break;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	*ms = timediff(&t1, &t2);
+	free(data);
+	snd_pcm_close(pcm);
+	return err;
+}
+
+static void help(void)
+{
+	printf(
+"Usage: iec958 [OPTION]...\n"
+"-h,--help           help\n"
+"-c,--channels       number of channels per stream\n"
+"-s,--seconds        seconds of 48 kHz audio per benchmark run\n"
+);
+}
+
+int main(int argc, char *argv[])
+{
+	struct option long_option[] =
+	{
+		{"help", 0, NULL, 'h'},
+		{"channels", 1, NULL, 'c'},
+		{"seconds", 1, NULL, 's'},
+		{NULL, 0, NULL, 0},
+	};
+	static const snd_pcm_format_t formats[] = {
+		SND_PCM_FORMAT_S16, SND_PCM_FORMAT_S32
+	};
+	unsigned int k;
+	int encode, err;
+
+	while (1) {
+		int c;
+		if ((c = getopt_long(argc, argv, "hc:s:", long_option, NULL)) < 0)
+			break;
+		switch (c) {
+		case 'h':
+			help();
+			return 0;
+		case 'c':
+			channels = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		}
+	}
+	if (channels == 0)
+		channels = 1;
+	if (seconds == 0)
+		seconds = 1;
+
+	for (k = 0; k < sizeof(formats) / sizeof(formats[0]); k++) {
+		err = roundtrip(formats[k]);
+		if (err < 0) {
+			printf("%s round-trip error: %s\n",
+			       snd_pcm_format_name(formats[k]), snd_strerror(err));
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("%u channels, %u s of audio per run\n", channels, seconds);
+	for (k = 0; k < sizeof(formats) / sizeof(formats[0]); k++) {
+		for (encode = 1; encode >= 0; encode--) {
+			double ms;
+			err = bench(formats[k], encode, &ms);
+			if (err < 0) {
+				printf("%s %s error: %s\n",
+				       snd_pcm_format_name(formats[k]),
+				       encode ? "encode" : "decode",
+				       snd_strerror(err));
+				return EXIT_FAILURE;
+			}
+			printf("%-6s %s: %9.3fms, %8.0f streams per core at 48 kHz\n",
+			       snd_pcm_format_name(formats[k]),
+			       encode ? "encode" : "decode",
+			       ms, ms > 0 ? seconds * 1000.0 / ms : 0);
+		}
+	}
+	return EXIT_SUCCESS;
+}
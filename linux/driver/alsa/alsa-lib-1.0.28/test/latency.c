@@ -10,6 +10,12 @@
  *  capture and playback. This latency is measured from driver (diff when
  *  playback and capture was started). Scheduler is set to SCHED_RR.
  *
+ *  The round trip is also timed with a marker frame sent through the
+ *  loop.  With --loopback the devices are replaced by an in-process
+ *  software loopback, --sweep runs every period size between the
+ *  minimum and maximum latency, and the results can be written as CSV
+ *  or JSON, so period settings can be tuned without a sound card.
+ *
  *
  *   This program is free software; you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -33,8 +39,15 @@
 #include <sched.h>
 #include <errno.h>
 #include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
 #include "../include/asoundlib.h"
+#include "../include/pcm_external.h"
 #include <sys/time.h>
+#include <sys/timerfd.h>
 #include <math.h>
 
 char *pdevice = "hw:0,0";
@@ -50,6 +63,12 @@ int loop_sec = 30;		/* seconds */
 int block = 0;			/* block mode */
 int use_poll = 0;
 int resample = 1;
+int loopback = 0;		/* in-process software loopback */
+int sweep = 0;			/* try every period size */
+int sweep_periods = 2;		/* periods per buffer when sweeping */
+int stress = 0;			/* CPU stress threads */
+const char *csv_file = NULL;
+const char *json_file = NULL;
 unsigned long loop_limit;
 
 snd_output_t *output = NULL;
@@ -227,19 +246,19 @@ int setparams(snd_pcm_t *phandle, snd_pcm_t *chandle, int *bufsize)
 		goto __again;
 
 	snd_pcm_hw_params_get_buffer_size(p_params, &p_size);
-	if (p_psize * 2 < p_size) {
+	if (p_psize * sweep_periods < p_size) {
                 snd_pcm_hw_params_get_periods_min(p_params, &val, NULL);
-                if (val > 2) {
-			printf("playback device does not support 2 periods per buffer\n");
+                if (val > (unsigned int)sweep_periods) {
+			printf("playback device does not support %i periods per buffer\n", sweep_periods);
 			exit(0);
 		}
 		goto __again;
 	}
 	snd_pcm_hw_params_get_buffer_size(c_params, &c_size);
-	if (c_psize * 2 < c_size) {
+	if (c_psize * sweep_periods < c_size) {
                 snd_pcm_hw_params_get_periods_min(c_params, &val, NULL);
-		if (val > 2 ) {
-			printf("capture device does not support 2 periods per buffer\n");
+		if (val > (unsigned int)sweep_periods) {
+			printf("capture device does not support %i periods per buffer\n", sweep_periods);
 			exit(0);
 		}
 		goto __again;
@@ -383,7 +402,7 @@ long writebuf(snd_pcm_t *handle, char *buf, long len, size_t *frames)
 		if (r < 0)
 			return r;
 		// showstat(handle, 0);
-		buf += r * 4;
+		buf += r * (snd_pcm_format_width(format) / 8) * channels;
 		len -= r;
 		*frames += r;
 	}
@@ -433,6 +452,587 @@ void applyeffect(char* buffer,int r)
 	}
 }
 
+/*
+ * In-process software loopback: two ioplug PCMs share a clock that
+ * advances in whole periods like the DMA pointer of a sound card, and
+ * a timerfd per stream stands in for the period interrupt.  A frame
+ * played at a clock position is recorded at the same position.
+ */
+
+struct loop_stream {
+	snd_pcm_ioplug_t io;
+	int running;
+	unsigned long long start;	/* clock position of the start */
+	snd_pcm_uframes_t avail_min;
+	snd_pcm_channel_area_t *areas;	/* play buffer or wire */
+};
+
+static struct loopback {
+	struct loop_stream stream[2];
+	struct timespec t0;
+	unsigned int rate;
+	snd_pcm_uframes_t period;
+	unsigned int frame_bytes;
+	unsigned long long clock;	/* frames moved to the wire so far */
+	char *play_buf;
+	char *wire;
+	snd_pcm_uframes_t wire_size;
+} lb;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long long loop_clock(void)
+{
+	unsigned long long ns, frames;
+
+	ns = now_ns() - (lb.t0.tv_sec * 1000000000ULL + lb.t0.tv_nsec);
+	frames = ns * lb.rate / 1000000000ULL;
+	return frames - frames % lb.period;
+}
+
+/* move what the playback side played to the wire */
+static unsigned long long loop_update(void)
+{
+	struct loop_stream *ps = &lb.stream[SND_PCM_STREAM_PLAYBACK];
+	unsigned long long now, c;
+
+	now = loop_clock();
+	if (!lb.wire)
+		return now;
+	c = lb.clock;
+	if (now - c > lb.wire_size)
+		c = now - lb.wire_size;
+	for (; c < now; c++) {
+		char *dst = lb.wire + (c % lb.wire_size) * lb.frame_bytes;
+		unsigned long long pos = c - ps->start;
+		if (ps->running && lb.play_buf && c >= ps->start &&
+		    pos < ps->io.appl_ptr)
+			memcpy(dst, lb.play_buf + (pos % ps->io.buffer_size) *
+			       lb.frame_bytes, lb.frame_bytes);
+		else
+			snd_pcm_format_set_silence(format, dst, channels);
+	}
+	lb.clock = now;
+	return now;
+}
+
+static void loop_timer(struct loop_stream *s, int enable)
+{
+	struct itimerspec its;
+	unsigned long long period_ns, first;
+
+	memset(&its, 0, sizeof(its));
+	if (enable) {
+		/* round up so that the period is complete at the wakeup */
+		period_ns = (lb.period * 1000000000ULL + lb.rate - 1) / lb.rate;
+		first = lb.t0.tv_sec * 1000000000ULL + lb.t0.tv_nsec +
+			(s->start / lb.period + 1) * period_ns;
+		its.it_value.tv_sec = first / 1000000000ULL;
+		its.it_value.tv_nsec = first % 1000000000ULL;
+		its.it_interval.tv_sec = period_ns / 1000000000ULL;
+		its.it_interval.tv_nsec = period_ns % 1000000000ULL;
+	}
+	timerfd_settime(s->io.poll_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static int loop_start(snd_pcm_ioplug_t *io)
+{
+	struct loop_stream *s = io->private_data;
+
+	if (!lb.stream[0].running && !lb.stream[1].running) {
+		clock_gettime(CLOCK_MONOTONIC, &lb.t0);
+		lb.clock = 0;
+	}
+	s->start = loop_update();
+	s->running = 1;
+	loop_timer(s, 1);
+	return 0;
+}
+
+static int loop_stop(snd_pcm_ioplug_t *io)
+{
+	struct loop_stream *s = io->private_data;
+
+	loop_update();
+	s->running = 0;
+	loop_timer(s, 0);
+	return 0;
+}
+
+static snd_pcm_sframes_t loop_pointer(snd_pcm_ioplug_t *io)
+{
+	struct loop_stream *s = io->private_data;
+	unsigned long long hw;
+
+	if (!s->running)
+		return io->hw_ptr % io->buffer_size;
+	hw = loop_update() - s->start;
+	if (io->stream == SND_PCM_STREAM_PLAYBACK) {
+		if (hw >= io->appl_ptr)
+			return -EPIPE;
+	} else {
+		if (hw - io->appl_ptr >= io->buffer_size)
+			return -EPIPE;
+	}
+	return hw % io->buffer_size;
+}
+
+static snd_pcm_sframes_t loop_transfer(snd_pcm_ioplug_t *io,
+				       const snd_pcm_channel_area_t *areas,
+				       snd_pcm_uframes_t offset,
+				       snd_pcm_uframes_t size)
+{
+	struct loop_stream *s = io->private_data;
+	unsigned long long c;
+	snd_pcm_uframes_t done, pos, n;
+
+	if (io->stream == SND_PCM_STREAM_PLAYBACK) {
+		for (done = 0; done < size; done += n) {
+			pos = (io->appl_ptr + done) % io->buffer_size;
+			n = size - done;
+			if (n > io->buffer_size - pos)
+				n = io->buffer_size - pos;
+			snd_pcm_areas_copy(s->areas, pos, areas, offset + done,
+					   io->channels, n, io->format);
+		}
+		return size;
+	}
+	loop_update();
+	c = s->start + io->appl_ptr;
+	for (done = 0; done < size; done += n) {
+		pos = (c + done) % lb.wire_size;
+		n = size - done;
+		if (n > lb.wire_size - pos)
+			n = lb.wire_size - pos;
+		snd_pcm_areas_copy(areas, offset + done, s->areas, pos,
+				   io->channels, n, io->format);
+	}
+	return size;
+}
+
+static int loop_hw_params(snd_pcm_ioplug_t *io,
+			  snd_pcm_hw_params_t *params ATTRIBUTE_UNUSED)
+{
+	struct loop_stream *s = io->private_data;
+	unsigned int width = snd_pcm_format_physical_width(io->format);
+	snd_pcm_uframes_t frames;
+	unsigned int ch;
+	char **buf;
+
+	lb.rate = io->rate;
+	lb.period = io->period_size;
+	lb.frame_bytes = width / 8 * io->channels;
+	if (io->stream == SND_PCM_STREAM_PLAYBACK) {
+		buf = &lb.play_buf;
+		frames = io->buffer_size;
+	} else {
+		buf = &lb.wire;
+		frames = lb.wire_size = io->buffer_size * 4;
+	}
+	free(*buf);
+	free(s->areas);
+	*buf = malloc(frames * lb.frame_bytes);
+	s->areas = calloc(io->channels, sizeof(*s->areas));
+	if (!*buf || !s->areas)
+		return -ENOMEM;
+	snd_pcm_format_set_silence(io->format, *buf, frames * io->channels);
+	for (ch = 0; ch < io->channels; ch++) {
+		s->areas[ch].addr = *buf;
+		s->areas[ch].first = ch * width;
+		s->areas[ch].step = io->channels * width;
+	}
+	return 0;
+}
+
+static int loop_sw_params(snd_pcm_ioplug_t *io, snd_pcm_sw_params_t *params)
+{
+	struct loop_stream *s = io->private_data;
+
+	return snd_pcm_sw_params_get_avail_min(params, &s->avail_min);
+}
+
+static int loop_prepare(snd_pcm_ioplug_t *io)
+{
+	struct loop_stream *s = io->private_data;
+
+	s->running = 0;
+	loop_timer(s, 0);
+	return 0;
+}
+
+static int loop_poll_revents(snd_pcm_ioplug_t *io, struct pollfd *pfd,
+			     unsigned int nfds, unsigned short *revents)
+{
+	struct loop_stream *s = io->private_data;
+	snd_pcm_sframes_t avail;
+	uint64_t expired;
+
+	if (nfds != 1)
+		return -EINVAL;
+	if (pfd[0].revents & POLLIN) {
+		if (read(io->poll_fd, &expired, sizeof(expired)) < 0)
+			expired = 0;
+	}
+	*revents = 0;
+	avail = snd_pcm_avail_update(io->pcm);
+	if (avail < 0)
+		*revents = POLLERR;
+	else if ((snd_pcm_uframes_t)avail >= s->avail_min)
+		*revents = io->stream == SND_PCM_STREAM_PLAYBACK ? POLLOUT : POLLIN;
+	return 0;
+}
+
+static int loop_close(snd_pcm_ioplug_t *io)
+{
+	struct loop_stream *s = io->private_data;
+
+	close(io->poll_fd);
+	free(s->areas);
+	s->areas = NULL;
+	if (io->stream == SND_PCM_STREAM_PLAYBACK) {
+		free(lb.play_buf);
+		lb.play_buf = NULL;
+	} else {
+		free(lb.wire);
+		lb.wire = NULL;
+	}
+	return 0;
+}
+
+static const snd_pcm_ioplug_callback_t loop_callback = {
+	.start = loop_start,
+	.stop = loop_stop,
+	.pointer = loop_pointer,
+	.transfer = loop_transfer,
+	.close = loop_close,
+	.hw_params = loop_hw_params,
+	.sw_params = loop_sw_params,
+	.prepare = loop_prepare,
+	.poll_revents = loop_poll_revents,
+};
+
+int loopback_open(snd_pcm_t **pcmp, snd_pcm_stream_t stream, int mode)
+{
+	static const unsigned int access_list[] = {
+		SND_PCM_ACCESS_RW_INTERLEAVED
+	};
+	struct loop_stream *s = &lb.stream[stream];
+	unsigned int format_list[1] = { format };
+	int err;
+
+	memset(s, 0, sizeof(*s));
+	s->io.version = SND_PCM_IOPLUG_VERSION;
+	s->io.name = "Software loopback";
+	s->io.flags = SND_PCM_IOPLUG_FLAG_MONOTONIC;
+	s->io.callback = &loop_callback;
+	s->io.private_data = s;
+	s->io.poll_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	s->io.poll_events = POLLIN;
+	if (s->io.poll_fd < 0)
+		return -errno;
+	err = snd_pcm_ioplug_create(&s->io, "loopback", stream, mode);
+	if (err < 0) {
+		close(s->io.poll_fd);
+		return err;
+	}
+	if ((err = snd_pcm_ioplug_set_param_list(&s->io, SND_PCM_IOPLUG_HW_ACCESS, 1, access_list)) < 0 ||
+	    (err = snd_pcm_ioplug_set_param_list(&s->io, SND_PCM_IOPLUG_HW_FORMAT, 1, format_list)) < 0 ||
+	    (err = snd_pcm_ioplug_set_param_minmax(&s->io, SND_PCM_IOPLUG_HW_CHANNELS, 1, 1024)) < 0 ||
+	    (err = snd_pcm_ioplug_set_param_minmax(&s->io, SND_PCM_IOPLUG_HW_RATE, 4000, 200000)) < 0 ||
+	    (err = snd_pcm_ioplug_set_param_minmax(&s->io, SND_PCM_IOPLUG_HW_PERIOD_BYTES, 64, 1024 * 1024)) < 0 ||
+	    (err = snd_pcm_ioplug_set_param_minmax(&s->io, SND_PCM_IOPLUG_HW_PERIODS, 2, 1024)) < 0) {
+		snd_pcm_ioplug_delete(&s->io);
+		return err;
+	}
+	*pcmp = s->io.pcm;
+	return 0;
+}
+
+/*
+ * Round trip measurement: a marker frame is sent when none is in
+ * flight, the captured marker is timed and not echoed back.
+ */
+
+#define MARKER		0x7abc
+#define MARKER_TIMEOUT	1000000000ULL	/* ns */
+
+struct probe {
+	int enabled;
+	int in_flight;
+	unsigned long long sent;	/* ns */
+	double *lat;			/* us */
+	size_t count, alloc;
+	unsigned long lost;
+	unsigned long xruns;
+} probe;
+
+struct result {
+	int period, buffer;
+	int ok;
+	unsigned long xruns, lost;
+	size_t count;
+	double p50, p99, min, max, jitter;	/* us */
+};
+
+void probe_reset(int effect)
+{
+	/* the filter would destroy the marker */
+	probe.enabled = format == SND_PCM_FORMAT_S16 && !effect;
+	probe.in_flight = 0;
+	probe.count = 0;
+	probe.lost = 0;
+	probe.xruns = 0;
+}
+
+void probe_send(char *buf, long frames)
+{
+	short *samples = (short *)buf;
+	int chn;
+
+	if (!probe.enabled || frames <= 0)
+		return;
+	if (probe.in_flight) {
+		if (now_ns() - probe.sent < MARKER_TIMEOUT)
+			return;
+		probe.lost++;
+	}
+	for (chn = 0; chn < channels; chn++)
+		samples[chn] = MARKER;
+	probe.sent = now_ns();
+	probe.in_flight = 1;
+}
+
+void probe_check(char *buf, long frames)
+{
+	short *samples = (short *)buf;
+	long i;
+	int chn;
+
+	if (!probe.enabled)
+		return;
+	for (i = 0; i < frames; i++, samples += channels) {
+		for (chn = 0; chn < channels; chn++)
+			if (samples[chn] != MARKER)
+				break;
+		if (chn < channels)
+			continue;
+		for (chn = 0; chn < channels; chn++)
+			samples[chn] = 0;
+		if (!probe.in_flight)
+			continue;
+		probe.in_flight = 0;
+		if (probe.count == probe.alloc) {
+			size_t alloc = probe.alloc ? probe.alloc * 2 : 1024;
+			double *lat = realloc(probe.lat, alloc * sizeof(*lat));
+			if (!lat)
+				continue;
+			probe.lat = lat;
+			probe.alloc = alloc;
+		}
+		probe.lat[probe.count++] = (now_ns() - probe.sent) / 1000.0;
+	}
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+void probe_result(struct result *res)
+{
+	double sum = 0, sq = 0, mean;
+	size_t i, k = probe.count;
+
+	res->xruns = probe.xruns;
+	res->lost = probe.lost;
+	res->count = k;
+	res->p50 = res->p99 = res->min = res->max = res->jitter = 0;
+	if (!k)
+		return;
+	qsort(probe.lat, k, sizeof(*probe.lat), cmp_double);
+	for (i = 0; i < k; i++) {
+		sum += probe.lat[i];
+		sq += probe.lat[i] * probe.lat[i];
+	}
+	mean = sum / k;
+	res->p50 = probe.lat[k / 2];
+	res->p99 = probe.lat[k * 99 / 100];
+	res->min = probe.lat[0];
+	res->max = probe.lat[k - 1];
+	res->jitter = sq / k > mean * mean ? sqrt(sq / k - mean * mean) : 0;
+}
+
+void showprobe(struct result *res)
+{
+	if (!probe.enabled) {
+		printf("Round trip not measured for %s\n", snd_pcm_format_name(format));
+		return;
+	}
+	printf("Round trip: %lu markers, %lu lost, %lu xruns\n",
+	       (unsigned long)res->count, res->lost, res->xruns);
+	if (res->count)
+		printf("Round trip latency: p50 %.1fus, p99 %.1fus, min %.1fus, max %.1fus, jitter %.1fus\n",
+		       res->p50, res->p99, res->min, res->max, res->jitter);
+}
+
+/*
+ * CSV and JSON reports, one row per run
+ */
+
+FILE *csv_out, *json_out;
+int json_rows;
+
+int report_open(void)
+{
+	if (csv_file) {
+		csv_out = fopen(csv_file, "w");
+		if (!csv_out) {
+			printf("Cannot create %s: %s\n", csv_file, strerror(errno));
+			return -errno;
+		}
+		fprintf(csv_out, "device,rate,channels,period,buffer,stress,seconds,ok,xruns,markers,lost,p50_us,p99_us,min_us,max_us,jitter_us\n");
+	}
+	if (json_file) {
+		json_out = fopen(json_file, "w");
+		if (!json_out) {
+			printf("Cannot create %s: %s\n", json_file, strerror(errno));
+			return -errno;
+		}
+		fprintf(json_out, "{\n  \"playback\": \"%s\",\n  \"capture\": \"%s\",\n"
+			"  \"rate\": %d,\n  \"channels\": %d,\n  \"format\": \"%s\",\n"
+			"  \"stress\": %d,\n  \"seconds\": %d,\n  \"results\": [",
+			pdevice, cdevice, rate, channels, snd_pcm_format_name(format),
+			stress, loop_sec);
+	}
+	return 0;
+}
+
+void report_row(struct result *res)
+{
+	if (csv_out)
+		fprintf(csv_out, "%s,%d,%d,%d,%d,%d,%d,%d,%lu,%lu,%lu,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+			pdevice, rate, channels, res->period, res->buffer, stress,
+			loop_sec, res->ok, res->xruns, (unsigned long)res->count,
+			res->lost, res->p50, res->p99, res->min, res->max,
+			res->jitter);
+	if (json_out) {
+		fprintf(json_out, "%s\n    { \"period\": %d, \"buffer\": %d, \"ok\": %s, "
+			"\"xruns\": %lu, \"markers\": %lu, \"lost\": %lu",
+			json_rows++ ? "," : "", res->period, res->buffer,
+			res->ok ? "true" : "false", res->xruns,
+			(unsigned long)res->count, res->lost);
+		if (res->count)
+			fprintf(json_out, ", \"latency_us_p50\": %.1f, \"latency_us_p99\": %.1f, "
+				"\"latency_us_min\": %.1f, \"latency_us_max\": %.1f, "
+				"\"jitter_us\": %.1f",
+				res->p50, res->p99, res->min, res->max, res->jitter);
+		fprintf(json_out, " }");
+	}
+}
+
+void report_close(void)
+{
+	if (csv_out)
+		fclose(csv_out);
+	if (json_out) {
+		fprintf(json_out, "\n  ]\n}\n");
+		fclose(json_out);
+	}
+}
+
+/*
+ * CPU stress: busy threads walking a buffer larger than the L2 cache
+ */
+
+volatile int stress_stop;
+
+void *stress_thread(void *arg ATTRIBUTE_UNUSED)
+{
+	size_t size = 4 * 1024 * 1024 / sizeof(unsigned int), i = 0;
+	unsigned int *mem = calloc(size, sizeof(*mem));
+	unsigned int acc = 1;
+
+	if (!mem)
+		return NULL;
+	while (!stress_stop) {
+		acc = acc * 1103515245 + 12345;
+		mem[i] += acc;
+		i = (i + 4099) % size;
+	}
+	free(mem);
+	return NULL;
+}
+
+int start_duplex(snd_pcm_t *phandle, snd_pcm_t *chandle,
+		 char *buffer, int latency, size_t *frames_out)
+{
+	int err;
+
+	if (snd_pcm_format_set_silence(format, buffer, latency*channels) < 0) {
+		fprintf(stderr, "silence error\n");
+		return -EINVAL;
+	}
+	if (writebuf(phandle, buffer, latency, frames_out) < 0) {
+		fprintf(stderr, "write error\n");
+		return -EIO;
+	}
+	if (writebuf(phandle, buffer, latency, frames_out) < 0) {
+		fprintf(stderr, "write error\n");
+		return -EIO;
+	}
+	/* the loopback streams cannot be linked */
+	if (loopback && (err = snd_pcm_start(phandle)) < 0) {
+		printf("Go error: %s\n", snd_strerror(err));
+		return err;
+	}
+	if ((err = snd_pcm_start(chandle)) < 0) {
+		printf("Go error: %s\n", snd_strerror(err));
+		return err;
+	}
+	return 0;
+}
+
+int recover_duplex(snd_pcm_t *phandle, snd_pcm_t *chandle,
+		   char *buffer, int latency, size_t *frames_out)
+{
+	int err;
+
+	snd_pcm_drop(chandle);
+	snd_pcm_drop(phandle);
+	if ((err = snd_pcm_prepare(phandle)) < 0 ||
+	    (err = snd_pcm_prepare(chandle)) < 0) {
+		printf("Prepare error: %s\n", snd_strerror(err));
+		return err;
+	}
+	if (probe.in_flight) {
+		probe.in_flight = 0;
+		probe.lost++;
+	}
+	return start_duplex(phandle, chandle, buffer, latency, frames_out);
+}
+
+void getsizes(snd_pcm_t *handle, struct result *res)
+{
+	snd_pcm_hw_params_t *params;
+	snd_pcm_uframes_t val;
+
+	snd_pcm_hw_params_alloca(&params);
+	res->period = res->buffer = 0;
+	if (snd_pcm_hw_params_current(handle, params) < 0)
+		return;
+	if (snd_pcm_hw_params_get_period_size(params, &val, NULL) >= 0)
+		res->period = val;
+	if (snd_pcm_hw_params_get_buffer_size(params, &val) >= 0)
+		res->buffer = val;
+}
+
 void help(void)
 {
 	int k;
@@ -453,6 +1053,12 @@ void help(void)
 "-b,--block     block mode\n"
 "-p,--poll      use poll (wait for event - reduces CPU usage)\n"
 "-e,--effect    apply an effect (bandpass filter sweep)\n"
+"-L,--loopback  use the in-process software loopback instead of devices\n"
+"-S,--sweep     run every period size from min to max (doubling)\n"
+"-N,--periods   periods per buffer when sweeping\n"
+"-x,--stress    run N CPU stress threads during the test\n"
+"-o,--csv       write the results to a CSV file\n"
+"-j,--json      write the results to a JSON file\n"
 );
         printf("Recognized sample formats are:");
         for (k = 0; k < SND_PCM_FORMAT_LAST; ++k) {
@@ -467,6 +1073,8 @@ void help(void)
 "  latency -m 8192 -M 8192 -t 1 -p\n"
 "Tip #2 (superb latency, non-blocking mode, but heavy CPU usage):\n"
 "  latency -m 128 -M 128\n"
+"Tip #3 (period size sweep with round trip histograms, no sound card needed):\n"
+"  latency -L -S -m 64 -M 1024 -s 5 -j latency.json\n"
 );
 }
 
@@ -489,6 +1097,12 @@ int main(int argc, char *argv[])
 		{"block", 0, NULL, 'b'},
 		{"poll", 0, NULL, 'p'},
 		{"effect", 0, NULL, 'e'},
+		{"loopback", 0, NULL, 'L'},
+		{"sweep", 0, NULL, 'S'},
+		{"periods", 1, NULL, 'N'},
+		{"stress", 1, NULL, 'x'},
+		{"csv", 1, NULL, 'o'},
+		{"json", 1, NULL, 'j'},
 		{NULL, 0, NULL, 0},
 	};
 	snd_pcm_t *phandle, *chandle;
@@ -499,10 +1113,13 @@ int main(int argc, char *argv[])
 	ssize_t r;
 	size_t frames_in, frames_out, in_max;
 	int effect = 0;
+	int period = 0;
+	struct result res;
+	pthread_t *stress_threads = NULL;
 	morehelp = 0;
 	while (1) {
 		int c;
-		if ((c = getopt_long(argc, argv, "hP:C:m:M:F:f:c:r:B:E:s:bpen", long_option, NULL)) < 0)
+		if ((c = getopt_long(argc, argv, "hP:C:m:M:F:f:c:r:B:E:s:bpenLSN:x:o:j:", long_option, NULL)) < 0)
 			break;
 		switch (c) {
 		case 'h':
@@ -563,6 +1180,26 @@ int main(int argc, char *argv[])
 		case 'n':
 			resample = 0;
 			break;
+		case 'L':
+			loopback = 1;
+			break;
+		case 'S':
+			sweep = 1;
+			break;
+		case 'N':
+			err = atoi(optarg);
+			sweep_periods = err >= 2 && err <= 1024 ? err : 2;
+			break;
+		case 'x':
+			err = atoi(optarg);
+			stress = err >= 0 && err <= 256 ? err : 0;
+			break;
+		case 'o':
+			csv_file = optarg;
+			break;
+		case 'j':
+			json_file = optarg;
+			break;
 		}
 	}
 
@@ -576,9 +1213,22 @@ int main(int argc, char *argv[])
 		return 0;
 	}
 
+	if (loopback)
+		pdevice = cdevice = "loopback";
 	loop_limit = loop_sec * rate;
 	latency = latency_min - 4;
-	buffer = malloc((latency_max * snd_pcm_format_width(format) / 8) * 2);
+	in_max = latency_max > buffer_size ? latency_max : buffer_size;
+	buffer = malloc(in_max * sweep_periods * (snd_pcm_format_width(format) / 8) * channels);
+	if (report_open() < 0)
+		return 0;
+
+	/* before the scheduler change, the stress runs at normal priority */
+	if (stress > 0) {
+		stress_threads = calloc(stress, sizeof(*stress_threads));
+		for (err = 0; stress_threads && err < stress; err++)
+			pthread_create(&stress_threads[err], NULL, stress_thread, NULL);
+		printf("Started %i stress threads\n", stress);
+	}
 
 	setscheduler();
 
@@ -588,11 +1238,19 @@ int main(int argc, char *argv[])
 	printf("Poll mode: %s\n", use_poll ? "yes" : "no");
 	printf("Loop limit is %li frames, minimum latency = %i, maximum latency = %i\n", loop_limit, latency_min * 2, latency_max * 2);
 
-	if ((err = snd_pcm_open(&phandle, pdevice, SND_PCM_STREAM_PLAYBACK, block ? 0 : SND_PCM_NONBLOCK)) < 0) {
+	if (loopback)
+		err = loopback_open(&phandle, SND_PCM_STREAM_PLAYBACK, block ? 0 : SND_PCM_NONBLOCK);
+	else
+		err = snd_pcm_open(&phandle, pdevice, SND_PCM_STREAM_PLAYBACK, block ? 0 : SND_PCM_NONBLOCK);
+	if (err < 0) {
 		printf("Playback open error: %s\n", snd_strerror(err));
 		return 0;
 	}
-	if ((err = snd_pcm_open(&chandle, cdevice, SND_PCM_STREAM_CAPTURE, block ? 0 : SND_PCM_NONBLOCK)) < 0) {
+	if (loopback)
+		err = loopback_open(&chandle, SND_PCM_STREAM_CAPTURE, block ? 0 : SND_PCM_NONBLOCK);
+	else
+		err = snd_pcm_open(&chandle, cdevice, SND_PCM_STREAM_CAPTURE, block ? 0 : SND_PCM_NONBLOCK);
+	if (err < 0) {
 		printf("Record open error: %s\n", snd_strerror(err));
 		return 0;
 	}
@@ -613,32 +1271,34 @@ int main(int argc, char *argv[])
 		y[2] = (float*) malloc(channels*sizeof(float));		
 	}
 			  
+	if (sweep)
+		period = latency_min * 2;
 	while (1) {
 		frames_in = frames_out = 0;
-		if (setparams(phandle, chandle, &latency) < 0)
-			break;
+		if (sweep) {
+			if (period > latency_max * 2)
+				break;
+			period_size = period;
+			buffer_size = latency = period * sweep_periods / 2;
+		}
+		if (setparams(phandle, chandle, &latency) < 0) {
+			if (!sweep)
+				break;
+			printf("Period size %i not available\n", period);
+			memset(&res, 0, sizeof(res));
+			res.period = period;
+			res.buffer = period * sweep_periods;
+			report_row(&res);
+			period *= 2;
+			continue;
+		}
 		showlatency(latency);
-		if ((err = snd_pcm_link(chandle, phandle)) < 0) {
+		if (!loopback && (err = snd_pcm_link(chandle, phandle)) < 0) {
 			printf("Streams link error: %s\n", snd_strerror(err));
 			exit(0);
 		}
-		if (snd_pcm_format_set_silence(format, buffer, latency*channels) < 0) {
-			fprintf(stderr, "silence error\n");
-			break;
-		}
-		if (writebuf(phandle, buffer, latency, &frames_out) < 0) {
-			fprintf(stderr, "write error\n");
-			break;
-		}
-		if (writebuf(phandle, buffer, latency, &frames_out) < 0) {
-			fprintf(stderr, "write error\n");
+		if (start_duplex(phandle, chandle, buffer, latency, &frames_out) < 0)
 			break;
-		}
-
-		if ((err = snd_pcm_start(chandle)) < 0) {
-			printf("Go error: %s\n", snd_strerror(err));
-			exit(0);
-		}
 		gettimestamp(phandle, &p_tstamp);
 		gettimestamp(chandle, &c_tstamp);
 #if 0
@@ -648,6 +1308,7 @@ int main(int argc, char *argv[])
 		showstat(chandle, frames_in);
 #endif
 
+		probe_reset(effect);
 		ok = 1;
 		in_max = 0;
 		while (ok && frames_in < loop_limit) {
@@ -658,13 +1319,20 @@ int main(int argc, char *argv[])
 			if ((r = readbuf(chandle, buffer, latency, &frames_in, &in_max)) < 0)
 				ok = 0;
 			else {
+				probe_check(buffer, r);
 				if (effect)
 					applyeffect(buffer,r);
+				probe_send(buffer, r);
 			 	if (writebuf(phandle, buffer, r, &frames_out) < 0)
 					ok = 0;
 			}
+			if (!ok && sweep) {
+				/* a sweep counts the xruns and carries on */
+				probe.xruns++;
+				ok = recover_duplex(phandle, chandle, buffer, latency, &frames_out) >= 0;
+			}
 		}
-		if (ok)
+		if (ok && !probe.xruns)
 			printf("Success\n");
 		else
 			printf("Failure\n");
@@ -673,14 +1341,19 @@ int main(int argc, char *argv[])
 		printf("Capture:\n");
 		showstat(chandle, frames_in);
 		showinmax(in_max);
-		if (p_tstamp.tv_sec == p_tstamp.tv_sec &&
+		probe_result(&res);
+		getsizes(phandle, &res);
+		res.ok = ok && !probe.xruns;
+		showprobe(&res);
+		report_row(&res);
+		if (p_tstamp.tv_sec == c_tstamp.tv_sec &&
 		    p_tstamp.tv_usec == c_tstamp.tv_usec)
 			printf("Hardware sync\n");
 		snd_pcm_drop(chandle);
 		snd_pcm_nonblock(phandle, 0);
 		snd_pcm_drain(phandle);
 		snd_pcm_nonblock(phandle, !block ? 1 : 0);
-		if (ok) {
+		if (ok && !sweep) {
 #if 1
 			printf("Playback time = %li.%i, Record time = %li.%i, diff = %li\n",
 			       p_tstamp.tv_sec,
@@ -691,11 +1364,20 @@ int main(int argc, char *argv[])
 #endif
 			break;
 		}
-		snd_pcm_unlink(chandle);
+		if (!loopback)
+			snd_pcm_unlink(chandle);
 		snd_pcm_hw_free(phandle);
 		snd_pcm_hw_free(chandle);
+		period *= 2;
 	}
 	snd_pcm_close(phandle);
 	snd_pcm_close(chandle);
+	report_close();
+	if (stress_threads) {
+		stress_stop = 1;
+		for (err = 0; err < stress; err++)
+			pthread_join(stress_threads[err], NULL);
+		free(stress_threads);
+	}
 	return 0;
 }
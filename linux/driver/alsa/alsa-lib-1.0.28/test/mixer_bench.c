@@ -0,0 +1,211 @@
+/*
+ *  Mixer open benchmark
+ *
+ *  Opens a simple mixer on a synthetic ctl_ext card with many controls
+ *  and reports the time spent in the mixer load.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "../include/asoundlib.h"
+#include "../include/control_external.h"
+
+static unsigned int controls = 5000;
+
+/*
+ * Controls come in Volume/Switch pairs, so each simple element
+ * is built from two hctl elements.
+ */
+static void synth_name(unsigned int offset, char *name, size_t len)
+{
+	snprintf(name, len, "Synth %u Playback %s", offset / 2,
+		 (offset & 1) ? "Switch" : "Volume");
+}
+
+static int synth_elem_count(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED)
+{
+	return controls;
+}
+
+static int synth_elem_list(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+			   unsigned int offset, snd_ctl_elem_id_t *id)
+{
+	char name[44];
+
+	synth_name(offset, name, sizeof(name));
+	snd_ctl_elem_id_set_interface(id, SND_CTL_ELEM_IFACE_MIXER);
+	snd_ctl_elem_id_set_name(id, name);
+	return 0;
+}
+
+static snd_ctl_ext_key_t synth_find_elem(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+					 const snd_ctl_elem_id_t *id)
+{
+	const char *name = snd_ctl_elem_id_get_name(id);
+	unsigned int idx;
+	char kind[8];
+
+	if (sscanf(name, "Synth %u Playback %7s", &idx, kind) != 2)
+		return SND_CTL_EXT_KEY_NOT_FOUND;
+	idx *= 2;
+	if (!strcmp(kind, "Switch"))
+		idx++;
+	if (idx >= controls)
+		return SND_CTL_EXT_KEY_NOT_FOUND;
+	return idx;
+}
+
+static int synth_get_attribute(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+			       snd_ctl_ext_key_t key, int *type,
+			       unsigned int *acc, unsigned int *count)
+{
+	*type = (key & 1) ? SND_CTL_ELEM_TYPE_BOOLEAN : SND_CTL_ELEM_TYPE_INTEGER;
+	*acc = SND_CTL_EXT_ACCESS_READWRITE;
+	*count = 2;
+	return 0;
+}
+
+static int synth_get_integer_info(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+				  snd_ctl_ext_key_t key,
+				  long *imin, long *imax, long *istep)
+{
+	*imin = 0;
+	*imax = (key & 1) ? 1 : 100;
+	*istep = 0;
+	return 0;
+}
+
+static int synth_read_integer(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+			      snd_ctl_ext_key_t key, long *value)
+{
+	value[0] = value[1] = (key & 1) ? 1 : 50;
+	return 0;
+}
+
+static int synth_write_integer(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+			       snd_ctl_ext_key_t key ATTRIBUTE_UNUSED,
+			       long *value ATTRIBUTE_UNUSED)
+{
+	return 0;
+}
+
+static const snd_ctl_ext_callback_t synth_ext_callback = {
+	.elem_count = synth_elem_count,
+	.elem_list = synth_elem_list,
+	.find_elem = synth_find_elem,
+	.get_attribute = synth_get_attribute,
+	.get_integer_info = synth_get_integer_info,
+	.read_integer = synth_read_integer,
+	.write_integer = synth_write_integer,
+};
+
+static double timediff(struct timespec *t1, struct timespec *t2)
+{
+	return (t2->tv_sec - t1->tv_sec) * 1000.0 +
+	       (t2->tv_nsec - t1->tv_nsec) / 1000000.0;
+}
+
+static int open_mixer(snd_ctl_ext_t *ext, double *ms, unsigned int *count)
+{
+	struct timespec t1, t2;
+	snd_hctl_t *hctl;
+	snd_mixer_t *mixer;
+	int err;
+
+	memset(ext, 0, sizeof(*ext));
+	ext->version = SND_CTL_EXT_VERSION;
+	ext->card_idx = 0;
+	strcpy(ext->id, "Synth");
+	strcpy(ext->driver, "Synth");
+	strcpy(ext->name, "Synthetic card");
+	strcpy(ext->longname, "Synthetic card for mixer benchmark");
+	strcpy(ext->mixername, "Synthetic mixer");
+	ext->poll_fd = -1;
+	ext->callback = &synth_ext_callback;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	if ((err = snd_ctl_ext_create(ext, "synth", 0)) < 0)
+		return err;
+	if ((err = snd_hctl_open_ctl(&hctl, ext->handle)) < 0) {
+		snd_ctl_close(ext->handle);
+		return err;
+	}
+	if ((err = snd_mixer_open(&mixer, 0)) < 0) {
+		snd_hctl_close(hctl);
+		return err;
+	}
+	if ((err = snd_mixer_attach_hctl(mixer, hctl)) < 0)
+		goto __close;
+	if ((err = snd_mixer_selem_register(mixer, NULL, NULL)) < 0)
+		goto __close;
+	if ((err = snd_mixer_load(mixer)) < 0)
+		goto __close;
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	*ms = timediff(&t1, &t2);
+	*count = snd_mixer_get_count(mixer);
+      __close:
+	snd_mixer_close(mixer);
+	return err;
+}
+
+static void help(void)
+{
+	printf(
+"Usage: mixer_bench [OPTION]...\n"
+"-h,--help      help\n"
+"-c,--controls  number of controls on the synthetic card\n"
+"-l,--loop      number of mixer opens\n"
+);
+}
+
+int main(int argc, char *argv[])
+{
+	struct option long_option[] =
+	{
+		{"help", 0, NULL, 'h'},
+		{"controls", 1, NULL, 'c'},
+		{"loop", 1, NULL, 'l'},
+		{NULL, 0, NULL, 0},
+	};
+	snd_ctl_ext_t ext;
+	unsigned int loop = 10, k, count = 0;
+	double ms, total = 0, best = 0;
+	int err;
+
+	while (1) {
+		int c;
+		if ((c = getopt_long(argc, argv, "hc:l:", long_option, NULL)) < 0)
+			break;
+		switch (c) {
+		case 'h':
+			help();
+			return 0;
+		case 'c':
+			controls = atoi(optarg);
+			break;
+		case 'l':
+			loop = atoi(optarg);
+			break;
+		}
+	}
+	if (loop == 0)
+		loop = 1;
+
+	for (k = 0; k < loop; k++) {
+		err = open_mixer(&ext, &ms, &count);
+		if (err < 0) {
+			printf("Mixer open error: %s\n", snd_strerror(err));
+			return EXIT_FAILURE;
+		}
+		total += ms;
+		if (k == 0 || ms < best)
+			best = ms;
+	}
+	printf("controls: %u, simple elements: %u\n", controls, count);
+	printf("mixer open: %.3fms average, %.3fms best (%u loops)\n",
+	       total / loop, best, loop);
+	return EXIT_SUCCESS;
+}
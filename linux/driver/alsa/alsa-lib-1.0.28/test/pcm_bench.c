@@ -0,0 +1,465 @@
+/*
+ *  PCM plugin benchmark
+ *
+ *  Builds plugin chains on top of the null PCM (optionally tapped by the
+ *  file PCM), pushes audio through them and reports the throughput, the
+ *  per-period write latency and the cache misses of every combination of
+ *  plugin, format, channel count and period size as JSON, so that runs
+ *  can be compared without sound hardware.
+ *
+ *  softvol and dmix need a card for their control and slave; they are
+ *  reported as skipped when it is not there.  ladspa is only run when a
+ *  plugin path and label are given.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "../include/asoundlib.h"
+
+#define RATE	48000
+
+static unsigned int seconds = 10;
+static int card = 0;
+static const char *ladspa_path;
+static const char *ladspa_label;
+static char *plugin_filter;
+static FILE *out;
+
+struct bench_result {
+	snd_pcm_uframes_t frames;
+	double ns_per_frame;
+	double frames_per_sec;
+	double write_us_p50;
+	double write_us_p99;
+	double write_us_max;
+	long long cache_misses;		/* -1 if not available */
+};
+
+struct plugin {
+	const char *name;
+	/* print the PCM definition for the given setup, NULL slave is null */
+	void (*conf)(char *buf, size_t size, snd_pcm_format_t format,
+		     unsigned int channels);
+};
+
+#define NULL_PCM	"{ type null }"
+#define FILE_PCM	"{ type file file \"/dev/null\" format raw slave.pcm { type null } }"
+
+static void conf_null(char *buf, size_t size, snd_pcm_format_t format ATTRIBUTE_UNUSED,
+		      unsigned int channels ATTRIBUTE_UNUSED)
+{
+	snprintf(buf, size, "pcm.bench %s", NULL_PCM);
+}
+
+static void conf_file(char *buf, size_t size, snd_pcm_format_t format ATTRIBUTE_UNUSED,
+		      unsigned int channels ATTRIBUTE_UNUSED)
+{
+	snprintf(buf, size, "pcm.bench %s", FILE_PCM);
+}
+
+static void conf_linear(char *buf, size_t size, snd_pcm_format_t format,
+			unsigned int channels ATTRIBUTE_UNUSED)
+{
+	snprintf(buf, size, "pcm.bench { type linear slave { pcm %s format %s } }",
+		 NULL_PCM, format == SND_PCM_FORMAT_S32_LE ? "S16_LE" : "S32_LE");
+}
+
+/* every channel gets itself plus half of its neighbour */
+static void conf_route(char *buf, size_t size, snd_pcm_format_t format ATTRIBUTE_UNUSED,
+		       unsigned int channels)
+{
+	unsigned int c;
+	int len;
+
+	len = snprintf(buf, size, "pcm.bench { type route slave { pcm %s channels %u } ttable {",
+		       NULL_PCM, channels);
+	for (c = 0; c < channels && len < (int)size; c++)
+		len += snprintf(buf + len, size - len, " %u { %u 1.0 %u 0.5 }",
+				c, c, (c + 1) % channels);
+	if (len < (int)size)
+		snprintf(buf + len, size - len, " } }");
+}
+
+static void conf_rate(char *buf, size_t size, snd_pcm_format_t format ATTRIBUTE_UNUSED,
+		      unsigned int channels ATTRIBUTE_UNUSED)
+{
+	snprintf(buf, size, "pcm.bench { type rate slave { pcm %s rate 44100 } }",
+		 NULL_PCM);
+}
+
+static void conf_softvol(char *buf, size_t size, snd_pcm_format_t format ATTRIBUTE_UNUSED,
+			 unsigned int channels ATTRIBUTE_UNUSED)
+{
+	snprintf(buf, size, "pcm.bench { type softvol slave.pcm %s "
+		 "control { name \"PCM Bench Volume\" card %d } }",
+		 NULL_PCM, card);
+}
+
+static void conf_lfloat(char *buf, size_t size, snd_pcm_format_t format ATTRIBUTE_UNUSED,
+			unsigned int channels ATTRIBUTE_UNUSED)
+{
+	snprintf(buf, size, "pcm.bench { type lfloat slave { pcm %s format FLOAT_LE } }",
+		 NULL_PCM);
+}
+
+/* dmix only runs on top of a hw PCM */
+static void conf_dmix(char *buf, size_t size, snd_pcm_format_t format,
+		      unsigned int channels)
+{
+	snprintf(buf, size, "pcm.bench { type dmix ipc_key %d "
+		 "slave { pcm \"hw:%d\" format %s channels %u rate %d } }",
+		 0x50434d42 + card, card, snd_pcm_format_name(format),
+		 channels, RATE);
+}
+
+/* ladspa works on FLOAT, so the conversions are part of the chain */
+static void conf_ladspa(char *buf, size_t size, snd_pcm_format_t format ATTRIBUTE_UNUSED,
+			unsigned int channels ATTRIBUTE_UNUSED)
+{
+	snprintf(buf, size, "pcm.bench { type plug slave.pcm { type ladspa "
+		 "slave.pcm { type plug slave.pcm %s } path \"%s\" "
+		 "plugins [ { label \"%s\" policy duplicate } ] } }",
+		 NULL_PCM, ladspa_path, ladspa_label);
+}
+
+static const struct plugin plugins[] = {
+	{ "null", conf_null },
+	{ "file", conf_file },
+	{ "linear", conf_linear },
+	{ "route", conf_route },
+	{ "rate", conf_rate },
+	{ "softvol", conf_softvol },
+	{ "lfloat", conf_lfloat },
+	{ "dmix", conf_dmix },
+	{ "ladspa", conf_ladspa },
+};
+
+static double timediff(struct timespec *t1, struct timespec *t2)
+{
+	return (t2->tv_sec - t1->tv_sec) * 1000000000.0 +
+	       (t2->tv_nsec - t1->tv_nsec);
+}
+
+static int perf_open(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static int open_bench(snd_pcm_t **pcmp, const struct plugin *plugin,
+		      snd_pcm_format_t format, unsigned int channels,
+		      snd_pcm_uframes_t period_size)
+{
+	char buf[4096];
+	snd_config_t *top;
+	snd_input_t *in;
+	snd_pcm_hw_params_t *params;
+	snd_pcm_uframes_t buffer_size = period_size * 4;
+	int err;
+
+	plugin->conf(buf, sizeof(buf), format, channels);
+	if ((err = snd_config_top(&top)) < 0)
+		return err;
+	if ((err = snd_input_buffer_open(&in, buf, strlen(buf))) < 0) {
+		snd_config_delete(top);
+		return err;
+	}
+	err = snd_config_load(top, in);
+	snd_input_close(in);
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcmp, "bench", SND_PCM_STREAM_PLAYBACK,
+					 0, top);
+	snd_config_delete(top);
+	if (err < 0)
+		return err;
+
+	snd_pcm_hw_params_alloca(&params);
+	if ((err = snd_pcm_hw_params_any(*pcmp, params)) < 0 ||
+	    (err = snd_pcm_hw_params_set_access(*pcmp, params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0 ||
+	    (err = snd_pcm_hw_params_set_format(*pcmp, params, format)) < 0 ||
+	    (err = snd_pcm_hw_params_set_channels(*pcmp, params, channels)) < 0 ||
+	    (err = snd_pcm_hw_params_set_rate(*pcmp, params, RATE, 0)) < 0 ||
+	    (err = snd_pcm_hw_params_set_period_size(*pcmp, params, period_size, 0)) < 0 ||
+	    (err = snd_pcm_hw_params_set_buffer_size_near(*pcmp, params, &buffer_size)) < 0 ||
+	    (err = snd_pcm_hw_params(*pcmp, params)) < 0)
+		snd_pcm_close(*pcmp);
+	return err;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+static int run(const struct plugin *plugin, snd_pcm_format_t format,
+	       unsigned int channels, snd_pcm_uframes_t period_size,
+	       struct bench_result *res)
+{
+	struct timespec t1, t2, w1, w2;
+	snd_pcm_t *pcm;
+	snd_pcm_uframes_t total = seconds * RATE, done;
+	unsigned int periods = (total + period_size - 1) / period_size, k;
+	unsigned char *data;
+	double *lat;
+	size_t bytes;
+	long long misses;
+	int perf_fd, err;
+
+	memset(res, 0, sizeof(*res));
+	if ((err = open_bench(&pcm, plugin, format, channels, period_size)) < 0)
+		return err;
+	bytes = snd_pcm_frames_to_bytes(pcm, period_size);
+	data = malloc(bytes);
+	lat = malloc(periods * sizeof(*lat));
+	if (!data || !lat) {
+		free(data);
+		free(lat);
+		snd_pcm_close(pcm);
+		return -ENOMEM;
+	}
+	snd_pcm_format_set_silence(format, data, period_size * channels);
+	for (done = 0; done < bytes; done += 7)
+		data[done] = rand();
+
+	perf_fd = perf_open();
+	if (perf_fd >= 0) {
+		ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	for (done = 0, k = 0; done < total; done += period_size, k++) {
+		snd_pcm_sframes_t r;
+		clock_gettime(CLOCK_MONOTONIC, &w1);
+		r = snd_pcm_writei(pcm, data, period_size);
+		clock_gettime(CLOCK_MONOTONIC, &w2);
+		if (r == -EPIPE) {
+			r = snd_pcm_prepare(pcm);
+			if (r >= 0)
+				r = 0;
+		}
+		if (r < 0) {
+			err = r;
+			break;
+		}
+		lat[k] = timediff(&w1, &w2) / 1000.0;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	misses = -1;
+	if (perf_fd >= 0) {
+		ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(perf_fd, &misses, sizeof(misses)) != sizeof(misses))
+			misses = -1;
+		close(perf_fd);
+	}
+	snd_pcm_close(pcm);
+
+	if (err >= 0 && k > 0) {
+		double ns = timediff(&t1, &t2);
+		qsort(lat, k, sizeof(*lat), cmp_double);
+		res->frames = done;
+		res->ns_per_frame = ns / done;
+		res->frames_per_sec = ns > 0 ? done * 1000000000.0 / ns : 0;
+		res->write_us_p50 = lat[k / 2];
+		res->write_us_p99 = lat[k * 99 / 100];
+		res->write_us_max = lat[k - 1];
+		res->cache_misses = misses;
+	}
+	free(data);
+	free(lat);
+	return err;
+}
+
+static int selected(const char *name)
+{
+	char *s, *p, *save = NULL;
+	int found = 0;
+
+	if (!plugin_filter)
+		return 1;
+	s = strdup(plugin_filter);
+	if (!s)
+		return 1;
+	for (p = strtok_r(s, ",", &save); p; p = strtok_r(NULL, ",", &save)) {
+		if (!strcmp(p, name)) {
+			found = 1;
+			break;
+		}
+	}
+	free(s);
+	return found;
+}
+
+static int parse_list(const char *str, unsigned int *vals, int max)
+{
+	char *s, *p, *save = NULL;
+	int n = 0;
+
+	s = strdup(str);
+	if (!s)
+		return 0;
+	for (p = strtok_r(s, ",", &save); p && n < max; p = strtok_r(NULL, ",", &save))
+		if (atoi(p) > 0)
+			vals[n++] = atoi(p);
+	free(s);
+	return n;
+}
+
+static int parse_formats(const char *str, snd_pcm_format_t *vals, int max)
+{
+	char *s, *p, *save = NULL;
+	int n = 0;
+
+	s = strdup(str);
+	if (!s)
+		return 0;
+	for (p = strtok_r(s, ",", &save); p && n < max; p = strtok_r(NULL, ",", &save)) {
+		snd_pcm_format_t format = snd_pcm_format_value(p);
+		if (format == SND_PCM_FORMAT_UNKNOWN)
+			fprintf(stderr, "unknown format %s\n", p);
+		else
+			vals[n++] = format;
+	}
+	free(s);
+	return n;
+}
+
+static void help(void)
+{
+	printf(
+"Usage: pcm_bench [OPTION]...\n"
+"-h,--help          help\n"
+"-s,--seconds       seconds of 48 kHz audio per run\n"
+"-f,--formats       comma separated formats (S16_LE,S32_LE)\n"
+"-c,--channels      comma separated channel counts (2,6)\n"
+"-p,--periods       comma separated period sizes in frames (256,1024)\n"
+"-P,--plugins       comma separated plugins to run (all)\n"
+"-C,--card          card for the softvol control and the dmix slave (0)\n"
+"-L,--ladspa-path   LADSPA plugin directory\n"
+"-l,--ladspa-label  LADSPA plugin label\n"
+"-o,--output        write the JSON to a file instead of stdout\n"
+);
+}
+
+int main(int argc, char *argv[])
+{
+	struct option long_option[] =
+	{
+		{"help", 0, NULL, 'h'},
+		{"seconds", 1, NULL, 's'},
+		{"formats", 1, NULL, 'f'},
+		{"channels", 1, NULL, 'c'},
+		{"periods", 1, NULL, 'p'},
+		{"plugins", 1, NULL, 'P'},
+		{"card", 1, NULL, 'C'},
+		{"ladspa-path", 1, NULL, 'L'},
+		{"ladspa-label", 1, NULL, 'l'},
+		{"output", 1, NULL, 'o'},
+		{NULL, 0, NULL, 0},
+	};
+	snd_pcm_format_t formats[16] = { SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_S32_LE };
+	unsigned int channels[16] = { 2, 6 };
+	unsigned int period_sizes[16] = { 256, 1024 };
+	int nformats = 2, nchannels = 2, nperiods = 2;
+	unsigned int k, f, c, p;
+	int first = 1, err;
+
+	out = stdout;
+	while (1) {
+		int opt;
+		if ((opt = getopt_long(argc, argv, "hs:f:c:p:P:C:L:l:o:", long_option, NULL)) < 0)
+			break;
+		switch (opt) {
+		case 'h':
+			help();
+			return 0;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'f':
+			nformats = parse_formats(optarg, formats, 16);
+			break;
+		case 'c':
+			nchannels = parse_list(optarg, channels, 16);
+			break;
+		case 'p':
+			nperiods = parse_list(optarg, period_sizes, 16);
+			break;
+		case 'P':
+			plugin_filter = optarg;
+			break;
+		case 'C':
+			card = atoi(optarg);
+			break;
+		case 'L':
+			ladspa_path = optarg;
+			break;
+		case 'l':
+			ladspa_label = optarg;
+			break;
+		case 'o':
+			out = fopen(optarg, "w");
+			if (!out) {
+				perror(optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		}
+	}
+	if (seconds == 0)
+		seconds = 1;
+
+	fprintf(out, "{\n  \"rate\": %d,\n  \"seconds\": %u,\n  \"results\": [",
+		RATE, seconds);
+	for (k = 0; k < sizeof(plugins) / sizeof(plugins[0]); k++) {
+		const struct plugin *plugin = &plugins[k];
+		if (!selected(plugin->name))
+			continue;
+		if (!strcmp(plugin->name, "ladspa") && (!ladspa_path || !ladspa_label))
+			continue;
+		for (f = 0; f < (unsigned int)nformats; f++)
+		for (c = 0; c < (unsigned int)nchannels; c++)
+		for (p = 0; p < (unsigned int)nperiods; p++) {
+			struct bench_result res;
+			err = run(plugin, formats[f], channels[c], period_sizes[p], &res);
+			fprintf(out, "%s\n    { \"plugin\": \"%s\", \"format\": \"%s\", "
+				"\"channels\": %u, \"period_size\": %u, ",
+				first ? "" : ",", plugin->name,
+				snd_pcm_format_name(formats[f]), channels[c],
+				period_sizes[p]);
+			first = 0;
+			if (err < 0) {
+				fprintf(out, "\"skipped\": \"%s\" }", snd_strerror(err));
+				continue;
+			}
+			fprintf(out, "\"frames\": %lu, \"ns_per_frame\": %.3f, "
+				"\"frames_per_sec\": %.0f, \"write_us_p50\": %.3f, "
+				"\"write_us_p99\": %.3f, \"write_us_max\": %.3f, ",
+				res.frames, res.ns_per_frame, res.frames_per_sec,
+				res.write_us_p50, res.write_us_p99, res.write_us_max);
+			if (res.cache_misses >= 0)
+				fprintf(out, "\"cache_misses\": %lld }", res.cache_misses);
+			else
+				fprintf(out, "\"cache_misses\": null }");
+		}
+	}
+	fprintf(out, "\n  ]\n}\n");
+	if (out != stdout)
+		fclose(out);
+	return EXIT_SUCCESS;
+}